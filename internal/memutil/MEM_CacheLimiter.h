@@ -7,6 +7,10 @@ struct MEM_CacheLimiterHandle_struct;
 typedef struct MEM_CacheLimiter_struct MEM_CacheLimiter;
 typedef struct MEM_CacheLimiterHandle_struct MEM_CacheLimiterHandle;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* function used to remove data from memory */
 typedef void (*MEM_CacheLimiter_Destruct_Fn)(void *);
 
@@ -42,27 +46,27 @@ MEM_CacheLimiter *new_MEM_CacheLimiter(MEM_CacheLimiter_Destruct_Fn data_destruc
  *
  * Frees the memory of the CacheLimiter but does not touch managed objects!
  *
- * param This: "This" pointer.
+ * param cache: The cache limiter.
  */
 
-void delete_MEM_CacheLimiter(MEM_CacheLimiter *this);
+void delete_MEM_CacheLimiter(MEM_CacheLimiter *cache);
 
 /**
  * Manage object
  *
- * param this: "this" pointer, data data object to manage.
+ * param cache: The cache limiter, data data object to manage.
  * return CacheLimiterHandle to ref, unref, touch the managed object
  */
 
-MEM_CacheLimiterHandle *MEM_CacheLimiter_insert(MEM_CacheLimiter *this, void *data);
+MEM_CacheLimiterHandle *MEM_CacheLimiter_insert(MEM_CacheLimiter *cache, void *data);
 
 /**
  * Free objects until memory constraints are satisfied
  *
- * param this: "this" pointer.
+ * param cache: The cache limiter.
  */
 
-void MEM_CacheLimiter_enforce_limits(MEM_CacheLimiter *this);
+void MEM_CacheLimiter_enforce_limits(MEM_CacheLimiter *cache);
 
 /**
  * Unmanage object previously inserted object.
@@ -115,12 +119,16 @@ int MEM_CacheLimiter_get_refcount(MEM_CacheLimiterHandle *handle);
 
 void *MEM_CacheLimiter_get(MEM_CacheLimiterHandle *handle);
 
-void MEM_CacheLimiter_ItemPriority_Fn_set(MEM_CacheLimiter *this,
-                                            MEM_CacheLimiter_ItemPriority_Fn item_priority_fn);
+void MEM_CacheLimiter_ItemPriority_Fn_set(MEM_CacheLimiter *cache,
+                                          MEM_CacheLimiter_ItemPriority_Fn item_priority_fn);
 
 void MEM_CacheLimiter_ItemDestroyable_Fn_set(
-    MEM_CacheLimiter *this, MEM_CacheLimiter_ItemDestroyable_Fn item_destroyable_fn);
+    MEM_CacheLimiter *cache, MEM_CacheLimiter_ItemDestroyable_Fn item_destroyable_fn);
+
+size_t MEM_CacheLimiter_get_memory_in_use(MEM_CacheLimiter *cache);
 
-size_t MEM_CacheLimiter_get_memory_in_use(MEM_CacheLimiter *this);
+#ifdef __cplusplus
+}
+#endif
 
 #endif  // __MEM_CACHELIMITERC_API_H__
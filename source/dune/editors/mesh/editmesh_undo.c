@@ -48,6 +48,16 @@
 #  define ARRAY_CHUNK_SIZE 256
 
 #  define USE_ARRAY_STORE_THREAD
+
+/* Compress chunks only used by older undo steps, see #BLI_array_store_compress_cold.
+ * Undoing that far back is rare, so it's worth decompressing them on access to save memory. */
+#  define USE_ARRAY_STORE_COMPRESS_COLD
+#endif
+
+#ifdef USE_ARRAY_STORE_COMPRESS_COLD
+/* States per stride kept uncompressed: the layers of the most recent steps,
+ * which the next step uses as a reference. */
+#  define ARRAY_STORE_STATES_HOT_NUM 32
 #endif
 
 #ifdef USE_ARRAY_STORE_THREAD
@@ -381,6 +391,18 @@ static void um_arraystore_compact_with_info(UndoMesh *um, const UndoMesh *um_ref
 
   um_arraystore_compact(um, um_ref);
 
+#  ifdef USE_ARRAY_STORE_COMPRESS_COLD
+  {
+    const size_t size_saved = BLI_array_store_at_size_compress_cold(&um_arraystore.bs_stride,
+                                                                    ARRAY_STORE_STATES_HOT_NUM);
+#    ifdef DEBUG_PRINT
+    printf("cold chunks compressed, saved: %zu bytes\n", size_saved);
+#    else
+    UNUSED_VARS(size_saved);
+#    endif
+  }
+#  endif
+
 #  ifdef DEBUG_TIME
   TIMEIT_END(mesh_undo_compact);
 #  endif
@@ -787,6 +809,14 @@ static bool mesh_undosys_step_encode(struct bContext *C, struct Main *bmain, Und
     elem->obedit_ref.ptr = ob;
     Mesh *me = elem->obedit_ref.ptr->data;
     BMEditMesh *em = me->edit_mesh;
+    if (mesh_compact_is_needed(em->bm)) {
+      /* Many faces were added or removed, re-pack the elements for faster access.
+       * Done here since the operator has finished, so no element pointers are held.
+       * This moves all loops, so the tessellation has to be recalculated. */
+      mesh_compact(em->bm);
+      BKE_editmesh_looptri_calc(em);
+      DEG_id_tag_update(&me->id, ID_RECALC_GEOMETRY);
+    }
     undomesh_from_editmesh(
         &elem->data, me->edit_mesh, me->key, um_references ? um_references[i] : NULL);
     em->needs_flush_to_id = 1;
@@ -2118,7 +2118,8 @@ bool initTransform(bContext *C, TransInfo *t, wmOperator *op, const wmEvent *eve
             mesh_edit_lnorspace_update(em);
             t->flag |= T_CLNOR_REBUILD;
           }
-          mesh_lnorspace_invalidate(em->mesh, true);
+          /* Done by the mesh updates, which know which geometry is modified. */
+          t->flag |= T_CLNOR_INVALIDATE;
         }
       }
     }
@@ -1952,6 +1952,9 @@ static void mesh_partial_update(TransInfo *t,
      * sel. It's impractical to calc this ahead of time. Further, the down side of
      * using partial updates when their not needed is negligible. */
    dune_meshedit_looptri_and_normals_calc(em);
+    if (t->flag & T_CLNOR_INVALIDATE) {
+      mesh_lnorspace_invalidate(me->mesh, true);
+    }
   }
   else {
     if (partial_for_looptri != PARTIAL_NONE) {
@@ -1970,6 +1973,10 @@ static void mesh_partial_update(TransInfo *t,
       MeshNormalsUpdate_Params params{};
       params.face_normals = face_normals;
       mesh_normals_update_w_partial_ex(meshedit->mesh, bmpinfo, &params);
+      if (t->flag & T_CLNOR_INVALIDATE) {
+        /* Only tags the loops of the partial update, the spaces are rebuilt when needed. */
+        mesh_lnorspace_invalidate_with_partial(me->mesh, bmpinfo);
+      }
     }
   }
 
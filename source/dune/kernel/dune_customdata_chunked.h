@@ -0,0 +1,77 @@
+#pragma once
+
+/* Chunked storage for CustomData layers too big to keep in memory as one array.
+ *
+ * A layer is split into fixed size chunks that are only loaded while used. With a backing file,
+ * chunks are evicted least recently used first once the #MEM_CacheLimiter budget shared by all
+ * layers is exceeded, modified chunks are written to the file and paged back in through a
+ * memory map.
+ * Without a backing file all chunks stay in memory, which is still useful for algorithms that
+ * stream over the layer chunk by chunk. */
+
+#include <stddef.h>
+
+#include "lib_compiler_attrs.h"
+#include "lib_sys_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CustomDataChunkedLayer CustomDataChunkedLayer;
+
+/* Elements per chunk when 0 is passed to dune_customdata_chunked_layer_new. */
+#define CD_CHUNK_ELEMS_DEFAULT (1 << 16)
+
+/* Create a layer of `totelem` elements of `elem_size` bytes, initialized to zero.
+ * When `use_disk` is set, evicted chunks are stored in a file in the session temp directory,
+ * returns NULL if that file can't be created. */
+CustomDataChunkedLayer *dune_customdata_chunked_layer_new(size_t elem_size,
+                                                          int totelem,
+                                                          int chunk_elems,
+                                                          bool use_disk) ATTR_WARN_UNUSED_RESULT;
+void dune_customdata_chunked_layer_free(CustomDataChunkedLayer *layer);
+
+int dune_customdata_chunked_layer_len(const CustomDataChunkedLayer *layer);
+int dune_customdata_chunked_layer_chunks_num(const CustomDataChunkedLayer *layer);
+/* Range of elements stored in a chunk. */
+void dune_customdata_chunked_layer_chunk_range(const CustomDataChunkedLayer *layer,
+                                               int chunk_index,
+                                               int *r_elem_start,
+                                               int *r_elem_len);
+
+/* Load a chunk and keep it in memory until released. Thread-safe.
+ * Acquiring for write marks the chunk as modified. */
+const void *dune_customdata_chunked_layer_chunk_acquire(CustomDataChunkedLayer *layer,
+                                                        int chunk_index);
+void *dune_customdata_chunked_layer_chunk_acquire_for_write(CustomDataChunkedLayer *layer,
+                                                            int chunk_index);
+void dune_customdata_chunked_layer_chunk_release(CustomDataChunkedLayer *layer, int chunk_index);
+
+/* Hint that a chunk will be acquired soon, so reading it from disk can start early. */
+void dune_customdata_chunked_layer_chunk_prefetch(CustomDataChunkedLayer *layer,
+                                                  int chunk_index);
+
+typedef void (*CustomDataChunkFn)(void *__restrict userdata,
+                                  void *data,
+                                  int elem_start,
+                                  int elem_len);
+
+/* Call `fn` for every chunk, acquiring each one only for the duration of the call
+ * and prefetching the next one. `data` may only be modified when `for_write` is set. */
+void dune_customdata_chunked_layer_foreach_chunk(CustomDataChunkedLayer *layer,
+                                                 bool for_write,
+                                                 bool use_threading,
+                                                 CustomDataChunkFn fn,
+                                                 void *userdata);
+
+/* Copy between a contiguous array of #dune_customdata_chunked_layer_len elements. */
+void dune_customdata_chunked_layer_read_array(CustomDataChunkedLayer *layer, void *r_data);
+void dune_customdata_chunked_layer_write_array(CustomDataChunkedLayer *layer, const void *data);
+
+/* True when writing or reading the backing file failed, affected chunks are zeroed. */
+bool dune_customdata_chunked_layer_has_io_error(const CustomDataChunkedLayer *layer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+/* Implicit sharing of CustomData layer data, see #CustomDataLayer.sharing_info.
+ *
+ * A layer without sharing info owns its data. Sharing it with another layer gives the data a
+ * user count, the data is then only freed once the last layer using it is freed, and a layer
+ * only copies it when written to while other layers still use it. */
+
+#include "lib_sys_types.h"
+
+#include "types_customdata.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Make `dst_layer` (which must not own data) another user of the data of `src_layer`. */
+void CustomData_layer_share_data(CustomDataLayer *dst_layer,
+                                 CustomDataLayer *src_layer,
+                                 int totelem);
+/* The layer data for modification, copied first while other layers use it. */
+void *CustomData_layer_data_for_write(CustomDataLayer *layer, int totelem);
+/* Remove the layer as a user of its data, freeing the data if it was the last one. */
+void CustomData_layer_data_free(CustomDataLayer *layer, int totelem);
+/* Clear the sharing info of layers copied by value (e.g. for writing to or reading from files),
+ * such copies never hold a user of the data. */
+void CustomData_layers_sharing_info_clear(CustomDataLayer *layers, int totlayer);
+bool CustomData_layer_is_shared(const CustomDataLayer *layer);
+/* Replace the data of the layers in `dest` by shared data of the matching layers in `source`. */
+void CustomData_share_layers(CustomData *source, CustomData *dest, int totelem);
+
+#ifdef __cplusplus
+}
+#endif
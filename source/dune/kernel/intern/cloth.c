@@ -42,6 +42,9 @@ static void cloth_update_spring_lengths(ClothModifierData *clmd, Mesh *mesh);
 static bool cloth_build_springs(ClothModifierData *clmd, Mesh *mesh);
 static void cloth_apply_vgroup(ClothModifierData *clmd, Mesh *mesh);
 
+/* Re-balance the collision trees once refitting made them this much worse. */
+#define CLOTH_BVH_REBUILD_FACTOR 2.0f
+
 typedef struct BendSpringRef {
   int index;
   int polys;
@@ -105,6 +108,9 @@ static BVHTree *bvhtree_build_from_cloth(ClothModifierData *clmd, float epsilon)
   /* balance tree */
   LIB_bvhtree_balance(bvhtree);
 
+  /* Only refit the branches above primitives that moved each step. */
+  LIB_bvhtree_use_dirty_refit(bvhtree, CLOTH_BVH_REBUILD_FACTOR);
+
   return bvhtree;
 }
 
@@ -165,7 +171,9 @@ void bvhtree_update_from_cloth(ClothModifierData *clmd, bool moving, bool self)
         }
       }
 
-      LIB_bvhtree_update_tree(bvhtree);
+      if (LIB_bvhtree_update_tree_dirty(bvhtree)) {
+        LIB_bvhtree_rebalance(bvhtree);
+      }
     }
   }
   else {
@@ -183,7 +191,9 @@ void bvhtree_update_from_cloth(ClothModifierData *clmd, bool moving, bool self)
         }
       }
 
-      LIB_bvhtree_update_tree(bvhtree);
+      if (LIB_bvhtree_update_tree_dirty(bvhtree)) {
+        LIB_bvhtree_rebalance(bvhtree);
+      }
     }
   }
 }
@@ -34,6 +34,10 @@
 #  include "eltopo-capi.h"
 #endif
 
+/* Re-balance the collision trees once refitting made them this much worse.
+ * Keep in sync with cloth.c. */
+#define CLOTH_BVH_REBUILD_FACTOR 2.0f
+
 typedef struct ColDetectData {
   ClothModifierData *clmd;
   CollisionModifierData *collmd;
@@ -108,6 +112,9 @@ BVHTree *bvhtree_build_from_mvert(const MVert *mvert,
   /* balance tree */
   BLI_bvhtree_balance(tree);
 
+  /* Colliders often move only in parts, refit the changed branches only. */
+  BLI_bvhtree_use_dirty_refit(tree, CLOTH_BVH_REBUILD_FACTOR);
+
   return tree;
 }
 
@@ -157,7 +164,9 @@ void bvhtree_update_from_mvert(BVHTree *bvhtree,
     }
   }
 
-  BLI_bvhtree_update_tree(bvhtree);
+  if (BLI_bvhtree_update_tree_dirty(bvhtree)) {
+    BLI_bvhtree_rebalance(bvhtree);
+  }
 }
 
 /* ***************************
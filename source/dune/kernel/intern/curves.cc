@@ -21,6 +21,7 @@
 #include "BKE_anim_data.h"
 #include "BKE_curves.hh"
 #include "BKE_customdata.h"
+#include "dune_customdata_sharing.h"
 #include "BKE_global.h"
 #include "BKE_idtype.h"
 #include "BKE_lib_id.h"
@@ -118,6 +119,9 @@ static void curves_blend_write(BlendWriter *writer, ID *id, const void *id_addre
       &curves->geometry.point_data, &players, players_buff, ARRAY_SIZE(players_buff));
   CustomData_blend_write_prepare(
       &curves->geometry.curve_data, &clayers, clayers_buff, ARRAY_SIZE(clayers_buff));
+  /* Sharing is run-time only, the pointers are meaningless in the file. */
+  CustomData_layers_sharing_info_clear(players, curves->geometry.point_data.totlayer);
+  CustomData_layers_sharing_info_clear(clayers, curves->geometry.curve_data.totlayer);
 
   /* Write LibData */
   BLO_write_id_struct(writer, Curves, id_address, &curves->id);
@@ -162,6 +166,10 @@ static void curves_blend_read_data(BlendDataReader *reader, ID *id)
   /* Geometry */
   CustomData_blend_read(reader, &curves->geometry.point_data, curves->geometry.point_size);
   CustomData_blend_read(reader, &curves->geometry.curve_data, curves->geometry.curve_size);
+  CustomData_layers_sharing_info_clear(curves->geometry.point_data.layers,
+                                       curves->geometry.point_data.totlayer);
+  CustomData_layers_sharing_info_clear(curves->geometry.curve_data.layers,
+                                       curves->geometry.curve_data.totlayer);
   update_custom_data_pointers(*curves);
 
   BLO_read_int32_array(reader, curves->geometry.curve_size + 1, &curves->geometry.curve_offsets);
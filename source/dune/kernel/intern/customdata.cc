@@ -17,6 +17,7 @@
 #include "BLI_bitmap.h"
 #include "BLI_color.hh"
 #include "BLI_endian_switch.h"
+#include "BLI_implicit_sharing.hh"
 #include "BLI_math.h"
 #include "BLI_math_color_blend.h"
 #include "BLI_math_vector.hh"
@@ -35,6 +36,7 @@
 #include "BKE_anonymous_attribute.h"
 #include "BKE_customdata.h"
 #include "BKE_customdata_file.h"
+#include "dune_customdata_sharing.h"
 #include "BKE_deform.h"
 #include "BKE_main.h"
 #include "BKE_mesh_mapping.h"
@@ -1225,3 +1227,135 @@ static void layerSwap_flnor(void *data, const int *corner_indices)
 
   memcpy(flnors, nors, sizeof(nors));
 }
+
+/* -------------------------------------------------------------------- */
+/* Implicit Sharing
+ *
+ * Layer data can be shared between layers (e.g. of an original and an evaluated mesh) through
+ * #ImplicitSharingInfo, so copying custom data only adds a user instead of duplicating layers.
+ * Layers without a sharing info own their data. Shared data is only duplicated once something
+ * needs write access to it, see #CustomData_layer_data_for_write.
+ */
+
+static const LayerTypeInfo *layerType_getInfo(int type);
+
+static void free_layer_data(const int type, const void *data, const int totelem)
+{
+  const LayerTypeInfo *typeInfo = layerType_getInfo(type);
+  if (typeInfo->free) {
+    typeInfo->free(const_cast<void *>(data), totelem, typeInfo->size);
+  }
+  MEM_freeN(const_cast<void *>(data));
+}
+
+static void *copy_layer_data(const int type, const void *data, const int totelem)
+{
+  const LayerTypeInfo *typeInfo = layerType_getInfo(type);
+  void *new_data = MEM_malloc_arrayN(size_t(totelem), size_t(typeInfo->size), __func__);
+  if (typeInfo->copy) {
+    typeInfo->copy(data, new_data, totelem);
+  }
+  else {
+    memcpy(new_data, data, size_t(totelem) * size_t(typeInfo->size));
+  }
+  return new_data;
+}
+
+/** Frees the layer data, including the data owned by its elements, once the last user is gone. */
+class CustomDataLayerImplicitSharing : public dune::ImplicitSharingInfo {
+ private:
+  const void *data_;
+  int totelem_;
+  int type_;
+
+ public:
+  CustomDataLayerImplicitSharing(const void *data, const int totelem, const int type)
+      : data_(data), totelem_(totelem), type_(type)
+  {
+  }
+
+ private:
+  void del_self_with_data() override
+  {
+    free_layer_data(type_, data_, totelem_);
+    MEM_delete(this);
+  }
+};
+
+void CustomData_layer_share_data(CustomDataLayer *dst_layer,
+                                 CustomDataLayer *src_layer,
+                                 const int totelem)
+{
+  BLI_assert(dst_layer->type == src_layer->type);
+  if (src_layer->data == nullptr) {
+    dst_layer->data = nullptr;
+    dst_layer->sharing_info = nullptr;
+    return;
+  }
+  if (src_layer->sharing_info == nullptr) {
+    /* The source owned its data until now, it becomes the first user. */
+    src_layer->sharing_info = MEM_new<CustomDataLayerImplicitSharing>(
+        __func__, src_layer->data, totelem, src_layer->type);
+  }
+  src_layer->sharing_info->add_user();
+  dst_layer->data = src_layer->data;
+  dst_layer->sharing_info = src_layer->sharing_info;
+}
+
+void *CustomData_layer_data_for_write(CustomDataLayer *layer, const int totelem)
+{
+  if (layer->sharing_info == nullptr) {
+    return layer->data;
+  }
+  if (layer->sharing_info->is_mutable()) {
+    /* The last user, take ownership back. */
+    layer->sharing_info->tag_ensured_mutable();
+    return layer->data;
+  }
+
+  /* Shared with other layers, copy before writing. */
+  void *new_data = copy_layer_data(layer->type, layer->data, totelem);
+  layer->sharing_info->remove_user_and_delete_if_last();
+  layer->sharing_info = nullptr;
+  layer->data = new_data;
+  return new_data;
+}
+
+void CustomData_layer_data_free(CustomDataLayer *layer, const int totelem)
+{
+  if (layer->sharing_info) {
+    layer->sharing_info->remove_user_and_delete_if_last();
+    layer->sharing_info = nullptr;
+  }
+  else if (layer->data) {
+    free_layer_data(layer->type, layer->data, totelem);
+  }
+  layer->data = nullptr;
+}
+
+void CustomData_layers_sharing_info_clear(CustomDataLayer *layers, const int totlayer)
+{
+  for (int i = 0; i < totlayer; i++) {
+    layers[i].sharing_info = nullptr;
+  }
+}
+
+bool CustomData_layer_is_shared(const CustomDataLayer *layer)
+{
+  return layer->sharing_info && !layer->sharing_info->is_mutable();
+}
+
+void CustomData_share_layers(CustomData *source, CustomData *dest, const int totelem)
+{
+  /* Layers in `dest` are expected to match those of `source`, see #CustomData_copy. */
+  BLI_assert(source->totlayer == dest->totlayer);
+  for (int i = 0; i < dest->totlayer; i++) {
+    CustomDataLayer *dst_layer = &dest->layers[i];
+    CustomDataLayer *src_layer = &source->layers[i];
+    if (dst_layer->data == src_layer->data && dst_layer->sharing_info == src_layer->sharing_info) {
+      continue;
+    }
+    CustomData_layer_data_free(dst_layer, totelem);
+    CustomData_layer_share_data(dst_layer, src_layer, totelem);
+  }
+}
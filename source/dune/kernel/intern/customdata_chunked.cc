@@ -0,0 +1,511 @@
+/** \file
+ * \ingroup bke
+ * Chunked, optionally disk backed storage for CustomData layers.
+ *
+ * dune_customdata_chunked.h contains the function prototypes for this file.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+
+#ifndef WIN32
+#  include <unistd.h>
+#else
+#  include <io.h>
+#endif
+
+#include "MEM_CacheLimiter.h"
+#include "MEM_guardedalloc.h"
+
+#include "lib_fileops.h"
+#include "lib_mmap.h"
+#include "lib_path_util.h"
+#include "lib_string.h"
+#include "lib_task.h"
+#include "lib_threads.h"
+#include "lib_utildefines.h"
+
+#include "dune_appdir.h"
+#include "dune_customdata_chunked.h" /* Own include. */
+
+#include "CLG_log.h"
+
+static CLG_LogRef LOG = {"dune.customdata_chunked"};
+
+struct CustomDataChunk {
+  CustomDataChunkedLayer *layer;
+  int index;
+
+  /** Loaded data, null while the chunk is evicted (or was never used). */
+  void *data;
+  /** Only set while loaded and the layer has a backing file. */
+  MEM_CacheLimiterHandle *cache_handle;
+  /** Next modified chunk evicted by the same #chunk_cache_enforce_limits_and_unlock call. */
+  CustomDataChunk *evicted_next;
+
+  /** The backing file holds this chunk's data. */
+  bool is_on_disk;
+  /** Modified since last written to the backing file. */
+  bool is_dirty;
+  /** Being read from or written back to the backing file without the lock held,
+   * other threads wait for it to finish before touching the chunk. */
+  bool is_busy;
+};
+
+struct CustomDataChunkedLayer {
+  size_t elem_size;
+  int totelem;
+  int chunk_elems;
+
+  CustomDataChunk *chunks;
+  int chunks_num;
+
+  /** Backing file, -1 when all chunks are kept in memory. */
+  int file;
+  char filepath[FILE_MAX];
+  /** Read-only mapping of `file` for paging in chunks,
+   * chunks written to the file later are visible through it (it's never written to itself). */
+  MmapFile *mmap;
+
+  /** Guards the offset of `file`, chunks may be written back from several threads. */
+  ThreadMutex file_mutex;
+
+  bool has_io_error;
+};
+
+/* One budget for the chunks of all layers, so resident memory doesn't grow with the number of
+ * layers. The lock guards the limiter and the loading state of every chunk
+ * (`data`, `cache_handle` & the flags), file I/O is done without it. */
+static MEM_CacheLimiter *chunk_cache = nullptr;
+static int chunk_cache_users = 0;
+/** Modified chunks evicted while enforcing the limit, written back once unlocked. */
+static CustomDataChunk *chunk_cache_evicted = nullptr;
+static ThreadMutex chunk_cache_lock = LIB_MUTEX_INITIALIZER;
+/** Notified when a chunk stops being busy. */
+static ThreadCondition chunk_cache_cond;
+
+/* -------------------------------------------------------------------- */
+/** Chunk Loading & Eviction
+ */
+
+static size_t chunked_layer_chunk_size(const CustomDataChunkedLayer *layer, const int chunk_index)
+{
+  const int elem_start = chunk_index * layer->chunk_elems;
+  return layer->elem_size * (size_t)MIN2(layer->chunk_elems, layer->totelem - elem_start);
+}
+
+static size_t chunked_layer_chunk_offset(const CustomDataChunkedLayer *layer, const int chunk_index)
+{
+  return layer->elem_size * (size_t)layer->chunk_elems * (size_t)chunk_index;
+}
+
+static bool chunked_layer_file_write(CustomDataChunkedLayer *layer,
+                                     size_t offset,
+                                     const char *data,
+                                     size_t len)
+{
+  bool ok = true;
+  lib_mutex_lock(&layer->file_mutex);
+  if (lib_lseek(layer->file, (int64_t)offset, SEEK_SET) == -1) {
+    ok = false;
+  }
+  while (ok && len) {
+    const int64_t written = write(layer->file, data, MIN2(len, (size_t)INT_MAX));
+    if (written <= 0) {
+      ok = false;
+      break;
+    }
+    data += written;
+    len -= (size_t)written;
+  }
+  lib_mutex_unlock(&layer->file_mutex);
+  return ok;
+}
+
+/** Called by the cache limiter (with #chunk_cache_lock held) when evicting a chunk. */
+static void chunk_cache_evict_cb(void *chunk_v)
+{
+  CustomDataChunk *chunk = static_cast<CustomDataChunk *>(chunk_v);
+
+  /* Freed by the cache limiter after this call. */
+  chunk->cache_handle = nullptr;
+
+  if (chunk->is_dirty) {
+    /* Written back once the lock is released, see #chunk_cache_enforce_limits_and_unlock. */
+    chunk->is_busy = true;
+    chunk->evicted_next = chunk_cache_evicted;
+    chunk_cache_evicted = chunk;
+    return;
+  }
+
+  MEM_freeN(chunk->data);
+  chunk->data = nullptr;
+}
+
+static size_t chunk_cache_chunk_size_cb(void *chunk_v)
+{
+  const CustomDataChunk *chunk = static_cast<const CustomDataChunk *>(chunk_v);
+  return chunked_layer_chunk_size(chunk->layer, chunk->index);
+}
+
+static void chunk_cache_user_add()
+{
+  lib_mutex_lock(&chunk_cache_lock);
+  if (chunk_cache_users++ == 0) {
+    chunk_cache = new_MEM_CacheLimiter(chunk_cache_evict_cb, chunk_cache_chunk_size_cb);
+    lib_condition_init(&chunk_cache_cond);
+  }
+  lib_mutex_unlock(&chunk_cache_lock);
+}
+
+static void chunk_cache_user_remove()
+{
+  lib_mutex_lock(&chunk_cache_lock);
+  if (--chunk_cache_users == 0) {
+    delete_MEM_CacheLimiter(chunk_cache);
+    chunk_cache = nullptr;
+    lib_condition_end(&chunk_cache_cond);
+  }
+  lib_mutex_unlock(&chunk_cache_lock);
+}
+
+/**
+ * Evict unused chunks until under the budget, then write back the modified ones.
+ * Called with #chunk_cache_lock held, which is released before writing.
+ */
+static void chunk_cache_enforce_limits_and_unlock()
+{
+  MEM_CacheLimiter_enforce_limits(chunk_cache);
+  CustomDataChunk *evicted = chunk_cache_evicted;
+  chunk_cache_evicted = nullptr;
+  lib_mutex_unlock(&chunk_cache_lock);
+
+  while (evicted) {
+    CustomDataChunk *chunk = evicted;
+    evicted = chunk->evicted_next;
+    CustomDataChunkedLayer *layer = chunk->layer;
+
+    /* Busy, so no other thread touches the chunk until it's written. */
+    const bool written = chunked_layer_file_write(layer,
+                                                  chunked_layer_chunk_offset(layer, chunk->index),
+                                                  static_cast<const char *>(chunk->data),
+                                                  chunked_layer_chunk_size(layer, chunk->index));
+    if (!written) {
+      CLOG_ERROR(&LOG, "failed to write chunk %d to '%s'", chunk->index, layer->filepath);
+    }
+
+    lib_mutex_lock(&chunk_cache_lock);
+    if (!written) {
+      layer->has_io_error = true;
+    }
+    chunk->is_on_disk = written;
+    chunk->is_dirty = false;
+    chunk->is_busy = false;
+    chunk->evicted_next = nullptr;
+    MEM_freeN(chunk->data);
+    chunk->data = nullptr;
+    lib_condition_notify_all(&chunk_cache_cond);
+    lib_mutex_unlock(&chunk_cache_lock);
+  }
+}
+
+static void *chunked_layer_chunk_acquire(CustomDataChunkedLayer *layer,
+                                         const int chunk_index,
+                                         const bool for_write)
+{
+  lib_assert(chunk_index >= 0 && chunk_index < layer->chunks_num);
+  CustomDataChunk *chunk = &layer->chunks[chunk_index];
+  bool inserted = false;
+
+  lib_mutex_lock(&chunk_cache_lock);
+  while (chunk->is_busy) {
+    lib_condition_wait(&chunk_cache_cond, &chunk_cache_lock);
+  }
+
+  if (chunk->data == nullptr) {
+    const size_t size = chunked_layer_chunk_size(layer, chunk_index);
+    if (chunk->is_on_disk) {
+      /* Read without the lock, only threads acquiring this chunk wait for it. */
+      chunk->is_busy = true;
+      lib_mutex_unlock(&chunk_cache_lock);
+
+      void *data = MEM_mallocN(size, __func__);
+      const bool read = lib_mmap_read(
+          layer->mmap, data, chunked_layer_chunk_offset(layer, chunk_index), size);
+      if (!read) {
+        CLOG_ERROR(&LOG, "failed to read chunk %d from '%s'", chunk_index, layer->filepath);
+        memset(data, 0, size);
+      }
+
+      lib_mutex_lock(&chunk_cache_lock);
+      if (!read) {
+        layer->has_io_error = true;
+      }
+      chunk->data = data;
+      chunk->is_busy = false;
+      lib_condition_notify_all(&chunk_cache_cond);
+    }
+    else {
+      chunk->data = MEM_callocN(size, __func__);
+    }
+
+    if (layer->file != -1) {
+      chunk->cache_handle = MEM_CacheLimiter_insert(chunk_cache, chunk);
+      inserted = true;
+    }
+  }
+
+  if (chunk->cache_handle) {
+    /* Referenced chunks are never evicted. */
+    MEM_CacheLimiter_ref(chunk->cache_handle);
+    MEM_CacheLimiter_touch(chunk->cache_handle);
+  }
+  if (for_write) {
+    chunk->is_dirty = true;
+  }
+
+  void *data = chunk->data;
+  if (inserted) {
+    /* Keep within the budget while loading too, not only when releasing. */
+    chunk_cache_enforce_limits_and_unlock();
+  }
+  else {
+    lib_mutex_unlock(&chunk_cache_lock);
+  }
+  return data;
+}
+
+/* -------------------------------------------------------------------- */
+/** Public API
+ */
+
+CustomDataChunkedLayer *dune_customdata_chunked_layer_new(const size_t elem_size,
+                                                          const int totelem,
+                                                          const int chunk_elems,
+                                                          const bool use_disk)
+{
+  lib_assert(elem_size > 0 && totelem >= 0);
+
+  CustomDataChunkedLayer *layer = MEM_cnew<CustomDataChunkedLayer>(__func__);
+  layer->elem_size = elem_size;
+  layer->totelem = totelem;
+  layer->chunk_elems = chunk_elems > 0 ? chunk_elems : CD_CHUNK_ELEMS_DEFAULT;
+  layer->chunks_num = (totelem + layer->chunk_elems - 1) / layer->chunk_elems;
+  layer->chunks = static_cast<CustomDataChunk *>(
+      MEM_calloc_arrayN((size_t)layer->chunks_num, sizeof(CustomDataChunk), __func__));
+  for (int i = 0; i < layer->chunks_num; i++) {
+    layer->chunks[i].layer = layer;
+    layer->chunks[i].index = i;
+  }
+  layer->file = -1;
+  lib_mutex_init(&layer->file_mutex);
+  chunk_cache_user_add();
+
+  if (use_disk && totelem > 0) {
+    char filename[64];
+    lib_snprintf(filename, sizeof(filename), "customdata_%p.chunks", (void *)layer);
+    lib_path_join(layer->filepath, sizeof(layer->filepath), dune_tempdir_session(), filename);
+
+    /* Size the file up-front, it has to be mapped with its final length. */
+    const size_t file_size = elem_size * (size_t)totelem;
+    layer->file = lib_open(layer->filepath, O_BINARY | O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if ((layer->file == -1) || !chunked_layer_file_write(layer, file_size - 1, "", 1) ||
+        !(layer->mmap = lib_mmap_open(layer->file)))
+    {
+      CLOG_ERROR(&LOG, "failed to create chunk file '%s'", layer->filepath);
+      dune_customdata_chunked_layer_free(layer);
+      return nullptr;
+    }
+    lib_mmap_advise(layer->mmap, 0, file_size, LIB_MMAP_ADVICE_SEQUENTIAL);
+  }
+
+  return layer;
+}
+
+void dune_customdata_chunked_layer_free(CustomDataChunkedLayer *layer)
+{
+  lib_mutex_lock(&chunk_cache_lock);
+  for (int i = 0; i < layer->chunks_num; i++) {
+    CustomDataChunk *chunk = &layer->chunks[i];
+    /* Another layer's thread may still be writing back a chunk it evicted. */
+    while (chunk->is_busy) {
+      lib_condition_wait(&chunk_cache_cond, &chunk_cache_lock);
+    }
+    if (chunk->cache_handle) {
+      MEM_CacheLimiter_unmanage(chunk->cache_handle);
+    }
+    MEM_SAFE_FREE(chunk->data);
+  }
+  lib_mutex_unlock(&chunk_cache_lock);
+  chunk_cache_user_remove();
+
+  if (layer->mmap) {
+    lib_mmap_free(layer->mmap);
+  }
+  if (layer->file != -1) {
+    close(layer->file);
+    lib_del(layer->filepath, false, false);
+  }
+  lib_mutex_end(&layer->file_mutex);
+  MEM_freeN(layer->chunks);
+  MEM_freeN(layer);
+}
+
+int dune_customdata_chunked_layer_len(const CustomDataChunkedLayer *layer)
+{
+  return layer->totelem;
+}
+
+int dune_customdata_chunked_layer_chunks_num(const CustomDataChunkedLayer *layer)
+{
+  return layer->chunks_num;
+}
+
+void dune_customdata_chunked_layer_chunk_range(const CustomDataChunkedLayer *layer,
+                                               const int chunk_index,
+                                               int *r_elem_start,
+                                               int *r_elem_len)
+{
+  *r_elem_start = chunk_index * layer->chunk_elems;
+  *r_elem_len = MIN2(layer->chunk_elems, layer->totelem - *r_elem_start);
+}
+
+const void *dune_customdata_chunked_layer_chunk_acquire(CustomDataChunkedLayer *layer,
+                                                        const int chunk_index)
+{
+  return chunked_layer_chunk_acquire(layer, chunk_index, false);
+}
+
+void *dune_customdata_chunked_layer_chunk_acquire_for_write(CustomDataChunkedLayer *layer,
+                                                            const int chunk_index)
+{
+  return chunked_layer_chunk_acquire(layer, chunk_index, true);
+}
+
+void dune_customdata_chunked_layer_chunk_release(CustomDataChunkedLayer *layer,
+                                                 const int chunk_index)
+{
+  CustomDataChunk *chunk = &layer->chunks[chunk_index];
+
+  /* The handle is cleared by evictions from other threads, only read it locked. */
+  lib_mutex_lock(&chunk_cache_lock);
+  if (chunk->cache_handle) {
+    MEM_CacheLimiter_unref(chunk->cache_handle);
+    chunk_cache_enforce_limits_and_unlock();
+    return;
+  }
+  /* Otherwise kept in memory. */
+  lib_mutex_unlock(&chunk_cache_lock);
+}
+
+void dune_customdata_chunked_layer_chunk_prefetch(CustomDataChunkedLayer *layer,
+                                                  const int chunk_index)
+{
+  if (chunk_index >= layer->chunks_num) {
+    return;
+  }
+  const CustomDataChunk *chunk = &layer->chunks[chunk_index];
+
+  /* Other threads may be loading or evicting the chunk. */
+  lib_mutex_lock(&chunk_cache_lock);
+  const bool needs_read = chunk->is_on_disk && chunk->data == nullptr && !chunk->is_busy;
+  lib_mutex_unlock(&chunk_cache_lock);
+
+  /* Only a hint, advising outside the lock is fine even if the chunk got loaded meanwhile. */
+  if (needs_read) {
+    lib_mmap_advise(layer->mmap,
+                    chunked_layer_chunk_offset(layer, chunk_index),
+                    chunked_layer_chunk_size(layer, chunk_index),
+                    LIB_MMAP_ADVICE_WILLNEED);
+  }
+}
+
+struct ChunkedLayerForeachData {
+  CustomDataChunkedLayer *layer;
+  bool for_write;
+  CustomDataChunkFn fn;
+  void *userdata;
+};
+
+static void chunked_layer_foreach_chunk_fn(void *__restrict userdata,
+                                           const int chunk_index,
+                                           const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const ChunkedLayerForeachData *data = static_cast<const ChunkedLayerForeachData *>(userdata);
+  CustomDataChunkedLayer *layer = data->layer;
+
+  dune_customdata_chunked_layer_chunk_prefetch(layer, chunk_index + 1);
+
+  void *chunk_data = chunked_layer_chunk_acquire(layer, chunk_index, data->for_write);
+  int elem_start, elem_len;
+  dune_customdata_chunked_layer_chunk_range(layer, chunk_index, &elem_start, &elem_len);
+  data->fn(data->userdata, chunk_data, elem_start, elem_len);
+  dune_customdata_chunked_layer_chunk_release(layer, chunk_index);
+}
+
+void dune_customdata_chunked_layer_foreach_chunk(CustomDataChunkedLayer *layer,
+                                                 const bool for_write,
+                                                 const bool use_threading,
+                                                 CustomDataChunkFn fn,
+                                                 void *userdata)
+{
+  ChunkedLayerForeachData data = {layer, for_write, fn, userdata};
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.use_threading = use_threading && (layer->chunks_num > 1);
+  settings.min_iter_per_thread = 1;
+  lib_task_parallel_range(0, layer->chunks_num, &data, chunked_layer_foreach_chunk_fn, &settings);
+}
+
+struct ChunkedLayerArrayData {
+  size_t elem_size;
+  char *array;
+};
+
+static void chunked_layer_read_array_fn(void *__restrict userdata,
+                                        void *data,
+                                        const int elem_start,
+                                        const int elem_len)
+{
+  const ChunkedLayerArrayData *array_data = static_cast<const ChunkedLayerArrayData *>(userdata);
+  memcpy(array_data->array + array_data->elem_size * (size_t)elem_start,
+         data,
+         array_data->elem_size * (size_t)elem_len);
+}
+
+static void chunked_layer_write_array_fn(void *__restrict userdata,
+                                         void *data,
+                                         const int elem_start,
+                                         const int elem_len)
+{
+  const ChunkedLayerArrayData *array_data = static_cast<const ChunkedLayerArrayData *>(userdata);
+  memcpy(data,
+         array_data->array + array_data->elem_size * (size_t)elem_start,
+         array_data->elem_size * (size_t)elem_len);
+}
+
+void dune_customdata_chunked_layer_read_array(CustomDataChunkedLayer *layer, void *r_data)
+{
+  ChunkedLayerArrayData array_data = {layer->elem_size, static_cast<char *>(r_data)};
+  dune_customdata_chunked_layer_foreach_chunk(
+      layer, false, true, chunked_layer_read_array_fn, &array_data);
+}
+
+void dune_customdata_chunked_layer_write_array(CustomDataChunkedLayer *layer, const void *data)
+{
+  ChunkedLayerArrayData array_data = {layer->elem_size,
+                                      const_cast<char *>(static_cast<const char *>(data))};
+  dune_customdata_chunked_layer_foreach_chunk(
+      layer, true, true, chunked_layer_write_array_fn, &array_data);
+}
+
+bool dune_customdata_chunked_layer_has_io_error(const CustomDataChunkedLayer *layer)
+{
+  lib_mutex_lock(&chunk_cache_lock);
+  const bool has_io_error = layer->has_io_error;
+  lib_mutex_unlock(&chunk_cache_lock);
+  return has_io_error;
+}
+
@@ -44,6 +44,7 @@
 #include "DUNE_modifier.h"
 #include "DUNE_multires.h"
 #include "DUNE_object.h"
+#include "dune_customdata_sharing.h"
 
 #include "PIL_time.h"
 
@@ -239,6 +240,12 @@ static void mesh_write(DuneWriter *writer, ID *id, const void *id_address)
     CustomData_write_prepare(&mesh->edata, &elayers, elayers_buff, ARRAY_SIZE(elayers_buff));
     CustomData_write_prepare(&mesh->ldata, &llayers, llayers_buff, ARRAY_SIZE(llayers_buff));
     CustomData_write_prepare(&mesh->pdata, &players, players_buff, ARRAY_SIZE(players_buff));
+
+    /* Sharing is run-time only, the pointers are meaningless in the file. */
+    CustomData_layers_sharing_info_clear(vlayers, mesh->vdata.totlayer);
+    CustomData_layers_sharing_info_clear(elayers, mesh->edata.totlayer);
+    CustomData_layers_sharing_info_clear(llayers, mesh->ldata.totlayer);
+    CustomData_layers_sharing_info_clear(players, mesh->pdata.totlayer);
   }
 
   LOADER_write_id_struct(writer, Mesh, id_address, &mesh->id);
@@ -316,6 +323,11 @@ static void mesh_read_data(DuneDataReader *reader, ID *id)
   CustomData_read(reader, &mesh->fdata, mesh->totface);
   CustomData_read(reader, &mesh->ldata, mesh->totloop);
   CustomData_read(reader, &mesh->pdata, mesh->totpoly);
+  CustomData_layers_sharing_info_clear(mesh->vdata.layers, mesh->vdata.totlayer);
+  CustomData_layers_sharing_info_clear(mesh->edata.layers, mesh->edata.totlayer);
+  CustomData_layers_sharing_info_clear(mesh->fdata.layers, mesh->fdata.totlayer);
+  CustomData_layers_sharing_info_clear(mesh->ldata.layers, mesh->ldata.totlayer);
+  CustomData_layers_sharing_info_clear(mesh->pdata.layers, mesh->pdata.totlayer);
 
   mesh->texflag &= ~ME_AUTOSPACE_EVALUATED;
   mesh->edit_mesh = nullptr;
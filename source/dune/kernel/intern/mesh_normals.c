@@ -30,9 +30,11 @@
 #include "KE_editmesh_cache.h"
 #include "KE_global.h"
 #include "KE_mesh.h"
+#include "KE_mesh_mapping.h"
 
 #include "atomic_ops.h"
 
+using blender::float3;
 using blender::Span;
 
 // #define DEBUG_TIME
@@ -222,18 +224,17 @@ struct MeshCalcNormalsData_PolyAndVertex {
   float (*vnors)[3];
 };
 
-static void mesh_calc_normals_poly_and_vertex_accum_fn(
-    void *__restrict userdata, const int pidx, const TaskParallelTLS *__restrict UNUSED(tls))
+/**
+ * Calculate the polygon normal, calling `corner_fn(corner, fac)` with the angle weight of each
+ * corner (relative to the polygon's loop-start) for accumulating into vertex normals.
+ */
+template<typename CornerFn>
+static void mesh_calc_poly_normal_and_corner_weights(const MPoly *mp,
+                                                     const MLoop *ml,
+                                                     const MVert *mverts,
+                                                     float pnor[3],
+                                                     const CornerFn &corner_fn)
 {
-  const MeshCalcNormalsData_PolyAndVertex *data = (MeshCalcNormalsData_PolyAndVertex *)userdata;
-  const MPoly *mp = &data->mpoly[pidx];
-  const MLoop *ml = &data->mloop[mp->loopstart];
-  const MVert *mverts = data->mvert;
-  float(*vnors)[3] = data->vnors;
-
-  float pnor_temp[3];
-  float *pnor = data->pnors ? data->pnors[pidx] : pnor_temp;
-
   const int i_end = mp->totloop - 1;
 
   /* Polygon Normal and edge-vector. */
@@ -252,7 +253,7 @@ static void mesh_calc_normals_poly_and_vertex_accum_fn(
     }
   }
 
-  /* Accumulate angle weighted face normal into the vertex normal. */
+  /* Angle weight of the face normal for each vertex. */
   /* Inline version of #accumulate_vertex_normals_poly_v3. */
   {
     float edvec_prev[3], edvec_next[3], edvec_end[3];
@@ -275,15 +276,33 @@ static void mesh_calc_normals_poly_and_vertex_accum_fn(
 
       /* Calculate angle between the two poly edges incident on this vertex. */
       const float fac = saacos(-dot_v3v3(edvec_prev, edvec_next));
-      const float vnor_add[3] = {pnor[0] * fac, pnor[1] * fac, pnor[2] * fac};
+      corner_fn(i_curr, fac);
 
-      add_v3_v3_atomic(vnors[ml[i_curr].v], vnor_add);
       v_curr = v_next;
       copy_v3_v3(edvec_prev, edvec_next);
     }
   }
 }
 
+static void mesh_calc_normals_poly_and_vertex_accum_fn(
+    void *__restrict userdata, const int pidx, const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const MeshCalcNormalsData_PolyAndVertex *data = (MeshCalcNormalsData_PolyAndVertex *)userdata;
+  const MPoly *mp = &data->mpoly[pidx];
+  const MLoop *ml = &data->mloop[mp->loopstart];
+  float(*vnors)[3] = data->vnors;
+
+  float pnor_temp[3];
+  float *pnor = data->pnors ? data->pnors[pidx] : pnor_temp;
+
+  /* Accumulate angle weighted face normal into the vertex normal. */
+  mesh_calc_poly_normal_and_corner_weights(
+      mp, ml, data->mvert, pnor, [&](const int i_curr, const float fac) {
+        const float vnor_add[3] = {pnor[0] * fac, pnor[1] * fac, pnor[2] * fac};
+        add_v3_v3_atomic(vnors[ml[i_curr].v], vnor_add);
+      });
+}
+
 static void mesh_calc_normals_poly_and_vertex_finalize_fn(
     void *__restrict userdata, const int vidx, const TaskParallelTLS *__restrict UNUSED(tls))
 {
@@ -329,6 +348,109 @@ void KERNEL_mesh_calc_normals_poly_and_vertex(const MVert *mvert,
       0, mvert_len, &data, mesh_calc_normals_poly_and_vertex_finalize_fn, &settings);
 }
 
+/* -------------------------------------------------------------------- */
+/** Mesh Normal Calculation (Polygons & Vertices, Gather)
+ *
+ * Alternative to #KERNEL_mesh_calc_normals_poly_and_vertex that doesn't use atomics.
+ * With many threads the atomic accumulation into shared vertex normals contends,
+ * instead the angle weight of every corner is stored first, then each vertex gathers
+ * the weighted normals of its polygons through a vertex to corner map.
+ * Since the map only depends on topology it can be reused while the mesh deforms.
+ */
+
+struct MeshCalcNormalsData_Gather {
+  const MVert *mvert;
+  const MLoop *mloop;
+  const MPoly *mpoly;
+  const MeshElemMap *vert_to_loop_map;
+  const int *loop_to_poly;
+
+  /** Angle weight of every corner. */
+  float *corner_weights;
+
+  /** Polygon normal output. */
+  float (*pnors)[3];
+  /** Vertex normal output. */
+  float (*vnors)[3];
+};
+
+static void mesh_calc_normals_poly_and_corner_weights_fn(
+    void *__restrict userdata, const int pidx, const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const MeshCalcNormalsData_Gather *data = (MeshCalcNormalsData_Gather *)userdata;
+  const MPoly *mp = &data->mpoly[pidx];
+  float *corner_weights = &data->corner_weights[mp->loopstart];
+
+  mesh_calc_poly_normal_and_corner_weights(
+      mp,
+      &data->mloop[mp->loopstart],
+      data->mvert,
+      data->pnors[pidx],
+      [&](const int i_curr, const float fac) { corner_weights[i_curr] = fac; });
+}
+
+static void mesh_calc_normals_vertex_gather_fn(void *__restrict userdata,
+                                               const int vidx,
+                                               const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const MeshCalcNormalsData_Gather *data = (MeshCalcNormalsData_Gather *)userdata;
+  const MeshElemMap &vert_loops = data->vert_to_loop_map[vidx];
+
+  /* Corners are sorted by polygon, so reads of weights & normals are mostly sequential,
+   * the sum is kept in registers and the result is written once, normalized. */
+  float3 no(0.0f);
+  for (int i = 0; i < vert_loops.count; i++) {
+    const int corner = vert_loops.indices[i];
+    no += float3(data->pnors[data->loop_to_poly[corner]]) *
+          data->corner_weights[corner];
+  }
+
+  float *r_no = data->vnors[vidx];
+  if (UNLIKELY(normalize_v3_v3(r_no, no) == 0.0f)) {
+    /* Following Mesh convention; we use vertex coordinate itself for normal in this case. */
+    normalize_v3_v3(r_no, data->mvert[vidx].co);
+  }
+}
+
+void KERNEL_mesh_calc_normals_poly_and_vertex_gather(const MVert *mvert,
+                                                  const int mvert_len,
+                                                  const MLoop *mloop,
+                                                  const int mloop_len,
+                                                  const MPoly *mpoly,
+                                                  const int mpoly_len,
+                                                  const MeshElemMap *vert_to_loop_map,
+                                                  const int *loop_to_poly,
+                                                  float (*r_poly_normals)[3],
+                                                  float (*r_vert_normals)[3])
+{
+  /* Polygon normals are read back when gathering. */
+  LIB_assert((r_poly_normals != nullptr) || (mpoly_len == 0));
+
+  TaskParallelSettings settings;
+  LIB_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1024;
+
+  MeshCalcNormalsData_Gather data = {};
+  data.mpoly = mpoly;
+  data.mloop = mloop;
+  data.mvert = mvert;
+  data.vert_to_loop_map = vert_to_loop_map;
+  data.loop_to_poly = loop_to_poly;
+  data.corner_weights = (float *)MEM_malloc_arrayN(
+      (size_t)mloop_len, sizeof(*data.corner_weights), __func__);
+  data.pnors = r_poly_normals;
+  data.vnors = r_vert_normals;
+
+  /* Compute poly normals & corner weights, each corner is only written once. */
+  LIB_task_parallel_range(
+      0, mpoly_len, &data, mesh_calc_normals_poly_and_corner_weights_fn, &settings);
+
+  /* Gather & normalize vertex normals, each vertex is only written once. */
+  LIB_task_parallel_range(0, mvert_len, &data, mesh_calc_normals_vertex_gather_fn, &settings);
+
+  MEM_freeN(data.corner_weights);
+}
+
 /* -------------------------------------------------------------------- */
 /** Mesh Normal Calculation
  */
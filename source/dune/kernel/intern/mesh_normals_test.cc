@@ -0,0 +1,165 @@
+#include "testing/testing.h"
+
+#include "MEM_guardedalloc.h"
+
+#include "STRUCTS_meshdata_types.h"
+
+#include "LI_math.h"
+#include "LI_time_utildefines.h"
+
+#include "KE_mesh.h"
+#include "KE_mesh_mapping.h"
+
+namespace blender::bke::tests {
+
+struct MeshNormalsTestGrid {
+  MVert *mvert;
+  MLoop *mloop;
+  MPoly *mpoly;
+  int mvert_len, mloop_len, mpoly_len;
+
+  MeshElemMap *vert_to_loop_map;
+  int *vert_to_loop_mem;
+  int *loop_to_poly;
+};
+
+/* A wavy grid of quads with `res * res` vertices. */
+static void test_mesh_normals_grid_init(MeshNormalsTestGrid *grid, const int res)
+{
+  grid->mvert_len = res * res;
+  grid->mpoly_len = (res - 1) * (res - 1);
+  grid->mloop_len = grid->mpoly_len * 4;
+  grid->mvert = (MVert *)MEM_calloc_arrayN(grid->mvert_len, sizeof(MVert), __func__);
+  grid->mloop = (MLoop *)MEM_calloc_arrayN(grid->mloop_len, sizeof(MLoop), __func__);
+  grid->mpoly = (MPoly *)MEM_calloc_arrayN(grid->mpoly_len, sizeof(MPoly), __func__);
+  grid->loop_to_poly = (int *)MEM_malloc_arrayN(grid->mloop_len, sizeof(int), __func__);
+
+  for (int y = 0; y < res; y++) {
+    for (int x = 0; x < res; x++) {
+      float *co = grid->mvert[y * res + x].co;
+      co[0] = (float)x;
+      co[1] = (float)y;
+      co[2] = sinf((float)x * 0.1f) * cosf((float)y * 0.1f);
+    }
+  }
+
+  int poly_index = 0;
+  for (int y = 0; y < res - 1; y++) {
+    for (int x = 0; x < res - 1; x++, poly_index++) {
+      MPoly *mp = &grid->mpoly[poly_index];
+      mp->loopstart = poly_index * 4;
+      mp->totloop = 4;
+      MLoop *ml = &grid->mloop[mp->loopstart];
+      ml[0].v = (uint)(y * res + x);
+      ml[1].v = (uint)(y * res + x + 1);
+      ml[2].v = (uint)((y + 1) * res + x + 1);
+      ml[3].v = (uint)((y + 1) * res + x);
+      for (int i = 0; i < 4; i++) {
+        grid->loop_to_poly[mp->loopstart + i] = poly_index;
+      }
+    }
+  }
+
+  BKE_mesh_vert_loop_map_create(&grid->vert_to_loop_map,
+                                &grid->vert_to_loop_mem,
+                                grid->mpoly,
+                                grid->mloop,
+                                grid->mvert_len,
+                                grid->mpoly_len,
+                                grid->mloop_len);
+}
+
+static void test_mesh_normals_grid_free(MeshNormalsTestGrid *grid)
+{
+  MEM_freeN(grid->mvert);
+  MEM_freeN(grid->mloop);
+  MEM_freeN(grid->mpoly);
+  MEM_freeN(grid->loop_to_poly);
+  MEM_freeN(grid->vert_to_loop_map);
+  MEM_freeN(grid->vert_to_loop_mem);
+}
+
+TEST(mesh_normals, gather_matches_atomic)
+{
+  MeshNormalsTestGrid grid;
+  test_mesh_normals_grid_init(&grid, 64);
+
+  float(*pnors_a)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mpoly_len, sizeof(float[3]), __func__);
+  float(*vnors_a)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mvert_len, sizeof(float[3]), __func__);
+  float(*pnors_b)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mpoly_len, sizeof(float[3]), __func__);
+  float(*vnors_b)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mvert_len, sizeof(float[3]), __func__);
+
+  KERNEL_mesh_calc_normals_poly_and_vertex(grid.mvert,
+                                        grid.mvert_len,
+                                        grid.mloop,
+                                        grid.mloop_len,
+                                        grid.mpoly,
+                                        grid.mpoly_len,
+                                        pnors_a,
+                                        vnors_a);
+  KERNEL_mesh_calc_normals_poly_and_vertex_gather(grid.mvert,
+                                               grid.mvert_len,
+                                               grid.mloop,
+                                               grid.mloop_len,
+                                               grid.mpoly,
+                                               grid.mpoly_len,
+                                               grid.vert_to_loop_map,
+                                               grid.loop_to_poly,
+                                               pnors_b,
+                                               vnors_b);
+
+  for (int i = 0; i < grid.mpoly_len; i++) {
+    EXPECT_V3_NEAR(pnors_a[i], pnors_b[i], 1e-6f);
+  }
+  for (int i = 0; i < grid.mvert_len; i++) {
+    EXPECT_V3_NEAR(vnors_a[i], vnors_b[i], 1e-5f);
+  }
+
+  MEM_freeN(pnors_a);
+  MEM_freeN(vnors_a);
+  MEM_freeN(pnors_b);
+  MEM_freeN(vnors_b);
+  test_mesh_normals_grid_free(&grid);
+}
+
+/* Benchmark: atomic accumulation vs. gathering on a ~20M vertex grid.
+ * Disabled by default, run with `--gtest_also_run_disabled_tests`. */
+TEST(mesh_normals_performance, DISABLED_poly_and_vertex_20M)
+{
+  const int res = 4472;
+  MeshNormalsTestGrid grid;
+  test_mesh_normals_grid_init(&grid, res);
+
+  float(*pnors)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mpoly_len, sizeof(float[3]), __func__);
+  float(*vnors)[3] = (float(*)[3])MEM_malloc_arrayN(grid.mvert_len, sizeof(float[3]), __func__);
+
+  TIMEIT_START(normals_atomic);
+  KERNEL_mesh_calc_normals_poly_and_vertex(grid.mvert,
+                                        grid.mvert_len,
+                                        grid.mloop,
+                                        grid.mloop_len,
+                                        grid.mpoly,
+                                        grid.mpoly_len,
+                                        pnors,
+                                        vnors);
+  TIMEIT_END(normals_atomic);
+
+  TIMEIT_START(normals_gather);
+  KERNEL_mesh_calc_normals_poly_and_vertex_gather(grid.mvert,
+                                               grid.mvert_len,
+                                               grid.mloop,
+                                               grid.mloop_len,
+                                               grid.mpoly,
+                                               grid.mpoly_len,
+                                               grid.vert_to_loop_map,
+                                               grid.loop_to_poly,
+                                               pnors,
+                                               vnors);
+  TIMEIT_END(normals_gather);
+
+  MEM_freeN(pnors);
+  MEM_freeN(vnors);
+  test_mesh_normals_grid_free(&grid);
+}
+
+}  // namespace blender::bke::tests
@@ -6,6 +6,7 @@
  */
 
 #include <limits.h>
+#include <string.h>
 
 #include "MEM_guardedalloc.h"
 
@@ -396,6 +397,9 @@ void KERNEL_mesh_tessface_calc(Mesh *mesh)
 
 /**
  * param face_normal: This will be optimized out as a constant.
+ * param cache_tris: Optional fill pattern of this polygon (ngons only),
+ * relative to its loop-start. Re-used when valid and the polygon is convex,
+ * otherwise written to after filling.
  */
 LIB_INLINE void mesh_calc_tessellation_for_face_impl(const MLoop *mloop,
                                                      const MPoly *mpoly,
@@ -404,7 +408,9 @@ LIB_INLINE void mesh_calc_tessellation_for_face_impl(const MLoop *mloop,
                                                      MLoopTri *mlt,
                                                      MemArena **pf_arena_p,
                                                      const bool face_normal,
-                                                     const float normal_precalc[3])
+                                                     const float normal_precalc[3],
+                                                     uint (*cache_tris)[3],
+                                                     const bool cache_tris_valid)
 {
   const uint mp_loopstart = (uint)mpoly[poly_index].loopstart;
   const uint mp_totloop = (uint)mpoly[poly_index].totloop;
@@ -490,7 +496,17 @@ LIB_INLINE void mesh_calc_tessellation_for_face_impl(const MLoop *mloop,
         mul_v2_m3v3(projverts[j], axis_mat, mvert[ml->v].co);
       }
 
-      LIB_polyfill_calc_arena(projverts, mp_totloop, 1, tris, pf_arena);
+      if (cache_tris && cache_tris_valid && is_poly_convex_v2(projverts, mp_totloop)) {
+        /* Any fill of a convex polygon is valid (no beautify is done here),
+         * so the pattern from a previous evaluation can be used as-is. */
+        tris = cache_tris;
+      }
+      else {
+        LIB_polyfill_calc_arena(projverts, mp_totloop, 1, tris, pf_arena);
+        if (cache_tris) {
+          memcpy(cache_tris, tris, sizeof(*tris) * (size_t)totfilltri);
+        }
+      }
 
       /* Apply fill. */
       for (uint j = 0; j < totfilltri; j++, mlt++) {
@@ -514,7 +530,7 @@ static void mesh_calc_tessellation_for_face(const MLoop *mloop,
                                             MemArena **pf_arena_p)
 {
   mesh_calc_tessellation_for_face_impl(
-      mloop, mpoly, mvert, poly_index, mlt, pf_arena_p, false, NULL);
+      mloop, mpoly, mvert, poly_index, mlt, pf_arena_p, false, NULL, NULL, false);
 }
 
 static void mesh_calc_tessellation_for_face_with_normal(const MLoop *mloop,
@@ -526,7 +542,7 @@ static void mesh_calc_tessellation_for_face_with_normal(const MLoop *mloop,
                                                         const float normal_precalc[3])
 {
   mesh_calc_tessellation_for_face_impl(
-      mloop, mpoly, mvert, poly_index, mlt, pf_arena_p, true, normal_precalc);
+      mloop, mpoly, mvert, poly_index, mlt, pf_arena_p, true, normal_precalc, NULL, false);
 }
 
 static void mesh_recalc_looptri__single_threaded(const MLoop *mloop,
@@ -599,7 +615,9 @@ static void mesh_calc_tessellation_for_face_fn(void *__restrict userdata,
                                        &data->mlooptri[tri_index],
                                        &tls_data->pf_arena,
                                        false,
-                                       NULL);
+                                       NULL,
+                                       NULL,
+                                       false);
 }
 
 static void mesh_calc_tessellation_for_face_with_normal_fn(void *__restrict userdata,
@@ -616,7 +634,9 @@ static void mesh_calc_tessellation_for_face_with_normal_fn(void *__restrict user
                                        &data->mlooptri[tri_index],
                                        &tls_data->pf_arena,
                                        true,
-                                       data->poly_normals[index]);
+                                       data->poly_normals[index],
+                                       NULL,
+                                       false);
 }
 
 static void mesh_calc_tessellation_for_face_free_fn(const void *__restrict UNUSED(userdata),
@@ -695,3 +715,209 @@ void KERNEL_mesh_recalc_looptri_with_normals(const MLoop *mloop,
         mloop, mpoly, mvert, totloop, totpoly, mlooptri, poly_normals);
   }
 }
+
+/* -------------------------------------------------------------------- */
+/** Cached Loop Tessellation
+ *
+ * Deforming meshes keep their topology between evaluations, only coordinates change.
+ * Store the fill pattern of every ngon so polyfill can be skipped for polygons
+ * that remain convex, see #mesh_calc_tessellation_for_face_impl.
+ * Triangles & quads are cheap to fill, so they aren't stored.
+ */
+
+struct MeshLoopTriCache {
+  /** Topology the patterns were calculated for. */
+  int totloop;
+  int totpoly;
+  /** Loop count of each polygon, compared against to detect topology changes. */
+  int *poly_totloop;
+  /** Index of each ngon's first triangle in `tris`. */
+  uint *poly_tri_offset;
+  /** Fill patterns, relative to the polygon's loop-start. */
+  uint (*tris)[3];
+  /** False until `tris` has been filled for the current topology. */
+  bool is_valid;
+};
+
+struct MeshLoopTriCache *KERNEL_mesh_looptri_cache_new(void)
+{
+  return MEM_callocN(sizeof(struct MeshLoopTriCache), __func__);
+}
+
+static void mesh_looptri_cache_clear(struct MeshLoopTriCache *cache)
+{
+  MEM_SAFE_FREE(cache->poly_totloop);
+  MEM_SAFE_FREE(cache->poly_tri_offset);
+  MEM_SAFE_FREE(cache->tris);
+  cache->totloop = 0;
+  cache->totpoly = 0;
+  cache->is_valid = false;
+}
+
+void KERNEL_mesh_looptri_cache_free(struct MeshLoopTriCache *cache)
+{
+  mesh_looptri_cache_clear(cache);
+  MEM_freeN(cache);
+}
+
+/**
+ * Reset the cache when the polygon sizes changed.
+ * Loop indices aren't compared since patterns are only re-used for convex polygons,
+ * where any pattern is valid.
+ */
+static void mesh_looptri_cache_ensure(struct MeshLoopTriCache *cache,
+                                      const MPoly *mpoly,
+                                      int totloop,
+                                      int totpoly)
+{
+  if (cache->is_valid && cache->totloop == totloop && cache->totpoly == totpoly) {
+    int i;
+    for (i = 0; i < totpoly; i++) {
+      if (mpoly[i].totloop != cache->poly_totloop[i]) {
+        break;
+      }
+    }
+    if (i == totpoly) {
+      return;
+    }
+  }
+
+  mesh_looptri_cache_clear(cache);
+  cache->totloop = totloop;
+  cache->totpoly = totpoly;
+  cache->poly_totloop = MEM_mallocN(sizeof(*cache->poly_totloop) * (size_t)totpoly, __func__);
+  cache->poly_tri_offset = MEM_mallocN(sizeof(*cache->poly_tri_offset) * (size_t)totpoly,
+                                       __func__);
+
+  uint tris_len = 0;
+  for (int i = 0; i < totpoly; i++) {
+    cache->poly_totloop[i] = mpoly[i].totloop;
+    cache->poly_tri_offset[i] = tris_len;
+    if (mpoly[i].totloop > 4) {
+      tris_len += (uint)(mpoly[i].totloop - 2);
+    }
+  }
+  if (tris_len) {
+    cache->tris = MEM_mallocN(sizeof(*cache->tris) * (size_t)tris_len, __func__);
+  }
+}
+
+struct TessellationCachedUserData {
+  struct TessellationUserData base;
+  struct MeshLoopTriCache *cache;
+  /** Cached patterns may be re-used (otherwise they're only written to). */
+  bool use_cache_tris;
+};
+
+LIB_INLINE void mesh_calc_tessellation_for_face_cached(
+    const struct TessellationCachedUserData *data, const uint poly_index, MemArena **pf_arena_p)
+{
+  const MPoly *mp = &data->base.mpoly[poly_index];
+  const int tri_index = poly_to_tri_count((int)poly_index, mp->loopstart);
+  uint(*cache_tris)[3] = (mp->totloop > 4) ?
+                             &data->cache->tris[data->cache->poly_tri_offset[poly_index]] :
+                             NULL;
+
+  if (data->base.poly_normals) {
+    mesh_calc_tessellation_for_face_impl(data->base.mloop,
+                                         data->base.mpoly,
+                                         data->base.mvert,
+                                         poly_index,
+                                         &data->base.mlooptri[tri_index],
+                                         pf_arena_p,
+                                         true,
+                                         data->base.poly_normals[poly_index],
+                                         cache_tris,
+                                         data->use_cache_tris);
+  }
+  else {
+    mesh_calc_tessellation_for_face_impl(data->base.mloop,
+                                         data->base.mpoly,
+                                         data->base.mvert,
+                                         poly_index,
+                                         &data->base.mlooptri[tri_index],
+                                         pf_arena_p,
+                                         false,
+                                         NULL,
+                                         cache_tris,
+                                         data->use_cache_tris);
+  }
+}
+
+static void mesh_calc_tessellation_for_face_cached_fn(void *__restrict userdata,
+                                                      const int index,
+                                                      const TaskParallelTLS *__restrict tls)
+{
+  struct TessellationUserTLS *tls_data = tls->userdata_chunk;
+  mesh_calc_tessellation_for_face_cached(userdata, (uint)index, &tls_data->pf_arena);
+}
+
+/**
+ * Calculate tessellation, re-using the ngon fill patterns stored in a cache
+ * from previous calls with the same topology (any changes reset the cache).
+ *
+ * param poly_normals: Optional pre-calculated polygon normals.
+ */
+void KERNEL_mesh_recalc_looptri_cached(const MLoop *mloop,
+                                    const MPoly *mpoly,
+                                    const MVert *mvert,
+                                    int totloop,
+                                    int totpoly,
+                                    MLoopTri *mlooptri,
+                                    const float (*poly_normals)[3],
+                                    struct MeshLoopTriCache *cache)
+{
+  mesh_looptri_cache_ensure(cache, mpoly, totloop, totpoly);
+
+  if (cache->tris == NULL) {
+    /* No ngons, nothing to cache. */
+    if (poly_normals) {
+      KERNEL_mesh_recalc_looptri_with_normals(
+          mloop, mpoly, mvert, totloop, totpoly, mlooptri, poly_normals);
+    }
+    else {
+      KERNEL_mesh_recalc_looptri(mloop, mpoly, mvert, totloop, totpoly, mlooptri);
+    }
+    cache->is_valid = true;
+    return;
+  }
+
+  struct TessellationCachedUserData data = {
+      .base =
+          {
+              .mloop = mloop,
+              .mpoly = mpoly,
+              .mvert = mvert,
+              .mlooptri = mlooptri,
+              .poly_normals = poly_normals,
+          },
+      .cache = cache,
+      .use_cache_tris = cache->is_valid,
+  };
+
+  if (totloop < MESH_FACE_TESSELLATE_THREADED_LIMIT) {
+    MemArena *pf_arena = NULL;
+    for (uint poly_index = 0; poly_index < (uint)totpoly; poly_index++) {
+      mesh_calc_tessellation_for_face_cached(&data, poly_index, &pf_arena);
+    }
+    if (pf_arena) {
+      LIB_memarena_free(pf_arena);
+    }
+  }
+  else {
+    struct TessellationUserTLS tls_data_dummy = {NULL};
+
+    TaskParallelSettings settings;
+    LIB_parallel_range_settings_defaults(&settings);
+
+    settings.userdata_chunk = &tls_data_dummy;
+    settings.userdata_chunk_size = sizeof(tls_data_dummy);
+
+    settings.func_free = mesh_calc_tessellation_for_face_free_fn;
+
+    LIB_task_parallel_range(
+        0, totpoly, &data, mesh_calc_tessellation_for_face_cached_fn, &settings);
+  }
+
+  cache->is_valid = true;
+}
@@ -419,12 +419,17 @@ void multires_flush_sculpt_updates(Object *object)
     return;
   }
 
+  /* Grids of nodes which were modified but not updated yet aren't tagged as dirty,
+   * the reshape would skip them otherwise. */
+  BKE_pbvh_grids_tag_pending_dirty(sculpt_session->pbvh, subdiv_ccg);
+
   Mesh *mesh = object->data;
   multiresModifier_reshapeFromCCG(
       sculpt_session->multires.modifier->totlvl, mesh, sculpt_session->subdiv_ccg);
 
   subdiv_ccg->dirty.coords = false;
   subdiv_ccg->dirty.hidden = false;
+  KERNEL_subdiv_ccg_dirty_grids_clear(subdiv_ccg);
 }
 
 void multires_force_sculpt_rebuild(Object *object)
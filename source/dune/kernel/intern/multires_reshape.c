@@ -12,6 +12,7 @@
 #include "BKE_modifier.h"
 #include "BKE_multires.h"
 #include "BKE_subdiv.h"
+#include "BKE_subdiv_ccg.h"
 #include "BKE_subsurf.h"
 #include "BLI_math_vector.h"
 
@@ -114,6 +115,26 @@ bool multiresModifier_reshapeFromDeformModifier(struct Depsgraph *depsgraph,
 /** \name Reshape from grids
  * \{ */
 
+/* Grids which are not reshaped keep their displacement, which is only valid when it is already
+ * stored at the top level. */
+static bool reshape_grids_allocated_at_level(const Mesh *mesh, const int level)
+{
+  const MDisps *mdisps = CustomData_get_layer(&mesh->ldata, CD_MDISPS);
+  const GridPaintMask *grid_paint_masks = CustomData_get_layer(&mesh->ldata, CD_GRID_PAINT_MASK);
+  if (mdisps == NULL) {
+    return false;
+  }
+  for (int grid_index = 0; grid_index < mesh->totloop; grid_index++) {
+    if (mdisps[grid_index].disps == NULL || mdisps[grid_index].level < level) {
+      return false;
+    }
+    if (grid_paint_masks != NULL && grid_paint_masks[grid_index].level < level) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool multiresModifier_reshapeFromCCG(const int tot_level,
                                      Mesh *coarse_mesh,
                                      struct SubdivCCG *subdiv_ccg)
@@ -126,6 +147,14 @@ bool multiresModifier_reshapeFromCCG(const int tot_level,
 
   multires_ensure_external_read(coarse_mesh, reshape_context.top.level);
 
+  /* Only reshape grids modified by sculpting since the last reshape, when known. Smoothing of
+   * lower levels works on the whole mesh, so those are always fully reshaped. */
+  if (subdiv_ccg->dirty.grids != NULL &&
+      reshape_context.reshape.level == reshape_context.top.level &&
+      reshape_grids_allocated_at_level(coarse_mesh, reshape_context.top.level)) {
+    multires_reshape_context_restrict_to_grids(&reshape_context, subdiv_ccg->dirty.grids);
+  }
+
   multires_reshape_store_original_grids(&reshape_context);
   multires_reshape_ensure_grids(coarse_mesh, reshape_context.top.level);
   if (!multires_reshape_assign_final_coords_from_ccg(&reshape_context, subdiv_ccg)) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "BLI_bitmap.h"
 #include "BLI_sys_types.h"
 
 #include "BKE_multires.h"
@@ -86,6 +87,10 @@ typedef struct MultiresReshapeContext {
 
   /* Vertex crease custom data layer, null if none is present. */
   const float *cd_vertex_crease;
+
+  /* Grids to be reshaped, all grids are when null.
+   * See #multires_reshape_context_restrict_to_grids. */
+  BLI_bitmap *grids_to_process;
 } MultiresReshapeContext;
 
 /**
@@ -162,6 +167,18 @@ bool multires_reshape_context_create_from_subdiv(MultiresReshapeContext *reshape
                                                  struct Subdiv *subdiv,
                                                  int top_level);
 
+/**
+ * Only reshape grids set in `dirty_grids` and the grids of base faces sharing a vertex with
+ * their faces, so changes at grid boundaries are propagated to neighbors.
+ *
+ * \note Only valid when reshape happens at the top level: the grids smoothing used for lower
+ * levels operates on the whole mesh.
+ */
+void multires_reshape_context_restrict_to_grids(MultiresReshapeContext *reshape_context,
+                                                const BLI_bitmap *dirty_grids);
+bool multires_reshape_context_grid_is_processed(const MultiresReshapeContext *reshape_context,
+                                                int grid_index);
+
 void multires_reshape_free_original_grids(MultiresReshapeContext *reshape_context);
 void multires_reshape_context_free(MultiresReshapeContext *reshape_context);
 
@@ -262,6 +262,57 @@ bool multires_reshape_context_create_from_subdiv(MultiresReshapeContext *reshape
   return context_verify_or_free(reshape_context);
 }
 
+void multires_reshape_context_restrict_to_grids(MultiresReshapeContext *reshape_context,
+                                                const BLI_bitmap *dirty_grids)
+{
+  BLI_assert(reshape_context->reshape.level == reshape_context->top.level);
+
+  const Mesh *base_mesh = reshape_context->base_mesh;
+  const MPoly *mpoly = base_mesh->mpoly;
+  const MLoop *mloop = base_mesh->mloop;
+  const int num_faces = base_mesh->totpoly;
+
+  /* Vertices of faces with a modified grid. */
+  BLI_bitmap *dirty_verts = BLI_BITMAP_NEW(base_mesh->totvert, __func__);
+  for (int face_index = 0; face_index < num_faces; face_index++) {
+    const MPoly *poly = &mpoly[face_index];
+    const int start_grid_index = reshape_context->face_start_grid_index[face_index];
+    for (int corner = 0; corner < poly->totloop; corner++) {
+      if (BLI_BITMAP_TEST(dirty_grids, start_grid_index + corner)) {
+        for (int i = 0; i < poly->totloop; i++) {
+          BLI_BITMAP_ENABLE(dirty_verts, mloop[poly->loopstart + i].v);
+        }
+        break;
+      }
+    }
+  }
+
+  /* All grids of faces using those vertices. */
+  MEM_SAFE_FREE(reshape_context->grids_to_process);
+  reshape_context->grids_to_process = BLI_BITMAP_NEW(reshape_context->num_grids, __func__);
+  for (int face_index = 0; face_index < num_faces; face_index++) {
+    const MPoly *poly = &mpoly[face_index];
+    for (int i = 0; i < poly->totloop; i++) {
+      if (BLI_BITMAP_TEST(dirty_verts, mloop[poly->loopstart + i].v)) {
+        const int start_grid_index = reshape_context->face_start_grid_index[face_index];
+        for (int corner = 0; corner < poly->totloop; corner++) {
+          BLI_BITMAP_ENABLE(reshape_context->grids_to_process, start_grid_index + corner);
+        }
+        break;
+      }
+    }
+  }
+
+  MEM_freeN(dirty_verts);
+}
+
+bool multires_reshape_context_grid_is_processed(const MultiresReshapeContext *reshape_context,
+                                                const int grid_index)
+{
+  return reshape_context->grids_to_process == NULL ||
+         BLI_BITMAP_TEST_BOOL(reshape_context->grids_to_process, grid_index);
+}
+
 void multires_reshape_free_original_grids(MultiresReshapeContext *reshape_context)
 {
   MDisps *orig_mdisps = reshape_context->orig.mdisps;
@@ -301,6 +352,7 @@ void multires_reshape_context_free(MultiresReshapeContext *reshape_context)
   MEM_SAFE_FREE(reshape_context->face_start_grid_index);
   MEM_SAFE_FREE(reshape_context->ptex_start_grid_index);
   MEM_SAFE_FREE(reshape_context->grid_to_face_index);
+  MEM_SAFE_FREE(reshape_context->grids_to_process);
 }
 
 /** \} */
@@ -586,6 +638,14 @@ void multires_reshape_store_original_grids(MultiresReshapeContext *reshape_conte
   const int num_grids = reshape_context->num_grids;
   for (int grid_index = 0; grid_index < num_grids; grid_index++) {
     MDisps *orig_grid = &orig_mdisps[grid_index];
+    if (!multires_reshape_context_grid_is_processed(reshape_context, grid_index)) {
+      /* Not accessed, don't pay for copying them. */
+      orig_grid->disps = NULL;
+      if (orig_grid_paint_masks != NULL) {
+        orig_grid_paint_masks[grid_index].data = NULL;
+      }
+      continue;
+    }
     /* Ignore possibly invalid/non-allocated original grids. They will be replaced with 0 original
      * data when accessed during reshape process.
      * Reshape process will ensure all grids are on top level, but that happens on separate set of
@@ -635,6 +695,9 @@ static void foreach_grid_face_coordinate_task(void *__restrict userdata_v,
   const int num_corners = mpoly[face_index].totloop;
   int grid_index = reshape_context->face_start_grid_index[face_index];
   for (int corner = 0; corner < num_corners; ++corner, ++grid_index) {
+    if (!multires_reshape_context_grid_is_processed(reshape_context, grid_index)) {
+      continue;
+    }
     for (int y = 0; y < grid_size; ++y) {
       const float v = (float)y * grid_size_1_inv;
       for (int x = 0; x < grid_size; ++x) {
@@ -1924,6 +1924,7 @@ void BKE_pbvh_node_get_grids(PBVH *pbvh,
 #include "BLI_ghash.h"
 #include "BLI_math.h"
 #include "BLI_rand.h"
+#include "BLI_sort_utils.h"
 #include "BLI_task.h"
 
 #include "DNA_mesh_types.h"
@@ -2144,56 +2145,49 @@ void pbvh_grow_nodes(PBVH *pbvh, int totnode)
   pbvh->totnode = totnode;
 }
 
-/* Add a vertex to the map, with a positive value for unique vertices and
- * a negative value for additional vertices */
-static int map_insert_vert(
-    PBVH *pbvh, GHash *map, unsigned int *face_verts, unsigned int *uniq_verts, int vertex)
+/* Index of `value` in the sorted `array`. */
+static int sorted_array_index(const int *array, int len, const int value)
 {
-  void *key, **value_p;
-
-  key = POINTER_FROM_INT(vertex);
-  if (!BLI_ghash_ensure_p(map, key, &value_p)) {
-    int value_i;
-    if (BLI_BITMAP_TEST(pbvh->vert_bitmap, vertex) == 0) {
-      BLI_BITMAP_ENABLE(pbvh->vert_bitmap, vertex);
-      value_i = *uniq_verts;
-      (*uniq_verts)++;
+  int lo = 0;
+  while (len > 0) {
+    const int half = len / 2;
+    if (array[lo + half] < value) {
+      lo += half + 1;
+      len -= half + 1;
     }
     else {
-      value_i = ~(*face_verts);
-      (*face_verts)++;
+      len = half;
     }
-    *value_p = POINTER_FROM_INT(value_i);
-    return value_i;
   }
-
-  return POINTER_AS_INT(*value_p);
+  BLI_assert(array[lo] == value);
+  return lo;
 }
 
-/* Find vertices used by the faces in this node and update the draw buffers */
-static void build_mesh_leaf_node(PBVH *pbvh, PBVHNode *node)
+/* Find vertices used by the faces in this node and update the draw buffers.
+ *
+ * A vertex is unique to the first leaf (in build order) using it, see `vert_owner`.
+ * Unique and other vertices are both stored in ascending order,
+ * so loops over the node's vertices walk the vertex arrays front to back. */
+static void build_mesh_leaf_node(PBVH *pbvh,
+                                 PBVHNode *node,
+                                 const int *vert_owner,
+                                 const int leaf_rank)
 {
   bool has_visible = false;
 
-  node->uniq_verts = node->face_verts = 0;
   const int totface = node->totprim;
 
-  /* reserve size is rough guess */
-  GHash *map = BLI_ghash_int_new_ex("build_mesh_leaf_node gh", 2 * totface);
-
-  int(*face_vert_indices)[3] = MEM_mallocN(sizeof(int[3]) * totface, "bvh node face vert indices");
-
-  node->face_vert_indices = (const int(*)[3])face_vert_indices;
-
   if (pbvh->respect_hide == false) {
     has_visible = true;
   }
 
+  /* All corner vertices, sorted and de-duplicated below. */
+  int *verts = MEM_mallocN(sizeof(int) * 3 * totface, __func__);
+
   for (int i = 0; i < totface; i++) {
     const MLoopTri *lt = &pbvh->looptri[node->prim_indices[i]];
     for (int j = 0; j < 3; j++) {
-      face_vert_indices[i][j] = map_insert_vert(
-          pbvh, map, &node->face_verts, &node->uniq_verts, pbvh->mloop[lt->tri[j]].v);
+      verts[i * 3 + j] = pbvh->mloop[lt->tri[j]].v;
     }
 
     if (has_visible == false) {
@@ -2203,38 +2197,54 @@ static void build_mesh_leaf_node(PBVH *pbvh, PBVHNode *node)
     }
   }
 
-  int *vert_indices = MEM_callocN(sizeof(int) * (node->uniq_verts + node->face_verts),
-                                  "bvh node vert indices");
-  node->vert_indices = vert_indices;
+  qsort(verts, 3 * totface, sizeof(int), BLI_sortutil_cmp_int);
 
-  /* Build the vertex list, unique verts first */
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, map) {
-    void *value = BLI_ghashIterator_getValue(&gh_iter);
-    int ndx = POINTER_AS_INT(value);
-
-    if (ndx < 0) {
-      ndx = -ndx + node->uniq_verts - 1;
+  int verts_num = 0;
+  int uniq_verts = 0;
+  for (int i = 0; i < 3 * totface; i++) {
+    if (verts_num == 0 || verts[i] != verts[verts_num - 1]) {
+      verts[verts_num++] = verts[i];
+      if (vert_owner[verts[i]] == leaf_rank) {
+        uniq_verts++;
+      }
     }
+  }
 
-    vert_indices[ndx] = POINTER_AS_INT(BLI_ghashIterator_getKey(&gh_iter));
+  /* Build the vertex list, unique verts first */
+  int *vert_indices = MEM_mallocN(sizeof(int) * verts_num, "bvh node vert indices");
+  int uniq_index = 0, other_index = uniq_verts;
+  for (int i = 0; i < verts_num; i++) {
+    if (vert_owner[verts[i]] == leaf_rank) {
+      vert_indices[uniq_index++] = verts[i];
+    }
+    else {
+      vert_indices[other_index++] = verts[i];
+    }
   }
+  MEM_freeN(verts);
 
-  for (int i = 0; i < totface; i++) {
-    const int sides = 3;
+  node->vert_indices = vert_indices;
+  node->uniq_verts = uniq_verts;
+  node->face_verts = verts_num - uniq_verts;
 
-    for (int j = 0; j < sides; j++) {
-      if (face_vert_indices[i][j] < 0) {
-        face_vert_indices[i][j] = -face_vert_indices[i][j] + node->uniq_verts - 1;
-      }
+  int(*face_vert_indices)[3] = MEM_mallocN(sizeof(int[3]) * totface, "bvh node face vert indices");
+  node->face_vert_indices = (const int(*)[3])face_vert_indices;
+
+  for (int i = 0; i < totface; i++) {
+    const MLoopTri *lt = &pbvh->looptri[node->prim_indices[i]];
+    for (int j = 0; j < 3; j++) {
+      const int v = pbvh->mloop[lt->tri[j]].v;
+      face_vert_indices[i][j] = (vert_owner[v] == leaf_rank) ?
+                                    sorted_array_index(vert_indices, uniq_verts, v) :
+                                    uniq_verts + sorted_array_index(vert_indices + uniq_verts,
+                                                                    verts_num - uniq_verts,
+                                                                    v);
     }
   }
 
   BKE_pbvh_node_mark_rebuild_draw(node);
 
   BKE_pbvh_node_fully_hidden_set(node, !has_visible);
-
-  BLI_ghash_free(map, NULL, NULL);
 }
 
 static void update_vb(PBVH *pbvh, PBVHNode *node, BBC *prim_bbc, int offset, int count)
@@ -2306,24 +2316,6 @@ static void build_grid_leaf_node(PBVH *pbvh, PBVHNode *node)
   BKE_pbvh_node_mark_rebuild_draw(node);
 }
 
-static void build_leaf(PBVH *pbvh, int node_index, BBC *prim_bbc, int offset, int count)
-{
-  pbvh->nodes[node_index].flag |= PBVH_Leaf;
-
-  pbvh->nodes[node_index].prim_indices = pbvh->prim_indices + offset;
-  pbvh->nodes[node_index].totprim = count;
-
-  /* Still need vb for searches */
-  update_vb(pbvh, &pbvh->nodes[node_index], prim_bbc, offset, count);
-
-  if (pbvh->looptri) {
-    build_mesh_leaf_node(pbvh, pbvh->nodes + node_index);
-  }
-  else {
-    build_grid_leaf_node(pbvh, pbvh->nodes + node_index);
-  }
-}
-
 /* Return zero if all primitives in the node can be drawn with the
  * same material (including flat/smooth shading), non-zero otherwise */
 static bool leaf_needs_material_split(PBVH *pbvh, int offset, int count)
@@ -2358,70 +2350,321 @@ static bool leaf_needs_material_split(PBVH *pbvh, int offset, int count)
   return false;
 }
 
-/* Recursively build a node in the tree
- *
- * vb is the voxel box around all of the primitives contained in
- * this node.
- *
- * cb is the bounding box around all the centroids of the primitives
- * contained in this node
+/* -------------------------------------------------------------------- */
+/** Build
  *
- * offset and start indicate a range in the array of primitive indices
+ * The tree is built in three steps:
+ * - Splitting, primitives are partitioned in place (binned SAH for large nodes),
+ *   sub-trees of large nodes are split in parallel.
+ * - Node creation, serially, giving the same node order as a recursive build.
+ * - Leaf creation in parallel, primitives and vertices of each leaf are sorted
+ *   so iterating over them walks mesh arrays front to back.
  */
 
-static void build_sub(PBVH *pbvh, int node_index, BB *cb, BBC *prim_bbc, int offset, int count)
+/* Nodes with more primitives split their sub-trees in a task. */
+#define PBVH_BUILD_THREADED_LIMIT 20000
+/* Nodes with more primitives bin them in parallel. */
+#define PBVH_SAH_THREADED_LIMIT 100000
+#define PBVH_SAH_BINS 16
+
+typedef struct PBVHBuildNode {
+  /* Null for leaves. */
+  struct PBVHBuildNode *children;
+  int offset, count;
+} PBVHBuildNode;
+
+typedef struct PBVHBuildData {
+  PBVH *pbvh;
+  BBC *prim_bbc;
+  /* Null when building single threaded. */
+  TaskPool *pool;
+} PBVHBuildData;
+
+typedef struct PBVHSAHBins {
+  BB bb[3][PBVH_SAH_BINS];
+  int count[3][PBVH_SAH_BINS];
+} PBVHSAHBins;
+
+typedef struct PBVHSAHBinData {
+  const PBVH *pbvh;
+  const BBC *prim_bbc;
+  const BB *cb;
+  float scale[3];
+  int offset;
+} PBVHSAHBinData;
+
+static float BB_surface_area(const BB *bb)
 {
+  float d[3];
+  sub_v3_v3v3(d, bb->bmax, bb->bmin);
+  return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+static void sah_bins_init(PBVHSAHBins *bins)
+{
+  for (int axis = 0; axis < 3; axis++) {
+    for (int b = 0; b < PBVH_SAH_BINS; b++) {
+      BB_reset(&bins->bb[axis][b]);
+      bins->count[axis][b] = 0;
+    }
+  }
+}
+
+static void sah_bins_add_cb(void *__restrict userdata,
+                            const int i,
+                            const TaskParallelTLS *__restrict tls)
+{
+  const PBVHSAHBinData *data = userdata;
+  PBVHSAHBins *bins = tls->userdata_chunk;
+  const BBC *bbc = &data->prim_bbc[data->pbvh->prim_indices[data->offset + i]];
+
+  for (int axis = 0; axis < 3; axis++) {
+    if (data->scale[axis] == 0.0f) {
+      continue;
+    }
+    int b = (int)((bbc->bcentroid[axis] - data->cb->bmin[axis]) * data->scale[axis]);
+    CLAMP(b, 0, PBVH_SAH_BINS - 1);
+    BB_expand_with_bb(&bins->bb[axis][b], (BB *)bbc);
+    bins->count[axis][b]++;
+  }
+}
+
+static void sah_bins_reduce(const void *__restrict UNUSED(userdata),
+                            void *__restrict chunk_join,
+                            void *__restrict chunk)
+{
+  PBVHSAHBins *join = chunk_join;
+  PBVHSAHBins *bins = chunk;
+  for (int axis = 0; axis < 3; axis++) {
+    for (int b = 0; b < PBVH_SAH_BINS; b++) {
+      BB_expand_with_bb(&join->bb[axis][b], &bins->bb[axis][b]);
+      join->count[axis][b] += bins->count[axis][b];
+    }
+  }
+}
+
+/* Partition primitives with the split of the lowest surface area heuristic cost,
+ * returns the index of the first element on the right of the partition. */
+static int partition_indices_sah(PBVH *pbvh, BBC *prim_bbc, const BB *cb, int offset, int count)
+{
+  PBVHSAHBinData data = {pbvh, prim_bbc, cb, {0.0f}, offset};
+  for (int axis = 0; axis < 3; axis++) {
+    const float extent = cb->bmax[axis] - cb->bmin[axis];
+    data.scale[axis] = (extent > FLT_EPSILON) ? (float)PBVH_SAH_BINS / extent : 0.0f;
+  }
+
+  PBVHSAHBins bins;
+  sah_bins_init(&bins);
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (count > PBVH_SAH_THREADED_LIMIT);
+  settings.userdata_chunk = &bins;
+  settings.userdata_chunk_size = sizeof(bins);
+  settings.func_reduce = sah_bins_reduce;
+  BLI_task_parallel_range(0, count, &data, sah_bins_add_cb, &settings);
+
+  float best_cost = FLT_MAX;
+  int best_axis = -1, best_bin = 0;
+
+  for (int axis = 0; axis < 3; axis++) {
+    if (data.scale[axis] == 0.0f) {
+      continue;
+    }
+
+    /* Cost of the right side of each split, the left side is accumulated while sweeping. */
+    float right_cost[PBVH_SAH_BINS];
+    BB bb;
+    int num = 0;
+    BB_reset(&bb);
+    for (int b = PBVH_SAH_BINS - 1; b > 0; b--) {
+      BB_expand_with_bb(&bb, &bins.bb[axis][b]);
+      num += bins.count[axis][b];
+      right_cost[b] = num ? BB_surface_area(&bb) * (float)num : 0.0f;
+    }
+
+    BB_reset(&bb);
+    num = 0;
+    for (int b = 0; b < PBVH_SAH_BINS - 1; b++) {
+      BB_expand_with_bb(&bb, &bins.bb[axis][b]);
+      num += bins.count[axis][b];
+      if (num == 0 || num == count) {
+        continue;
+      }
+      const float cost = BB_surface_area(&bb) * (float)num + right_cost[b + 1];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+
+  if (best_axis == -1) {
+    /* All centroids in one bin, fall back to the middle of the widest axis. */
+    const int axis = BB_widest_axis(cb);
+    return partition_indices(pbvh->prim_indices,
+                             offset,
+                             offset + count - 1,
+                             axis,
+                             (cb->bmax[axis] + cb->bmin[axis]) * 0.5f,
+                             prim_bbc);
+  }
+
+  const float mid = cb->bmin[best_axis] + (float)(best_bin + 1) / data.scale[best_axis];
+  return partition_indices(
+      pbvh->prim_indices, offset, offset + count - 1, best_axis, mid, prim_bbc);
+}
+
+static void build_split(PBVHBuildData *data, PBVHBuildNode *bnode, const BB *cb);
+
+static void build_split_task_cb(TaskPool *__restrict pool, void *taskdata)
+{
+  PBVHBuildData *data = BLI_task_pool_user_data(pool);
+  build_split(data, taskdata, NULL);
+}
+
+/* Recursively partition the primitives of a node, leaving leaves without children.
+ *
+ * cb is the bounding box around all the centroids of the primitives
+ * contained in this node (calculated when null). */
+static void build_split(PBVHBuildData *data, PBVHBuildNode *bnode, const BB *cb)
+{
+  PBVH *pbvh = data->pbvh;
+  const int offset = bnode->offset;
+  const int count = bnode->count;
   int end;
-  BB cb_backing;
 
   /* Decide whether this is a leaf or not */
   const bool below_leaf_limit = count <= pbvh->leaf_limit;
   if (below_leaf_limit) {
     if (!leaf_needs_material_split(pbvh, offset, count)) {
-      build_leaf(pbvh, node_index, prim_bbc, offset, count);
       return;
     }
   }
 
-  /* Add two child nodes */
-  pbvh->nodes[node_index].children_offset = pbvh->totnode;
-  pbvh_grow_nodes(pbvh, pbvh->totnode + 2);
-
-  /* Update parent node bounding box */
-  update_vb(pbvh, &pbvh->nodes[node_index], prim_bbc, offset, count);
-
   if (!below_leaf_limit) {
-    /* Find axis with widest range of primitive centroids */
+    BB cb_backing;
     if (!cb) {
-      cb = &cb_backing;
-      BB_reset(cb);
+      BB_reset(&cb_backing);
       for (int i = offset + count - 1; i >= offset; i--) {
-        BB_expand(cb, prim_bbc[pbvh->prim_indices[i]].bcentroid);
+        BB_expand(&cb_backing, data->prim_bbc[pbvh->prim_indices[i]].bcentroid);
       }
+      cb = &cb_backing;
     }
-    const int axis = BB_widest_axis(cb);
-
-    /* Partition primitives along that axis */
-    end = partition_indices(pbvh->prim_indices,
-                            offset,
-                            offset + count - 1,
-                            axis,
-                            (cb->bmax[axis] + cb->bmin[axis]) * 0.5f,
-                            prim_bbc);
+    end = partition_indices_sah(pbvh, data->prim_bbc, cb, offset, count);
   }
   else {
     /* Partition primitives by material */
     end = partition_indices_material(pbvh, offset, offset + count - 1);
   }
 
+  PBVHBuildNode *children = MEM_callocN(sizeof(PBVHBuildNode[2]), __func__);
+  children[0].offset = offset;
+  children[0].count = end - offset;
+  children[1].offset = end;
+  children[1].count = offset + count - end;
+  bnode->children = children;
+
   /* Build children */
-  build_sub(pbvh, pbvh->nodes[node_index].children_offset, NULL, prim_bbc, offset, end - offset);
-  build_sub(pbvh,
-            pbvh->nodes[node_index].children_offset + 1,
-            NULL,
-            prim_bbc,
-            end,
-            offset + count - end);
+  if (data->pool && count > PBVH_BUILD_THREADED_LIMIT) {
+    BLI_task_pool_push(data->pool, build_split_task_cb, &children[1], false, NULL);
+  }
+  else {
+    build_split(data, &children[1], NULL);
+  }
+  build_split(data, &children[0], NULL);
+}
+
+static int build_leaves_count(const PBVHBuildNode *bnode)
+{
+  if (bnode->children == NULL) {
+    return 1;
+  }
+  return build_leaves_count(&bnode->children[0]) + build_leaves_count(&bnode->children[1]);
+}
+
+/* Create the nodes in the same order as a recursive build would,
+ * appending leaves to `r_leaves` in build order. */
+static void build_nodes(PBVH *pbvh,
+                        PBVHBuildNode *bnode,
+                        const int node_index,
+                        int *r_leaves,
+                        int *r_leaves_num)
+{
+  if (bnode->children == NULL) {
+    PBVHNode *node = &pbvh->nodes[node_index];
+    node->flag |= PBVH_Leaf;
+    node->prim_indices = pbvh->prim_indices + bnode->offset;
+    node->totprim = bnode->count;
+    r_leaves[(*r_leaves_num)++] = node_index;
+    return;
+  }
+
+  /* Add two child nodes */
+  const int children_offset = pbvh->totnode;
+  pbvh->nodes[node_index].children_offset = children_offset;
+  pbvh_grow_nodes(pbvh, pbvh->totnode + 2);
+
+  build_nodes(pbvh, &bnode->children[0], children_offset, r_leaves, r_leaves_num);
+  build_nodes(pbvh, &bnode->children[1], children_offset + 1, r_leaves, r_leaves_num);
+
+  MEM_freeN(bnode->children);
+  bnode->children = NULL;
+}
+
+typedef struct PBVHBuildLeavesData {
+  PBVH *pbvh;
+  BBC *prim_bbc;
+  const int *leaves;
+  /* Build order of the first leaf using each vertex. */
+  int *vert_owner;
+} PBVHBuildLeavesData;
+
+static void build_leaves_vert_owner_cb(void *__restrict userdata,
+                                       const int leaf_rank,
+                                       const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PBVHBuildLeavesData *data = userdata;
+  const PBVH *pbvh = data->pbvh;
+  const PBVHNode *node = &pbvh->nodes[data->leaves[leaf_rank]];
+
+  for (int i = 0; i < node->totprim; i++) {
+    const MLoopTri *lt = &pbvh->looptri[node->prim_indices[i]];
+    for (int j = 0; j < 3; j++) {
+      int32_t *owner = &data->vert_owner[pbvh->mloop[lt->tri[j]].v];
+      int32_t owner_prev = *owner;
+      while (leaf_rank < owner_prev) {
+        const int32_t owner_test = atomic_cas_int32(owner, owner_prev, leaf_rank);
+        if (owner_test == owner_prev) {
+          break;
+        }
+        owner_prev = owner_test;
+      }
+    }
+  }
+}
+
+static void build_leaves_cb(void *__restrict userdata,
+                            const int leaf_rank,
+                            const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  PBVHBuildLeavesData *data = userdata;
+  PBVH *pbvh = data->pbvh;
+  PBVHNode *node = &pbvh->nodes[data->leaves[leaf_rank]];
+
+  /* Access primitives in memory order. */
+  qsort(node->prim_indices, node->totprim, sizeof(int), BLI_sortutil_cmp_int);
+
+  /* Still need vb for searches */
+  update_vb(pbvh, node, data->prim_bbc, node->prim_indices - pbvh->prim_indices, node->totprim);
+
+  if (pbvh->looptri) {
+    build_mesh_leaf_node(pbvh, node, data->vert_owner, leaf_rank);
+  }
+  else {
+    build_grid_leaf_node(pbvh, node);
+  }
 }
 
 static void pbvh_build(PBVH *pbvh, BB *cb, BBC *prim_bbc, int totprim)
@@ -2445,8 +2688,54 @@ static void pbvh_build(PBVH *pbvh, BB *cb, BBC *prim_bbc, int totprim)
     }
   }
 
+  /* Split. */
+  PBVHBuildNode root = {NULL, 0, totprim};
+  PBVHBuildData data = {pbvh, prim_bbc, NULL};
+  if (totprim > PBVH_BUILD_THREADED_LIMIT) {
+    data.pool = BLI_task_pool_create(&data, TASK_PRIORITY_HIGH);
+    build_split(&data, &root, cb);
+    BLI_task_pool_work_and_wait(data.pool);
+    BLI_task_pool_free(data.pool);
+  }
+  else {
+    build_split(&data, &root, cb);
+  }
+
+  /* Create nodes. */
+  int *leaves = MEM_mallocN(sizeof(int) * build_leaves_count(&root), __func__);
+  int leaves_num = 0;
   pbvh->totnode = 1;
-  build_sub(pbvh, 0, cb, prim_bbc, 0, totprim);
+  build_nodes(pbvh, &root, 0, leaves, &leaves_num);
+
+  /* Create leaves. */
+  PBVHBuildLeavesData leaves_data = {pbvh, prim_bbc, leaves, NULL};
+
+  TaskParallelSettings settings;
+  BLI_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1;
+
+  if (pbvh->looptri) {
+    leaves_data.vert_owner = MEM_mallocN(sizeof(int) * pbvh->totvert, __func__);
+    copy_vn_i(leaves_data.vert_owner, pbvh->totvert, INT_MAX);
+    BLI_task_parallel_range(
+        0, leaves_num, &leaves_data, build_leaves_vert_owner_cb, &settings);
+  }
+  BLI_task_parallel_range(0, leaves_num, &leaves_data, build_leaves_cb, &settings);
+
+  /* Bounds of the other nodes, children are always after their parent. */
+  for (int i = pbvh->totnode - 1; i >= 0; i--) {
+    PBVHNode *node = &pbvh->nodes[i];
+    if (node->flag & PBVH_Leaf) {
+      continue;
+    }
+    BB_reset(&node->vb);
+    BB_expand_with_bb(&node->vb, &pbvh->nodes[node->children_offset].vb);
+    BB_expand_with_bb(&node->vb, &pbvh->nodes[node->children_offset + 1].vb);
+    node->orig_vb = node->vb;
+  }
+
+  MEM_SAFE_FREE(leaves_data.vert_owner);
+  MEM_freeN(leaves);
 }
 
 void BKE_pbvh_build_mesh(PBVH *pbvh,
@@ -2508,9 +2797,6 @@ void BKE_pbvh_build_mesh(PBVH *pbvh,
   }
 
   MEM_freeN(prim_bbc);
-
-  /* Clear the bitmap so it can be used as an update tag later on. */
-  BLI_bitmap_set_all(pbvh->vert_bitmap, false, totvert);
 }
 
 void BKE_pbvh_build_grids(PBVH *pbvh,
@@ -3008,33 +3294,6 @@ static void pbvh_update_normals_store_task_cb(void *__restrict userdata,
   }
 }
 
-static void pbvh_faces_update_normals(PBVH *pbvh, PBVHNode **nodes, int totnode)
-{
-  /* subtle assumptions:
-   * - We know that for all edited vertices, the nodes with faces
-   *   adjacent to these vertices have been marked with PBVH_UpdateNormals.
-   *   This is true because if the vertex is inside the brush radius, the
-   *   bounding box of its adjacent faces will be as well.
-   * - However this is only true for the vertices that have actually been
-   *   edited, not for all vertices in the nodes marked for update, so we
-   *   can only update vertices marked in the `vert_bitmap`.
-   */
-
-  PBVHUpdateData data = {
-      .pbvh = pbvh,
-      .nodes = nodes,
-      .vnors = pbvh->vert_normals,
-  };
-
-  TaskParallelSettings settings;
-  BKE_pbvh_parallel_range_settings(&settings, true, totnode);
-
-  /* Zero normals before accumulation. */
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_normals_clear_task_cb, &settings);
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_normals_accum_task_cb, &settings);
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_normals_store_task_cb, &settings);
-}
-
 static void pbvh_update_mask_redraw_task_cb(void *__restrict userdata,
                                             const int n,
                                             const TaskParallelTLS *__restrict UNUSED(tls))
@@ -3071,19 +3330,6 @@ static void pbvh_update_mask_redraw_task_cb(void *__restrict userdata,
   }
 }
 
-static void pbvh_update_mask_redraw(PBVH *pbvh, PBVHNode **nodes, int totnode, int flag)
-{
-  PBVHUpdateData data = {
-      .pbvh = pbvh,
-      .nodes = nodes,
-      .flag = flag,
-  };
-
-  TaskParallelSettings settings;
-  BKE_pbvh_parallel_range_settings(&settings, true, totnode);
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_mask_redraw_task_cb, &settings);
-}
-
 static void pbvh_update_visibility_redraw_task_cb(void *__restrict userdata,
                                                   const int n,
                                                   const TaskParallelTLS *__restrict UNUSED(tls))
@@ -3108,19 +3354,6 @@ static void pbvh_update_visibility_redraw_task_cb(void *__restrict userdata,
   }
 }
 
-static void pbvh_update_visibility_redraw(PBVH *pbvh, PBVHNode **nodes, int totnode, int flag)
-{
-  PBVHUpdateData data = {
-      .pbvh = pbvh,
-      .nodes = nodes,
-      .flag = flag,
-  };
-
-  TaskParallelSettings settings;
-  BKE_pbvh_parallel_range_settings(&settings, true, totnode);
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_visibility_redraw_task_cb, &settings);
-}
-
 static void pbvh_update_BB_redraw_task_cb(void *__restrict userdata,
                                           const int n,
                                           const TaskParallelTLS *__restrict UNUSED(tls))
@@ -3240,10 +3473,13 @@ static void pbvh_update_draw_buffer_cb(void *__restrict userdata,
   }
 }
 
-static void pbvh_update_draw_buffers(PBVH *pbvh, PBVHNode **nodes, int totnode, int update_flag)
+/* Free buffers uses OpenGL, so not in parallel. */
+static void pbvh_draw_buffers_free_for_update(PBVH *pbvh,
+                                              PBVHNode **nodes,
+                                              int totnode,
+                                              int update_flag)
 {
   if ((update_flag & PBVH_RebuildDrawBuffers) || ELEM(pbvh->type, PBVH_GRIDS, PBVH_BMESH)) {
-    /* Free buffers uses OpenGL, so not in parallel. */
     for (int n = 0; n < totnode; n++) {
       PBVHNode *node = nodes[n];
       if (node->flag & PBVH_RebuildDrawBuffers) {
@@ -3261,17 +3497,10 @@ static void pbvh_update_draw_buffers(PBVH *pbvh, PBVHNode **nodes, int totnode,
       }
     }
   }
+}
 
-  /* Parallel creation and update of draw buffers. */
-  PBVHUpdateData data = {
-      .pbvh = pbvh,
-      .nodes = nodes,
-  };
-
-  TaskParallelSettings settings;
-  BKE_pbvh_parallel_range_settings(&settings, true, totnode);
-  BLI_task_parallel_range(0, totnode, &data, pbvh_update_draw_buffer_cb, &settings);
-
+static void pbvh_draw_buffers_flush(PBVHNode **nodes, int totnode)
+{
   for (int i = 0; i < totnode; i++) {
     PBVHNode *node = nodes[i];
 
@@ -3316,29 +3545,270 @@ static int pbvh_flush_bb(PBVH *pbvh, PBVHNode *node, int flag)
   return update;
 }
 
-void BKE_pbvh_update_bounds(PBVH *pbvh, int flag)
+/* -------------------------------------------------------------------- */
+/** Update Pipeline
+ *
+ * Nodes needing any of the requested updates are gathered once, then every stage runs for a
+ * node within the same task, in dependency order. Passes over all nodes are only split where
+ * a stage reads data written for other nodes: vertex normals of mesh PBVHs are accumulated
+ * from the faces of all nodes, so the draw buffers using them wait for all normals.
+ *
+ * With USE_PBVH_UPDATE_TIMINGS, the time spent in each stage is accumulated into
+ * PBVH.update_timings until reset by #BKE_pbvh_update_timings_reset,
+ * so one update cycle (several calls to #BKE_pbvh_update) can be measured as a whole.
+ * Disabled by default, since it reads the timer for every stage of every node. */
+
+// #define USE_PBVH_UPDATE_TIMINGS
+
+/* Every update the pipeline handles, to run whatever is pending in one call. */
+#define PBVH_UPDATE_FLAGS_ALL \
+  (PBVH_UpdateBB | PBVH_UpdateOriginalBB | PBVH_UpdateRedraw | PBVH_UpdateNormals | \
+   PBVH_UpdateMask | PBVH_UpdateVisibility | PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers)
+
+typedef struct PBVHUpdatePassData {
+  PBVHUpdateData *data;
+  /* Stages run for each node in this pass. */
+  int stages;
+  PBVHUpdateTimings timings;
+} PBVHUpdatePassData;
+
+static void pbvh_update_stage_run(PBVHUpdateData *data,
+                                  const int stage,
+                                  const int n,
+                                  const TaskParallelTLS *__restrict tls)
+{
+  switch (stage) {
+    case PBVH_STAGE_BOUNDS:
+      pbvh_update_BB_redraw_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_MASK:
+      pbvh_update_mask_redraw_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_VISIBILITY:
+      pbvh_update_visibility_redraw_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_NORMALS_CLEAR:
+      pbvh_update_normals_clear_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_NORMALS_ACCUM:
+      pbvh_update_normals_accum_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_NORMALS_STORE:
+      pbvh_update_normals_store_task_cb(data, n, tls);
+      break;
+    case PBVH_STAGE_DRAW_BUFFERS:
+      pbvh_update_draw_buffer_cb(data, n, tls);
+      break;
+  }
+}
+
+static void pbvh_update_pass_task_cb(void *__restrict userdata,
+                                     const int n,
+                                     const TaskParallelTLS *__restrict tls)
 {
-  if (!pbvh->nodes) {
+  PBVHUpdatePassData *pass = userdata;
+#ifdef USE_PBVH_UPDATE_TIMINGS
+  PBVHUpdateTimings *timings = tls->userdata_chunk;
+  double time_prev = PIL_check_seconds_timer();
+#endif
+
+  for (int stage = 0; stage < PBVH_STAGES_NUM; stage++) {
+    if (!(pass->stages & (1 << stage))) {
+      continue;
+    }
+    pbvh_update_stage_run(pass->data, stage, n, tls);
+
+#ifdef USE_PBVH_UPDATE_TIMINGS
+    const double time = PIL_check_seconds_timer();
+    timings->stage_time[stage] += time - time_prev;
+    timings->stage_time_max[stage] = max_dd(timings->stage_time_max[stage], time - time_prev);
+    time_prev = time;
+#endif
+  }
+}
+
+#ifdef USE_PBVH_UPDATE_TIMINGS
+static void pbvh_update_timings_reduce(PBVHUpdateTimings *join, const PBVHUpdateTimings *timings)
+{
+  for (int stage = 0; stage < PBVH_STAGES_NUM; stage++) {
+    join->stage_time[stage] += timings->stage_time[stage];
+    join->stage_time_max[stage] = max_dd(join->stage_time_max[stage],
+                                         timings->stage_time_max[stage]);
+  }
+}
+
+static void pbvh_update_pass_reduce(const void *__restrict UNUSED(userdata),
+                                    void *__restrict chunk_join,
+                                    void *__restrict chunk)
+{
+  pbvh_update_timings_reduce(chunk_join, chunk);
+}
+#endif
+
+static void pbvh_update_pass(PBVHUpdateData *data, const int stages, PBVHUpdateTimings *timings)
+{
+  if (stages == 0) {
     return;
   }
 
-  PBVHNode **nodes;
-  int totnode;
+  PBVHUpdatePassData pass = {.data = data, .stages = stages};
 
-  BKE_pbvh_search_gather(pbvh, update_search_cb, POINTER_FROM_INT(flag), &nodes, &totnode);
+  TaskParallelSettings settings;
+  BKE_pbvh_parallel_range_settings(&settings, true, data->totnode);
+#ifdef USE_PBVH_UPDATE_TIMINGS
+  settings.userdata_chunk = &pass.timings;
+  settings.userdata_chunk_size = sizeof(pass.timings);
+  settings.func_reduce = pbvh_update_pass_reduce;
+#endif
+  BLI_task_parallel_range(0, data->totnode, &pass, pbvh_update_pass_task_cb, &settings);
+
+#ifdef USE_PBVH_UPDATE_TIMINGS
+  pbvh_update_timings_reduce(timings, &pass.timings);
+#else
+  UNUSED_VARS(timings);
+#endif
+}
+
+#ifdef USE_PBVH_UPDATE_TIMINGS
+#  define PBVH_UPDATE_TIME_GET() PIL_check_seconds_timer()
+#else
+#  define PBVH_UPDATE_TIME_GET() 0.0
+#endif
+
+/* Time a stage running over all nodes at once, counted as the slowest node too. */
+static void pbvh_update_timings_add_global(PBVHUpdateTimings *timings,
+                                           const int stage,
+                                           const double time_start)
+{
+#ifdef USE_PBVH_UPDATE_TIMINGS
+  const double time = PIL_check_seconds_timer() - time_start;
+  timings->stage_time[stage] += time;
+  timings->stage_time_max[stage] = max_dd(timings->stage_time_max[stage], time);
+#else
+  UNUSED_VARS(timings, stage, time_start);
+#endif
+}
+
+static void pbvh_update_nodes(PBVH *pbvh,
+                              PBVHNode **nodes,
+                              int totnode,
+                              const int flag,
+                              struct SubdivCCG *subdiv_ccg)
+{
+  PBVHUpdateTimings *timings = &pbvh->update_timings;
+
+  if (totnode == 0) {
+    return;
+  }
 
-  if (flag & (PBVH_UpdateBB | PBVH_UpdateOriginalBB | PBVH_UpdateRedraw)) {
-    pbvh_update_BB_redraw(pbvh, nodes, totnode, flag);
+  const double time_start = PBVH_UPDATE_TIME_GET();
+
+  int update_flag = 0;
+  for (int n = 0; n < totnode; n++) {
+    update_flag |= nodes[n]->flag;
   }
+  update_flag &= flag;
 
-  if (flag & (PBVH_UpdateBB | PBVH_UpdateOriginalBB)) {
+  /* Multires only reshapes grids modified since the last flush. */
+  if (pbvh->type == PBVH_GRIDS && pbvh->subdiv_ccg != NULL &&
+      (update_flag & (PBVH_UpdateNormals | PBVH_UpdateMask))) {
+    for (int n = 0; n < totnode; n++) {
+      PBVHNode *node = nodes[n];
+      if (node->flag & update_flag & (PBVH_UpdateNormals | PBVH_UpdateMask)) {
+        KERNEL_subdiv_ccg_tag_grids_dirty(pbvh->subdiv_ccg, node->prim_indices, node->totprim);
+      }
+    }
+  }
+
+  int stages = 0;
+  if (update_flag & (PBVH_UpdateBB | PBVH_UpdateOriginalBB | PBVH_UpdateRedraw)) {
+    stages |= (1 << PBVH_STAGE_BOUNDS);
+  }
+  if (update_flag & PBVH_UpdateMask) {
+    stages |= (1 << PBVH_STAGE_MASK);
+  }
+  if (update_flag & PBVH_UpdateVisibility) {
+    stages |= (1 << PBVH_STAGE_VISIBILITY);
+  }
+  const bool update_normals = (update_flag & PBVH_UpdateNormals) != 0;
+  const bool update_draw = (update_flag &
+                            (PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers)) != 0;
+
+  PBVHUpdateData data = {
+      .pbvh = pbvh,
+      .nodes = nodes,
+      .totnode = totnode,
+      .vnors = pbvh->vert_normals,
+      .flag = flag,
+  };
+
+  /* Normals not computed per node. */
+  if (update_normals && pbvh->type != PBVH_FACES) {
+    const double time = PBVH_UPDATE_TIME_GET();
+    if (pbvh->type == PBVH_BMESH) {
+      pbvh_bmesh_normals_update(nodes, totnode);
+    }
+    else if (pbvh->type == PBVH_GRIDS) {
+      struct CCGFace **faces;
+      int num_faces;
+      BKE_pbvh_get_grid_updates(pbvh, true, (void ***)&faces, &num_faces);
+      if (num_faces > 0) {
+        BKE_subdiv_ccg_update_normals(subdiv_ccg, faces, num_faces);
+        MEM_freeN(faces);
+      }
+    }
+    pbvh_update_timings_add_global(timings, PBVH_STAGE_NORMALS_STORE, time);
+  }
+
+  if (update_draw) {
+    const double time = PBVH_UPDATE_TIME_GET();
+    pbvh_draw_buffers_free_for_update(pbvh, nodes, totnode, update_flag);
+    pbvh_update_timings_add_global(timings, PBVH_STAGE_DRAW_BUFFERS, time);
+  }
+
+  if (update_normals && pbvh->type == PBVH_FACES) {
+    /* subtle assumptions:
+     * - We know that for all edited vertices, the nodes with faces
+     *   adjacent to these vertices have been marked with PBVH_UpdateNormals.
+     *   This is true because if the vertex is inside the brush radius, the
+     *   bounding box of its adjacent faces will be as well.
+     * - However this is only true for the vertices that have actually been
+     *   edited, not for all vertices in the nodes marked for update, so we
+     *   can only update vertices marked in the `vert_bitmap`.
+     *
+     * Normals are zeroed, accumulated and normalized in separate passes,
+     * since vertices are shared with other nodes. */
+    pbvh_update_pass(&data, stages | (1 << PBVH_STAGE_NORMALS_CLEAR), timings);
+    pbvh_update_pass(&data, (1 << PBVH_STAGE_NORMALS_ACCUM), timings);
+    pbvh_update_pass(&data, (1 << PBVH_STAGE_NORMALS_STORE), timings);
+    stages = 0;
+  }
+  if (update_draw) {
+    stages |= (1 << PBVH_STAGE_DRAW_BUFFERS);
+  }
+  pbvh_update_pass(&data, stages, timings);
+
+  if (update_draw) {
+    const double time = PBVH_UPDATE_TIME_GET();
+    pbvh_draw_buffers_flush(nodes, totnode);
+    pbvh_update_timings_add_global(timings, PBVH_STAGE_DRAW_BUFFERS, time);
+  }
+
+  if (update_flag & (PBVH_UpdateBB | PBVH_UpdateOriginalBB)) {
+    const double time = PBVH_UPDATE_TIME_GET();
     pbvh_flush_bb(pbvh, pbvh->nodes, flag);
+    pbvh_update_timings_add_global(timings, PBVH_STAGE_BOUNDS, time);
   }
 
-  MEM_SAFE_FREE(nodes);
+#ifdef USE_PBVH_UPDATE_TIMINGS
+  timings->total_time += PIL_check_seconds_timer() - time_start;
+  timings->totnode += totnode;
+#else
+  UNUSED_VARS(time_start);
+#endif
 }
 
-void BKE_pbvh_update_vertex_data(PBVH *pbvh, int flag)
+void BKE_pbvh_update(PBVH *pbvh, int flag, struct SubdivCCG *subdiv_ccg)
 {
   if (!pbvh->nodes) {
     return;
@@ -3349,23 +3819,48 @@ void BKE_pbvh_update_vertex_data(PBVH *pbvh, int flag)
 
   BKE_pbvh_search_gather(pbvh, update_search_cb, POINTER_FROM_INT(flag), &nodes, &totnode);
 
-  if (flag & (PBVH_UpdateMask)) {
-    pbvh_update_mask_redraw(pbvh, nodes, totnode, flag);
-  }
+  pbvh_update_nodes(pbvh, nodes, totnode, flag, subdiv_ccg);
 
-  if (flag & (PBVH_UpdateColor)) {
-    /* Do nothing */
-  }
+  MEM_SAFE_FREE(nodes);
+}
 
-  if (flag & (PBVH_UpdateVisibility)) {
-    pbvh_update_visibility_redraw(pbvh, nodes, totnode, flag);
+void BKE_pbvh_grids_tag_pending_dirty(PBVH *pbvh, struct SubdivCCG *subdiv_ccg)
+{
+  if (pbvh->type != PBVH_GRIDS || subdiv_ccg == NULL) {
+    return;
   }
 
-  if (nodes) {
-    MEM_freeN(nodes);
+  /* Nodes modified since the last update still carry their update flags,
+   * their grids aren't tagged by #pbvh_update_nodes yet. */
+  for (int n = 0; n < pbvh->totnode; n++) {
+    PBVHNode *node = &pbvh->nodes[n];
+    if ((node->flag & PBVH_Leaf) && (node->flag & (PBVH_UpdateNormals | PBVH_UpdateMask))) {
+      KERNEL_subdiv_ccg_tag_grids_dirty(subdiv_ccg, node->prim_indices, node->totprim);
+    }
   }
 }
 
+const PBVHUpdateTimings *BKE_pbvh_update_timings_get(const PBVH *pbvh)
+{
+  return &pbvh->update_timings;
+}
+
+void BKE_pbvh_update_timings_reset(PBVH *pbvh)
+{
+  memset(&pbvh->update_timings, 0, sizeof(pbvh->update_timings));
+}
+
+void BKE_pbvh_update_bounds(PBVH *pbvh, int flag)
+{
+  BKE_pbvh_update(
+      pbvh, flag & (PBVH_UpdateBB | PBVH_UpdateOriginalBB | PBVH_UpdateRedraw), NULL);
+}
+
+void BKE_pbvh_update_vertex_data(PBVH *pbvh, int flag)
+{
+  BKE_pbvh_update(pbvh, flag & (PBVH_UpdateMask | PBVH_UpdateVisibility), NULL);
+}
+
 static void pbvh_faces_node_visibility_update(PBVH *pbvh, PBVHNode *node)
 {
   MVert *mvert;
@@ -4558,32 +5053,7 @@ bool BKE_pbvh_node_frustum_exclude_AABB(PBVHNode *node, void *data)
 
 void BKE_pbvh_update_normals(PBVH *pbvh, struct SubdivCCG *subdiv_ccg)
 {
-  /* Update normals */
-  PBVHNode **nodes;
-  int totnode;
-
-  BKE_pbvh_search_gather(
-      pbvh, update_search_cb, POINTER_FROM_INT(PBVH_UpdateNormals), &nodes, &totnode);
-
-  if (totnode > 0) {
-    if (pbvh->type == PBVH_BMESH) {
-      pbvh_bmesh_normals_update(nodes, totnode);
-    }
-    else if (pbvh->type == PBVH_FACES) {
-      pbvh_faces_update_normals(pbvh, nodes, totnode);
-    }
-    else if (pbvh->type == PBVH_GRIDS) {
-      struct CCGFace **faces;
-      int num_faces;
-      BKE_pbvh_get_grid_updates(pbvh, true, (void ***)&faces, &num_faces);
-      if (num_faces > 0) {
-        BKE_subdiv_ccg_update_normals(subdiv_ccg, faces, num_faces);
-        MEM_freeN(faces);
-      }
-    }
-  }
-
-  MEM_SAFE_FREE(nodes);
+  BKE_pbvh_update(pbvh, PBVH_UpdateNormals, subdiv_ccg);
 }
 
 void BKE_pbvh_face_sets_color_set(PBVH *pbvh, int seed, int color_default)
@@ -4595,10 +5065,15 @@ void BKE_pbvh_face_sets_color_set(PBVH *pbvh, int seed, int color_default)
 /**
  * PBVH drawing, updating draw buffers as needed and culling any nodes outside
  * the specified frustum.
+ *
+ * Draw buffers are only updated for nodes that are drawn, others keep their update flags
+ * until they enter the view or are unhidden.
  */
 typedef struct PBVHDrawSearchData {
   PBVHFrustumPlanes *frustum;
   int accum_update_flag;
+  /* Skip fully hidden nodes, they aren't drawn. */
+  bool skip_hidden;
 } PBVHDrawSearchData;
 
 static bool pbvh_draw_search_cb(PBVHNode *node, void *data_v)
@@ -4607,17 +5082,40 @@ static bool pbvh_draw_search_cb(PBVHNode *node, void *data_v)
   if (data->frustum && !BKE_pbvh_node_frustum_contain_AABB(node, data->frustum)) {
     return false;
   }
+  if (data->skip_hidden && (node->flag & PBVH_Leaf) && (node->flag & PBVH_FullyHidden)) {
+    return false;
+  }
 
   data->accum_update_flag |= node->flag;
   return true;
 }
 
-void BKE_pbvh_draw_cb(PBVH *pbvh,
-                      bool update_only_visible,
-                      PBVHFrustumPlanes *update_frustum,
-                      PBVHFrustumPlanes *draw_frustum,
-                      void (*draw_fn)(void *user_data, GPU_PBVH_Buffers *buffers),
-                      void *user_data)
+/* Whether a node is far enough from the view to draw with coarse buffers. */
+static bool pbvh_draw_node_use_lod(const PBVHNode *node,
+                                   const float lod_view_co[3],
+                                   const float lod_distance_factor)
+{
+  if (lod_view_co == NULL || lod_distance_factor <= 0.0f) {
+    return false;
+  }
+
+  float nearest[3];
+  for (int i = 0; i < 3; i++) {
+    nearest[i] = clamp_f(lod_view_co[i], node->vb.bmin[i], node->vb.bmax[i]);
+  }
+  const float size_sq = len_squared_v3v3(node->vb.bmin, node->vb.bmax);
+  return len_squared_v3v3(lod_view_co, nearest) >
+         size_sq * lod_distance_factor * lod_distance_factor;
+}
+
+void BKE_pbvh_draw_lod_cb(PBVH *pbvh,
+                          bool update_only_visible,
+                          PBVHFrustumPlanes *update_frustum,
+                          PBVHFrustumPlanes *draw_frustum,
+                          const float lod_view_co[3],
+                          float lod_distance_factor,
+                          void (*draw_fn)(void *user_data, GPU_PBVH_Buffers *buffers, bool fast),
+                          void *user_data)
 {
   PBVHNode **nodes;
   int totnode;
@@ -4625,39 +5123,73 @@ void BKE_pbvh_draw_cb(PBVH *pbvh,
 
   /* Search for nodes that need updates. */
   if (update_only_visible) {
-    /* Get visible nodes with draw updates. */
-    PBVHDrawSearchData data = {.frustum = update_frustum, .accum_update_flag = 0};
+    /* Get visible nodes with draw updates. Only the draw buffers can be updated for a subset of
+     * the nodes, bounds are flushed & normals accumulated over all of them. */
+    PBVHDrawSearchData data = {
+        .frustum = update_frustum, .accum_update_flag = 0, .skip_hidden = true};
     BKE_pbvh_search_gather(pbvh, pbvh_draw_search_cb, &data, &nodes, &totnode);
-    update_flag = data.accum_update_flag;
+    update_flag = data.accum_update_flag & (PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers);
   }
   else {
-    /* Get all nodes with draw updates, also those outside the view. */
-    const int search_flag = PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers;
+    /* Get all nodes with pending updates, also those outside the view,
+     * so they run in the same pass as the draw buffers instead of gathering nodes per stage. */
+    update_flag = PBVH_UPDATE_FLAGS_ALL;
     BKE_pbvh_search_gather(
-        pbvh, update_search_cb, POINTER_FROM_INT(search_flag), &nodes, &totnode);
-    update_flag = PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers;
+        pbvh, update_search_cb, POINTER_FROM_INT(update_flag), &nodes, &totnode);
   }
 
-  /* Update draw buffers. */
-  if (totnode != 0 && (update_flag & (PBVH_RebuildDrawBuffers | PBVH_UpdateDrawBuffers))) {
-    pbvh_update_draw_buffers(pbvh, nodes, totnode, update_flag);
+  if (totnode != 0 && update_flag) {
+    pbvh_update_nodes(pbvh, nodes, totnode, update_flag, pbvh->subdiv_ccg);
   }
   MEM_SAFE_FREE(nodes);
 
   /* Draw visible nodes. */
-  PBVHDrawSearchData draw_data = {.frustum = draw_frustum, .accum_update_flag = 0};
+  PBVHDrawSearchData draw_data = {
+      .frustum = draw_frustum, .accum_update_flag = 0, .skip_hidden = true};
   BKE_pbvh_search_gather(pbvh, pbvh_draw_search_cb, &draw_data, &nodes, &totnode);
 
   for (int i = 0; i < totnode; i++) {
     PBVHNode *node = nodes[i];
-    if (!(node->flag & PBVH_FullyHidden)) {
-      draw_fn(user_data, node->draw_buffers);
+    /* Nodes outside of the update frustum may not have buffers yet. */
+    if (node->draw_buffers) {
+      draw_fn(user_data,
+              node->draw_buffers,
+              pbvh_draw_node_use_lod(node, lod_view_co, lod_distance_factor));
     }
   }
 
   MEM_SAFE_FREE(nodes);
 }
 
+typedef struct PBVHDrawCallbackData {
+  void (*draw_fn)(void *user_data, GPU_PBVH_Buffers *buffers);
+  void *user_data;
+} PBVHDrawCallbackData;
+
+static void pbvh_draw_no_lod_cb(void *user_data, GPU_PBVH_Buffers *buffers, bool UNUSED(fast))
+{
+  PBVHDrawCallbackData *data = user_data;
+  data->draw_fn(data->user_data, buffers);
+}
+
+void BKE_pbvh_draw_cb(PBVH *pbvh,
+                      bool update_only_visible,
+                      PBVHFrustumPlanes *update_frustum,
+                      PBVHFrustumPlanes *draw_frustum,
+                      void (*draw_fn)(void *user_data, GPU_PBVH_Buffers *buffers),
+                      void *user_data)
+{
+  PBVHDrawCallbackData data = {draw_fn, user_data};
+  BKE_pbvh_draw_lod_cb(pbvh,
+                       update_only_visible,
+                       update_frustum,
+                       draw_frustum,
+                       NULL,
+                       0.0f,
+                       pbvh_draw_no_lod_cb,
+                       &data);
+}
+
 void BKE_pbvh_draw_debug_cb(
     PBVH *pbvh,
     void (*draw_fn)(void *user_data, const float bmin[3], const float bmax[3], PBVHNodeFlags flag),
@@ -95,6 +95,31 @@ typedef enum {
 
 typedef struct PBVHBMeshLog PBVHBMeshLog;
 
+/* Stages of the node update pipeline, in the order they run for a node. */
+typedef enum {
+  PBVH_STAGE_BOUNDS = 0,
+  PBVH_STAGE_MASK,
+  PBVH_STAGE_VISIBILITY,
+  PBVH_STAGE_NORMALS_CLEAR,
+  PBVH_STAGE_NORMALS_ACCUM,
+  PBVH_STAGE_NORMALS_STORE,
+  PBVH_STAGE_DRAW_BUFFERS,
+} PBVHUpdateStage;
+#define PBVH_STAGES_NUM 7
+
+/* Timings of node updates since the last #BKE_pbvh_update_timings_reset, in seconds.
+ * Only filled in when built with USE_PBVH_UPDATE_TIMINGS (pbvh.c). */
+typedef struct PBVHUpdateTimings {
+  /* Time spent in each stage, summed over all nodes. */
+  double stage_time[PBVH_STAGES_NUM];
+  /* Time of the slowest node in each stage, stages that can't run
+   * per node count as a single node. */
+  double stage_time_max[PBVH_STAGES_NUM];
+  double total_time;
+  /* Nodes updated, a node updated by several calls counts once per call. */
+  int totnode;
+} PBVHUpdateTimings;
+
 struct PBVH {
   PBVHType type;
   PBVHFlags flags;
@@ -159,6 +184,8 @@ struct PBVH {
 
   struct BMLog *bm_log;
   struct SubdivCCG *subdiv_ccg;
+
+  PBVHUpdateTimings update_timings;
 };
 
 /* pbvh.c */
@@ -17,6 +17,7 @@
 
 #include "DUNE_anim_data.h"
 #include "DUNE_customdata.h"
+#include "dune_customdata_sharing.h"
 #include "DUNE_geometry_set.hh"
 #include "DUNE_global.h"
 #include "DUNE_idtype.h"
@@ -104,6 +105,8 @@ static void dune_pointcloud_write(DuneWriter *writer, ID *id, const void *id_add
   CustomDataLayer *players = nullptr, players_buff[CD_TEMP_CHUNK_SIZE];
   CustomData_write_prepare(
       &pointcloud->pdata, &players, players_buff, ARRAY_SIZE(players_buff));
+  /* Sharing is run-time only, the pointers are meaningless in the file. */
+  CustomData_layers_sharing_info_clear(players, pointcloud->pdata.totlayer);
 
   /* Write LibData */
   LOADER_write_id_struct(writer, PointCloud, id_address, &pointcloud->id);
@@ -132,6 +135,7 @@ static void pointcloud_read_data(DuneDataReader *reader, ID *id)
 
   /* Geometry */
   CustomData_read(reader, &pointcloud->pdata, pointcloud->totpoint);
+  CustomData_layers_sharing_info_clear(pointcloud->pdata.layers, pointcloud->pdata.totlayer);
   DUNE_pointcloud_update_customdata_pointers(pointcloud);
 
   /* Materials */
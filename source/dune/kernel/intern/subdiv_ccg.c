@@ -5,6 +5,7 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "LIB_bitmap.h"
 #include "LIB_ghash.h"
 #include "LIB_math_bits.h"
 #include "LIB_math_vector.h"
@@ -17,6 +18,7 @@
 #include "KERNEL_subdiv.h"
 #include "KERNEL_subdiv_eval.h"
 
+#include "opensubdiv_evaluator_capi.h"
 #include "opensubdiv_topology_refiner_capi.h"
 
 /* -------------------------------------------------------------------- */
@@ -148,30 +150,49 @@ typedef struct CCGEvalGridsData {
   int *face_ptex_offset;
   SubdivCCGMaskEvaluator *mask_evaluator;
   SubdivCCGMaterialFlagsEvaluator *material_flags_evaluator;
+  /* Ptex (u, v) of every grid element, the same for all faces with the same number of grids.
+   * Four patterns for the corners of quads, followed by the one used by all grids of other
+   * faces. */
+  float (*grid_uvs)[2];
 } CCGEvalGridsData;
 
-static void subdiv_ccg_eval_grid_element_limit(CCGEvalGridsData *data,
-                                               const int ptex_face_index,
-                                               const float u,
-                                               const float v,
-                                               unsigned char *element)
+/* Per-thread storage for evaluating all elements of a grid at once. */
+typedef struct CCGEvalGridsTLS {
+  OpenSubdiv_PatchCoord *patch_coords;
+  float (*P)[3];
+  float (*dPdu)[3];
+  float (*dPdv)[3];
+} CCGEvalGridsTLS;
+
+#define CCG_GRID_UVS_SPECIAL 4
+
+static float (*subdiv_ccg_grid_uvs_create(const int grid_size))[2]
 {
-  Subdiv *subdiv = data->subdiv;
-  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  if (subdiv->displacement_evaluator != NULL) {
-    KERNEL_subdiv_eval_final_point(subdiv, ptex_face_index, u, v, (float *)element);
-  }
-  else if (subdiv_ccg->has_normal) {
-    KERNEL_subdiv_eval_limit_point_and_normal(subdiv,
-                                           ptex_face_index,
-                                           u,
-                                           v,
-                                           (float *)element,
-                                           (float *)(element + subdiv_ccg->normal_offset));
+  const int grid_area = grid_size * grid_size;
+  const float grid_size_1_inv = 1.0f / (grid_size - 1);
+  float(*grid_uvs)[2] = MEM_malloc_arrayN(
+      (size_t)grid_area * (CCG_GRID_UVS_SPECIAL + 1), sizeof(float[2]), "ccg grid uvs");
+  for (int corner = 0; corner < 4; corner++) {
+    float(*corner_uvs)[2] = &grid_uvs[corner * grid_area];
+    for (int y = 0; y < grid_size; y++) {
+      const float grid_v = y * grid_size_1_inv;
+      for (int x = 0; x < grid_size; x++) {
+        const float grid_u = x * grid_size_1_inv;
+        float *uv = corner_uvs[y * grid_size + x];
+        KERNEL_subdiv_rotate_grid_to_quad(corner, grid_u, grid_v, &uv[0], &uv[1]);
+      }
+    }
   }
-  else {
-    KERNEL_subdiv_eval_limit_point(subdiv, ptex_face_index, u, v, (float *)element);
+  float(*special_uvs)[2] = &grid_uvs[CCG_GRID_UVS_SPECIAL * grid_area];
+  for (int y = 0; y < grid_size; y++) {
+    const float u = 1.0f - (y * grid_size_1_inv);
+    for (int x = 0; x < grid_size; x++) {
+      const float v = 1.0f - (x * grid_size_1_inv);
+      special_uvs[y * grid_size + x][0] = u;
+      special_uvs[y * grid_size + x][1] = v;
+    }
   }
+  return grid_uvs;
 }
 
 static void subdiv_ccg_eval_grid_element_mask(CCGEvalGridsData *data,
@@ -193,40 +214,78 @@ static void subdiv_ccg_eval_grid_element_mask(CCGEvalGridsData *data,
   }
 }
 
-static void subdiv_ccg_eval_grid_element(CCGEvalGridsData *data,
-                                         const int ptex_face_index,
-                                         const float u,
-                                         const float v,
-                                         unsigned char *element)
+/* Evaluate all elements of a grid with a single limit surface query. */
+static void subdiv_ccg_eval_grid(CCGEvalGridsData *data,
+                                 CCGEvalGridsTLS *tls,
+                                 const int grid_index,
+                                 const int ptex_face_index,
+                                 const float (*uvs)[2])
 {
-  subdiv_ccg_eval_grid_element_limit(data, ptex_face_index, u, v, element);
-  subdiv_ccg_eval_grid_element_mask(data, ptex_face_index, u, v, element);
+  Subdiv *subdiv = data->subdiv;
+  SubdivCCG *subdiv_ccg = data->subdiv_ccg;
+  const int grid_size = subdiv_ccg->grid_size;
+  const int grid_area = grid_size * grid_size;
+  const int element_size = element_size_bytes_get(subdiv_ccg);
+  const bool has_displacement = (subdiv->displacement_evaluator != NULL);
+  const bool need_derivatives = has_displacement || subdiv_ccg->has_normal;
+
+  if (tls->patch_coords == NULL) {
+    tls->patch_coords = MEM_malloc_arrayN(grid_area, sizeof(*tls->patch_coords), __func__);
+    tls->P = MEM_malloc_arrayN(grid_area, sizeof(*tls->P), __func__);
+    tls->dPdu = MEM_malloc_arrayN(grid_area, sizeof(*tls->dPdu), __func__);
+    tls->dPdv = MEM_malloc_arrayN(grid_area, sizeof(*tls->dPdv), __func__);
+  }
+
+  for (int i = 0; i < grid_area; i++) {
+    tls->patch_coords[i].ptex_face = ptex_face_index;
+    tls->patch_coords[i].u = uvs[i][0];
+    tls->patch_coords[i].v = uvs[i][1];
+  }
+  KERNEL_subdiv_eval_limit_patch_coords_and_derivatives(subdiv,
+                                                        tls->patch_coords,
+                                                        grid_area,
+                                                        tls->P,
+                                                        need_derivatives ? tls->dPdu : NULL,
+                                                        need_derivatives ? tls->dPdv : NULL);
+
+  unsigned char *grid = (unsigned char *)subdiv_ccg->grids[grid_index];
+  for (int i = 0; i < grid_area; i++) {
+    unsigned char *element = &grid[(size_t)i * element_size];
+    float *co = (float *)element;
+    copy_v3_v3(co, tls->P[i]);
+    if (has_displacement) {
+      /* Normals are calculated once all final coordinates are known. */
+      float D[3];
+      KERNEL_subdiv_eval_displacement(
+          subdiv, ptex_face_index, uvs[i][0], uvs[i][1], tls->dPdu[i], tls->dPdv[i], D);
+      add_v3_v3(co, D);
+    }
+    else if (subdiv_ccg->has_normal) {
+      float *no = (float *)(element + subdiv_ccg->normal_offset);
+      cross_v3_v3v3(no, tls->dPdu[i], tls->dPdv[i]);
+      normalize_v3(no);
+    }
+    subdiv_ccg_eval_grid_element_mask(data, ptex_face_index, uvs[i][0], uvs[i][1], element);
+  }
 }
 
-static void subdiv_ccg_eval_regular_grid(CCGEvalGridsData *data, const int face_index)
+static void subdiv_ccg_eval_regular_grid(CCGEvalGridsData *data,
+                                         CCGEvalGridsTLS *tls,
+                                         const int face_index)
 {
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
   const int ptex_face_index = data->face_ptex_offset[face_index];
-  const int grid_size = subdiv_ccg->grid_size;
-  const float grid_size_1_inv = 1.0f / (grid_size - 1);
-  const int element_size = element_size_bytes_get(subdiv_ccg);
+  const int grid_area = subdiv_ccg->grid_size * subdiv_ccg->grid_size;
   SubdivCCGFace *faces = subdiv_ccg->faces;
   SubdivCCGFace **grid_faces = subdiv_ccg->grid_faces;
   const SubdivCCGFace *face = &faces[face_index];
   for (int corner = 0; corner < face->num_grids; corner++) {
     const int grid_index = face->start_grid_index + corner;
-    unsigned char *grid = (unsigned char *)subdiv_ccg->grids[grid_index];
-    for (int y = 0; y < grid_size; y++) {
-      const float grid_v = y * grid_size_1_inv;
-      for (int x = 0; x < grid_size; x++) {
-        const float grid_u = x * grid_size_1_inv;
-        float u, v;
-        KERNEL_subdiv_rotate_grid_to_quad(corner, grid_u, grid_v, &u, &v);
-        const size_t grid_element_index = (size_t)y * grid_size + x;
-        const size_t grid_element_offset = grid_element_index * element_size;
-        subdiv_ccg_eval_grid_element(data, ptex_face_index, u, v, &grid[grid_element_offset]);
-      }
-    }
+    subdiv_ccg_eval_grid(data,
+                         tls,
+                         grid_index,
+                         ptex_face_index,
+                         (const float(*)[2])&data->grid_uvs[corner * grid_area]);
     /* Assign grid's face. */
     grid_faces[grid_index] = &faces[face_index];
     /* Assign material flags. */
@@ -235,28 +294,23 @@ static void subdiv_ccg_eval_regular_grid(CCGEvalGridsData *data, const int face_
   }
 }
 
-static void subdiv_ccg_eval_special_grid(CCGEvalGridsData *data, const int face_index)
+static void subdiv_ccg_eval_special_grid(CCGEvalGridsData *data,
+                                         CCGEvalGridsTLS *tls,
+                                         const int face_index)
 {
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
-  const int grid_size = subdiv_ccg->grid_size;
-  const float grid_size_1_inv = 1.0f / (grid_size - 1);
-  const int element_size = element_size_bytes_get(subdiv_ccg);
+  const int grid_area = subdiv_ccg->grid_size * subdiv_ccg->grid_size;
   SubdivCCGFace *faces = subdiv_ccg->faces;
   SubdivCCGFace **grid_faces = subdiv_ccg->grid_faces;
   const SubdivCCGFace *face = &faces[face_index];
   for (int corner = 0; corner < face->num_grids; corner++) {
     const int grid_index = face->start_grid_index + corner;
     const int ptex_face_index = data->face_ptex_offset[face_index] + corner;
-    unsigned char *grid = (unsigned char *)subdiv_ccg->grids[grid_index];
-    for (int y = 0; y < grid_size; y++) {
-      const float u = 1.0f - (y * grid_size_1_inv);
-      for (int x = 0; x < grid_size; x++) {
-        const float v = 1.0f - (x * grid_size_1_inv);
-        const size_t grid_element_index = (size_t)y * grid_size + x;
-        const size_t grid_element_offset = grid_element_index * element_size;
-        subdiv_ccg_eval_grid_element(data, ptex_face_index, u, v, &grid[grid_element_offset]);
-      }
-    }
+    subdiv_ccg_eval_grid(data,
+                         tls,
+                         grid_index,
+                         ptex_face_index,
+                         (const float(*)[2])&data->grid_uvs[CCG_GRID_UVS_SPECIAL * grid_area]);
     /* Assign grid's face. */
     grid_faces[grid_index] = &faces[face_index];
     /* Assign material flags. */
@@ -267,19 +321,29 @@ static void subdiv_ccg_eval_special_grid(CCGEvalGridsData *data, const int face_
 
 static void subdiv_ccg_eval_grids_task(void *__restrict userdata_v,
                                        const int face_index,
-                                       const TaskParallelTLS *__restrict UNUSED(tls))
+                                       const TaskParallelTLS *__restrict tls)
 {
   CCGEvalGridsData *data = userdata_v;
+  CCGEvalGridsTLS *eval_tls = tls->userdata_chunk;
   SubdivCCG *subdiv_ccg = data->subdiv_ccg;
   SubdivCCGFace *face = &subdiv_ccg->faces[face_index];
   if (face->num_grids == 4) {
-    subdiv_ccg_eval_regular_grid(data, face_index);
+    subdiv_ccg_eval_regular_grid(data, eval_tls, face_index);
   }
   else {
-    subdiv_ccg_eval_special_grid(data, face_index);
+    subdiv_ccg_eval_special_grid(data, eval_tls, face_index);
   }
 }
 
+static void subdiv_ccg_eval_grids_free(const void *__restrict UNUSED(userdata), void *chunk)
+{
+  CCGEvalGridsTLS *eval_tls = chunk;
+  MEM_SAFE_FREE(eval_tls->patch_coords);
+  MEM_SAFE_FREE(eval_tls->P);
+  MEM_SAFE_FREE(eval_tls->dPdu);
+  MEM_SAFE_FREE(eval_tls->dPdv);
+}
+
 static bool subdiv_ccg_evaluate_grids(SubdivCCG *subdiv_ccg,
                                       Subdiv *subdiv,
                                       SubdivCCGMaskEvaluator *mask_evaluator,
@@ -294,11 +358,17 @@ static bool subdiv_ccg_evaluate_grids(SubdivCCG *subdiv_ccg,
   data.face_ptex_offset = BKE_subdiv_face_ptex_offset_get(subdiv);
   data.mask_evaluator = mask_evaluator;
   data.material_flags_evaluator = material_flags_evaluator;
+  data.grid_uvs = subdiv_ccg_grid_uvs_create(subdiv_ccg->grid_size);
   /* Threaded grids evaluation. */
+  CCGEvalGridsTLS eval_tls = {NULL};
   TaskParallelSettings parallel_range_settings;
   LIB_parallel_range_settings_defaults(&parallel_range_settings);
+  parallel_range_settings.userdata_chunk = &eval_tls;
+  parallel_range_settings.userdata_chunk_size = sizeof(eval_tls);
+  parallel_range_settings.func_free = subdiv_ccg_eval_grids_free;
   LIB_task_parallel_range(
       0, num_faces, &data, subdiv_ccg_eval_grids_task, &parallel_range_settings);
+  MEM_freeN(data.grid_uvs);
   /* If displacement is used, need to calculate normals after all final
    * coordinates are known. */
   if (subdiv->displacement_evaluator != NULL) {
@@ -627,6 +697,7 @@ void KERNEL_subdiv_ccg_destroy(SubdivCCG *subdiv_ccg)
   }
   MEM_SAFE_FREE(subdiv_ccg->adjacent_vertices);
   MEM_SAFE_FREE(subdiv_ccg->cache_.start_face_grid_index);
+  MEM_SAFE_FREE(subdiv_ccg->dirty.grids);
   MEM_freeN(subdiv_ccg);
 }
 
@@ -2014,6 +2085,23 @@ void KERNEL_subdiv_ccg_grid_hidden_ensure(SubdivCCG *subdiv_ccg, int grid_index)
   subdiv_ccg->grid_hidden[grid_index] = LIB_BITMAP_NEW(key.grid_area, __func__);
 }
 
+void KERNEL_subdiv_ccg_tag_grids_dirty(SubdivCCG *subdiv_ccg,
+                                      const int *grid_indices,
+                                      const int num_grid_indices)
+{
+  if (subdiv_ccg->dirty.grids == NULL) {
+    subdiv_ccg->dirty.grids = LIB_BITMAP_NEW(subdiv_ccg->num_grids, __func__);
+  }
+  for (int i = 0; i < num_grid_indices; i++) {
+    LIB_BITMAP_ENABLE(subdiv_ccg->dirty.grids, grid_indices[i]);
+  }
+}
+
+void KERNEL_subdiv_ccg_dirty_grids_clear(SubdivCCG *subdiv_ccg)
+{
+  MEM_SAFE_FREE(subdiv_ccg->dirty.grids);
+}
+
 static void subdiv_ccg_coord_to_ptex_coord(const SubdivCCG *subdiv_ccg,
                                            const SubdivCCGCoord *coord,
                                            int *r_ptex_face_index,
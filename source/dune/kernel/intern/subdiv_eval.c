@@ -314,3 +314,37 @@ void KERNEL_subdiv_eval_final_point(
     KERNEL_subdiv_eval_limit_point(subdiv, ptex_face_index, u, v, r_P);
   }
 }
+
+/* =========================== Batched point queries ======================== */
+
+void KERNEL_subdiv_eval_limit_patch_coords_and_derivatives(
+    Subdiv *subdiv,
+    const OpenSubdiv_PatchCoord *patch_coords,
+    const int num_patch_coords,
+    float (*r_P)[3],
+    float (*r_dPdu)[3],
+    float (*r_dPdv)[3])
+{
+  subdiv->evaluator->evaluatePatchesLimit(subdiv->evaluator,
+                                          patch_coords,
+                                          num_patch_coords,
+                                          &r_P[0][0],
+                                          r_dPdu ? &r_dPdu[0][0] : NULL,
+                                          r_dPdv ? &r_dPdv[0][0] : NULL);
+
+  /* Step inside of the face where derivatives are degenerate, same as for single points. */
+  if (r_dPdu != NULL && r_dPdv != NULL) {
+    for (int i = 0; i < num_patch_coords; i++) {
+      if ((is_zero_v3(r_dPdu[i]) || is_zero_v3(r_dPdv[i])) || equals_v3v3(r_dPdu[i], r_dPdv[i])) {
+        const OpenSubdiv_PatchCoord *patch_coord = &patch_coords[i];
+        subdiv->evaluator->evaluateLimit(subdiv->evaluator,
+                                         patch_coord->ptex_face,
+                                         patch_coord->u * 0.999f + 0.0005f,
+                                         patch_coord->v * 0.999f + 0.0005f,
+                                         r_P[i],
+                                         r_dPdu[i],
+                                         r_dPdv[i]);
+      }
+    }
+  }
+}
@@ -75,15 +75,29 @@
  *
  * Once a match is found, there is a high chance next chunks match too,
  * so this is checked to avoid performing so many hash-lookups.
- * Otherwise new chunks are created. */
+ * Otherwise new chunks are created.
+ *
+ * Chunk Boundaries
+ *
+ * New data is split where a rolling hash of the elements matches a mask
+ * (see: USE_CONTENT_DEFINED_CHUNKS), instead of at fixed offsets.
+ * Inserting or removing elements then only changes the chunks around the edit,
+ * so identical data added by different states ends up in identical chunks.
+ *
+ * Cold Chunks
+ *
+ * Chunks no longer used by recent states can be compressed with zstd,
+ * see: lib_array_store_compress_cold. They're decompressed when used as a ref again. */
 
 #include <stdlib.h>
 #include <string.h>
+#include <zstd.h>
 
 #include "mem_guardedalloc.h"
 
 #include "lib_list.h"
 #include "lib_mempool.h"
+#include "lib_task.h"
 
 #include "lib_strict_flags.h"
 
@@ -162,6 +176,22 @@
 /* How much larger the table is then the total number of chunks. */
 #define BCHUNK_HASH_TABLE_MUL 3
 
+/* Hash arrays of this many elements or more are calculated in parallel. */
+#define HASH_ARRAY_PARALLEL_MIN (1 << 16)
+/* Num of elements hashed by each task. */
+#define HASH_ARRAY_PARALLEL_BLOCK (1 << 14)
+
+/* Split new data where a rolling hash over the element hashes matches a mask,
+ * so chunk boundaries depend on content, not on the offset in the array.
+ * Chunks stay within the min/max limits, the mask is sized so the average
+ * chunk is close to #ArrayInfo::chunk_byte_size. */
+#if defined(USE_HASH_TABLE_ACCUMULATE) && defined(USE_MERGE_CHUNKS)
+#  define USE_CONTENT_DEFINED_CHUNKS
+#endif
+
+/* Compression level for cold chunks, favor speed since this runs on undo push. */
+#define CHUNK_COLD_ZSTD_LEVEL 1
+
 /* Merge too small/large chunks:
  * Using this means chunks below a threshold will be merged together.
  * Even though short term this uses more mem,
@@ -208,6 +238,10 @@ typedef struct ArrayInfo {
   size_t accum_steps;
   size_t accum_read_ahead_len;
 #endif
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+  /* Cut a chunk where the rolling hash has none of these bits set. */
+  hash_key cdc_mask;
+#endif
 } ArrayInfo;
 
 typedef struct ArrayMem {
@@ -257,10 +291,15 @@ typedef struct ChunkList {
 
 /* A chunk of mem in an array (unit of de-dup). */
 typedef struct Chunk {
+  /* When `data_compressed_len` is set, this is zstd compressed. */
   const uchar *data;
   size_t data_len;
+  /* Non-zero for cold chunks, see: lib_array_store_compress_cold. */
+  size_t data_compressed_len;
   /* num of ChunkList using this. */
   int users;
+  /* Tmp tag, used when finding cold chunks. */
+  bool is_hot;
 
 #ifdef USE_HASH_TABLE_KEY_CACHE
   hash_key key;
@@ -285,6 +324,12 @@ typedef struct TableRef {
 } TableRef;
 
 static size_t bchunk_list_size(const ChunkList *chunk_list);
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+static void hash_array_from_data_parallel(const ArrayInfo *info,
+                                          const uchar *data_slice,
+                                          const size_t data_slice_len,
+                                          hash_key *hash_array);
+#endif
 
 /* Internal Chunk API */
 static Chunk *chunk_new(ArrayMem *bs_mem, const uchar *data, const size_t data_len)
@@ -292,7 +337,9 @@ static Chunk *chunk_new(ArrayMem *bs_mem, const uchar *data, const size_t data_l
   Chunk *chunk = lib_mempool_alloc(bs_mem->chunk);
   chunk->data = data;
   chunk->data_len = data_len;
+  chunk->data_compressed_len = 0;
   chunk->users = 0;
+  chunk->is_hot = false;
 #ifdef USE_HASH_TABLE_KEY_CACHE
   chunk->key = HASH_TABLE_KEY_UNSET;
 #endif
@@ -306,6 +353,35 @@ static Chunk *chunk_new_copydata(ArrayMem *s_mem, const uchar *data, const size_
   return chunk_new(bs_mem, data_copy, data_len);
 }
 
+/* Decompress a cold chunk in-place, the data is unchanged from the users perspective. */
+static void chunk_data_thaw(Chunk *chunk)
+{
+  if (chunk->data_compressed_len == 0) {
+    return;
+  }
+  uchar *data = mem_malloc(chunk->data_len, __func__);
+  const size_t data_len = ZSTD_decompress(
+      data, chunk->data_len, chunk->data, chunk->data_compressed_len);
+  lib_assert(!ZSTD_isError(data_len) && data_len == chunk->data_len);
+  UNUSED_VARS_NDEBUG(data_len);
+  mem_free((void *)chunk->data);
+  chunk->data = data;
+  chunk->data_compressed_len = 0;
+}
+
+static void chunk_data_copy(const Chunk *chunk, uchar *r_data)
+{
+  if (chunk->data_compressed_len) {
+    const size_t data_len = ZSTD_decompress(
+        r_data, chunk->data_len, chunk->data, chunk->data_compressed_len);
+    lib_assert(!ZSTD_isError(data_len) && data_len == chunk->data_len);
+    UNUSED_VARS_NDEBUG(data_len);
+  }
+  else {
+    memcpy(r_data, chunk->data, chunk->data_len);
+  }
+}
+
 static void chunk_decref(ArrayMem *bs_mem, Chunk *chunk)
 {
   lib_assert(chunk->users > 0);
@@ -587,6 +663,78 @@ static void chunk_list_append_data(const ArrayInfo *info,
 #endif
 }
 
+static void chunk_list_append(const ArrayInfo *info,
+                               ArrayMem *bs_mem,
+                               ChunkList *chunk_list,
+                               Chunk *chunk)
+{
+  chunk_list_append_only(bs_mem, chunk_list, chunk);
+
+#ifdef USE_MERGE_CHUNKS
+  chunk_list_ensure_min_size_last(info, bs_mem, chunk_list);
+#else
+  UNUSED_VARS(info);
+#endif
+}
+
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+/* Return the num of elements in the next chunk,
+ * param hash_array: Element hashes starting at the chunk. */
+static size_t chunk_cdc_len(const ArrayInfo *info,
+                            const hash_key *hash_array,
+                            const size_t hash_array_len)
+{
+  const size_t len_min = info->chunk_byte_size_min / info->chunk_stride;
+  const size_t len_max = MIN2(info->chunk_byte_size_max / info->chunk_stride, hash_array_len);
+  hash_key h = 0;
+  for (size_t i = 0; i < len_max; i++) {
+    /* Multiply to spread the element hash over all bits (Fibonacci hashing). */
+    h = (h << 1) + (hash_array[i] * (hash_key)2654435761u);
+    if ((i + 1 >= len_min) && ((h & info->cdc_mask) == 0)) {
+      return i + 1;
+    }
+  }
+  return len_max;
+}
+
+/* Write data into chunks split at content defined boundaries.
+ * All chunks are within the size limits, the first is merged w the last chunk in the list
+ * when either is too small. */
+static void chunk_list_append_data_cdc(const ArrayInfo *info,
+                                        ArrayMem *bs_mem,
+                                        ChunkList *chunk_list,
+                                        const uchar *data,
+                                        const size_t data_len)
+{
+  const size_t stride = info->chunk_stride;
+  const size_t hash_array_len = data_len / stride;
+  hash_key *hash_array = mem_malloc(sizeof(*hash_array) * hash_array_len, __func__);
+  hash_array_from_data_parallel(info, data, data_len, hash_array);
+
+  size_t i_prev = 0;
+  while (i_prev != data_len) {
+    const size_t data_left = data_len - i_prev;
+    size_t len = chunk_cdc_len(info, &hash_array[i_prev / stride], data_left / stride) * stride;
+    if ((data_left - len != 0) && (data_left - len < info->chunk_byte_size_min)) {
+      /* Don't leave a tail that's too small, split so both sides are in range. */
+      len = (data_left <= info->chunk_byte_size_max) ? data_left :
+                                                        data_left - info->chunk_byte_size_min;
+    }
+
+    Chunk *chunk = chunk_new_copydata(bs_mem, &data[i_prev], len);
+    if (i_prev == 0) {
+      chunk_list_append(info, bs_mem, chunk_list, chunk);
+    }
+    else {
+      chunk_list_append_only(bs_mem, chunk_list, chunk);
+    }
+    i_prev += len;
+  }
+
+  mem_free(hash_array);
+}
+#endif /* USE_CONTENT_DEFINED_CHUNKS */
+
 /* Similar to chunk_list_append_data, but handle multiple chunks.
  * Use for adding arrays of arbitrary sized mem at once.
  * This fn takes care not to perform redundant chunk-merging checks,
@@ -597,6 +745,9 @@ static void chunk_list_append_data_n(const ArrayInfo *info,
                                       const uchar *data,
                                       size_t data_len)
 {
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+  chunk_list_append_data_cdc(info, bs_mem, chunk_list, data, data_len);
+#else
   size_t data_trim_len, data_last_chunk_len;
   chunk_list_calc_trim_len(info, data_len, &data_trim_len, &data_last_chunk_len);
 
@@ -629,6 +780,7 @@ static void chunk_list_append_data_n(const ArrayInfo *info,
       // i_prev = data_len;  /* UNUSED */
     }
   }
+#endif /* USE_CONTENT_DEFINED_CHUNKS */
 
 #ifdef USE_MERGE_CHUNKS
   if (data_len > info->chunk_byte_size) {
@@ -638,20 +790,6 @@ static void chunk_list_append_data_n(const ArrayInfo *info,
 #endif
 }
 
-static void chunk_list_append(const ArrayInfo *info,
-                               ArrayMem *bs_mem,
-                               ChunkList *chunk_list,
-                               Chunk *chunk)
-{
-  chunk_list_append_only(bs_mem, chunk_list, chunk);
-
-#ifdef USE_MERGE_CHUNKS
-  chunk_list_ensure_min_size_last(info, bs_mem, chunk_list);
-#else
-  UNUSED_VARS(info);
-#endif
-}
-
 static void bchunk_list_fill_from_array(const ArrayInfo *info,
                                         ArrayMem *bs_mem,
                                         ChunkList *chunk_list,
@@ -660,6 +798,9 @@ static void bchunk_list_fill_from_array(const ArrayInfo *info,
 {
   lib_assert(lib_list_is_empty(&chunk_list->chunk_refs));
 
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+  chunk_list_append_data_cdc(info, bs_mem, chunk_list, data, data_len);
+#else
   size_t data_trim_len, data_last_chunk_len;
   chunk_list_calc_trim_len(info, data_len, &data_trim_len, &data_last_chunk_len);
 
@@ -676,6 +817,7 @@ static void bchunk_list_fill_from_array(const ArrayInfo *info,
     chunk_list_append_only(bs_mem, chunk_list, chunk);
     // i_prev = data_len;
   }
+#endif /* USE_CONTENT_DEFINED_CHUNKS */
 
 #ifdef USE_MERGE_CHUNKS
   if (data_len > info->chunk_byte_size) {
@@ -740,6 +882,54 @@ static void hash_array_from_data(const ArrayInfo *info,
   }
 }
 
+typedef struct HashArrayTaskData {
+  const ArrayInfo *info;
+  const uchar *data;
+  size_t hash_array_len;
+  hash_key *hash_array;
+} HashArrayTaskData;
+
+static void hash_array_from_data_task_cb(void *__restrict userdata,
+                                         const int block,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const HashArrayTaskData *task_data = userdata;
+  const size_t stride = task_data->info->chunk_stride;
+  const size_t i_start = (size_t)block * HASH_ARRAY_PARALLEL_BLOCK;
+  const size_t i_end = MIN2(i_start + HASH_ARRAY_PARALLEL_BLOCK, task_data->hash_array_len);
+  hash_array_from_data(task_data->info,
+                       &task_data->data[i_start * stride],
+                       (i_end - i_start) * stride,
+                       &task_data->hash_array[i_start]);
+}
+
+/* Same as hash_array_from_data, splits large arrays into blocks hashed in parallel. */
+static void hash_array_from_data_parallel(const ArrayInfo *info,
+                                          const uchar *data_slice,
+                                          const size_t data_slice_len,
+                                          hash_key *hash_array)
+{
+  const size_t hash_array_len = data_slice_len / info->chunk_stride;
+  if (hash_array_len < HASH_ARRAY_PARALLEL_MIN) {
+    hash_array_from_data(info, data_slice, data_slice_len, hash_array);
+    return;
+  }
+
+  HashArrayTaskData task_data = {
+      .info = info,
+      .data = data_slice,
+      .hash_array_len = hash_array_len,
+      .hash_array = hash_array,
+  };
+  const int blocks_num = (int)((hash_array_len + HASH_ARRAY_PARALLEL_BLOCK - 1) /
+                               HASH_ARRAY_PARALLEL_BLOCK);
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1;
+  lib_task_parallel_range(0, blocks_num, &task_data, hash_array_from_data_task_cb, &settings);
+}
+
 /* Similar to hash_array_from_data,
  * but able to step into the next chunk if we run-out of data. */
 static void hash_array_from_cref(const ArrayInfo *info,
@@ -1137,7 +1327,7 @@ static ChunkList *chunk_list_from_data_merge(const ArrayInfo *info,
     const size_t table_hash_array_len = (data_len - i_prev) / info->chunk_stride;
     hash_key *table_hash_array = mem_malloc(sizeof(*table_hash_array) * table_hash_array_len,
                                              __func__);
-    hash_array_from_data(info, &data[i_prev], data_len - i_prev, table_hash_array);
+    hash_array_from_data_parallel(info, &data[i_prev], data_len - i_prev, table_hash_array);
 
     hash_accum(table_hash_array, table_hash_array_len, info->accum_steps);
 #else
@@ -1394,6 +1584,20 @@ ArrayStore *lib_array_store_create(uint stride, uint chunk_count)
   bs->info.accum_read_ahead_bytes = MIN2((size_t)CHUNK_HASH_LEN, chunk_count) * stride;
 #endif
 
+#ifdef USE_CONTENT_DEFINED_CHUNKS
+  {
+    /* Boundaries are only checked after the min size,
+     * so the average chunk is the min size plus the mask range. */
+    const size_t chunk_count_min = bs->info.chunk_byte_size_min / stride;
+    const size_t mask_range = (chunk_count > chunk_count_min) ? chunk_count - chunk_count_min : 1;
+    hash_key mask_len = 1;
+    while ((size_t)mask_len * 2 <= mask_range) {
+      mask_len *= 2;
+    }
+    bs->info.cdc_mask = mask_len - 1;
+  }
+#endif
+
   bs->mem.chunk_list = lib_mempool_create(sizeof(ChunkList), 0, 512, LIB_MEMPOOL_NOP);
   bs->mem.chunk_ref = lib_mempool_create(sizeof(ChunkRef), 0, 512, LIB_MEMPOOL_NOP);
   /* Allow iter to simplify freeing, otherwise its not needed
@@ -1465,11 +1669,88 @@ size_t lib_array_store_calc_size_compacted_get(const ArrayStore *bs)
   lib_mempool_iternew(bs->memory.chunk, &iter);
   while ((chunk = lib_mempool_iterstep(&iter))) {
     lib_assert(chunk->users > 0);
-    size_total += (size_t)chunk->data_len;
+    size_total += chunk->data_compressed_len ? chunk->data_compressed_len :
+                                               (size_t)chunk->data_len;
   }
   return size_total;
 }
 
+/* ArrayStore Cold Chunks */
+
+typedef struct ChunkCompressTaskData {
+  Chunk **chunks;
+  size_t *saved;
+} ChunkCompressTaskData;
+
+static void chunk_compress_task_cb(void *__restrict userdata,
+                                   const int i,
+                                   const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const ChunkCompressTaskData *task_data = userdata;
+  Chunk *chunk = task_data->chunks[i];
+  task_data->saved[i] = 0;
+
+  const size_t bound = ZSTD_compressBound(chunk->data_len);
+  uchar *data = mem_malloc(bound, __func__);
+  const size_t data_len = ZSTD_compress(
+      data, bound, chunk->data, chunk->data_len, CHUNK_COLD_ZSTD_LEVEL);
+
+  /* Only keep when it saves at least an 8th, decompressing isn't free. */
+  if (ZSTD_isError(data_len) || data_len > chunk->data_len - (chunk->data_len / 8)) {
+    mem_free(data);
+    return;
+  }
+  mem_free((void *)chunk->data);
+  chunk->data = mem_realloc(data, data_len);
+  chunk->data_compressed_len = data_len;
+  task_data->saved[i] = chunk->data_len - data_len;
+}
+
+size_t lib_array_store_compress_cold(ArrayStore *bs, const int states_hot_num)
+{
+  /* Tag chunks used by the most recently added states. */
+  int state_index = 0;
+  LIST_FOREACH_BACKWARD (ArrayState *, state, &bs->states) {
+    if (state_index++ == states_hot_num) {
+      break;
+    }
+    LIST_FOREACH (ChunkRef *, cref, &state->chunk_list->chunk_refs) {
+      cref->link->is_hot = true;
+    }
+  }
+
+  Chunk **chunks = mem_malloc(sizeof(*chunks) * (size_t)lib_mempool_len(bs->mem.chunk), __func__);
+  int chunks_len = 0;
+  {
+    lib_mempool_iter iter;
+    Chunk *chunk;
+    lib_mempool_iternew(bs->mem.chunk, &iter);
+    while ((chunk = lib_mempool_iterstep(&iter))) {
+      if (!chunk->is_hot && chunk->data_compressed_len == 0) {
+        chunks[chunks_len++] = chunk;
+      }
+      chunk->is_hot = false;
+    }
+  }
+
+  size_t *saved = mem_malloc(sizeof(*saved) * (size_t)MAX2(chunks_len, 1), __func__);
+  ChunkCompressTaskData task_data = {chunks, saved};
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 8;
+  lib_task_parallel_range(0, chunks_len, &task_data, chunk_compress_task_cb, &settings);
+
+  size_t saved_total = 0;
+  for (int i = 0; i < chunks_len; i++) {
+    saved_total += saved[i];
+  }
+
+  mem_free(saved);
+  mem_free(chunks);
+  return saved_total;
+}
+
 /* ArrayState Access */
 ArrayState *lib_array_store_state_add(ArrayStore *bs,
                                        const void *data,
@@ -1487,6 +1768,10 @@ ArrayState *lib_array_store_state_add(ArrayStore *bs,
 
   ChunkList *chunk_list;
   if (state_ref) {
+    /* Ref chunks are compared & merged, these must not be compressed. */
+    LIST_FOREACH (ChunkRef *, cref, &state_ref->chunk_list->chunk_refs) {
+      chunk_data_thaw(cref->link);
+    }
     chunk_list = chunk_list_from_data_merge(&bs->info,
                                              &bs->mem,
                                              (const uchar *)data,
@@ -1549,7 +1834,7 @@ void lib_array_store_state_data_get(ArrayState *state, void *data)
   uchar *data_step = (uchar *)data;
   LIST_FOREACH (ChunkRef *, cref, &state->chunk_list->chunk_refs) {
     lib_assert(cref->link->users > 0);
-    memcpy(data_step, cref->link->data, cref->link->data_len);
+    chunk_data_copy(cref->link, data_step);
     data_step += cref->link->data_len;
   }
 }
@@ -1605,7 +1890,9 @@ bool lib_array_store_is_valid(ArrayStore *bs)
     Chunk *chunk;
     lib_mempool_iternew(bs->mem.chunk, &iter);
     while ((chunk = lib_mempool_iterstep(&iter))) {
-      if (!(mem_alloc_len(chunk->data) >= chunk->data_len)) {
+      const size_t data_alloc_len = chunk->data_compressed_len ? chunk->data_compressed_len :
+                                                                 chunk->data_len;
+      if (!(mem_alloc_len(chunk->data) >= data_alloc_len)) {
         return false;
       }
     }
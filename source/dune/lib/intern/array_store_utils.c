@@ -70,3 +70,16 @@ void lib_array_store_at_size_calc_mem_usage(struct ArrayStoreAtSize *bs_stride,
   *r_size_expanded = size_expanded;
   *r_size_compacted = size_compacted;
 }
+
+size_t lib_array_store_at_size_compress_cold(struct ArrayStoreAtSize *bs_stride,
+                                             const int states_hot_num)
+{
+  size_t saved = 0;
+  for (int i = 0; i < bs_stride->stride_table_len; i++) {
+    ArrayStore *bs = bs_stride->stride_table[i];
+    if (bs) {
+      saved += lib_array_store_compress_cold(bs, states_hot_num);
+    }
+  }
+  return saved;
+}
@@ -118,3 +118,60 @@ FileReader *lib_filereader_new_mmap(int filedes)
 
   return (FileReader *)mem;
 }
+
+/* Lazily paged reading.
+ * Instead of copying, large blocks can be accessed in place. Their pages are only
+ * read from disk when first touched, so data that is never used doesn't cost any IO
+ * or resident mem. */
+
+/* Blocks taken in place from this size on are marked for random access. */
+#define MMAP_LAZY_BLOCK_RANDOM_MIN (1 << 20)
+
+bool lib_filereader_is_mmap(const FileReader *reader)
+{
+  return reader->close == mem_close_mmap;
+}
+
+const void *lib_filereader_mmap_read_ptr(FileReader *reader, size_t size)
+{
+  if (!lib_filereader_is_mmap(reader)) {
+    return NULL;
+  }
+  MemReader *mem = (MemReader *)reader;
+
+  const void *data = lib_mmap_get_ptr_range(mem->mmap, (size_t)mem->reader.offset, size);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  /* The rest of the file keeps the default advice, so reading headers sequentially still
+   * benefits from read-ahead. Large blocks taken in place are accessed randomly (or not at
+   * all), don't let touching them pull in the pages around the accessed ones. */
+  if (size >= MMAP_LAZY_BLOCK_RANDOM_MIN) {
+    lib_mmap_advise(mem->mmap, (size_t)mem->reader.offset, size, LIB_MMAP_ADVICE_RANDOM);
+  }
+  mem->reader.offset += size;
+
+  /* Pointers stay valid until the reader is closed.
+   * An IO err while accessing them fills the pages w zeros,
+   * check lib_filereader_mmap_io_error once done w the data. */
+  return data;
+}
+
+void lib_filereader_mmap_prefetch(FileReader *reader, off64_t offset, size_t size)
+{
+  if (!lib_filereader_is_mmap(reader) || offset < 0) {
+    return;
+  }
+  MemReader *mem = (MemReader *)reader;
+  lib_mmap_advise(mem->mmap, (size_t)offset, size, LIB_MMAP_ADVICE_WILLNEED);
+}
+
+bool lib_filereader_mmap_io_error(const FileReader *reader)
+{
+  if (!lib_filereader_is_mmap(reader)) {
+    return false;
+  }
+  const MemReader *mem = (const MemReader *)reader;
+  return lib_mmap_any_io_error(mem->mmap);
+}
@@ -5,9 +5,30 @@
 #include "lib_endian_switch.h"
 #include "lib_filereader.h"
 #include "lib_math_base.h"
+#include "lib_task.h"
 
 #include "mem_guardedalloc.h"
 
+/* Max num of frames decompressed together, see ZstdFrameBatch. */
+#define ZSTD_PREFETCH_FRAMES_MAX 16
+
+typedef struct ZstdFrame {
+  char *compressed;
+  size_t compressed_size;
+  /* NULL when decompressing failed. */
+  char *content;
+  size_t uncompressed_size;
+} ZstdFrame;
+
+/* Consecutive frames, decompressed in parallel by a task pool.
+ * While one batch is read from, the next one is decompressed in the background. */
+typedef struct ZstdFrameBatch {
+  TaskPool *pool;
+  int frame_first;
+  int frames_len;
+  ZstdFrame frames[ZSTD_PREFETCH_FRAMES_MAX];
+} ZstdFrameBatch;
+
 typedef struct {
   FileReader reader;
 
@@ -22,8 +43,9 @@ typedef struct {
     size_t *compressed_ofs;
     size_t *uncompressed_ofs;
 
-    char *cached_content;
-    int cached_frame;
+    /* Batch being read from and the one after it. */
+    ZstdFrameBatch batches[2];
+    int batch_frames_len;
   } seek;
 } ZstdReader;
 
@@ -119,7 +141,8 @@ static bool zstd_read_seek_table(ZstdReader *zstd)
     return false;
   }
 
-  zstd->seek.cached_frame = -1;
+  zstd->seek.batch_frames_len = clamp_i(
+      lib_task_scheduler_num_threads(), 1, ZSTD_PREFETCH_FRAMES_MAX);
 
   return true;
 }
@@ -147,42 +170,107 @@ static int zstd_frame_from_pos(ZstdReader *zstd, size_t pos)
   return low;
 }
 
-/* Ensure that the currently loaded frame is the correct one. */
-static const char *zstd_ensure_cache(ZstdReader *zstd, int frame)
+static void zstd_frame_decompress_task(TaskPool *__restrict UNUSED(pool), void *taskdata)
 {
-  if (zstd->seek.cached_frame == frame) {
-    /* Cached frame matches, so just return it. */
-    return zstd->seek.cached_content;
+  ZstdFrame *frame = taskdata;
+  size_t res = ZSTD_decompress(
+      frame->content, frame->uncompressed_size, frame->compressed, frame->compressed_size);
+  if (ZSTD_isError(res) || res < frame->uncompressed_size) {
+    MEM_SAFE_FREE(frame->content);
   }
+  MEM_SAFE_FREE(frame->compressed);
+}
+
+static void zstd_batch_wait(ZstdFrameBatch *batch)
+{
+  if (batch->pool) {
+    lib_task_pool_work_and_wait(batch->pool);
+    lib_task_pool_free(batch->pool);
+    batch->pool = NULL;
+  }
+}
 
-  /* Cached frame doesn't match, so discard it and cache the wanted one instead. */
-  MEM_SAFE_FREE(zstd->seek.cached_content);
+static void zstd_batch_clear(ZstdFrameBatch *batch)
+{
+  zstd_batch_wait(batch);
+  for (int i = 0; i < batch->frames_len; i++) {
+    MEM_SAFE_FREE(batch->frames[i].content);
+  }
+  batch->frames_len = 0;
+}
 
-  size_t compressed_size = zstd->seek.compressed_ofs[frame + 1] - zstd->seek.compressed_ofs[frame];
-  size_t uncompressed_size = zstd->seek.uncompressed_ofs[frame + 1] -
-                             zstd->seek.uncompressed_ofs[frame];
+static bool zstd_batch_contains(const ZstdFrameBatch *batch, int frame)
+{
+  return (frame >= batch->frame_first) && (frame < batch->frame_first + batch->frames_len);
+}
 
-  char *uncompressed_data = mem_malloc(uncompressed_size, __func__);
-  char *compressed_data = mem_malloc(compressed_size, __func__);
-  if (zstd->base->seek(zstd->base, zstd->seek.compressed_ofs[frame], SEEK_SET) < 0 ||
-      zstd->base->read(zstd->base, compressed_data, compressed_size) < compressed_size)
-  {
-    mem_free(compressed_data);
-    mem_free(uncompressed_data);
-    return NULL;
+/* Read the compressed frames and start decompressing them in the background.
+ * The compressed data is read on the calling thread, since the base reader isn't thread-safe. */
+static void zstd_batch_start(ZstdReader *zstd, ZstdFrameBatch *batch, int frame_first)
+{
+  lib_assert(batch->pool == NULL && batch->frames_len == 0);
+
+  batch->frame_first = frame_first;
+  batch->frames_len = min_ii(zstd->seek.batch_frames_len, zstd->seek.frames_num - frame_first);
+  batch->pool = lib_task_pool_create(NULL, TASK_PRIORITY_HIGH);
+
+  for (int i = 0; i < batch->frames_len; i++) {
+    const int frame_index = frame_first + i;
+    ZstdFrame *frame = &batch->frames[i];
+    frame->compressed_size = zstd->seek.compressed_ofs[frame_index + 1] -
+                             zstd->seek.compressed_ofs[frame_index];
+    frame->uncompressed_size = zstd->seek.uncompressed_ofs[frame_index + 1] -
+                               zstd->seek.uncompressed_ofs[frame_index];
+    frame->compressed = mem_malloc(frame->compressed_size, __func__);
+    frame->content = mem_malloc(frame->uncompressed_size, __func__);
+
+    if (zstd->base->seek(zstd->base, zstd->seek.compressed_ofs[frame_index], SEEK_SET) < 0 ||
+        zstd->base->read(zstd->base, frame->compressed, frame->compressed_size) <
+            frame->compressed_size)
+    {
+      MEM_SAFE_FREE(frame->compressed);
+      MEM_SAFE_FREE(frame->content);
+      continue;
+    }
+    lib_task_pool_push(batch->pool, zstd_frame_decompress_task, frame, false, NULL);
   }
+}
 
-  size_t res = ZSTD_decompressDCxt(
-      zstd->cxt, uncompressed_data, uncompressed_size, compressed_data, compressed_size);
-  mem_free(compressed_data);
-  if (ZSTD_isError(res) || res < uncompressed_size) {
-    mem_free(uncompressed_data);
-    return NULL;
+/* Ensure that the wanted frame is decompressed.
+ * Frames are decompressed in batches, w the next batch prefetched while reading from this one,
+ * so sequential reading rarely has to wait. */
+static const char *zstd_ensure_cache(ZstdReader *zstd, int frame)
+{
+  ZstdFrameBatch *batch = NULL, *batch_other = NULL;
+  for (int i = 0; i < 2; i++) {
+    if (zstd_batch_contains(&zstd->seek.batches[i], frame)) {
+      batch = &zstd->seek.batches[i];
+      batch_other = &zstd->seek.batches[1 - i];
+      break;
+    }
   }
 
-  zstd->seek.cached_frame = frame;
-  zstd->seek.cached_content = uncompressed_data;
-  return uncompressed_data;
+  if (batch == NULL) {
+    /* Not prefetched (first read or a seek), start over from this frame. */
+    zstd_batch_clear(&zstd->seek.batches[0]);
+    zstd_batch_clear(&zstd->seek.batches[1]);
+    batch = &zstd->seek.batches[0];
+    batch_other = &zstd->seek.batches[1];
+    zstd_batch_start(zstd, batch, frame);
+  }
+
+  zstd_batch_wait(batch);
+
+  /* Prefetch the frames following this batch. */
+  const int frame_next = batch->frame_first + batch->frames_len;
+  if (frame_next < zstd->seek.frames_num &&
+      !(batch_other->frames_len && batch_other->frame_first == frame_next))
+  {
+    zstd_batch_clear(batch_other);
+    zstd_batch_start(zstd, batch_other, frame_next);
+  }
+
+  return batch->frames[frame - batch->frame_first].content;
 }
 
 static int64_t zstd_read_seekable(FileReader *reader, void *buf, size_t size)
@@ -275,10 +363,9 @@ static void zstd_close(FileReader *reader)
   if (zstd->reader.seek) {
     mem_free(zstd->seek.uncompressed_ofs);
     mem_free(zstd->seek.compressed_ofs);
-    /* When an error has occurred this may be NULL, see: #99744. */
-    if (zstd->seek.cached_content) {
-      mem_free(zstd->seek.cached_content);
-    }
+    /* Frames that failed to decompress are NULL, see: #99744. */
+    zstd_batch_clear(&zstd->seek.batches[0]);
+    zstd_batch_clear(&zstd->seek.batches[1]);
   }
   else {
     mem_free((void *)zstd->in_buf.src);
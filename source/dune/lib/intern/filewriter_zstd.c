@@ -0,0 +1,192 @@
+/* Seekable zstd writing.
+ *
+ * Data is split into independently compressed frames followed by a seek table,
+ * using the layout of the zstd seekable format that lib_filereader_new_zstd reads.
+ * Since frames don't depend on each other, they're compressed in parallel
+ * and readers can decompress them in parallel too. */
+#include <stdio.h>
+#include <string.h>
+#include <zstd.h>
+
+#include "lib_endian_switch.h"
+#include "lib_task.h"
+#include "lib_utildefines.h"
+
+#include "mem_guardedalloc.h"
+
+/* Magic of the skippable frame holding the seek table and of its footer. */
+#define ZSTD_SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZSTD_SEEKABLE_FOOTER_MAGIC 0x8F92EAB1
+
+/* Frames compressed in one batch, per thread. */
+#define ZSTD_WRITER_BATCH_PER_THREAD 2
+
+typedef struct ZstdWriterFrame {
+  char *data;
+  size_t data_len;
+  char *compressed;
+  size_t compressed_len;
+} ZstdWriterFrame;
+
+typedef struct ZstdSeekableWriter {
+  FILE *file;
+  int compression_level;
+  size_t frame_size;
+
+  /* Frames filled by lib_zstd_seekable_writer_write, compressed once the batch is full. */
+  ZstdWriterFrame *batch;
+  int batch_len;
+  int batch_max;
+
+  /* Compressed & uncompressed size of every written frame. */
+  uint32_t (*seek_table)[2];
+  int frames_num;
+  int frames_alloc;
+
+  bool error;
+} ZstdSeekableWriter;
+
+ZstdSeekableWriter *lib_zstd_seekable_writer_new(FILE *file,
+                                                 const int compression_level,
+                                                 const size_t frame_size)
+{
+  /* Frame sizes are stored as 32bit in the seek table. */
+  lib_assert(frame_size > 0 && frame_size <= UINT32_MAX);
+
+  ZstdSeekableWriter *writer = mem_calloc(sizeof(ZstdSeekableWriter), __func__);
+  writer->file = file;
+  writer->compression_level = compression_level;
+  writer->frame_size = frame_size;
+
+  writer->batch_max = MAX2(1, lib_task_scheduler_num_threads()) * ZSTD_WRITER_BATCH_PER_THREAD;
+  writer->batch = mem_calloc(sizeof(*writer->batch) * (size_t)writer->batch_max, __func__);
+
+  return writer;
+}
+
+static void zstd_writer_compress_task_cb(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  ZstdSeekableWriter *writer = userdata;
+  ZstdWriterFrame *frame = &writer->batch[i];
+
+  const size_t bound = ZSTD_compressBound(frame->data_len);
+  frame->compressed = mem_malloc(bound, __func__);
+  frame->compressed_len = ZSTD_compress(
+      frame->compressed, bound, frame->data, frame->data_len, writer->compression_level);
+}
+
+static bool zstd_writer_write_u32(ZstdSeekableWriter *writer, uint32_t val)
+{
+#ifdef __BIG_ENDIAN__
+  lib_endian_switch_uint32(&val);
+#endif
+  return fwrite(&val, sizeof(val), 1, writer->file) == 1;
+}
+
+/* Compress all frames of the batch in parallel, then write them in order. */
+static void zstd_writer_flush_batch(ZstdSeekableWriter *writer)
+{
+  if (writer->batch_len == 0) {
+    return;
+  }
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1;
+  settings.use_threading = (writer->batch_len > 1);
+  lib_task_parallel_range(0, writer->batch_len, writer, zstd_writer_compress_task_cb, &settings);
+
+  for (int i = 0; i < writer->batch_len; i++) {
+    ZstdWriterFrame *frame = &writer->batch[i];
+
+    if (!writer->error) {
+      if (ZSTD_isError(frame->compressed_len) ||
+          fwrite(frame->compressed, 1, frame->compressed_len, writer->file) !=
+              frame->compressed_len)
+      {
+        writer->error = true;
+      }
+    }
+
+    if (!writer->error) {
+      if (writer->frames_num == writer->frames_alloc) {
+        writer->frames_alloc = MAX2(64, writer->frames_alloc * 2);
+        writer->seek_table = mem_realloc(
+            writer->seek_table, sizeof(*writer->seek_table) * (size_t)writer->frames_alloc);
+      }
+      writer->seek_table[writer->frames_num][0] = (uint32_t)frame->compressed_len;
+      writer->seek_table[writer->frames_num][1] = (uint32_t)frame->data_len;
+      writer->frames_num++;
+    }
+
+    MEM_SAFE_FREE(frame->compressed);
+    frame->data_len = 0;
+  }
+  writer->batch_len = 0;
+}
+
+bool lib_zstd_seekable_writer_write(ZstdSeekableWriter *writer, const void *data, size_t len)
+{
+  const char *data_step = data;
+  while (len && !writer->error) {
+    ZstdWriterFrame *frame = &writer->batch[writer->batch_len];
+    if (frame->data == NULL) {
+      frame->data = mem_malloc(writer->frame_size, __func__);
+    }
+
+    const size_t copy_len = MIN2(len, writer->frame_size - frame->data_len);
+    memcpy(frame->data + frame->data_len, data_step, copy_len);
+    frame->data_len += copy_len;
+    data_step += copy_len;
+    len -= copy_len;
+
+    if (frame->data_len == writer->frame_size) {
+      writer->batch_len++;
+      if (writer->batch_len == writer->batch_max) {
+        zstd_writer_flush_batch(writer);
+      }
+    }
+  }
+  return !writer->error;
+}
+
+bool lib_zstd_seekable_writer_finish(ZstdSeekableWriter *writer)
+{
+  /* Include the partially filled frame. */
+  if (writer->batch[writer->batch_len].data_len) {
+    writer->batch_len++;
+  }
+  zstd_writer_flush_batch(writer);
+
+  /* Seek table: a skippable frame w an entry per frame, followed by the footer. */
+  if (!writer->error) {
+    const uint32_t frame_length = (uint32_t)writer->frames_num * 8 + 9;
+    bool ok = zstd_writer_write_u32(writer, ZSTD_SEEKABLE_SKIPPABLE_MAGIC) &&
+              zstd_writer_write_u32(writer, frame_length);
+    for (int i = 0; ok && i < writer->frames_num; i++) {
+      ok = zstd_writer_write_u32(writer, writer->seek_table[i][0]) &&
+           zstd_writer_write_u32(writer, writer->seek_table[i][1]);
+    }
+    /* No check-sums. */
+    const uint8_t flags = 0;
+    ok = ok && zstd_writer_write_u32(writer, (uint32_t)writer->frames_num) &&
+         (fwrite(&flags, 1, 1, writer->file) == 1) &&
+         zstd_writer_write_u32(writer, ZSTD_SEEKABLE_FOOTER_MAGIC);
+    if (!ok) {
+      writer->error = true;
+    }
+  }
+
+  const bool ok = !writer->error;
+
+  for (int i = 0; i < writer->batch_max; i++) {
+    MEM_SAFE_FREE(writer->batch[i].data);
+  }
+  mem_free(writer->batch);
+  MEM_SAFE_FREE(writer->seek_table);
+  mem_free(writer);
+
+  return ok;
+}
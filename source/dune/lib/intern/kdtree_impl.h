@@ -2,6 +2,7 @@
 
 #include "lib_kdtree_impl.h"
 #include "lib_math_base.h"
+#include "lib_task.h"
 #include "lib_strict_flags.h"
 #include "lib_utildefines.h"
 
@@ -41,6 +42,11 @@ struct KDTree {
 
 #define KD_NODE_UNSET ((uint)-1)
 
+/* Sub-trees w fewer nodes are balanced on the current thread. */
+#define KD_BALANCE_PARALLEL_MIN 8192
+/* Min num of queries per thread for the batched search fns. */
+#define KD_BATCH_GRAIN_SIZE 256
+
 /* When set we know all vas are unbalanced,
  * otherwise clear them when re-balancing: see #62210. */
 #define KD_NODE_ROOT_IS_INIT ((uint)-2)
@@ -118,19 +124,12 @@ void lib_kdtree_nd_(insert)(KDTree *tree, int index, const float co[KD_DIMS])
 #endif
 }
 
-static uint kdtree_balance(KDTreeNode *nodes, uint nodes_len, uint axis, const uint ofs)
+/* Partition nodes around their median on axis, returns the median. */
+static uint kdtree_balance_partition(KDTreeNode *nodes, const uint nodes_len, const uint axis)
 {
-  KDTreeNode *node;
   float co;
   uint left, right, median, i, j;
 
-  if (nodes_len <= 0) {
-    return KD_NODE_UNSET;
-  }
-  else if (nodes_len == 1) {
-    return 0 + ofs;
-  }
-
   /* Quick-sort style sorting around median. */
   left = 0;
   right = nodes_len - 1;
@@ -163,6 +162,23 @@ static uint kdtree_balance(KDTreeNode *nodes, uint nodes_len, uint axis, const u
     }
   }
 
+  return median;
+}
+
+static uint kdtree_balance(KDTreeNode *nodes, uint nodes_len, uint axis, const uint ofs)
+{
+  KDTreeNode *node;
+  uint median;
+
+  if (nodes_len <= 0) {
+    return KD_NODE_UNSET;
+  }
+  else if (nodes_len == 1) {
+    return 0 + ofs;
+  }
+
+  median = kdtree_balance_partition(nodes, nodes_len, axis);
+
   /* Set node and sort sub-nodes. */
   node = &nodes[median];
   node->d = axis;
@@ -174,6 +190,53 @@ static uint kdtree_balance(KDTreeNode *nodes, uint nodes_len, uint axis, const u
   return median + ofs;
 }
 
+/* Parallel balancing: the two halves of a split are independent, so the right
+ * half is pushed as a task while the left half is balanced on this thread.
+ * The resulting tree is identical to the one from kdtree_balance. */
+typedef struct KDBalanceTask {
+  KDTreeNode *nodes;
+  uint nodes_len;
+  uint axis;
+  uint ofs;
+} KDBalanceTask;
+
+static void kdtree_balance_parallel(
+    TaskPool *pool, KDTreeNode *nodes, uint nodes_len, uint axis, const uint ofs);
+
+static void kdtree_balance_task_fn(TaskPool *__restrict pool, void *taskdata)
+{
+  const KDBalanceTask *task = taskdata;
+  kdtree_balance_parallel(pool, task->nodes, task->nodes_len, task->axis, task->ofs);
+}
+
+static void kdtree_balance_parallel(
+    TaskPool *pool, KDTreeNode *nodes, uint nodes_len, uint axis, const uint ofs)
+{
+  while (nodes_len >= KD_BALANCE_PARALLEL_MIN) {
+    const uint median = kdtree_balance_partition(nodes, nodes_len, axis);
+    const uint right_len = nodes_len - (median + 1);
+    KDTreeNode *node = &nodes[median];
+    node->d = axis;
+    axis = (axis + 1) % KD_DIMS;
+
+    /* Roots of the sub-trees only depend on their size (see kdtree_balance),
+     * so they can be set before the sub-trees are balanced. */
+    node->left = (median / 2) + ofs;
+    node->right = (right_len == 1) ? (median + 1) + ofs : (right_len / 2) + (median + 1) + ofs;
+
+    KDBalanceTask *task = mem_malloc(sizeof(*task), __func__);
+    task->nodes = nodes + median + 1;
+    task->nodes_len = right_len;
+    task->axis = axis;
+    task->ofs = (median + 1) + ofs;
+    lib_task_pool_push(pool, kdtree_balance_task_fn, task, true, NULL);
+
+    nodes_len = median;
+  }
+
+  kdtree_balance(nodes, nodes_len, axis, ofs);
+}
+
 void lib_kdtree_nd_(balance)(KDTree *tree)
 {
   if (tree->root != KD_NODE_ROOT_IS_INIT) {
@@ -183,7 +246,16 @@ void lib_kdtree_nd_(balance)(KDTree *tree)
     }
   }
 
-  tree->root = kdtree_balance(tree->nodes, tree->nodes_len, 0, 0);
+  if (tree->nodes_len >= KD_BALANCE_PARALLEL_MIN) {
+    TaskPool *pool = lib_task_pool_create(NULL, TASK_PRIORITY_HIGH);
+    kdtree_balance_parallel(pool, tree->nodes, tree->nodes_len, 0, 0);
+    lib_task_pool_work_and_wait(pool);
+    lib_task_pool_free(pool);
+    tree->root = tree->nodes_len / 2;
+  }
+  else {
+    tree->root = kdtree_balance(tree->nodes, tree->nodes_len, 0, 0);
+  }
 
 #ifndef NDEBUG
   tree->is_balanced = true;
@@ -946,4 +1018,158 @@ int lib_kdtree_nd_(dedup)(KDTree *tree)
   return (int)tree->nodes_len;
 }
 
+/* Re-order nodes breadth-first (run after balancing).
+ *
+ * Balancing leaves nodes in the order of the median splits, so the nodes
+ * visited by a search from the root are far apart in memory. Breadth-first
+ * order keeps the upper levels, which every search visits, in a few cache lines.
+ * Note this changes the order nodes are looped over in calc_dups_fast
+ * when use_index_order is false. */
+void lib_kdtree_nd_(optimize_layout)(KDTree *tree)
+{
+#ifndef NDEBUG
+  lib_assert(tree->is_balanced == true);
+#endif
+
+  if (tree->root == KD_NODE_UNSET || tree->nodes_len < 2) {
+    return;
+  }
+
+  const KDTreeNode *nodes_src = tree->nodes;
+  KDTreeNode *nodes_dst = mem_malloc(sizeof(KDTreeNode) * tree->nodes_len, __func__);
+  /* The destination array doubles as the breadth-first queue. Children are
+   * appended after their parent, their indices are patched once they are placed. */
+  nodes_dst[0] = nodes_src[tree->root];
+  uint dst_len = 1;
+  for (uint i = 0; i < dst_len; i++) {
+    KDTreeNode *node = &nodes_dst[i];
+    if (node->left != KD_NODE_UNSET) {
+      nodes_dst[dst_len] = nodes_src[node->left];
+      node->left = dst_len++;
+    }
+    if (node->right != KD_NODE_UNSET) {
+      nodes_dst[dst_len] = nodes_src[node->right];
+      node->right = dst_len++;
+    }
+  }
+  lib_assert(dst_len == tree->nodes_len);
+
+  mem_free(tree->nodes);
+  tree->nodes = nodes_dst;
+  tree->root = 0;
+}
+
+/* Batched Queries
+ * Run many independent queries over the task scheduler. */
+
+typedef struct KDBatchData {
+  const KDTree *tree;
+  const float (*cos)[KD_DIMS];
+  KDTreeNearest *nearest;
+  KDTreeNearest **nearest_range;
+  int *nearest_len;
+  uint nearest_len_capacity;
+  float range;
+} KDBatchData;
+
+static void kdtree_find_nearest_batch_fn(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const KDBatchData *data = userdata;
+  lib_kdtree_nd_(find_nearest)(data->tree, data->cos[i], &data->nearest[i]);
+}
+
+static void kdtree_find_nearest_n_batch_fn(void *__restrict userdata,
+                                           const int i,
+                                           const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const KDBatchData *data = userdata;
+  data->nearest_len[i] = lib_kdtree_nd_(find_nearest_n)(
+      data->tree,
+      data->cos[i],
+      &data->nearest[(size_t)i * data->nearest_len_capacity],
+      data->nearest_len_capacity);
+}
+
+static void kdtree_range_search_batch_fn(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const KDBatchData *data = userdata;
+  data->nearest_len[i] = lib_kdtree_nd_(range_search)(
+      data->tree, data->cos[i], &data->nearest_range[i], data->range);
+}
+
+static void kdtree_batch_run(const int cos_len, KDBatchData *data, TaskParallelRangeFn fn)
+{
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = KD_BATCH_GRAIN_SIZE;
+  lib_task_parallel_range(0, cos_len, data, fn, &settings);
+}
+
+/* Batched lib_kdtree_3d_find_nearest.
+ * param r_nearest: An arr of cos_len nearest, index is -1 for an empty tree. */
+void lib_kdtree_nd_(find_nearest_batch)(const KDTree *tree,
+                                        const float (*cos)[KD_DIMS],
+                                        const int cos_len,
+                                        KDTreeNearest *r_nearest)
+{
+  if (UNLIKELY(tree->root == KD_NODE_UNSET)) {
+    for (int i = 0; i < cos_len; i++) {
+      r_nearest[i].index = -1;
+    }
+    return;
+  }
+
+  KDBatchData data = {
+      .tree = tree,
+      .cos = cos,
+      .nearest = r_nearest,
+  };
+  kdtree_batch_run(cos_len, &data, kdtree_find_nearest_batch_fn);
+}
+
+/* Batched lib_kdtree_3d_find_nearest_n.
+ * param r_nearest: An arr of cos_len * nearest_len_capacity nearest,
+ * results for co i start at i * nearest_len_capacity.
+ * param r_nearest_len: Num of points found for each co. */
+void lib_kdtree_nd_(find_nearest_n_batch)(const KDTree *tree,
+                                          const float (*cos)[KD_DIMS],
+                                          const int cos_len,
+                                          KDTreeNearest *r_nearest,
+                                          const uint nearest_len_capacity,
+                                          int *r_nearest_len)
+{
+  KDBatchData data = {
+      .tree = tree,
+      .cos = cos,
+      .nearest = r_nearest,
+      .nearest_len = r_nearest_len,
+      .nearest_len_capacity = nearest_len_capacity,
+  };
+  kdtree_batch_run(cos_len, &data, kdtree_find_nearest_n_batch_fn);
+}
+
+/* Batched lib_kdtree_3d_range_search.
+ * param r_nearest: An arr of cos_len alloc'd arrs (caller is responsible for freeing them).
+ * param r_nearest_len: Num of points found for each co. */
+void lib_kdtree_nd_(range_search_batch)(const KDTree *tree,
+                                        const float (*cos)[KD_DIMS],
+                                        const int cos_len,
+                                        const float range,
+                                        KDTreeNearest **r_nearest,
+                                        int *r_nearest_len)
+{
+  KDBatchData data = {
+      .tree = tree,
+      .cos = cos,
+      .nearest_range = r_nearest,
+      .nearest_len = r_nearest_len,
+      .range = range,
+  };
+  kdtree_batch_run(cos_len, &data, kdtree_range_search_batch_fn);
+}
+
 /** \} */
@@ -0,0 +1,505 @@
+/* A concurrent (ptr -> ptr) hash table, sibling of GHash & GSet using the same key callbacks.
+ *
+ * Entries are split over shards (by the upper bits of the hash), each shard being an
+ * open addressing table w linear probing.
+ * - Lookups are lock-free: a slot's hash & value are written before its key is published,
+ *   and keys are never removed or moved within a published table.
+ * - Insertions only lock their own shard.
+ * - Growing a shard publishes a new table, the old one is kept alive (readers may still be
+ *   probing it) until #lib_ghash_concurrent_reclaim or #lib_ghash_concurrent_free.
+ *
+ * NULL keys are not supported (an empty slot has a NULL key), and there is no removal. */
+#include <string.h>
+
+#include "mem_guardedalloc.h"
+
+#include "lib_task.h"
+#include "lib_threads.h"
+#include "lib_utildefines.h"
+
+#define GHASH_INTERNAL_API
+#include "lib_ghash.h" /* own include */
+
+#include "atomic_ops.h"
+
+/* keep last */
+#include "lib_strict_flags.h"
+
+#define GHASH_CONCURRENT_SHARDS_PER_THREAD 4
+#define GHASH_CONCURRENT_SHARD_BIT_MAX 8
+#define GHASH_CONCURRENT_SLOT_BIT_MIN 4
+
+/* Open addressing degrades quickly above this load. */
+#define GHASH_CONCURRENT_LIMIT_GROW(_nslots) (((_nslots)*5) / 8)
+
+typedef struct GHashSlot {
+  void *key;
+  void *val;
+  uint hash;
+} GHashSlot;
+
+typedef struct GHashShardTable {
+  /* Tables replaced by a bigger one, freed on reclaim. */
+  struct GHashShardTable *retired;
+  uint slot_mask;
+  GHashSlot slots[];
+} GHashShardTable;
+
+/* Cache line aligned, so writers of neighbor shards don't contend. */
+typedef struct ATTR_ALIGN(64) GHashShard {
+  GHashShardTable *table;
+  SpinLock lock;
+  uint nentries;
+  uint limit_grow;
+} GHashShard;
+
+struct GHashConcurrent {
+  GHashHashFP hashfp;
+  GHashCmpFP cmpfp;
+
+  GHashShard *shards;
+  uint shard_bit;
+  uint flag;
+};
+
+/* Internal Utils */
+
+/* User hashes may only be well distributed in their lower bits (e.g. ptr hashing),
+ * while shards are picked from the upper bits: finalize them (`fmix32` from MurmurHash3). */
+LIB_INLINE uint ghash_concurrent_hash(const GHashConcurrent *gh, const void *key)
+{
+  uint h = gh->hashfp(key);
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+LIB_INLINE uint ghash_concurrent_shard_index(const GHashConcurrent *gh, const uint hash)
+{
+  return gh->shard_bit ? (hash >> (32 - gh->shard_bit)) : 0;
+}
+
+LIB_INLINE GHashShard *ghash_concurrent_shard(const GHashConcurrent *gh, const uint hash)
+{
+  return &gh->shards[ghash_concurrent_shard_index(gh, hash)];
+}
+
+static GHashShardTable *ghash_shard_table_alloc(const uint nslots)
+{
+  GHashShardTable *table = mem_calloc(sizeof(*table) + sizeof(GHashSlot) * nslots, __func__);
+  table->slot_mask = nslots - 1;
+  return table;
+}
+
+/* Smallest power of two number of slots able to hold nentries w/o growing. */
+static uint ghash_shard_slots_num(const uint nentries)
+{
+  uint nslots = 1u << GHASH_CONCURRENT_SLOT_BIT_MIN;
+  while (GHASH_CONCURRENT_LIMIT_GROW(nslots) <= nentries) {
+    nslots <<= 1;
+  }
+  return nslots;
+}
+
+static void ghash_shard_init(GHashShard *shard, const uint nentries_reserve)
+{
+  const uint nslots = ghash_shard_slots_num(nentries_reserve);
+  shard->table = ghash_shard_table_alloc(nslots);
+  shard->nentries = 0;
+  shard->limit_grow = GHASH_CONCURRENT_LIMIT_GROW(nslots);
+  lib_spin_init(&shard->lock);
+}
+
+/* Lock-free probing, returns the slot holding key or NULL. */
+static GHashSlot *ghash_shard_table_lookup(const GHashConcurrent *gh,
+                                           GHashShardTable *table,
+                                           const void *key,
+                                           const uint hash)
+{
+  for (uint i = hash & table->slot_mask;; i = (i + 1) & table->slot_mask) {
+    GHashSlot *slot = &table->slots[i];
+    void *slot_key = atomic_load_ptr(&slot->key);
+    if (slot_key == NULL) {
+      return NULL;
+    }
+    if (slot->hash == hash && (slot_key == key || !gh->cmpfp(key, slot_key))) {
+      return slot;
+    }
+  }
+}
+
+/* Caller must own the table (shard locked, or table not published yet). */
+static void ghash_shard_table_insert(GHashShardTable *table,
+                                     void *key,
+                                     void *val,
+                                     const uint hash)
+{
+  uint i = hash & table->slot_mask;
+  while (table->slots[i].key != NULL) {
+    i = (i + 1) & table->slot_mask;
+  }
+  GHashSlot *slot = &table->slots[i];
+  slot->hash = hash;
+  slot->val = val;
+  /* Publish last, concurrent readers must never see a key w/o its value. */
+  atomic_store_ptr(&slot->key, key);
+}
+
+/* Caller must hold the shard lock. */
+static void ghash_shard_grow(GHashShard *shard)
+{
+  GHashShardTable *table_old = shard->table;
+  const uint nslots = (table_old->slot_mask + 1) * 2;
+  GHashShardTable *table_new = ghash_shard_table_alloc(nslots);
+
+  for (uint i = 0; i <= table_old->slot_mask; i++) {
+    GHashSlot *slot = &table_old->slots[i];
+    if (slot->key) {
+      ghash_shard_table_insert(table_new, slot->key, slot->val, slot->hash);
+    }
+  }
+
+  table_new->retired = table_old;
+  shard->limit_grow = GHASH_CONCURRENT_LIMIT_GROW(nslots);
+  atomic_store_ptr((void **)&shard->table, table_new);
+}
+
+/* Returns the value stored for key: either the existing one or val when newly added. */
+static void *ghash_concurrent_ensure(GHashConcurrent *gh, void *key, void *val, bool *r_added)
+{
+  lib_assert(key != NULL);
+  const uint hash = ghash_concurrent_hash(gh, key);
+  GHashShard *shard = ghash_concurrent_shard(gh, hash);
+
+  lib_spin_lock(&shard->lock);
+  GHashSlot *slot = ghash_shard_table_lookup(gh, shard->table, key, hash);
+  if (slot) {
+    val = slot->val;
+    *r_added = false;
+  }
+  else {
+    if (shard->nentries + 1 >= shard->limit_grow) {
+      ghash_shard_grow(shard);
+    }
+    ghash_shard_table_insert(shard->table, key, val, hash);
+    shard->nentries++;
+    *r_added = true;
+  }
+  lib_spin_unlock(&shard->lock);
+
+  return val;
+}
+
+static GHashConcurrent *ghash_concurrent_new(GHashHashFP hashfp,
+                                             GHashCmpFP cmpfp,
+                                             const char *info,
+                                             const uint nentries_reserve,
+                                             const uint flag)
+{
+  GHashConcurrent *gh = mem_malloc(sizeof(*gh), info);
+  gh->hashfp = hashfp;
+  gh->cmpfp = cmpfp;
+  gh->flag = flag;
+
+  const uint shards_num_min = (uint)MAX2(1, lib_task_scheduler_num_threads()) *
+                              GHASH_CONCURRENT_SHARDS_PER_THREAD;
+  gh->shard_bit = 0;
+  while ((1u << gh->shard_bit) < shards_num_min &&
+         gh->shard_bit < GHASH_CONCURRENT_SHARD_BIT_MAX)
+  {
+    gh->shard_bit++;
+  }
+
+  const uint shards_num = 1u << gh->shard_bit;
+  gh->shards = mem_malloc_aligned(sizeof(*gh->shards) * shards_num, 64, info);
+  /* Some headroom, entries won't be spread perfectly evenly. */
+  const uint shard_reserve = nentries_reserve ? (nentries_reserve / shards_num) * 5 / 4 + 1 : 0;
+  for (uint i = 0; i < shards_num; i++) {
+    ghash_shard_init(&gh->shards[i], shard_reserve);
+  }
+
+  return gh;
+}
+
+/* Bulk Construction
+ *
+ * Hashes are computed in parallel, items are then bucketed per shard (keeping their order),
+ * and each shard is filled by a single task, w/o any locking. */
+
+typedef struct GHashConcurrentBuildData {
+  GHashConcurrent *gh;
+  void **keys;
+  void **vals;
+  uint *hashes;
+  /* Item indices sorted by shard, `shard_offsets[i]` being the first item of shard i. */
+  uint *order;
+  uint *shard_offsets;
+} GHashConcurrentBuildData;
+
+static void ghash_concurrent_build_hash_cb(void *__restrict userdata,
+                                           const int i,
+                                           const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  GHashConcurrentBuildData *data = userdata;
+  lib_assert(data->keys[i] != NULL);
+  data->hashes[i] = ghash_concurrent_hash(data->gh, data->keys[i]);
+}
+
+static void ghash_concurrent_build_shard_cb(void *__restrict userdata,
+                                            const int shard_index,
+                                            const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  GHashConcurrentBuildData *data = userdata;
+  GHashConcurrent *gh = data->gh;
+  GHashShard *shard = &gh->shards[shard_index];
+  const uint begin = data->shard_offsets[shard_index];
+  const uint end = data->shard_offsets[shard_index + 1];
+
+  /* Size the table once, duplicates only make it slightly bigger than needed. */
+  const uint nslots = ghash_shard_slots_num(end - begin);
+  if (nslots != shard->table->slot_mask + 1) {
+    mem_free(shard->table);
+    shard->table = ghash_shard_table_alloc(nslots);
+    shard->limit_grow = GHASH_CONCURRENT_LIMIT_GROW(nslots);
+  }
+
+  for (uint i = begin; i < end; i++) {
+    const uint item = data->order[i];
+    void *key = data->keys[item];
+    const uint hash = data->hashes[item];
+    /* First occurrence of a key wins, same as #lib_ghash_concurrent_add. */
+    if (ghash_shard_table_lookup(gh, shard->table, key, hash) == NULL) {
+      ghash_shard_table_insert(shard->table, key, data->vals ? data->vals[item] : NULL, hash);
+      shard->nentries++;
+    }
+  }
+}
+
+static GHashConcurrent *ghash_concurrent_new_from_array(GHashHashFP hashfp,
+                                                        GHashCmpFP cmpfp,
+                                                        const char *info,
+                                                        void **keys,
+                                                        void **vals,
+                                                        const uint nentries,
+                                                        const uint flag)
+{
+  GHashConcurrent *gh = ghash_concurrent_new(hashfp, cmpfp, info, 0, flag);
+  if (nentries == 0) {
+    return gh;
+  }
+  const uint shards_num = 1u << gh->shard_bit;
+
+  GHashConcurrentBuildData data = {
+      .gh = gh,
+      .keys = keys,
+      .vals = vals,
+      .hashes = mem_malloc(sizeof(uint) * nentries, __func__),
+      .order = mem_malloc(sizeof(uint) * nentries, __func__),
+      .shard_offsets = mem_calloc(sizeof(uint) * (shards_num + 1), __func__),
+  };
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1024;
+  lib_task_parallel_range(0, (int)nentries, &data, ghash_concurrent_build_hash_cb, &settings);
+
+  /* Counting sort of items by shard, stable so the first duplicate stays first. */
+  for (uint i = 0; i < nentries; i++) {
+    data.shard_offsets[ghash_concurrent_shard_index(gh, data.hashes[i]) + 1]++;
+  }
+  for (uint i = 0; i < shards_num; i++) {
+    data.shard_offsets[i + 1] += data.shard_offsets[i];
+  }
+  uint *shard_fill = mem_malloc(sizeof(uint) * shards_num, __func__);
+  memcpy(shard_fill, data.shard_offsets, sizeof(uint) * shards_num);
+  for (uint i = 0; i < nentries; i++) {
+    data.order[shard_fill[ghash_concurrent_shard_index(gh, data.hashes[i])]++] = i;
+  }
+  mem_free(shard_fill);
+
+  settings.min_iter_per_thread = 1;
+  lib_task_parallel_range(0, (int)shards_num, &data, ghash_concurrent_build_shard_cb, &settings);
+
+  mem_free(data.hashes);
+  mem_free(data.order);
+  mem_free(data.shard_offsets);
+
+  return gh;
+}
+
+static void ghash_shard_retired_free(GHashShardTable *table)
+{
+  for (GHashShardTable *retired = table->retired, *retired_next; retired; retired = retired_next)
+  {
+    retired_next = retired->retired;
+    mem_free(retired);
+  }
+  table->retired = NULL;
+}
+
+/* GHashConcurrent Public API */
+
+GHashConcurrent *lib_ghash_concurrent_new_ex(GHashHashFP hashfp,
+                                             GHashCmpFP cmpfp,
+                                             const char *info,
+                                             const uint nentries_reserve)
+{
+  return ghash_concurrent_new(hashfp, cmpfp, info, nentries_reserve, 0);
+}
+
+GHashConcurrent *lib_ghash_concurrent_new(GHashHashFP hashfp,
+                                          GHashCmpFP cmpfp,
+                                          const char *info)
+{
+  return lib_ghash_concurrent_new_ex(hashfp, cmpfp, info, 0);
+}
+
+GHashConcurrent *lib_ghash_concurrent_new_from_array(GHashHashFP hashfp,
+                                                     GHashCmpFP cmpfp,
+                                                     const char *info,
+                                                     void **keys,
+                                                     void **vals,
+                                                     const uint nentries)
+{
+  return ghash_concurrent_new_from_array(hashfp, cmpfp, info, keys, vals, nentries, 0);
+}
+
+void lib_ghash_concurrent_free(GHashConcurrent *gh,
+                               GHashKeyFreeFP keyfreefp,
+                               GHashValFreeFP valfreefp)
+{
+  const uint shards_num = 1u << gh->shard_bit;
+  for (uint i = 0; i < shards_num; i++) {
+    GHashShard *shard = &gh->shards[i];
+    GHashShardTable *table = shard->table;
+    if (keyfreefp || valfreefp) {
+      for (uint j = 0; j <= table->slot_mask; j++) {
+        GHashSlot *slot = &table->slots[j];
+        if (slot->key) {
+          if (keyfreefp) {
+            keyfreefp(slot->key);
+          }
+          if (valfreefp) {
+            valfreefp(slot->val);
+          }
+        }
+      }
+    }
+    ghash_shard_retired_free(table);
+    mem_free(table);
+    lib_spin_end(&shard->lock);
+  }
+  mem_free(gh->shards);
+  mem_free(gh);
+}
+
+void lib_ghash_concurrent_reclaim(GHashConcurrent *gh)
+{
+  const uint shards_num = 1u << gh->shard_bit;
+  for (uint i = 0; i < shards_num; i++) {
+    ghash_shard_retired_free(gh->shards[i].table);
+  }
+}
+
+bool lib_ghash_concurrent_add(GHashConcurrent *gh, void *key, void *val)
+{
+  bool added;
+  ghash_concurrent_ensure(gh, key, val, &added);
+  return added;
+}
+
+void *lib_ghash_concurrent_ensure(GHashConcurrent *gh, void *key, void *val)
+{
+  bool added;
+  return ghash_concurrent_ensure(gh, key, val, &added);
+}
+
+void *lib_ghash_concurrent_lookup(const GHashConcurrent *gh, const void *key)
+{
+  return lib_ghash_concurrent_lookup_default(gh, key, NULL);
+}
+
+void *lib_ghash_concurrent_lookup_default(const GHashConcurrent *gh,
+                                          const void *key,
+                                          void *val_default)
+{
+  const uint hash = ghash_concurrent_hash(gh, key);
+  GHashShard *shard = ghash_concurrent_shard(gh, hash);
+  GHashShardTable *table = atomic_load_ptr((void **)&shard->table);
+  GHashSlot *slot = ghash_shard_table_lookup(gh, table, key, hash);
+  return slot ? slot->val : val_default;
+}
+
+bool lib_ghash_concurrent_haskey(const GHashConcurrent *gh, const void *key)
+{
+  const uint hash = ghash_concurrent_hash(gh, key);
+  GHashShard *shard = ghash_concurrent_shard(gh, hash);
+  GHashShardTable *table = atomic_load_ptr((void **)&shard->table);
+  return ghash_shard_table_lookup(gh, table, key, hash) != NULL;
+}
+
+uint lib_ghash_concurrent_len(const GHashConcurrent *gh)
+{
+  const uint shards_num = 1u << gh->shard_bit;
+  uint len = 0;
+  for (uint i = 0; i < shards_num; i++) {
+    len += gh->shards[i].nentries;
+  }
+  return len;
+}
+
+/* GSetConcurrent Public API
+ *
+ * Use ghash API to give 'set' functionality. */
+
+GSetConcurrent *lib_gset_concurrent_new_ex(GSetHashFP hashfp,
+                                           GSetCmpFP cmpfp,
+                                           const char *info,
+                                           const uint nentries_reserve)
+{
+  return (GSetConcurrent *)ghash_concurrent_new(
+      hashfp, cmpfp, info, nentries_reserve, GHASH_FLAG_IS_GSET);
+}
+
+GSetConcurrent *lib_gset_concurrent_new(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info)
+{
+  return lib_gset_concurrent_new_ex(hashfp, cmpfp, info, 0);
+}
+
+GSetConcurrent *lib_gset_concurrent_new_from_array(GSetHashFP hashfp,
+                                                   GSetCmpFP cmpfp,
+                                                   const char *info,
+                                                   void **keys,
+                                                   const uint nentries)
+{
+  return (GSetConcurrent *)ghash_concurrent_new_from_array(
+      hashfp, cmpfp, info, keys, NULL, nentries, GHASH_FLAG_IS_GSET);
+}
+
+void lib_gset_concurrent_free(GSetConcurrent *gs, GSetKeyFreeFP keyfreefp)
+{
+  lib_ghash_concurrent_free((GHashConcurrent *)gs, keyfreefp, NULL);
+}
+
+void lib_gset_concurrent_reclaim(GSetConcurrent *gs)
+{
+  lib_ghash_concurrent_reclaim((GHashConcurrent *)gs);
+}
+
+bool lib_gset_concurrent_add(GSetConcurrent *gs, void *key)
+{
+  return lib_ghash_concurrent_add((GHashConcurrent *)gs, key, NULL);
+}
+
+bool lib_gset_concurrent_haskey(const GSetConcurrent *gs, const void *key)
+{
+  return lib_ghash_concurrent_haskey((const GHashConcurrent *)gs, key);
+}
+
+uint lib_gset_concurrent_len(const GSetConcurrent *gs)
+{
+  return lib_ghash_concurrent_len((const GHashConcurrent *)gs);
+}
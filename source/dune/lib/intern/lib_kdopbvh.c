@@ -10,13 +10,23 @@
  * - Overlapping 2 trees:
  *   lib_bvhtree_overlap, BVHOverlapDataShared, BVHOverlapDataThread
  * - Range Query:
- *   lib_bvhtree_range_query */
+ *   lib_bvhtree_range_query
+ * - Binned SAH build:
+ *   lib_bvhtree_balance_sah, BVHSAHBuildData
+ * - 4-wide node layout for ray-casting many rays:
+ *   lib_bvhtree_build_wide, lib_bvhtree_ray_cast_stream, BVHNodeWide
+ * - Refitting only the branches above changed leafs:
+ *   lib_bvhtree_update_tree_dirty, BVHTreeRefit */
 #include "mem_guardedalloc.h"
 
+#include "atomic_ops.h"
+
 #include "lib_alloca.h"
 #include "lib_heap_simple.h"
 #include "lib_kdopbvh.h"
+#include "lib_math_bits.h"
 #include "lib_math_geom.h"
+#include "lib_simd.h"
 #include "lib_stack.h"
 #include "lib_task.h"
 #include "lib_utildefines.h"
@@ -54,25 +64,73 @@ typedef struct BVHNode {
   int index;      /* face, edge, vert index */
   char node_num;  /* how many nodes are used, used for speedup */
   char main_axis; /* Axis used to split this node */
+  char flag;      /* BVH_NODE_DIRTY */
 } BVHNode;
 
+/* BVHNode.flag */
+enum {
+  /* Bounds changed since the last refit, see lib_bvhtree_update_tree_dirty. */
+  BVH_NODE_DIRTY = (1 << 0),
+};
+
+/* BVHTree.build_type, used when re-balancing. */
+enum {
+  BVH_BUILD_MEDIAN = 0,
+  BVH_BUILD_SAH = 1,
+};
+
+/* State for refitting only the branches above changed leafs,
+ * see lib_bvhtree_use_dirty_refit. */
+typedef struct BVHTreeRefit {
+  /* Leafs tagged by lib_bvhtree_update_node, followed by their ancestors while refitting. */
+  BVHNode **dirty;
+  int dirty_num;
+  /* Sum of the surface area of all branches, kept up to date while refitting. */
+  float area_sum;
+  /* Quality (area_sum / root area) right after balancing. */
+  float cost_initial;
+  /* Re-balance once the quality is worse than cost_initial by this factor. */
+  float rebuild_factor;
+} BVHTreeRefit;
+
+/* Width of BVHNodeWide, matches the SSE register width. */
+#define BVH_WIDE_WIDTH 4
+
+/* Flattened 4-wide node used for ray-casting, see lib_bvhtree_build_wide.
+ * The xyz bounds of all children are stored together so a ray can be tested
+ * against all of them at once. */
+typedef struct BVHNodeWide {
+  /* Child bounds: min x, y, z then max x, y, z, one column per child. */
+  float bounds[6][BVH_WIDE_WIDTH];
+  /* Nodes the bounds are copied from, used when re-fitting. */
+  const BVHNode *src[BVH_WIDE_WIDTH];
+  /* Index of the child in BVHTree.nodewide, -1 for leafs. */
+  int children[BVH_WIDE_WIDTH];
+  int children_num;
+  char main_axis;
+} BVHNodeWide;
+
 /* keep under 26 bytes for speed purposes */
 struct BVHTree {
   BVHNode **nodes;
   BVHNode *nodearray;  /* pre-alloc branch nodes */
   BVHNode **nodechild; /* pre-alloc children for nodes */
   float *nodebv;       /* pre-alloc bounding-volumes for nodes */
+  BVHNodeWide *nodewide; /* optional 4-wide copy of the branches for ray-casting */
+  BVHTreeRefit *refit;   /* optional dirty-leaf tracking */
   float epsilon;       /* Epsilon is used for inflation of the K-DOP. */
   int leaf_num;        /* leafs */
   int branch_num;
+  int wide_num;
   axis_t start_axis, stop_axis; /* bvhtree_kdop_axes array indices according to axis */
   axis_t axis;                  /* KDOP type (6 => OBB, 7 => AABB, ...) */
   char tree_type;               /* type of tree (4 => quad-tree). */
+  char build_type;              /* BVH_BUILD_MEDIAN or BVH_BUILD_SAH */
 };
 
 /* optimization, ensure we stay small */
-LIB_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 48) ||
-                      (sizeof(void *) == 4 && sizeof(BVHTree) <= 32),
+LIB_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 72) ||
+                      (sizeof(void *) == 4 && sizeof(BVHTree) <= 48),
                   "over sized")
 
 /* avoid dup vars in BVHOverlapDataThread */
@@ -867,6 +925,11 @@ void lib_bvhtree_free(BVHTree *tree)
     MEM_SAFE_FREE(tree->nodearray);
     MEM_SAFE_FREE(tree->nodebv);
     MEM_SAFE_FREE(tree->nodechild);
+    MEM_SAFE_FREE(tree->nodewide);
+    if (tree->refit) {
+      MEM_SAFE_FREE(tree->refit->dirty);
+      MEM_freeN(tree->refit);
+    }
     MEM_freeN(tree);
   }
 }
@@ -903,6 +966,510 @@ void lib_bvhtree_balance(BVHTree *tree)
 #endif
 }
 
+/* lib_bvhtree_balance_sah
+ *
+ * Top-down build that splits the leafs where the surface area heuristic
+ * (SAH) estimates the lowest traversal cost, evaluated on a fixed num of
+ * bins per axis. Splits are binary; wider trees are made by collapsing
+ * the binary nodes, always opening the child w the largest surface area.
+ *
+ * The binary tree is stored implicitly: node i covering n leafs has its left
+ * child at i + 1 and its right child at i + 2 * (left leafs), so sub-trees
+ * can be built on separate threads wo any sync and the result doesn't
+ * depend on scheduling. */
+
+#define BVH_SAH_BINS 16
+
+typedef struct BVHSAHNode {
+  int begin, end;
+  char split_axis;
+  /* Surface area of the bounds, used for collapsing. */
+  float area;
+} BVHSAHNode;
+
+typedef struct BVHSAHBuildData {
+  BVHNode **leafs_array;
+  BVHSAHNode *sah_nodes;
+} BVHSAHBuildData;
+
+typedef struct BVHSAHTask {
+  int node_index;
+  int begin, end;
+} BVHSAHTask;
+
+static void bvh_aabb_init(float bb[6])
+{
+  bb[0] = bb[2] = bb[4] = FLT_MAX;
+  bb[1] = bb[3] = bb[5] = -FLT_MAX;
+}
+
+static void bvh_aabb_expand(float bb[6], const float bv[6])
+{
+  for (int i = 0; i < 6; i += 2) {
+    bb[i] = min_ff(bb[i], bv[i]);
+    bb[i + 1] = max_ff(bb[i + 1], bv[i + 1]);
+  }
+}
+
+static float bvh_aabb_area(const float bb[6])
+{
+  if (bb[0] > bb[1]) {
+    return 0.0f;
+  }
+  const float dx = bb[1] - bb[0], dy = bb[3] - bb[2], dz = bb[5] - bb[4];
+  return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static int bvh_sah_bin(const BVHNode *leaf, const int axis, const float cmin, const float scale)
+{
+  const float centroid = (leaf->bv[2 * axis] + leaf->bv[2 * axis + 1]) * 0.5f;
+  const int bin = (int)((centroid - cmin) * scale);
+  return clamp_i(bin, 0, BVH_SAH_BINS - 1);
+}
+
+/* Partition the leafs in [begin, end), returns the first leaf of the right side. */
+static int bvh_sah_split(BVHNode **leafs, const int begin, const int end, BVHSAHNode *node)
+{
+  float bounds[6], centroid_bounds[6];
+  bvh_aabb_init(bounds);
+  bvh_aabb_init(centroid_bounds);
+  for (int i = begin; i < end; i++) {
+    const float *bv = leafs[i]->bv;
+    bvh_aabb_expand(bounds, bv);
+    for (int axis = 0; axis < 3; axis++) {
+      const float centroid = (bv[2 * axis] + bv[2 * axis + 1]) * 0.5f;
+      centroid_bounds[2 * axis] = min_ff(centroid_bounds[2 * axis], centroid);
+      centroid_bounds[2 * axis + 1] = max_ff(centroid_bounds[2 * axis + 1], centroid);
+    }
+  }
+  node->area = bvh_aabb_area(bounds);
+
+  int best_axis = get_largest_axis(centroid_bounds) / 2;
+  int best_bin = -1;
+
+  if (end - begin > 2) {
+    float best_cost = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+      const float cmin = centroid_bounds[2 * axis];
+      const float extent = centroid_bounds[2 * axis + 1] - cmin;
+      if (extent <= 0.0f) {
+        continue;
+      }
+      const float scale = (float)BVH_SAH_BINS / extent;
+
+      int bin_count[BVH_SAH_BINS] = {0};
+      float bin_bounds[BVH_SAH_BINS][6];
+      for (int b = 0; b < BVH_SAH_BINS; b++) {
+        bvh_aabb_init(bin_bounds[b]);
+      }
+      for (int i = begin; i < end; i++) {
+        const int b = bvh_sah_bin(leafs[i], axis, cmin, scale);
+        bin_count[b]++;
+        bvh_aabb_expand(bin_bounds[b], leafs[i]->bv);
+      }
+
+      /* Sweep from the right to get the cost of each right side. */
+      float right_area[BVH_SAH_BINS];
+      int right_count[BVH_SAH_BINS];
+      float bb[6];
+      int count = 0;
+      bvh_aabb_init(bb);
+      for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+        bvh_aabb_expand(bb, bin_bounds[b]);
+        count += bin_count[b];
+        right_area[b] = bvh_aabb_area(bb);
+        right_count[b] = count;
+      }
+
+      /* Then from the left, splitting before bin b. */
+      count = 0;
+      bvh_aabb_init(bb);
+      for (int b = 1; b < BVH_SAH_BINS; b++) {
+        bvh_aabb_expand(bb, bin_bounds[b - 1]);
+        count += bin_count[b - 1];
+        if (count == 0 || right_count[b] == 0) {
+          continue;
+        }
+        const float cost = bvh_aabb_area(bb) * (float)count +
+                           right_area[b] * (float)right_count[b];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+  }
+
+  node->split_axis = (char)best_axis;
+
+  int mid = (begin + end) / 2;
+  if (best_bin != -1) {
+    const float cmin = centroid_bounds[2 * best_axis];
+    const float scale = (float)BVH_SAH_BINS /
+                        (centroid_bounds[2 * best_axis + 1] - centroid_bounds[2 * best_axis]);
+    int i = begin, j = end - 1;
+    while (i <= j) {
+      if (bvh_sah_bin(leafs[i], best_axis, cmin, scale) < best_bin) {
+        i++;
+      }
+      else {
+        SWAP(BVHNode *, leafs[i], leafs[j]);
+        j--;
+      }
+    }
+    mid = i;
+  }
+
+  if (mid == begin || mid == end) {
+    /* All centroids coincide, fall back to a median split. */
+    mid = (begin + end) / 2;
+    partition_nth_element(leafs, begin, end, mid, 2 * best_axis + 1);
+  }
+  return mid;
+}
+
+static void bvh_sah_build_task_cb(TaskPool *__restrict pool, void *taskdata);
+
+static void bvh_sah_build_range(TaskPool *pool,
+                                const BVHSAHBuildData *data,
+                                int node_index,
+                                int begin,
+                                int end)
+{
+  while (end - begin > 1) {
+    BVHSAHNode *node = &data->sah_nodes[node_index];
+    node->begin = begin;
+    node->end = end;
+    const int mid = bvh_sah_split(data->leafs_array, begin, end, node);
+
+    const int left_index = node_index + 1;
+    const int right_index = node_index + 2 * (mid - begin);
+
+    /* Continue w the larger side here, so the recursion depth stays logarithmic. */
+    int small_index = left_index, small_begin = begin, small_end = mid;
+    if (mid - begin > end - mid) {
+      small_index = right_index;
+      small_begin = mid;
+      small_end = end;
+      end = mid;
+      node_index = left_index;
+    }
+    else {
+      begin = mid;
+      node_index = right_index;
+    }
+
+    if (pool && small_end - small_begin > KDOPBVH_THREAD_LEAF_THRESHOLD) {
+      BVHSAHTask *task = mem_malloc(sizeof(*task), __func__);
+      task->node_index = small_index;
+      task->begin = small_begin;
+      task->end = small_end;
+      lib_task_pool_push(pool, bvh_sah_build_task_cb, task, true, NULL);
+    }
+    else {
+      bvh_sah_build_range(NULL, data, small_index, small_begin, small_end);
+    }
+  }
+
+  BVHSAHNode *leaf = &data->sah_nodes[node_index];
+  leaf->begin = begin;
+  leaf->end = end;
+  leaf->area = 0.0f;
+}
+
+static void bvh_sah_build_task_cb(TaskPool *__restrict pool, void *taskdata)
+{
+  const BVHSAHBuildData *data = lib_task_pool_user_data(pool);
+  const BVHSAHTask *task = taskdata;
+  bvh_sah_build_range(pool, data, task->node_index, task->begin, task->end);
+}
+
+LIB_INLINE bool bvh_sah_node_is_leaf(const BVHSAHNode *node)
+{
+  return node->end - node->begin == 1;
+}
+
+/* Make sure there is room for branch_num branches. Collapsed SAH trees may need
+ * more branches than the implicit tree the arrays were sized for. Must run before
+ * balancing, while the leafs are still in insertion order. */
+static void bvhtree_branch_capacity_ensure(BVHTree *tree, const int branch_num)
+{
+  const int numnodes_prev = (int)(mem_alloc_len(tree->nodearray) / sizeof(BVHNode));
+  const int numnodes = tree->leaf_num + branch_num + tree->tree_type;
+  if (numnodes <= numnodes_prev) {
+    return;
+  }
+
+  const int axis = tree->axis;
+  BVHNode **nodes = mem_calloc(sizeof(BVHNode *) * (size_t)numnodes, "BVHNodes");
+  float *nodebv = mem_calloc(sizeof(float) * (size_t)(axis * numnodes), "BVHNodeBV");
+  BVHNode **nodechild = mem_calloc(sizeof(BVHNode *) * (size_t)(tree->tree_type * numnodes),
+                                   "BVHNodeBV");
+  BVHNode *nodearray = mem_calloc(sizeof(BVHNode) * (size_t)numnodes, "BVHNodeArray");
+
+  memcpy(nodebv, tree->nodebv, sizeof(float) * (size_t)(axis * tree->leaf_num));
+  for (int i = 0; i < numnodes; i++) {
+    nodearray[i].bv = &nodebv[i * axis];
+    nodearray[i].children = &nodechild[i * tree->tree_type];
+  }
+  for (int i = 0; i < tree->leaf_num; i++) {
+    nodearray[i].index = tree->nodearray[i].index;
+    nodes[i] = &nodearray[i];
+  }
+
+  MEM_freeN(tree->nodes);
+  MEM_freeN(tree->nodebv);
+  MEM_freeN(tree->nodechild);
+  MEM_freeN(tree->nodearray);
+  tree->nodes = nodes;
+  tree->nodebv = nodebv;
+  tree->nodechild = nodechild;
+  tree->nodearray = nodearray;
+}
+
+/* Turn the binary SAH tree into BVHNode branches of up to tree_type children.
+ * Branches are numbered in pre-order, so children always have a greater index
+ * than their parent, as lib_bvhtree_update_tree expects. */
+static int bvh_sah_collapse(BVHTree *tree, BVHNode **leafs_array, const BVHSAHNode *sah_nodes)
+{
+  const int tree_type = tree->tree_type;
+  BVHNode *branches = tree->nodearray + tree->leaf_num;
+  int branch_num = 0;
+
+  typedef struct StackItem {
+    int sah_index;
+    BVHNode *parent;
+    int slot;
+  } StackItem;
+  StackItem *stack = mem_malloc(sizeof(*stack) * (size_t)(2 * tree->leaf_num + tree_type),
+                                __func__);
+  int stack_len = 0;
+
+  stack[stack_len++] = (StackItem){0, NULL, 0};
+  while (stack_len) {
+    const StackItem item = stack[--stack_len];
+    const BVHSAHNode *sah_node = &sah_nodes[item.sah_index];
+
+    if (bvh_sah_node_is_leaf(sah_node)) {
+      BVHNode *leaf = leafs_array[sah_node->begin];
+      item.parent->children[item.slot] = leaf;
+      leaf->parent = item.parent;
+      continue;
+    }
+
+    BVHNode *branch = &branches[branch_num++];
+    branch->parent = item.parent;
+    if (item.parent) {
+      item.parent->children[item.slot] = branch;
+    }
+    branch->main_axis = sah_node->split_axis;
+
+    /* Open the children w the largest area until the branch is full. */
+    int children[MAX_TREETYPE];
+    int children_num = 2;
+    children[0] = item.sah_index + 1;
+    children[1] = item.sah_index + 2 * (sah_nodes[children[0]].end - sah_node->begin);
+    while (children_num < tree_type) {
+      int best = -1;
+      for (int i = 0; i < children_num; i++) {
+        const BVHSAHNode *child = &sah_nodes[children[i]];
+        if (!bvh_sah_node_is_leaf(child) &&
+            (best == -1 || child->area > sah_nodes[children[best]].area))
+        {
+          best = i;
+        }
+      }
+      if (best == -1) {
+        break;
+      }
+      const int open_index = children[best];
+      const int open_left = open_index + 1;
+      const int open_right = open_index + 2 * (sah_nodes[open_left].end -
+                                               sah_nodes[open_index].begin);
+      memmove(&children[best + 2],
+              &children[best + 1],
+              sizeof(int) * (size_t)(children_num - best - 1));
+      children[best] = open_left;
+      children[best + 1] = open_right;
+      children_num++;
+    }
+
+    branch->node_num = (char)children_num;
+    for (int i = children_num; i < tree_type; i++) {
+      branch->children[i] = NULL;
+    }
+    /* Reverse order so the first child is numbered first. */
+    for (int i = children_num - 1; i >= 0; i--) {
+      stack[stack_len++] = (StackItem){children[i], branch, i};
+    }
+  }
+
+  MEM_freeN(stack);
+  return branch_num;
+}
+
+void lib_bvhtree_balance_sah(BVHTree *tree)
+{
+  /* This fn should only be called once. */
+  lib_assert(tree->branch_num == 0);
+
+  /* SAH works on the xyz bounds. */
+  if (tree->start_axis != 0 || tree->leaf_num < 2) {
+    lib_bvhtree_balance(tree);
+    return;
+  }
+
+  bvhtree_branch_capacity_ensure(tree, tree->leaf_num - 1);
+
+  BVHSAHBuildData data = {
+      .leafs_array = tree->nodes,
+      .sah_nodes = mem_malloc(sizeof(BVHSAHNode) * (size_t)(2 * tree->leaf_num - 1), __func__),
+  };
+
+  if (tree->leaf_num > KDOPBVH_THREAD_LEAF_THRESHOLD) {
+    TaskPool *pool = lib_task_pool_create(&data, TASK_PRIORITY_HIGH);
+    bvh_sah_build_range(pool, &data, 0, 0, tree->leaf_num);
+    lib_task_pool_work_and_wait(pool);
+    lib_task_pool_free(pool);
+  }
+  else {
+    bvh_sah_build_range(NULL, &data, 0, 0, tree->leaf_num);
+  }
+
+  tree->branch_num = bvh_sah_collapse(tree, tree->nodes, data.sah_nodes);
+  tree->build_type = BVH_BUILD_SAH;
+  MEM_freeN(data.sah_nodes);
+
+  for (int i = 0; i < tree->branch_num; i++) {
+    tree->nodes[tree->leaf_num + i] = &tree->nodearray[tree->leaf_num + i];
+  }
+
+  lib_bvhtree_update_tree(tree);
+
+#ifdef USE_SKIP_LINKS
+  build_skip_links(tree, tree->nodes[tree->leaf_num], NULL, NULL);
+#endif
+
+#ifdef USE_VERIFY_TREE
+  bvhtree_verify(tree);
+#endif
+}
+
+/* lib_bvhtree_build_wide
+ *
+ * Flattens the branches into BVHNodeWide nodes of up to 4 children, opening
+ * the largest child branches of narrower trees until the node is full.
+ * Only the xyz bounds are stored, so this needs a tree using the first axes. */
+
+static float bvh_node_area(const BVHNode *node)
+{
+  return bvh_aabb_area(node->bv);
+}
+
+static void bvhtree_wide_node_fill(BVHNodeWide *wnode)
+{
+  for (int k = 0; k < BVH_WIDE_WIDTH; k++) {
+    const BVHNode *src = (k < wnode->children_num) ? wnode->src[k] : NULL;
+    for (int a = 0; a < 3; a++) {
+      wnode->bounds[a][k] = src ? src->bv[2 * a] : FLT_MAX;
+      wnode->bounds[3 + a][k] = src ? src->bv[2 * a + 1] : -FLT_MAX;
+    }
+  }
+}
+
+static void bvhtree_wide_refit(BVHTree *tree)
+{
+  for (int i = 0; i < tree->wide_num; i++) {
+    bvhtree_wide_node_fill(&tree->nodewide[i]);
+  }
+}
+
+bool lib_bvhtree_build_wide(BVHTree *tree)
+{
+  if (tree->start_axis != 0 || tree->tree_type > BVH_WIDE_WIDTH || tree->branch_num == 0) {
+    return false;
+  }
+
+  MEM_SAFE_FREE(tree->nodewide);
+  tree->nodewide = mem_malloc(sizeof(BVHNodeWide) * (size_t)tree->branch_num, __func__);
+  tree->wide_num = 0;
+
+  const BVHNode **stack = mem_malloc(sizeof(*stack) * (size_t)tree->branch_num, __func__);
+  int *stack_slot = mem_malloc(sizeof(*stack_slot) * (size_t)tree->branch_num, __func__);
+  int stack_len = 0;
+
+  stack[stack_len] = tree->nodes[tree->leaf_num];
+  stack_slot[stack_len] = -1;
+  stack_len++;
+
+  while (stack_len) {
+    stack_len--;
+    const BVHNode *node = stack[stack_len];
+    const int parent_slot = stack_slot[stack_len];
+
+    const int wide_index = tree->wide_num++;
+    BVHNodeWide *wnode = &tree->nodewide[wide_index];
+    if (parent_slot != -1) {
+      /* Slot is encoded as (parent wide index * width + child). */
+      tree->nodewide[parent_slot / BVH_WIDE_WIDTH].children[parent_slot % BVH_WIDE_WIDTH] =
+          wide_index;
+    }
+
+    wnode->children_num = node->node_num;
+    wnode->main_axis = node->main_axis;
+    for (int k = 0; k < node->node_num; k++) {
+      wnode->src[k] = node->children[k];
+    }
+
+    /* Open the largest child branch while its children still fit. */
+    while (true) {
+      int best = -1;
+      float best_area = -1.0f;
+      for (int k = 0; k < wnode->children_num; k++) {
+        const BVHNode *child = wnode->src[k];
+        if (child->node_num != 0 &&
+            wnode->children_num - 1 + child->node_num <= BVH_WIDE_WIDTH &&
+            bvh_node_area(child) > best_area)
+        {
+          best = k;
+          best_area = bvh_node_area(child);
+        }
+      }
+      if (best == -1) {
+        break;
+      }
+      const BVHNode *open = wnode->src[best];
+      const int tail = wnode->children_num - best - 1;
+      memmove(&wnode->src[best + open->node_num],
+              &wnode->src[best + 1],
+              sizeof(*wnode->src) * (size_t)tail);
+      for (int k = 0; k < open->node_num; k++) {
+        wnode->src[best + k] = open->children[k];
+      }
+      wnode->children_num += open->node_num - 1;
+    }
+
+    for (int k = 0; k < wnode->children_num; k++) {
+      wnode->children[k] = -1;
+      if (wnode->src[k]->node_num != 0) {
+        stack[stack_len] = wnode->src[k];
+        stack_slot[stack_len] = wide_index * BVH_WIDE_WIDTH + k;
+        stack_len++;
+      }
+    }
+    for (int k = wnode->children_num; k < BVH_WIDE_WIDTH; k++) {
+      wnode->src[k] = NULL;
+      wnode->children[k] = -1;
+    }
+    bvhtree_wide_node_fill(wnode);
+  }
+
+  MEM_freeN(stack);
+  MEM_freeN(stack_slot);
+  return true;
+}
+
 static void bvhtree_node_inflate(const BVHTree *tree, BVHNode *node, const float dist)
 {
   axis_t axis_iter;
@@ -943,6 +1510,11 @@ bool lib_bvhtree_update_node(
 
   node = tree->nodearray + index;
 
+  float bv_prev[26];
+  if (tree->refit) {
+    memcpy(bv_prev, node->bv, sizeof(float) * (size_t)tree->axis);
+  }
+
   create_kdop_hull(tree, node, co, numpoints, 0);
 
   if (co_moving) {
@@ -952,9 +1524,35 @@ bool lib_bvhtree_update_node(
   /* inflate the bv with some epsilon */
   bvhtree_node_inflate(tree, node, tree->epsilon);
 
+  if (tree->refit && !(node->flag & BVH_NODE_DIRTY) &&
+      memcmp(bv_prev, node->bv, sizeof(float) * (size_t)tree->axis) != 0)
+  {
+    /* Leafs may be updated from multiple threads, each leaf from one thread only. */
+    node->flag |= BVH_NODE_DIRTY;
+    const int dirty_index = atomic_fetch_and_add_int32(&tree->refit->dirty_num, 1);
+    tree->refit->dirty[dirty_index] = node;
+  }
+
   return true;
 }
 
+/* Clear all tags and recompute the area sum, after a full refit. */
+static void bvhtree_refit_reset(BVHTree *tree)
+{
+  BVHTreeRefit *refit = tree->refit;
+  for (int i = 0; i < refit->dirty_num; i++) {
+    refit->dirty[i]->flag &= (char)~BVH_NODE_DIRTY;
+  }
+  refit->dirty_num = 0;
+
+  refit->area_sum = 0.0f;
+  if (tree->start_axis == 0) {
+    for (int i = 0; i < tree->branch_num; i++) {
+      refit->area_sum += bvh_node_area(tree->nodes[tree->leaf_num + i]);
+    }
+  }
+}
+
 void lib_bvhtree_update_tree(BVHTree *tree)
 {
   /* Update bottom=>top
@@ -967,6 +1565,217 @@ void lib_bvhtree_update_tree(BVHTree *tree)
   for (; index >= root; index--) {
     node_join(tree, *index);
   }
+
+  if (tree->nodewide) {
+    bvhtree_wide_refit(tree);
+  }
+
+  if (tree->refit) {
+    bvhtree_refit_reset(tree);
+  }
+}
+
+/* lib_bvhtree_update_tree_dirty
+ *
+ * Only the ancestors of leafs tagged by lib_bvhtree_update_node are refit,
+ * level by level from the deepest up, each level in parallel. The summed
+ * branch area is updated along the way and used as a cheap quality metric
+ * to tell when the tree should be re-balanced. */
+
+/* Above this fraction of dirty leafs a full refit is cheaper. */
+#define BVH_REFIT_DIRTY_FRACTION 0.25f
+#define BVH_REFIT_LEVEL_MIN_THREADED 512
+
+typedef struct BVHRefitLevelData {
+  BVHTree *tree;
+  BVHNode **nodes;
+} BVHRefitLevelData;
+
+typedef struct BVHRefitChunk {
+  float area_delta;
+} BVHRefitChunk;
+
+static void bvhtree_refit_level_cb(void *__restrict userdata,
+                                   const int i,
+                                   const TaskParallelTLS *__restrict tls)
+{
+  const BVHRefitLevelData *data = userdata;
+  BVHRefitChunk *chunk = tls->userdata_chunk;
+  BVHNode *node = data->nodes[i];
+
+  const float area_prev = bvh_node_area(node);
+  node_join(data->tree, node);
+  chunk->area_delta += bvh_node_area(node) - area_prev;
+  node->flag &= (char)~BVH_NODE_DIRTY;
+}
+
+static void bvhtree_refit_level_reduce(const void *__restrict UNUSED(userdata),
+                                       void *__restrict chunk_join,
+                                       void *__restrict chunk)
+{
+  BVHRefitChunk *dst = chunk_join;
+  const BVHRefitChunk *src = chunk;
+  dst->area_delta += src->area_delta;
+}
+
+static float bvhtree_refit_cost(const BVHTree *tree)
+{
+  const float root_area = bvh_node_area(tree->nodes[tree->leaf_num]);
+  return (root_area > 0.0f) ? tree->refit->area_sum / root_area : 0.0f;
+}
+
+void lib_bvhtree_use_dirty_refit(BVHTree *tree, const float rebuild_factor)
+{
+  /* Tree must be balanced. */
+  lib_assert(tree->branch_num > 0 || tree->leaf_num == 0);
+
+  if (tree->refit == NULL) {
+    tree->refit = mem_calloc(sizeof(*tree->refit), __func__);
+  }
+  /* Branch num may differ after re-balancing. */
+  MEM_SAFE_FREE(tree->refit->dirty);
+  tree->refit->dirty = mem_malloc(
+      sizeof(BVHNode *) * (size_t)(tree->leaf_num + tree->branch_num), __func__);
+  tree->refit->rebuild_factor = rebuild_factor;
+
+  bvhtree_refit_reset(tree);
+  tree->refit->cost_initial = bvhtree_refit_cost(tree);
+}
+
+bool lib_bvhtree_update_tree_dirty(BVHTree *tree)
+{
+  BVHTreeRefit *refit = tree->refit;
+  if (refit == NULL) {
+    lib_bvhtree_update_tree(tree);
+    return false;
+  }
+  if (refit->dirty_num == 0) {
+    return false;
+  }
+
+  if ((float)refit->dirty_num > (float)tree->leaf_num * BVH_REFIT_DIRTY_FRACTION) {
+    lib_bvhtree_update_tree(tree);
+  }
+  else {
+    const int leafs_dirty_num = refit->dirty_num;
+    int depth_max = 0;
+
+    /* Tag the ancestors, stopping at branches already reached from another leaf.
+     * The branches are appended after the leafs. */
+    for (int i = 0; i < leafs_dirty_num; i++) {
+      refit->dirty[i]->flag &= (char)~BVH_NODE_DIRTY;
+      for (BVHNode *node = refit->dirty[i]->parent; node && !(node->flag & BVH_NODE_DIRTY);
+           node = node->parent)
+      {
+        node->flag |= BVH_NODE_DIRTY;
+        refit->dirty[refit->dirty_num++] = node;
+      }
+    }
+
+    BVHNode **branches = refit->dirty + leafs_dirty_num;
+    const int branches_num = refit->dirty_num - leafs_dirty_num;
+    int *depths = mem_malloc(sizeof(int) * (size_t)branches_num, __func__);
+    for (int i = 0; i < branches_num; i++) {
+      int depth = 0;
+      for (const BVHNode *node = branches[i]->parent; node; node = node->parent) {
+        depth++;
+      }
+      depths[i] = depth;
+      depth_max = max_ii(depth_max, depth);
+    }
+
+    /* Counting sort by depth, deepest level first. */
+    int *level_start = mem_calloc(sizeof(int) * (size_t)(depth_max + 2), __func__);
+    for (int i = 0; i < branches_num; i++) {
+      level_start[depth_max - depths[i] + 1]++;
+    }
+    for (int level = 0; level <= depth_max; level++) {
+      level_start[level + 1] += level_start[level];
+    }
+    BVHNode **levels = mem_malloc(sizeof(BVHNode *) * (size_t)branches_num, __func__);
+    int *level_fill = mem_malloc(sizeof(int) * (size_t)(depth_max + 1), __func__);
+    memcpy(level_fill, level_start, sizeof(int) * (size_t)(depth_max + 1));
+    for (int i = 0; i < branches_num; i++) {
+      levels[level_fill[depth_max - depths[i]]++] = branches[i];
+    }
+
+    float area_delta = 0.0f;
+    for (int level = 0; level <= depth_max; level++) {
+      const int level_len = level_start[level + 1] - level_start[level];
+      BVHRefitLevelData data = {tree, levels + level_start[level]};
+      /* Zeroed per level, every split of a threaded level starts from a copy of it. */
+      BVHRefitChunk chunk = {0.0f};
+
+      TaskParallelSettings settings;
+      lib_parallel_range_settings_defaults(&settings);
+      settings.use_threading = (level_len >= BVH_REFIT_LEVEL_MIN_THREADED);
+      settings.userdata_chunk = &chunk;
+      settings.userdata_chunk_size = sizeof(chunk);
+      settings.fn_reduce = bvhtree_refit_level_reduce;
+      lib_task_parallel_range(0, level_len, &data, bvhtree_refit_level_cb, &settings);
+      area_delta += chunk.area_delta;
+    }
+
+    if (tree->start_axis == 0) {
+      refit->area_sum += area_delta;
+    }
+    refit->dirty_num = 0;
+
+    MEM_freeN(depths);
+    MEM_freeN(level_start);
+    MEM_freeN(level_fill);
+    MEM_freeN(levels);
+
+    if (tree->nodewide) {
+      bvhtree_wide_refit(tree);
+    }
+  }
+
+  if (tree->start_axis != 0 || refit->cost_initial <= 0.0f) {
+    return false;
+  }
+  return bvhtree_refit_cost(tree) > refit->cost_initial * refit->rebuild_factor;
+}
+
+void lib_bvhtree_rebalance(BVHTree *tree)
+{
+  if (tree->leaf_num == 0) {
+    return;
+  }
+
+  /* Balancing may re-alloc the nodes, drop any pending tags first. */
+  if (tree->refit) {
+    tree->refit->dirty_num = 0;
+  }
+
+  /* Restore the leafs to insertion order, so the result matches a new tree. */
+  for (int i = 0; i < tree->leaf_num; i++) {
+    tree->nodes[i] = &tree->nodearray[i];
+    tree->nodes[i]->flag = 0;
+  }
+  for (int i = 0; i < tree->branch_num; i++) {
+    BVHNode *branch = &tree->nodearray[tree->leaf_num + i];
+    memset(branch->children, 0, sizeof(*branch->children) * (size_t)tree->tree_type);
+    branch->parent = NULL;
+    branch->node_num = 0;
+    branch->flag = 0;
+    tree->nodes[tree->leaf_num + i] = NULL;
+  }
+  tree->branch_num = 0;
+
+  if (tree->build_type == BVH_BUILD_SAH) {
+    lib_bvhtree_balance_sah(tree);
+  }
+  else {
+    lib_bvhtree_balance(tree);
+  }
+
+  if (tree->nodewide) {
+    lib_bvhtree_build_wide(tree);
+  }
+  if (tree->refit) {
+    lib_bvhtree_use_dirty_refit(tree, tree->refit->rebuild_factor);
+  }
 }
 int lib_bvhtree_get_len(const BVHTree *tree)
 {
@@ -1933,6 +2742,204 @@ int lib_bvhtree_ray_cast(const BVHTree *tree,
       tree, co, dir, radius, hit, cb, userdata, BVH_RAYCAST_DEFAULT);
 }
 
+/* lib_bvhtree_ray_cast_stream
+ *
+ * Casts many rays in parallel. When the tree has a wide layout
+ * (see lib_bvhtree_build_wide) each ray tests 4 child boxes at once,
+ * otherwise the regular dfs_raycast is used. */
+
+/* Enough for a depth of 64 wide nodes, deeper nodes fall back to dfs_raycast. */
+#define BVH_WIDE_STACK_SIZE 192
+
+/* Ray vs the child boxes of a wide node.
+ * Returns a bit-mask of the children hit, w the entry distances in r_dist. */
+static int bvhtree_wide_ray_test(const BVHRayCastData *data,
+                                 const BVHNodeWide *wnode,
+                                 float r_dist[BVH_WIDE_WIDTH])
+{
+  const int children_mask = (1 << wnode->children_num) - 1;
+  const float radius = data->ray.radius;
+
+#ifdef LIB_HAVE_SSE2
+  __m128 tnear = _mm_set1_ps(-FLT_MAX);
+  __m128 tfar = _mm_set1_ps(FLT_MAX);
+  for (int a = 0; a < 3; a++) {
+    /* 1 when the ray enters through the max side. */
+    const int flip = data->index[2 * a] - 2 * a;
+    const __m128 origin = _mm_set1_ps(data->ray.origin[a]);
+    const __m128 idot = _mm_set1_ps(data->idot_axis[a]);
+    const __m128 near_bound = _mm_add_ps(_mm_loadu_ps(wnode->bounds[a + 3 * flip]),
+                                         _mm_set1_ps(flip ? radius : -radius));
+    const __m128 far_bound = _mm_add_ps(_mm_loadu_ps(wnode->bounds[a + 3 * (1 - flip)]),
+                                        _mm_set1_ps(flip ? -radius : radius));
+    tnear = _mm_max_ps(tnear, _mm_mul_ps(_mm_sub_ps(near_bound, origin), idot));
+    tfar = _mm_min_ps(tfar, _mm_mul_ps(_mm_sub_ps(far_bound, origin), idot));
+  }
+  const __m128 hit_mask = _mm_and_ps(
+      _mm_and_ps(_mm_cmple_ps(tnear, tfar), _mm_cmpge_ps(tfar, _mm_setzero_ps())),
+      _mm_cmplt_ps(tnear, _mm_set1_ps(data->hit.dist)));
+  _mm_storeu_ps(r_dist, tnear);
+  return _mm_movemask_ps(hit_mask) & children_mask;
+#else
+  int mask = 0;
+  for (int k = 0; k < wnode->children_num; k++) {
+    float tnear = -FLT_MAX, tfar = FLT_MAX;
+    for (int a = 0; a < 3; a++) {
+      const int flip = data->index[2 * a] - 2 * a;
+      const float near_bound = wnode->bounds[a + 3 * flip][k] + (flip ? radius : -radius);
+      const float far_bound = wnode->bounds[a + 3 * (1 - flip)][k] + (flip ? -radius : radius);
+      tnear = max_ff(tnear, (near_bound - data->ray.origin[a]) * data->idot_axis[a]);
+      tfar = min_ff(tfar, (far_bound - data->ray.origin[a]) * data->idot_axis[a]);
+    }
+    r_dist[k] = tnear;
+    if (tnear <= tfar && tfar >= 0.0f && tnear < data->hit.dist) {
+      mask |= (1 << k);
+    }
+  }
+  return mask & children_mask;
+#endif
+}
+
+static void wide_raycast(BVHRayCastData *data)
+{
+  const BVHTree *tree = data->tree;
+  int stack[BVH_WIDE_STACK_SIZE];
+  float stack_dist[BVH_WIDE_STACK_SIZE];
+  int stack_len = 0;
+
+  stack[stack_len] = 0;
+  stack_dist[stack_len] = -FLT_MAX;
+  stack_len++;
+
+  while (stack_len) {
+    stack_len--;
+    if (stack_dist[stack_len] >= data->hit.dist) {
+      continue;
+    }
+    const BVHNodeWide *wnode = &tree->nodewide[stack[stack_len]];
+
+    float dist[BVH_WIDE_WIDTH];
+    int mask = bvhtree_wide_ray_test(data, wnode, dist);
+    if (mask == 0) {
+      continue;
+    }
+
+    /* Sort the hit children near to far. */
+    int order[BVH_WIDE_WIDTH];
+    int order_len = 0;
+    for (; mask; mask &= mask - 1) {
+      const int k = bitscan_forward_i(mask);
+      int j = order_len++;
+      for (; j > 0 && dist[order[j - 1]] > dist[k]; j--) {
+        order[j] = order[j - 1];
+      }
+      order[j] = k;
+    }
+
+    /* Leafs are handled right away, branches are pushed far to near. */
+    for (int i = 0; i < order_len; i++) {
+      const int k = order[i];
+      const BVHNode *src = wnode->src[k];
+      if (src->node_num != 0 || dist[k] >= data->hit.dist) {
+        continue;
+      }
+      if (data->cb) {
+        data->cb(data->userdata, src->index, &data->ray, &data->hit);
+      }
+      else {
+        data->hit.index = src->index;
+        data->hit.dist = dist[k];
+        madd_v3_v3v3fl(data->hit.co, data->ray.origin, data->ray.direction, dist[k]);
+      }
+    }
+    for (int i = order_len - 1; i >= 0; i--) {
+      const int k = order[i];
+      if (wnode->children[k] == -1) {
+        continue;
+      }
+      if (stack_len == BVH_WIDE_STACK_SIZE) {
+        dfs_raycast(data, (BVHNode *)wnode->src[k]);
+        continue;
+      }
+      stack[stack_len] = wnode->children[k];
+      stack_dist[stack_len] = dist[k];
+      stack_len++;
+    }
+  }
+}
+
+typedef struct BVHRayStreamData {
+  const BVHTree *tree;
+  const float (*origins)[3];
+  const float (*directions)[3];
+  float radius;
+  BVHTreeRayHit *hits;
+  BVHTreeRayCastCb cb;
+  void *userdata;
+  int flag;
+} BVHRayStreamData;
+
+static void bvhtree_ray_cast_stream_cb(void *__restrict userdata,
+                                       const int i,
+                                       const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  const BVHRayStreamData *stream = userdata;
+  const BVHTree *tree = stream->tree;
+  BVHRayCastData data;
+
+  LIB_ASSERT_UNIT_V3(stream->directions[i]);
+
+  data.tree = tree;
+  data.cb = stream->cb;
+  data.userdata = stream->userdata;
+
+  copy_v3_v3(data.ray.origin, stream->origins[i]);
+  copy_v3_v3(data.ray.direction, stream->directions[i]);
+  data.ray.radius = stream->radius;
+
+  bvhtree_ray_cast_data_precalc(&data, stream->flag);
+  memcpy(&data.hit, &stream->hits[i], sizeof(data.hit));
+
+  if (tree->nodewide) {
+    wide_raycast(&data);
+  }
+  else if (tree->nodes[tree->leaf_num]) {
+    dfs_raycast(&data, tree->nodes[tree->leaf_num]);
+  }
+
+  memcpy(&stream->hits[i], &data.hit, sizeof(data.hit));
+}
+
+void lib_bvhtree_ray_cast_stream(const BVHTree *tree,
+                                 const float (*origins)[3],
+                                 const float (*directions)[3],
+                                 const int rays_num,
+                                 const float radius,
+                                 BVHTreeRayHit *hits,
+                                 BVHTreeRayCastCb cb,
+                                 void *userdata,
+                                 const int flag)
+{
+  /* hits must be init'd by the caller (index -1, dist = max distance).
+   * Callbacks run from multiple threads. */
+  BVHRayStreamData stream = {
+      .tree = tree,
+      .origins = origins,
+      .directions = directions,
+      .radius = radius,
+      .hits = hits,
+      .cb = cb,
+      .userdata = userdata,
+      .flag = flag,
+  };
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (rays_num > 256);
+  settings.min_iter_per_thread = 64;
+  lib_task_parallel_range(0, rays_num, &stream, bvhtree_ray_cast_stream_cb, &settings);
+}
+
 float lib_bvhtree_bb_raycast(const float bv[6],
                              const float light_start[3],
                              const float light_end[3],
@@ -3,7 +3,11 @@
  * Mem arena's are commonly used when the program
  * needs to quickly alloc lots of little bits of data,
  * which are all freed at the same moment.
- * - Mem can't be freed during the arena's lifetime. */
+ * - Mem can't be freed during the arena's lifetime.
+ * - Alloc can be rolled back to a checkpoint.
+ * - Optionally bufs are retained across clear, to avoid malloc churn
+ *   for arenas that are filled and cleared repeatedly. */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,6 +15,8 @@
 
 #include "lib_asan.h"
 #include "lib_memarena.h"
+#include "lib_task.h"
+#include "lib_threads.h"
 #include "lib_strict_flags.h"
 #include "lib_utildefines.h"
 
@@ -25,6 +31,8 @@
 
 struct MemBuf {
   struct MemBuf *next;
+  /* Size of data in bytes. */
+  size_t size;
   uchar data[0];
 };
 
@@ -37,8 +45,84 @@ struct MemArena {
   size_t align;
 
   bool use_calloc;
+
+  /* Bufs kept for reuse after clear or rollback, largest first. */
+  struct MemBuf *bufs_retained;
+  size_t retained_size;
+  /* Max bytes to retain, zero disables retaining. */
+  size_t retain_size;
+
+  /* Bytes handed out since the last clear and their high-water mark. */
+  size_t used, used_peak;
 };
 
+/* Print peak usage per arena name with lib_memarena_peak_print. */
+// #define USE_MEMARENA_PEAK_PRINT
+
+/* Peak usage per arena name, updated when arenas are freed. */
+#define MEMARENA_PEAK_NAMES_MAX 128
+
+static struct {
+  const char *name;
+  size_t peak;
+} memarena_peaks[MEMARENA_PEAK_NAMES_MAX];
+static int memarena_peaks_len = 0;
+static ThreadMutex memarena_peaks_mutex = LIB_MUTEX_INITIALIZER;
+
+static void memarena_peak_report(MemArena *ma)
+{
+  if (ma->used_peak == 0 || ma->name == NULL) {
+    return;
+  }
+
+  lib_mutex_lock(&memarena_peaks_mutex);
+  int i;
+  for (i = 0; i < memarena_peaks_len; i++) {
+    if (STREQ(memarena_peaks[i].name, ma->name)) {
+      break;
+    }
+  }
+  if (i == memarena_peaks_len) {
+    if (memarena_peaks_len == MEMARENA_PEAK_NAMES_MAX) {
+      lib_mutex_unlock(&memarena_peaks_mutex);
+      return;
+    }
+    memarena_peaks[i].name = ma->name;
+    memarena_peaks[i].peak = 0;
+    memarena_peaks_len++;
+  }
+  memarena_peaks[i].peak = MAX2(memarena_peaks[i].peak, ma->used_peak);
+  lib_mutex_unlock(&memarena_peaks_mutex);
+
+  ma->used_peak = 0;
+}
+
+size_t lib_memarena_peak_get(const char *name)
+{
+  size_t peak = 0;
+  lib_mutex_lock(&memarena_peaks_mutex);
+  for (int i = 0; i < memarena_peaks_len; i++) {
+    if (STREQ(memarena_peaks[i].name, name)) {
+      peak = memarena_peaks[i].peak;
+      break;
+    }
+  }
+  lib_mutex_unlock(&memarena_peaks_mutex);
+  return peak;
+}
+
+#ifdef USE_MEMARENA_PEAK_PRINT
+void lib_memarena_peak_print(void)
+{
+  lib_mutex_lock(&memarena_peaks_mutex);
+  printf("MemArena peak usage:\n");
+  for (int i = 0; i < memarena_peaks_len; i++) {
+    printf("  %s: %zu bytes\n", memarena_peaks[i].name, memarena_peaks[i].peak);
+  }
+  lib_mutex_unlock(&memarena_peaks_mutex);
+}
+#endif
+
 static void memarena_buf_free_all(struct MemBuf *mb)
 {
   while (mb != NULL) {
@@ -82,9 +166,28 @@ void lib_memarena_use_align(MemArena *ma, const size_t align)
   ma->align = align;
 }
 
+void lib_memarena_use_retain(MemArena *ma, const size_t retain_size)
+{
+  ma->retain_size = retain_size;
+  if (ma->retained_size > retain_size) {
+    /* Drop everything, simpler than trimming and rarely needed. */
+    memarena_buf_free_all(ma->bufs_retained);
+    ma->bufs_retained = NULL;
+    ma->retained_size = 0;
+  }
+}
+
+size_t lib_memarena_used_peak(const MemArena *ma)
+{
+  return ma->used_peak;
+}
+
 void lib_memarena_free(MemArena *ma)
 {
+  memarena_peak_report(ma);
+
   memarena_buf_free_all(ma->bufs);
+  memarena_buf_free_all(ma->bufs_retained);
 
   VALGRIND_DESTROY_MEMPOOL(ma);
 
@@ -94,6 +197,60 @@ void lib_memarena_free(MemArena *ma)
 /* Pad num up by amt (must be power of two). */
 #define PADUP(num, amt) (((num) + ((amt)-1)) & ~((amt)-1))
 
+/* Keep mb for reuse when it fits in the retain budget, otherwise free it.
+ * Retained bufs are sorted by size so the smallest are dropped first. */
+static void memarena_buf_release(MemArena *ma, struct MemBuf *mb)
+{
+  if (mb->size > ma->retain_size) {
+    lib_asan_unpoison(mb, (uint)mem_alloc_len(mb));
+    mem_free(mb);
+    return;
+  }
+
+  if (ma->use_calloc) {
+    lib_asan_unpoison(mb->data, mb->size);
+    memset(mb->data, 0, mb->size);
+  }
+  lib_asan_poison(mb->data, mb->size);
+
+  struct MemBuf **mb_link = &ma->bufs_retained;
+  while (*mb_link && (*mb_link)->size >= mb->size) {
+    mb_link = &(*mb_link)->next;
+  }
+  mb->next = *mb_link;
+  *mb_link = mb;
+  ma->retained_size += mb->size;
+
+  while (ma->retained_size > ma->retain_size) {
+    /* Drop the smallest. */
+    mb_link = &ma->bufs_retained;
+    while ((*mb_link)->next) {
+      mb_link = &(*mb_link)->next;
+    }
+    ma->retained_size -= (*mb_link)->size;
+    memarena_buf_free_all(*mb_link);
+    *mb_link = NULL;
+  }
+}
+
+/* Take the smallest retained buf that holds at least size bytes. */
+static struct MemBuf *memarena_buf_retained_pop(MemArena *ma, const size_t size)
+{
+  struct MemBuf **mb_link_best = NULL;
+  for (struct MemBuf **mb_link = &ma->bufs_retained; *mb_link && (*mb_link)->size >= size;
+       mb_link = &(*mb_link)->next)
+  {
+    mb_link_best = mb_link;
+  }
+  if (mb_link_best == NULL) {
+    return NULL;
+  }
+  struct MemBuf *mb = *mb_link_best;
+  *mb_link_best = mb->next;
+  ma->retained_size -= mb->size;
+  return mb;
+}
+
 /* Align alloc'd mem (needed if `align > 8`). */
 static void memarena_curbuf_align(MemArena *ma)
 {
@@ -119,8 +276,14 @@ void *lib_memarena_alloc(MemArena *ma, size_t size)
       ma->cursize = ma->bufsize;
     }
 
-    struct MemBuf *mb = (ma->use_calloc ? MEM_callocN : MEM_mallocN)(sizeof(*mb) + ma->cursize,
-                                                                     ma->name);
+    struct MemBuf *mb = memarena_buf_retained_pop(ma, ma->cursize);
+    if (mb) {
+      ma->cursize = mb->size;
+    }
+    else {
+      mb = (ma->use_calloc ? MEM_callocN : MEM_mallocN)(sizeof(*mb) + ma->cursize, ma->name);
+      mb->size = ma->cursize;
+    }
     ma->curbuf = mb->data;
     mb->next = ma->bufs;
     ma->bufs = mb;
@@ -134,6 +297,11 @@ void *lib_memarena_alloc(MemArena *ma, size_t size)
   ma->curbuf += size;
   ma->cursize -= size;
 
+  ma->used += size;
+  if (ma->used > ma->used_peak) {
+    ma->used_peak = ma->used;
+  }
+
   VALGRIND_MEMPOOL_ALLOC(ma, ptr, size);
 
   lib_asan_unpoison(ptr, size);
@@ -189,9 +357,13 @@ void lib_memarena_merge(MemArena *ma_dst, MemArena *ma_src)
     ma_dst->bufs->next = ma_src->bufs;
   }
 
+  ma_dst->used += ma_src->used;
+  ma_dst->used_peak = MAX2(ma_dst->used_peak, ma_dst->used);
+
   ma_src->bufs = NULL;
   ma_src->curbuf = NULL;
   ma_src->cursize = 0;
+  ma_src->used = 0;
 
   VALGRIND_MOVE_MEMPOOL(ma_src, ma_dst);
   VALGRIND_CREATE_MEMPOOL(ma_src, 0, false);
@@ -199,12 +371,25 @@ void lib_memarena_merge(MemArena *ma_dst, MemArena *ma_src)
 
 void lib_memarena_clear(MemArena *ma)
 {
+  /* The peak is kept until the arena is freed, reporting it here would serialize
+   * arenas cleared per item on the global lock. */
+  ma->used = 0;
+
   if (ma->bufs) {
     uchar *curbuf_prev;
     size_t curbuf_used;
 
     if (ma->bufs->next) {
-      memarena_buf_free_all(ma->bufs->next);
+      if (ma->retain_size) {
+        struct MemBuf *mb_next;
+        for (struct MemBuf *mb = ma->bufs->next; mb; mb = mb_next) {
+          mb_next = mb->next;
+          memarena_buf_release(ma, mb);
+        }
+      }
+      else {
+        memarena_buf_free_all(ma->bufs->next);
+      }
       ma->bufs->next = NULL;
     }
 
@@ -225,3 +410,123 @@ void lib_memarena_clear(MemArena *ma)
   VALGRIND_DESTROY_MEMPOOL(ma);
   VALGRIND_CREATE_MEMPOOL(ma, 0, false);
 }
+
+void lib_memarena_checkpoint(const MemArena *ma, MemArenaCheckpoint *r_checkpoint)
+{
+  r_checkpoint->buf = ma->bufs;
+  r_checkpoint->curbuf = ma->curbuf;
+  r_checkpoint->cursize = ma->cursize;
+  r_checkpoint->used = ma->used;
+}
+
+void lib_memarena_rollback(MemArena *ma, const MemArenaCheckpoint *checkpoint)
+{
+  /* Bufs added after the checkpoint. The checkpoint is invalid after merging
+   * into or clearing the arena, since the buf it refers to may be gone. */
+  while (ma->bufs != checkpoint->buf) {
+    lib_assert(ma->bufs != NULL);
+    struct MemBuf *mb = ma->bufs;
+    ma->bufs = mb->next;
+    memarena_buf_release(ma, mb);
+  }
+
+  if (checkpoint->buf) {
+    if (ma->use_calloc) {
+      /* When newer bufs were added, the rest of the checkpoint buf may be in use. */
+      const uchar *curbuf_end = (ma->curbuf >= checkpoint->buf->data &&
+                                 ma->curbuf <= checkpoint->curbuf + checkpoint->cursize) ?
+                                    ma->curbuf :
+                                    checkpoint->curbuf + checkpoint->cursize;
+      memset(checkpoint->curbuf, 0, (size_t)(curbuf_end - checkpoint->curbuf));
+    }
+    ma->curbuf = checkpoint->curbuf;
+    ma->cursize = checkpoint->cursize;
+    lib_asan_poison(ma->curbuf, ma->cursize);
+  }
+  else {
+    ma->curbuf = NULL;
+    ma->cursize = 0;
+  }
+  ma->used = checkpoint->used;
+}
+
+/* Arena Set
+ * One arena per thread, for parallel tasks that alloc into arenas
+ * which are merged or cleared together afterwards. Arenas are created
+ * on first use, the per-thread slot comes from lib_task_parallel_thread_id. */
+
+struct MemArenaSet {
+  MemArena *arenas[DUNE_MAX_THREADS];
+  const char *name;
+  size_t bufsize;
+  size_t align;
+  size_t retain_size;
+  bool use_calloc;
+};
+
+MemArenaSet *lib_memarena_set_new(const size_t bufsize, const char *name)
+{
+  MemArenaSet *set = mem_calloc(sizeof(*set), "memarena set");
+  set->name = name;
+  set->bufsize = bufsize;
+  set->align = 8;
+  return set;
+}
+
+void lib_memarena_set_use_calloc(MemArenaSet *set)
+{
+  set->use_calloc = true;
+}
+
+void lib_memarena_set_use_align(MemArenaSet *set, const size_t align)
+{
+  lib_assert((align & (align - 1)) == 0);
+  set->align = align;
+}
+
+void lib_memarena_set_use_retain(MemArenaSet *set, const size_t retain_size)
+{
+  set->retain_size = retain_size;
+}
+
+MemArena *lib_memarena_set_get(MemArenaSet *set, const TaskParallelTLS *tls)
+{
+  const int thread_id = lib_task_parallel_thread_id(tls);
+  MemArena *ma = set->arenas[thread_id];
+  if (UNLIKELY(ma == NULL)) {
+    ma = lib_memarena_new(set->bufsize, set->name);
+    ma->align = set->align;
+    ma->use_calloc = set->use_calloc;
+    ma->retain_size = set->retain_size;
+    set->arenas[thread_id] = ma;
+  }
+  return ma;
+}
+
+void lib_memarena_set_merge(MemArenaSet *set, MemArena *ma_dst)
+{
+  for (int i = 0; i < DUNE_MAX_THREADS; i++) {
+    if (set->arenas[i] && set->arenas[i] != ma_dst) {
+      lib_memarena_merge(ma_dst, set->arenas[i]);
+    }
+  }
+}
+
+void lib_memarena_set_clear(MemArenaSet *set)
+{
+  for (int i = 0; i < DUNE_MAX_THREADS; i++) {
+    if (set->arenas[i]) {
+      lib_memarena_clear(set->arenas[i]);
+    }
+  }
+}
+
+void lib_memarena_set_free(MemArenaSet *set)
+{
+  for (int i = 0; i < DUNE_MAX_THREADS; i++) {
+    if (set->arenas[i]) {
+      lib_memarena_free(set->arenas[i]);
+    }
+  }
+  mem_free(set);
+}
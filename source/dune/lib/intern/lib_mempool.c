@@ -13,9 +13,7 @@
 #include "lib_mempool.h"         /* own include */
 #include "lib_mempool_private.h" /* own include */
 
-#ifdef WITH_ASAN
-#  include "lib_threads.h"
-#endif
+#include "lib_threads.h"
 
 #include "mem_guardedalloc.h"
 #include "lib_strict_flags.h" /* keep last */
@@ -62,6 +60,14 @@
 /* optimize pool size */
 #define USE_CHUNK_POW2
 
+/* Internal flag for pools created w lib_mempool_create_concurrent,
+ * kept out of the range of the public LIB_MEMPOOL_* flags. */
+#define MEMPOOL_FLAG_CONCURRENT (1u << 31)
+
+/* Concurrent pools find the chunk of an elem by masking its address, so chunks
+ * are alloc aligned to their size. Keep them small enough for aligned alloc. */
+#define MEMPOOL_CONCURRENT_CHUNK_SIZE_MAX 16384
+
 #ifndef NDEBUG
 static bool mempool_debug_memset = false;
 #endif
@@ -79,8 +85,28 @@ typedef struct LibFreeNode {
  * lib_mempool.chunks as a double linked list. */
 typedef struct LibMempoolChunk {
   struct LibMempoolChunk *next;
+  /* Magazine that hands out the elems of this chunk, concurrent pools only. */
+  struct LibMempoolMagazine *owner;
 } LibMempoolChunk;
 
+/* Per-thread cache of free elems for concurrent pools.
+ * Only the thread that acquired the magazine allocs from it and pushes to
+ * its local free list. Other threads return elems of chunks owned by this
+ * magazine through remote_free, a lock-free stack drained in one go by the
+ * owner once its local list runs empty, so it has no ABA problem. */
+typedef struct LibMempoolMagazine {
+  struct LibMempoolMagazine *next;
+  LibMempool *pool;
+  /* Local free list, owner thread only. */
+  LibFreenode *free;
+  /* Elems freed by other threads. */
+  LibFreenode *volatile remote_free;
+  /* Allocs minus frees done through this magazine, may be negative
+   * when elems are freed on another thread than the one that alloc'd them. */
+  int totused;
+  bool in_use;
+} LibMempoolMagazine;
+
 /* The mempool, stores and tracks mem chunks and elements within those chunks free. */
 struct LibMempool {
 #ifdef WITH_ASAN
@@ -105,12 +131,21 @@ struct LibMempool {
   LibFreenode *free;
   /* Use to know how many chunks to keep for #BLI_mempool_clear. */
   uint maxchunks;
-  /* Num of elems currently in use. */
+  /* Num of elems currently in use. Concurrent pools count per magazine instead,
+   * use lib_mempool_len for the total. */
   uint totused;
 #ifdef USE_TOTALLOC
   /* Num of elems alloc in total. */
   uint totalloc;
 #endif
+
+  /* Concurrent pools only. */
+  /* Protects the chunk list and the magazine list. */
+  ThreadMutex *concurrent_mutex;
+  /* All magazines created for this pool, freed w the pool. */
+  LibMempoolMagazine *magazines;
+  /* Alignment of chunk allocs, power of 2. */
+  uint chunk_align;
 };
 
 #define MEMPOOL_ELEM_SIZE_MIN (sizeof(void *) * 2)
@@ -172,6 +207,10 @@ LIB_INLINE uint mempool_maxchunks(const uint elem_num, const uint pchunk)
 
 static LibMempoolChunk *mempool_chunk_alloc(LibMempool *pool)
 {
+  if (pool->flag & MEMPOOL_FLAG_CONCURRENT) {
+    return mem_malloc_aligned(
+        sizeof(LibMempoolChunk) + (size_t)pool->csize, pool->chunk_align, "mempool chunk");
+  }
   return mem_malloc(sizeof(LibMempoolChunk) + (size_t)pool->csize, "mempool chunk");
 }
 
@@ -199,6 +238,7 @@ static LibFreenode *mempool_chunk_add(LibMempool *pool,
   }
 
   mpchunk->next = NULL;
+  mpchunk->owner = NULL;
   pool->chunk_tail = mpchunk;
 
   if (UNLIKELY(pool->free == NULL)) {
@@ -334,6 +374,11 @@ LibMempool *lib_mempool_create(uint esize, uint elem_num, uint pchunk, uint flag
 
   esize += POISON_REDZONE_SIZE;
 
+  if (flag & MEMPOOL_FLAG_CONCURRENT) {
+    lib_assert(esize < MEMPOOL_CONCURRENT_CHUNK_SIZE_MAX / 2);
+    pchunk = MIN2(pchunk, MAX2(1u, (MEMPOOL_CONCURRENT_CHUNK_SIZE_MAX / 2) / esize));
+  }
+
   maxchunks = mempool_maxchunks(elem_num, pchunk);
 
   pool->chunks = NULL;
@@ -366,6 +411,14 @@ LibMempool *lib_mempool_create(uint esize, uint elem_num, uint pchunk, uint flag
   pool->totalloc = 0;
 #endif
   pool->totused = 0;
+  pool->concurrent_mutex = NULL;
+  pool->magazines = NULL;
+  pool->chunk_align = 0;
+
+  if (flag & MEMPOOL_FLAG_CONCURRENT) {
+    pool->concurrent_mutex = lib_mutex_alloc();
+    pool->chunk_align = power_of_2_max_u((uint)sizeof(LibMempoolChunk) + pool->csize);
+  }
 
   if (elem_num) {
     /* Alloc the actual chunks. */
@@ -386,6 +439,9 @@ void *lib_mempool_alloc(LibMempool *pool)
 {
   LibFreenode *free_pop;
 
+  lib_assert_msg((pool->flag & MEMPOOL_FLAG_CONCURRENT) == 0,
+                 "Concurrent pools alloc through lib_mempool_magazine_alloc");
+
   if (UNLIKELY(pool->free == NULL)) {
     /* Need to alloc a new chunk. */
     LibMempoolChunk *mpchunk = mempool_chunk_alloc(pool);
@@ -423,6 +479,44 @@ void *lib_mempool_alloc(LibMempool *pool)
   return (void *)free_pop;
 }
 
+/* Alloc chunks ahead of time, so that the next elem_num allocs don't need to,
+ * useful when the num of elems to add is known (bulk conversions e.g.). */
+void lib_mempool_reserve(LibMempool *pool, const uint elem_num)
+{
+  LibFreenode *free_old = pool->free;
+  LibFreenode *last_tail = NULL;
+  uint elem_free = 0;
+
+  lib_assert_msg((pool->flag & MEMPOOL_FLAG_CONCURRENT) == 0,
+                 "Concurrent pools alloc chunks on demand, per magazine");
+
+  for (LibMempoolChunk *mpchunk = pool->chunks; mpchunk; mpchunk = mpchunk->next) {
+    elem_free += pool->pchunk;
+  }
+  elem_free -= pool->totused;
+  if (elem_free >= elem_num) {
+    return;
+  }
+
+  const uint maxchunks = mempool_maxchunks(elem_num - elem_free, pool->pchunk);
+  pool->free = NULL; /* mempool_chunk_add assigns */
+  for (uint i = 0; i < maxchunks; i++) {
+    LibMempoolChunk *mpchunk = mempool_chunk_alloc(pool);
+    last_tail = mempool_chunk_add(pool, mpchunk, last_tail);
+  }
+
+  /* Elems freed before are used once the reserved ones run out. */
+  lib_asan_unpoison(last_tail, pool->esize - POISON_REDZONE_SIZE);
+#ifdef WITH_MEM_VALGRIND
+  VALGRIND_MAKE_MEM_DEFINED(last_tail, pool->esize - POISON_REDZONE_SIZE);
+#endif
+  last_tail->next = free_old;
+  lib_asan_poison(last_tail, pool->esize);
+#ifdef WITH_MEM_VALGRIND
+  VALGRIND_MAKE_MEM_UNDEFINED(last_tail, pool->esize);
+#endif
+}
+
 void *lib_mempool_calloc(LibMempool *pool)
 {
   void *retval = lib_mempool_alloc(pool);
@@ -438,6 +532,9 @@ void lib_mempool_free(LibMempool *pool, void *addr)
 {
   LibFreenode *newhead = addr;
 
+  lib_assert_msg((pool->flag & MEMPOOL_FLAG_CONCURRENT) == 0,
+                 "Concurrent pools free through lib_mempool_magazine_free");
+
 #ifndef NDEBUG
   {
     LibMempool_chunk *chunk;
@@ -530,6 +627,12 @@ int lib_mempool_len(const LibMempool *pool)
 {
   int ret = (int)pool->totused;
 
+  /* Concurrent pools count per magazine (pool->totused stays 0),
+   * so the total is only exact while no thread allocs or frees. */
+  for (const LibMempoolMagazine *mag = pool->magazines; mag; mag = mag->next) {
+    ret += mag->totused;
+  }
+
   return ret;
 }
 
@@ -539,7 +642,7 @@ void *lib_mempool_findelem(LibMempool *pool, uint index)
 
   lib_assert(pool->flag & LIB_MEMPOOL_ALLOW_ITER);
 
-  if (index < (uint)pool->totused) {
+  if (index < (uint)lib_mempool_len(pool)) {
     /* We could have some faster mem chunk stepping code inline. */
     LibMempoolIter iter;
     void *elem;
@@ -570,12 +673,12 @@ void lib_mempool_as_table(LibMempool *pool, void **data)
     *p++ = elem;
   }
 
-  lib_assert((ptrdiff_t)(p - data) == (ptrdiff_t)pool->totused);
+  lib_assert((ptrdiff_t)(p - data) == (ptrdiff_t)lib_mempool_len(pool));
 }
 
 void **lib_mempool_as_tableN(LibMempool *pool, const char *allocstr)
 {
-  void **data = mem_malloc((size_t)pool->totused * sizeof(void *), allocstr);
+  void **data = mem_malloc((size_t)lib_mempool_len(pool) * sizeof(void *), allocstr);
   lib_mempool_as_table(pool, data);
   return data;
 }
@@ -599,7 +702,7 @@ void lib_mempool_as_array(LibMempool *pool, void *data)
 
 void *lib_mempool_as_array(Mempool *pool, const char *allocstr)
 {
-  char *data = mem_malloc_array((size_t)pool->totused, pool->esize, allocstr);
+  char *data = mem_malloc_array((size_t)lib_mempool_len(pool), pool->esize, allocstr);
   lib_mempool_as_array(pool, data);
   return data;
 }
@@ -816,6 +919,185 @@ void *mempool_iter_threadsafe_step(MempoolThreadsafeIter *ts_iter)
 
 #endif
 
+/* Concurrent Pools
+ *
+ * Threads alloc and free through a magazine acquired from the pool, so the
+ * common case touches no shared state. A magazine that runs empty first takes
+ * the elems other threads returned to it, then claims a whole new chunk, which
+ * is the only step that locks the pool. */
+
+LibMempool *lib_mempool_create_concurrent(uint esize, uint pchunk, uint flag)
+{
+  return lib_mempool_create(esize, 0, pchunk, flag | MEMPOOL_FLAG_CONCURRENT);
+}
+
+LibMempoolMagazine *lib_mempool_magazine_acquire(LibMempool *pool)
+{
+  lib_assert(pool->flag & MEMPOOL_FLAG_CONCURRENT);
+
+  lib_mutex_lock(pool->concurrent_mutex);
+  LibMempoolMagazine *mag;
+  for (mag = pool->magazines; mag; mag = mag->next) {
+    if (!mag->in_use) {
+      break;
+    }
+  }
+  if (mag == NULL) {
+    mag = mem_calloc(sizeof(*mag), "mempool magazine");
+    mag->pool = pool;
+    mag->next = pool->magazines;
+    pool->magazines = mag;
+  }
+  mag->in_use = true;
+  lib_mutex_unlock(pool->concurrent_mutex);
+
+  return mag;
+}
+
+void lib_mempool_magazine_release(LibMempoolMagazine *mag)
+{
+  LibMempool *pool = mag->pool;
+
+  /* Free elems stay in the magazine, the next thread to acquire it reuses them. */
+  lib_mutex_lock(pool->concurrent_mutex);
+  mag->in_use = false;
+  lib_mutex_unlock(pool->concurrent_mutex);
+}
+
+LIB_INLINE LibMempoolChunk *mempool_concurrent_chunk_from_elem(const LibMempool *pool, void *addr)
+{
+  return (LibMempoolChunk *)((uintptr_t)addr & ~((uintptr_t)pool->chunk_align - 1));
+}
+
+/* Claim a new chunk for mag, returns the head of its free list. */
+static LibFreenode *mempool_magazine_chunk_claim(LibMempoolMagazine *mag)
+{
+  LibMempool *pool = mag->pool;
+  const uint esize = pool->esize;
+  LibMempoolChunk *mpchunk = mempool_chunk_alloc(pool);
+  LibFreenode *head = CHUNK_DATA(mpchunk);
+  LibFreenode *curnode = head;
+
+  lib_assert(mempool_concurrent_chunk_from_elem(pool, head) == mpchunk);
+
+  mpchunk->next = NULL;
+  mpchunk->owner = mag;
+
+  /* Building the free list is done outside the lock. */
+  for (uint j = pool->pchunk; j--;) {
+    LibFreenode *next = (j != 0) ? NODE_STEP_NEXT(curnode) : NULL;
+    lib_asan_unpoison(curnode, esize - POISON_REDZONE_SIZE);
+    curnode->next = next;
+    if (pool->flag & LIB_MEMPOOL_ALLOW_ITER) {
+      curnode->freeword = FREEWORD;
+    }
+    lib_asan_poison(curnode, esize);
+    curnode = next;
+  }
+
+  lib_mutex_lock(pool->concurrent_mutex);
+  if (pool->chunk_tail) {
+    pool->chunk_tail->next = mpchunk;
+  }
+  else {
+    pool->chunks = mpchunk;
+  }
+  pool->chunk_tail = mpchunk;
+#ifdef USE_TOTALLOC
+  pool->totalloc += pool->pchunk;
+#endif
+  lib_mutex_unlock(pool->concurrent_mutex);
+
+  return head;
+}
+
+static void mempool_magazine_refill(LibMempoolMagazine *mag)
+{
+  /* Take all remotely freed elems at once. */
+  LibFreenode *remote;
+  do {
+    remote = mag->remote_free;
+  } while (remote && atomic_cas_ptr((void **)&mag->remote_free, remote, NULL) != remote);
+
+  mag->free = remote ? remote : mempool_magazine_chunk_claim(mag);
+}
+
+void *lib_mempool_magazine_alloc(LibMempoolMagazine *mag)
+{
+  if (UNLIKELY(mag->free == NULL)) {
+    mempool_magazine_refill(mag);
+  }
+
+  LibFreenode *free_pop = mag->free;
+  lib_asan_unpoison(free_pop, mag->pool->esize - POISON_REDZONE_SIZE);
+
+  if (mag->pool->flag & LIB_MEMPOOL_ALLOW_ITER) {
+    free_pop->freeword = USEDWORD;
+  }
+
+  mag->free = free_pop->next;
+  mag->totused++;
+
+  return (void *)free_pop;
+}
+
+void *lib_mempool_magazine_calloc(LibMempoolMagazine *mag)
+{
+  void *retval = lib_mempool_magazine_alloc(mag);
+
+  memset(retval, 0, (size_t)mag->pool->esize - POISON_REDZONE_SIZE);
+
+  return retval;
+}
+
+void lib_mempool_magazine_free(LibMempoolMagazine *mag, void *addr)
+{
+  LibMempool *pool = mag->pool;
+  LibFreenode *newhead = addr;
+  LibMempoolMagazine *owner = mempool_concurrent_chunk_from_elem(pool, addr)->owner;
+
+  lib_assert(owner && owner->pool == pool);
+
+  if (pool->flag & LIB_MEMPOOL_ALLOW_ITER) {
+    /* This will detect double free's. */
+    lib_assert(newhead->freeword != FREEWORD);
+    newhead->freeword = FREEWORD;
+  }
+
+  mag->totused--;
+
+  if (owner == mag) {
+    newhead->next = mag->free;
+    mag->free = newhead;
+  }
+  else {
+    LibFreenode *head;
+    do {
+      head = owner->remote_free;
+      newhead->next = head;
+    } while (atomic_cas_ptr((void **)&owner->remote_free, head, newhead) != head);
+  }
+
+  lib_asan_poison(newhead, pool->esize);
+}
+
+static void mempool_concurrent_clear(LibMempool *pool)
+{
+  mempool_chunk_free_all(pool->chunks, pool);
+  pool->chunks = NULL;
+  pool->chunk_tail = NULL;
+  pool->totused = 0;
+#ifdef USE_TOTALLOC
+  pool->totalloc = 0;
+#endif
+
+  for (LibMempoolMagazine *mag = pool->magazines; mag; mag = mag->next) {
+    mag->free = NULL;
+    mag->remote_free = NULL;
+    mag->totused = 0;
+  }
+}
+
 void lib_mempool_clear_ex(LibMempool *pool, const int elem_num_reserve)
 {
   BLI_mempool_chunk *mpchunk;
@@ -830,6 +1112,12 @@ void lib_mempool_clear_ex(LibMempool *pool, const int elem_num_reserve)
   VALGRIND_CREATE_MEMPOOL(pool, 0, false);
 #endif
 
+  if (pool->flag & MEMPOOL_FLAG_CONCURRENT) {
+    /* Chunks are handed to magazines on demand, so nothing is reserved. */
+    mempool_concurrent_clear(pool);
+    return;
+  }
+
   if (elem_num_reserve == -1) {
     maxchunks = pool->maxchunks;
   }
@@ -877,6 +1165,15 @@ void lib_mempool_destroy(LibMempool *pool)
 {
   mempool_chunk_free_all(pool->chunks, pool);
 
+  if (pool->flag & MEMPOOL_FLAG_CONCURRENT) {
+    LibMempoolMagazine *mag_next;
+    for (LibMempoolMagazine *mag = pool->magazines; mag; mag = mag_next) {
+      mag_next = mag->next;
+      mem_free(mag);
+    }
+    lib_mutex_free(pool->concurrent_mutex);
+  }
+
 #ifdef WITH_MEM_VALGRIND
   VALGRIND_DESTROY_MEMPOOL(pool);
 #endif
@@ -1,6 +1,7 @@
 #include "lib_mmap.h"
 #include "lib_fileops.h"
 #include "lib_list.h"
+#include "lib_utildefines.h"
 #include "mem_guardedalloc.h"
 
 #include <string.h>
@@ -202,6 +203,57 @@ void *lib_mmap_get_ptr(MmapFile *file)
   return file->mem;
 }
 
+const void *lib_mmap_get_ptr_range(MmapFile *file, size_t offset, size_t length)
+{
+  if (file->io_error || (offset + length > file->length)) {
+    return NULL;
+  }
+  return file->mem + offset;
+}
+
+bool lib_mmap_any_io_error(const MmapFile *file)
+{
+  return file->io_error;
+}
+
+void lib_mmap_advise(MmapFile *file, size_t offset, size_t length, eLibMmapAdvice advice)
+{
+  if (offset >= file->length) {
+    return;
+  }
+  length = MIN2(length, file->length - offset);
+
+#ifndef WIN32
+  /* madvise needs a page aligned address. */
+  const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t offset_aligned = offset - (offset % page_size);
+  length += offset - offset_aligned;
+
+  int posix_advice = MADV_NORMAL;
+  switch (advice) {
+    case LIB_MMAP_ADVICE_NORMAL:
+      posix_advice = MADV_NORMAL;
+      break;
+    case LIB_MMAP_ADVICE_RANDOM:
+      posix_advice = MADV_RANDOM;
+      break;
+    case LIB_MMAP_ADVICE_SEQUENTIAL:
+      posix_advice = MADV_SEQUENTIAL;
+      break;
+    case LIB_MMAP_ADVICE_WILLNEED:
+      posix_advice = MADV_WILLNEED;
+      break;
+  }
+  /* Only a hint, failing is harmless. */
+  madvise(file->mem + offset_aligned, length, posix_advice);
+#else
+  if (advice == LIB_MMAP_ADVICE_WILLNEED) {
+    WIN32_MEMORY_RANGE_ENTRY range = {file->mem + offset, length};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  }
+#endif
+}
+
 size_t lib_mmap_get_length(const MmapFile *file)
 {
   return file->length;
@@ -28,6 +28,8 @@
 
 #  include "lib_mesh_bool.hh"
 
+#  include "mesh_intersect_private.hh"
+
 #  ifdef WITH_TBB
 #    include <tbb/parallel_reduce.h>
 #    include <tbb/spin_mutex.h>
@@ -851,6 +853,36 @@ static const Vert *find_flap_vert(const Face &tri, const Edge e, bool *r_rev)
   return flapv;
 }
 
+/**
+ * Same as `orient3d` on the exact coords of a, b, c, d, but try first w double arithmetic.
+ * The double coords have at most one rounding error, so the error bound for the plane side test
+ * in mesh_intersect.cc (Burnikel et al.) applies: the normal is constructed from the coords
+ * and the sign of the final dot product is certain when its abs is above the bound
+ * given by #index_plane_side.
+ */
+static int filtered_orient3d(const Vert *a, const Vert *b, const Vert *c, const Vert *d)
+{
+  /* A vert of the triangle is exactly on its plane. Verts are de-duplicated by the arena. */
+  if (ELEM(d, a, b, c)) {
+    return 0;
+  }
+  const double3 n = math::cross(b->co - a->co, c->co - a->co);
+  /* `orient3d(a, b, c, d)` is positive when d is below the plane of the ccw a, b, c. */
+  const double side = -math::dot(d->co - a->co, n);
+  const double3 abs_a = math::abs(a->co);
+  const double3 ab = math::abs(b->co) + abs_a;
+  const double3 ac = math::abs(c->co) + abs_a;
+  const double3 sup_n(ab[1] * ac[2] + ab[2] * ac[1],
+                      ab[2] * ac[0] + ab[0] * ac[2],
+                      ab[0] * ac[1] + ab[1] * ac[0]);
+  const double err_bound = math::dot(math::abs(d->co) + abs_a, sup_n) * index_plane_side *
+                           DBL_EPSILON;
+  if (fabs(side) > err_bound) {
+    return side > 0 ? 1 : -1;
+  }
+  return orient3d(a->co_exact, b->co_exact, c->co_exact, d->co_exact);
+}
+
 /* Triangle tri and tri0 share edge e.
  * Classify tri with respect to tri0 as described in
  * sort_tris_around_edge, and return 1, 2, 3, or 4 as tri is:
@@ -869,9 +901,6 @@ static int sort_tris_class(const Face &tri, const Face &tri0, const Edge e)
   if (dbg_level > 0) {
     std::cout << "classify  e = " << e << "\n";
   }
-  mpq3 a0 = tri0[0]->co_exact;
-  mpq3 a1 = tri0[1]->co_exact;
-  mpq3 a2 = tri0[2]->co_exact;
   bool rev;
   bool rev0;
   const Vert *flapv0 = find_flap_vert(tri0, e, &rev0);
@@ -883,9 +912,8 @@ static int sort_tris_class(const Face &tri, const Face &tri0, const Edge e)
     std::cout << " rev = " << rev << " flapv = " << flapv << "\n";
   }
   lib_assert(flapv != nullptr && flapv0 != nullptr);
-  const mpq3 flap = flapv->co_exact;
-  /* orient will be positive if flap is below oriented plane of a0,a1,a2. */
-  int orient = orient3d(a0, a1, a2, flap);
+  /* orient will be positive if flap is below oriented plane of tri0. */
+  int orient = filtered_orient3d(tri0[0], tri0[1], tri0[2], flapv);
   int ans;
   if (orient > 0) {
     ans = rev0 ? 4 : 3;
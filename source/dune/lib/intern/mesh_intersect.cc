@@ -34,6 +34,8 @@
 
 #  include "lib_mesh_intersect.hh"
 
+#  include "mesh_intersect_private.hh"
+
 // #  define PERFDEBUG
 
 namespace dune::meshintersect {
@@ -49,6 +51,10 @@ static void dump_perfdata();
 /* For debug, can disable threading in intersect code with this static constant. */
 static constexpr bool intersect_use_threading = true;
 
+/* For debug, can make triangle-triangle intersection skip the double arithmetic filter
+ * and use exact arithmetic for every overlapping pair. */
+static constexpr bool intersect_use_filter = true;
+
 Vert::Vert(const mpq3 &mco, const double3 &dco, int id, int orig)
     : co_exact(mco), co(dco), id(id), orig(orig)
 {
@@ -182,6 +188,8 @@ void Face::populate_plane(bool need_exact)
       normal_exact = math::cross(tr02, tr12);
     }
     mpq_class d_exact = -math::dot(normal_exact, vert[0]->co_exact);
+    /* Replaces a plane that only had the double part populated. */
+    delete plane;
     plane = new Plane(normal_exact, d_exact);
   }
   else {
@@ -1060,11 +1068,6 @@ static double supremum_dot_cross(const double3 &a, const double3 &b)
   return math::dot(c, c);
 }
 
-/* The index of dot when inputs are plane_coords with index 1 is much higher.
- * Plane coords have index 6.
- */
-constexpr int index_dot_plane_coords = 15;
-
 /**
  * Used with supremum to get error bound. See Burnikel et al paper.
  * index_plane_coord is the index of a plane coordinate calculated
@@ -1083,22 +1086,22 @@ constexpr int index_dot_cross = 11;
  * If the answer is 0, we are unsure about which side of the plane (or if it is on the plane).
  * In exact arithmetic, the answer is just `sgn(dot(p - plane_p, plane_no))`.
  *
- * The plane_no input is constructed, so has a higher index.
+ * The plane_no input is constructed, so has a higher index,
+ * and sup_plane_no is the supremum of the calculation that constructed it,
+ * the error bound uses #index_plane_side.
  */
-constexpr int index_plane_side = 3 + 2 * index_dot_plane_coords;
-
 static int filter_plane_side(const double3 &p,
                              const double3 &plane_p,
                              const double3 &plane_no,
                              const double3 &abs_p,
                              const double3 &abs_plane_p,
-                             const double3 &abs_plane_no)
+                             const double3 &sup_plane_no)
 {
   double d = math::dot(p - plane_p, plane_no);
   if (d == 0.0) {
     return 0;
   }
-  double supremum = math::dot(abs_p + abs_plane_p, abs_plane_no);
+  double supremum = math::dot(abs_p + abs_plane_p, sup_plane_no);
   double err_bound = supremum * index_plane_side * DBL_EPSILON;
   if (fabs(d) > err_bound) {
     return d > 0 ? 1 : -1;
@@ -1341,7 +1344,106 @@ static ITT_value itt_canon1(const mpq3 &p1,
   return ITT_value(ICOPLANAR);
 }
 
-static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2)
+/**
+ * Signs of the distances of t1's verts to the plane of t2 (s1), and of t2's verts to the plane
+ * of t1 (s2), in vertex order. Signs the double filter couldn't decide are #itt_sign_unknown.
+ */
+struct ITT_signs {
+  int s1[3];
+  int s2[3];
+};
+
+constexpr int itt_sign_unknown = 2;
+
+static bool itt_signs_all_same_side(const int s[3])
+{
+  return (s[0] == 1 && s[1] == 1 && s[2] == 1) || (s[0] == -1 && s[1] == -1 && s[2] == -1);
+}
+
+/**
+ * Supremum of the normal of tri as calculated in doubles by #Face::populate_plane,
+ * i.e. `cross(v0 - v2, v1 - v2)` using absolute values and always using +.
+ * The abs of the calculated normal isn't enough for the error bound of
+ * #filter_plane_side, as its coordinates can suffer from cancellation.
+ */
+static double3 supremum_tri_normal(const Face &tri)
+{
+  const double3 abs_v2 = math::abs(tri[2]->co);
+  const double3 a = math::abs(tri[0]->co) + abs_v2;
+  const double3 b = math::abs(tri[1]->co) + abs_v2;
+  return double3(a[1] * b[2] + a[2] * b[1], a[2] * b[0] + a[0] * b[2], a[0] * b[1] + a[1] * b[0]);
+}
+
+/**
+ * Side of v with respect to the plane of tri. A vert of tri is exactly on its plane:
+ * since the arena de-duplicates verts, that's the case for every vert shared by two triangles.
+ * Otherwise use the double filter, returning #itt_sign_unknown if it can't decide.
+ */
+static int filter_tri_vert_side(const Vert *v,
+                                const Face &tri,
+                                const double3 &abs_plane_p,
+                                const double3 &sup_plane_no)
+{
+  if (ELEM(v, tri[0], tri[1], tri[2])) {
+    return 0;
+  }
+  int side = filter_plane_side(
+      v->co, tri[2]->co, tri.plane->norm, math::abs(v->co), abs_plane_p, sup_plane_no);
+  return side == 0 ? itt_sign_unknown : side;
+}
+
+/**
+ * The double arithmetic part of #intersect_tri_tri: fill in r_signs as far as the filter can
+ * decide them, and return true if that's enough to know that t1 and t2 don't intersect.
+ * Only needs the double part of the triangles' planes.
+ */
+static bool intersect_tri_tri_filter(const IMesh &tm, int t1, int t2, ITT_signs &r_signs)
+{
+  constexpr int dbg_level = 0;
+  const Face &tri1 = *tm.face(t1);
+  const Face &tri2 = *tm.face(t2);
+  BLI_assert(tri1.plane_populated() && tri2.plane_populated());
+
+  /* If the signs calculated here are not #itt_sign_unknown, they are the same
+   * as what they would be using exact arithmetic. */
+  const double3 abs_r2 = math::abs(tri2[2]->co);
+  const double3 sup_n2 = supremum_tri_normal(tri2);
+  for (int i = 0; i < 3; i++) {
+    r_signs.s1[i] = filter_tri_vert_side(tri1[i], tri2, abs_r2, sup_n2);
+  }
+  if (itt_signs_all_same_side(r_signs.s1)) {
+#  ifdef PERFDEBUG
+    incperfcount(2); /* Triangle-triangle intersects decided by filter plane tests. */
+#  endif
+    if (dbg_level > 0) {
+      std::cout << "no intersection, all t1's verts above or below t2\n";
+    }
+    return true;
+  }
+
+  const double3 abs_r1 = math::abs(tri1[2]->co);
+  const double3 sup_n1 = supremum_tri_normal(tri1);
+  for (int i = 0; i < 3; i++) {
+    r_signs.s2[i] = filter_tri_vert_side(tri2[i], tri1, abs_r1, sup_n1);
+  }
+  if (itt_signs_all_same_side(r_signs.s2)) {
+#  ifdef PERFDEBUG
+    incperfcount(2); /* Triangle-triangle intersects decided by filter plane tests. */
+#  endif
+    if (dbg_level > 0) {
+      std::cout << "no intersection, all t2's verts above or below t1\n";
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Intersect triangles t1 and t2 that #intersect_tri_tri_filter couldn't separate,
+ * calculating the signs it left unknown with exact arithmetic.
+ * Needs the exact part of the triangles' planes.
+ */
+static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2, const ITT_signs &signs)
 {
   constexpr int dbg_level = 0;
 #  ifdef PERFDEBUG
@@ -1349,7 +1451,7 @@ static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2)
 #  endif
   const Face &tri1 = *tm.face(t1);
   const Face &tri2 = *tm.face(t2);
-  BLI_assert(tri1.plane_populated() && tri2.plane_populated());
+  BLI_assert(tri1.plane->exact_populated() && tri2.plane->exact_populated());
   const Vert *vp1 = tri1[0];
   const Vert *vq1 = tri1[1];
   const Vert *vr1 = tri1[2];
@@ -1366,55 +1468,14 @@ static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2)
     std::cout << "  r2 = " << vr2 << "\n";
   }
 
-  /* Get signs of t1's vertices' distances to plane of t2 and vice versa. */
-
-  /* Try first getting signs with double arithmetic, with error bounds.
-   * If the signs calculated in this section are not 0, they are the same
-   * as what they would be using exact arithmetic. */
-  const double3 &d_p1 = vp1->co;
-  const double3 &d_q1 = vq1->co;
-  const double3 &d_r1 = vr1->co;
-  const double3 &d_p2 = vp2->co;
-  const double3 &d_q2 = vq2->co;
-  const double3 &d_r2 = vr2->co;
-  const double3 &d_n2 = tri2.plane->norm;
-
-  const double3 &abs_d_p1 = math::abs(d_p1);
-  const double3 &abs_d_q1 = math::abs(d_q1);
-  const double3 &abs_d_r1 = math::abs(d_r1);
-  const double3 &abs_d_r2 = math::abs(d_r2);
-  const double3 &abs_d_n2 = math::abs(d_n2);
-
-  int sp1 = filter_plane_side(d_p1, d_r2, d_n2, abs_d_p1, abs_d_r2, abs_d_n2);
-  int sq1 = filter_plane_side(d_q1, d_r2, d_n2, abs_d_q1, abs_d_r2, abs_d_n2);
-  int sr1 = filter_plane_side(d_r1, d_r2, d_n2, abs_d_r1, abs_d_r2, abs_d_n2);
-  if ((sp1 > 0 && sq1 > 0 && sr1 > 0) || (sp1 < 0 && sq1 < 0 && sr1 < 0)) {
-#  ifdef PERFDEBUG
-    incperfcount(2); /* Triangle-triangle intersects decided by filter plane tests. */
-#  endif
-    if (dbg_level > 0) {
-      std::cout << "no intersection, all t1's verts above or below t2\n";
-    }
-    return ITT_value(INONE);
-  }
-
-  const double3 &d_n1 = tri1.plane->norm;
-  const double3 &abs_d_p2 = math::abs(d_p2);
-  const double3 &abs_d_q2 = math::abs(d_q2);
-  const double3 &abs_d_n1 = math::abs(d_n1);
-
-  int sp2 = filter_plane_side(d_p2, d_r1, d_n1, abs_d_p2, abs_d_r1, abs_d_n1);
-  int sq2 = filter_plane_side(d_q2, d_r1, d_n1, abs_d_q2, abs_d_r1, abs_d_n1);
-  int sr2 = filter_plane_side(d_r2, d_r1, d_n1, abs_d_r2, abs_d_r1, abs_d_n1);
-  if ((sp2 > 0 && sq2 > 0 && sr2 > 0) || (sp2 < 0 && sq2 < 0 && sr2 < 0)) {
-#  ifdef PERFDEBUG
-    incperfcount(2); /* Triangle-triangle intersects decided by filter plane tests. */
-#  endif
-    if (dbg_level > 0) {
-      std::cout << "no intersection, all t2's verts above or below t1\n";
-    }
-    return ITT_value(INONE);
-  }
+  /* Get signs of t1's vertices' distances to plane of t2 and vice versa,
+   * where the filter didn't already. */
+  int sp1 = signs.s1[0];
+  int sq1 = signs.s1[1];
+  int sr1 = signs.s1[2];
+  int sp2 = signs.s2[0];
+  int sq2 = signs.s2[1];
+  int sr2 = signs.s2[2];
 
   mpq3 buf[2];
   const mpq3 &p1 = vp1->co_exact;
@@ -1425,17 +1486,17 @@ static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2)
   const mpq3 &r2 = vr2->co_exact;
 
   const mpq3 &n2 = tri2.plane->norm_exact;
-  if (sp1 == 0) {
+  if (sp1 == itt_sign_unknown) {
     buf[0] = p1;
     buf[0] -= r2;
     sp1 = sgn(math::dot_with_buffer(buf[0], n2, buf[1]));
   }
-  if (sq1 == 0) {
+  if (sq1 == itt_sign_unknown) {
     buf[0] = q1;
     buf[0] -= r2;
     sq1 = sgn(math::dot_with_buffer(buf[0], n2, buf[1]));
   }
-  if (sr1 == 0) {
+  if (sr1 == itt_sign_unknown) {
     buf[0] = r1;
     buf[0] -= r2;
     sr1 = sgn(math::dot_with_buffer(buf[0], n2, buf[1]));
@@ -1457,17 +1518,17 @@ static ITT_value intersect_tri_tri(const IMesh &tm, int t1, int t2)
 
   /* Repeat for signs of t2's vertices with respect to plane of t1. */
   const mpq3 &n1 = tri1.plane->norm_exact;
-  if (sp2 == 0) {
+  if (sp2 == itt_sign_unknown) {
     buf[0] = p2;
     buf[0] -= r1;
     sp2 = sgn(math::dot_with_buffer(buf[0], n1, buf[1]));
   }
-  if (sq2 == 0) {
+  if (sq2 == itt_sign_unknown) {
     buf[0] = q2;
     buf[0] -= r1;
     sq2 = sgn(math::dot_with_buffer(buf[0], n1, buf[1]));
   }
-  if (sr2 == 0) {
+  if (sr2 == itt_sign_unknown) {
     buf[0] = r2;
     buf[0] -= r1;
     sr2 = sgn(math::dot_with_buffer(buf[0], n1, buf[1]));
@@ -2441,6 +2502,12 @@ class TriOverlaps {
 /* Data needed for parallelization of calc_overlap_itts. */
 struct OverlapIttsData {
   Vector<std::pair<int, int>> intersect_pairs;
+  /** Parallels intersect_pairs, the signs found by the double filter. */
+  Array<ITT_signs> pair_signs;
+  /** Parallels intersect_pairs, true if the filter found the pair doesn't intersect. */
+  Array<bool> pair_separated;
+  /** Indices into intersect_pairs of the pairs the filter couldn't separate. */
+  Vector<int> exact_pairs;
   Map<std::pair<int, int>, ITT_value> &itt_map;
   const IMesh &tm;
   IMeshArena *arena;
@@ -2461,28 +2528,50 @@ static std::pair<int, int> canon_int_pair(int a, int b)
   return std::pair<int, int>(a, b);
 }
 
+static void calc_overlap_itts_filter_range_func(void *__restrict userdata,
+                                                const int iter,
+                                                const TaskParallelTLS *__restrict /*tls*/)
+{
+  OverlapIttsData *data = static_cast<OverlapIttsData *>(userdata);
+  std::pair<int, int> tri_pair = data->intersect_pairs[iter];
+  ITT_signs &signs = data->pair_signs[iter];
+  if (intersect_use_filter) {
+    data->pair_separated[iter] = intersect_tri_tri_filter(
+        data->tm, tri_pair.first, tri_pair.second, signs);
+  }
+  else {
+    std::fill_n(signs.s1, 3, itt_sign_unknown);
+    std::fill_n(signs.s2, 3, itt_sign_unknown);
+    data->pair_separated[iter] = false;
+  }
+}
+
 static void calc_overlap_itts_range_func(void *__restrict userdata,
                                          const int iter,
                                          const TaskParallelTLS *__restrict /*tls*/)
 {
   constexpr int dbg_level = 0;
   OverlapIttsData *data = static_cast<OverlapIttsData *>(userdata);
-  std::pair<int, int> tri_pair = data->intersect_pairs[iter];
+  const int pair_index = data->exact_pairs[iter];
+  std::pair<int, int> tri_pair = data->intersect_pairs[pair_index];
   int a = tri_pair.first;
   int b = tri_pair.second;
   if (dbg_level > 0) {
     std::cout << "calc_overlap_itts_range_fn a=" << a << ", b=" << b << "\n";
   }
-  ITT_val itt = intersect_tri_tri(data->tm, a, b);
+  ITT_val itt = intersect_tri_tri(data->tm, a, b, data->pair_signs[pair_index]);
   if (dbg_level > 0) {
     std::cout << "result of intersecting " << a << " and " << b << " = " << itt << "\n";
   }
   lib_assert(data->itt_map.contains(tri_pair));
   data->itt_map.add_overwrite(tri_pair, itt);
 }
-
 /* Fill in itt_map w the vector of ITT_values that result from intersecting the triangles in
- * ov. Use a canonical order for triangles: (a,b) where  a < b. */
+ * ov. Use a canonical order for triangles: (a,b) where  a < b.
+ *
+ * Most overlapping pairs are separated by the double filter, so first run that on all pairs,
+ * then populate the exact planes of only the triangles in the remaining pairs,
+ * and finish those w exact arithmetic. */
 static void calc_overlap_itts(Map<std::pair<int, int>, ITT_value> &itt_map,
                               const IMesh &tm,
                               const TriOverlaps &ov,
@@ -2491,7 +2580,10 @@ static void calc_overlap_itts(Map<std::pair<int, int>, ITT_value> &itt_map,
   OverlapIttsData data(itt_map, tm, arena);
   /* Put dummy vals in `itt_map` initially,
    * so map entries will exist when doing the range fn.
-   * This means we won't have to protect the `itt_map.add_overwrite` function with a lock. */
+   * This means we won't have to protect the `itt_map.add_overwrite` function with a lock.
+   * The dummy vals are INONE, which is the answer for the pairs separated by the filter.
+   * The overlaps are sorted by indexA, so consecutive pairs (and the pairs given to each task)
+   * mostly share their first triangle. */
   for (const BVHTreeOverlap &olap : ov.overlap()) {
     std::pair<int, int> key = canon_int_pair(olap.indexA, olap.indexB);
     if (!itt_map.contains(key)) {
@@ -2500,11 +2592,38 @@ static void calc_overlap_itts(Map<std::pair<int, int>, ITT_value> &itt_map,
     }
   }
   int tot_intersect_pairs = data.intersect_pairs.size();
+  data.pair_signs.reinitialize(tot_intersect_pairs);
+  data.pair_separated.reinitialize(tot_intersect_pairs);
   TaskParallelSettings settings;
   lib_parallel_range_settings_defaults(&settings);
   settings.min_iter_per_thread = 1000;
   settings.use_threading = intersect_use_threading;
-  lib_task_parallel_range(0, tot_intersect_pairs, &data, calc_overlap_itts_range_func, &settings);
+  lib_task_parallel_range(
+      0, tot_intersect_pairs, &data, calc_overlap_itts_filter_range_func, &settings);
+
+  Array<bool> tri_needs_exact(tm.face_size(), false);
+  for (int i : data.intersect_pairs.index_range()) {
+    if (!data.pair_separated[i]) {
+      data.exact_pairs.append(i);
+      tri_needs_exact[data.intersect_pairs[i].first] = true;
+      tri_needs_exact[data.intersect_pairs[i].second] = true;
+    }
+  }
+#  ifdef PERFDEBUG
+  bumpperfcount(5, data.exact_pairs.size()); /* Triangle-triangle pairs needing exact tests. */
+#  endif
+  threading::parallel_for(tm.face_index_range(), 1024, [&](IndexRange range) {
+    for (int t : range) {
+      if (tri_needs_exact[t]) {
+        tm.face(t)->populate_plane(true);
+      }
+    }
+  });
+
+  /* Exact tests cost a lot more than filtered ones, so use a smaller grain. */
+  settings.min_iter_per_thread = 64;
+  lib_task_parallel_range(
+      0, data.exact_pairs.size(), &data, calc_overlap_itts_range_func, &settings);
 }
 
 /* For each triangle in tm, fill in the corresponding slot in
@@ -2958,10 +3077,12 @@ IMesh trimesh_nary_intersect(const IMesh &tm_in,
   std::cout << "intersect overlaps calculated, time = " << overlap_time - bb_calc_time << "\n";
 #  endif
   Array<IMesh> tri_subdivided(tm_clean->face_size(), NoInitialization());
+  /* Only the double part of the planes is needed by the filter in calc_overlap_itts,
+   * which populates the exact part for the triangles that need it. */
   threading::parallel_for(tm_clean->face_index_range(), 1024, [&](IndexRange range) {
     for (int t : range) {
       if (tri_ov.first_overlap_index(t) != -1) {
-        tm_clean->face(t)->populate_plane(true);
+        tm_clean->face(t)->populate_plane(false);
       }
       new (static_cast<void *>(&tri_subdivided[t])) IMesh;
     }
@@ -2996,10 +3117,14 @@ IMesh trimesh_nary_intersect(const IMesh &tm_in,
   std::cout << "subdivided non-cluster tris found, time = " << subdivided_tris_time - itt_time
             << "\n";
 #  endif
+  /* The CDT of each cluster is independent, adding the results to the arena is done after. */
   Array<CDT_data> cluster_subdivided(clinfo.tot_cluster());
-  for (int c : clinfo.index_range()) {
-    cluster_subdivided[c] = calc_cluster_subdivided(clinfo, c, *tm_clean, tri_ov, itt_map, arena);
-  }
+  threading::parallel_for(clinfo.index_range(), 1, [&](IndexRange range) {
+    for (int c : range) {
+      cluster_subdivided[c] = calc_cluster_subdivided(
+          clinfo, c, *tm_clean, tri_ov, itt_map, arena);
+    }
+  });
 #  ifdef PERFDEBUG
   double cluster_subdivide_time = PIL_check_seconds_timer();
   std::cout << "subdivided clusters found, time = "
@@ -3147,6 +3272,10 @@ static void perfdata_init()
   perfdata->count.append(0);
   perfdata->count_name.append("final non-NONE intersects");
 
+  /* count 5. */
+  perfdata->count.append(0);
+  perfdata->count_name.append("tri tri pairs needing exact tests");
+
   /* max 0. */
   perfdata->max.append(0);
   perfdata->max_name.append("total faces");
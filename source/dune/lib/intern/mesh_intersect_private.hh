@@ -0,0 +1,19 @@
+#pragma once
+/* Error bounds shared by the floating point filters of
+ * mesh_intersect.cc & mesh_bool.cc, see Burnikel et al. */
+
+namespace dune::meshintersect {
+
+/* The index of dot when inputs are plane_coords with index 1 is much higher.
+ * Plane coords have index 6.
+ */
+constexpr int index_dot_plane_coords = 15;
+
+/**
+ * Index of the side of a point with respect to a plane, `dot(p - plane_p, plane_no)`,
+ * where plane_no is constructed from coords with index 1.
+ * Multiplied by the supremum of the calculation & DBL_EPSILON, it bounds the error.
+ */
+constexpr int index_plane_side = 3 + 2 * index_dot_plane_coords;
+
+}  // namespace dune::meshintersect
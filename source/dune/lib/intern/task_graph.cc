@@ -1,8 +1,14 @@
 #include "mem_guardedalloc.h"
 
 #include "lib_task.h"
+#include "lib_threads.h"
+#include "lib_time.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #ifdef WITH_TBB
@@ -16,6 +22,18 @@ struct TaskGraph {
 #endif
   std::vector<std::unique_ptr<TaskNode>> nodes;
 
+  /* Critical-path scheduling. When enabled, pushed nodes are only recorded
+   * as roots and the graph is ex in work_and_wait() by the graph's own
+   * scheduler instead of the TBB flow graph. */
+  bool use_scheduler = false;
+  /* Nodes pushed since the last work_and_wait(). */
+  std::vector<TaskNode *> roots;
+  /* Roots of the last scheduled run, used by replay. */
+  std::vector<TaskNode *> replay_roots;
+  /* Set after the first scheduled run, so later runs can replay the graph
+   * using the measured node costs. */
+  bool has_recording = false;
+
 #ifdef WITH_CXX_GUARDEDALLOC
   MEM_CXX_CLASS_ALLOC_FNS("task_graph:TaskGraph")
 #endif
@@ -27,7 +45,8 @@ struct TaskNode {
 #ifdef WITH_TBB
   tbb::flow::continue_node<tbb::flow::continue_msg> tbb_node;
 #endif
-  /* Successors to ex after this task, for serial ex fallback. */
+  /* Successors to ex after this task, for serial ex fallback
+   * and for the critical-path scheduler. */
   std::vector<TaskNode *> successors;
 
   /* User fn to be ex w given task data. */
@@ -37,6 +56,24 @@ struct TaskNode {
    * is shared between nodes, only a single task node should free the data. */
   TaskGraphNodeFreeFn free_fn;
 
+  /* Graph owning this node. */
+  TaskGraph *graph;
+
+  /* Scheduling hints. Higher priority nodes are always picked first among
+   * ready nodes, cost is a relative estimate of the run time of the node. */
+  int priority = 0;
+  float cost = 1.0f;
+  /* Preferred worker, -1 when the node can run anywhere. */
+  int affinity = -1;
+
+  /* Scheduler state, (re)initialized before every scheduled run. */
+  int num_predecessors = 0;
+  std::atomic<int> num_pending;
+  /* Cost of the longest path from this node to the end of the graph. */
+  float critical_path = 0.0f;
+  /* Run time of the last scheduled ex in seconds, negative when unknown. */
+  double recorded_time = -1.0;
+
   TaskNode(TaskGraph *task_graph,
            TaskGraphNodeRunFn run_fn,
            void *task_data,
@@ -49,11 +86,10 @@ struct TaskNode {
 #endif
         run_fn(run_fn),
         task_data(task_data),
-        free_fn(free_fn)
+        free_fn(free_fn),
+        graph(task_graph),
+        num_pending(0)
   {
-#ifndef WITH_TBB
-    UNUSED_VARS(task_graph);
-#endif
   }
 
   TaskNode(const TaskNode &other) = delete;
@@ -82,16 +118,302 @@ struct TaskNode {
     }
   }
 
+  void run_recorded()
+  {
+    const double start_time = time_check_seconds_timer();
+    run_fn(task_data);
+    recorded_time = time_check_seconds_timer() - start_time;
+  }
+
+  /* Cost used for ranking, the measured time wins over the user hint once
+   * the graph has been ex. Measured times are in seconds, so they are scaled
+   * to be in the same ballpark as the default hint of 1 per node. */
+  float effective_cost(const bool use_recording) const
+  {
+    if (use_recording && recorded_time >= 0.0) {
+      return float(recorded_time * 1000.0);
+    }
+    return cost;
+  }
+
 #ifdef WITH_CXX_GUARDEDALLOC
   MEM_CXX_CLASS_ALLOC_FNS("task_graph:TaskNode")
 #endif
 };
 
+/* Critical-Path Scheduler
+ *
+ * Ready nodes are kept in one heap per worker plus a shared heap for nodes
+ * wo affinity. Heaps are ordered by priority first and by the length of the
+ * remaining critical path second, so nodes that gate deep dependency chains
+ * are started before cheap leaf work. Idle workers steal the best node from
+ * the other heaps. */
+
+static bool task_node_rank_less(const TaskNode *a, const TaskNode *b)
+{
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
+  }
+  return a->critical_path < b->critical_path;
+}
+
+struct TaskGraphReadyQueue {
+  std::mutex mutex;
+  std::vector<TaskNode *> heap;
+
+  void push(TaskNode *node)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    heap.push_back(node);
+    std::push_heap(heap.begin(), heap.end(), task_node_rank_less);
+  }
+
+  TaskNode *pop()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (heap.empty()) {
+      return nullptr;
+    }
+    std::pop_heap(heap.begin(), heap.end(), task_node_rank_less);
+    TaskNode *node = heap.back();
+    heap.pop_back();
+    return node;
+  }
+
+  /* Best node, only used as a heuristic when choosing a victim. */
+  const TaskNode *peek()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return heap.empty() ? nullptr : heap.front();
+  }
+};
+
+struct TaskGraphScheduler {
+  TaskGraph *graph;
+  int num_workers;
+  /* One queue per worker, the last one is shared. */
+  std::vector<TaskGraphReadyQueue> queues;
+  std::atomic<int> num_remaining;
+  /* Nodes in any of the queues, idle workers sleep while there are none. */
+  std::atomic<int> num_ready;
+  std::mutex wait_mutex;
+  std::condition_variable wait_cond;
+
+  TaskGraphScheduler(TaskGraph *graph, const int num_workers)
+      : graph(graph),
+        num_workers(num_workers),
+        queues(num_workers + 1),
+        num_remaining(0),
+        num_ready(0)
+  {
+  }
+
+  TaskGraphReadyQueue &queue_for_node(const TaskNode *node)
+  {
+    if (node->affinity >= 0) {
+      return queues[node->affinity % num_workers];
+    }
+    return queues[num_workers];
+  }
+
+  void push_ready(TaskNode *node)
+  {
+    queue_for_node(node).push(node);
+    num_ready.fetch_add(1);
+  }
+
+  /* Wake sleeping workers after the ready or remaining count changed. Taking the lock
+   * ensures a worker is either waiting already or will see the new count. */
+  void notify(const bool notify_all)
+  {
+    {
+      std::lock_guard<std::mutex> lock(wait_mutex);
+    }
+    if (notify_all) {
+      wait_cond.notify_all();
+    }
+    else {
+      wait_cond.notify_one();
+    }
+  }
+
+  TaskNode *find_work_in_queues(const int worker)
+  {
+    if (TaskNode *node = queues[worker].pop()) {
+      return node;
+    }
+    if (TaskNode *node = queues[num_workers].pop()) {
+      return node;
+    }
+    /* Steal from the worker whose best ready node ranks highest. */
+    int victim = -1;
+    const TaskNode *best = nullptr;
+    for (int i = 0; i < num_workers; i++) {
+      const TaskNode *top = queues[i].peek();
+      if (i != worker && top && (best == nullptr || task_node_rank_less(best, top))) {
+        best = top;
+        victim = i;
+      }
+    }
+    return (victim != -1) ? queues[victim].pop() : nullptr;
+  }
+
+  TaskNode *find_work(const int worker)
+  {
+    TaskNode *node = find_work_in_queues(worker);
+    if (node) {
+      num_ready.fetch_sub(1);
+    }
+    return node;
+  }
+
+  void node_done(TaskNode *node)
+  {
+    int num_new_ready = 0;
+    for (TaskNode *successor : node->successors) {
+      if (successor->num_pending.fetch_sub(1) == 1) {
+        push_ready(successor);
+        num_new_ready++;
+      }
+    }
+    if (num_remaining.fetch_sub(1) == 1) {
+      notify(true);
+    }
+    else if (num_new_ready > 0) {
+      notify(num_new_ready > 1);
+    }
+  }
+
+  void worker_run(const int worker)
+  {
+    while (num_remaining.load() > 0) {
+      TaskNode *node = find_work(worker);
+      if (node == nullptr) {
+        /* Nodes still running on other workers will make new work ready. */
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        wait_cond.wait(lock, [&]() { return num_ready.load() > 0 || num_remaining.load() == 0; });
+        continue;
+      }
+      node->run_recorded();
+      node_done(node);
+    }
+  }
+};
+
+static void task_graph_scheduler_worker(TaskPool *__restrict pool, void *taskdata)
+{
+  TaskGraphScheduler *scheduler = static_cast<TaskGraphScheduler *>(
+      lib_task_pool_user_data(pool));
+  scheduler->worker_run(POINTER_AS_INT(taskdata));
+}
+
+/* Count predecessors and compute the critical path length of every node
+ * reachable from the roots. Returns the num of reachable nodes. */
+static int task_graph_schedule_prepare(TaskGraph *task_graph,
+                                       const std::vector<TaskNode *> &roots)
+{
+  const bool use_recording = task_graph->has_recording;
+
+  /* Collect reachable nodes in topological order (Kahn's algorithm). */
+  for (std::unique_ptr<TaskNode> &node : task_graph->nodes) {
+    node->num_predecessors = 0;
+  }
+  std::vector<TaskNode *> reachable;
+  std::vector<TaskNode *> stack(roots);
+  for (TaskNode *root : roots) {
+    /* Mark roots as visited. */
+    root->num_predecessors = -1;
+  }
+  while (!stack.empty()) {
+    TaskNode *node = stack.back();
+    stack.pop_back();
+    reachable.push_back(node);
+    for (TaskNode *successor : node->successors) {
+      if (successor->num_predecessors == 0) {
+        stack.push_back(successor);
+      }
+      if (successor->num_predecessors >= 0) {
+        successor->num_predecessors++;
+      }
+    }
+  }
+
+  std::vector<TaskNode *> order;
+  order.reserve(reachable.size());
+  for (TaskNode *node : reachable) {
+    node->num_pending.store(std::max(node->num_predecessors, 0));
+    if (node->num_predecessors <= 0) {
+      order.push_back(node);
+    }
+  }
+  for (int i = 0; i < int(order.size()); i++) {
+    for (TaskNode *successor : order[i]->successors) {
+      if (successor->num_pending.fetch_sub(1) == 1) {
+        order.push_back(successor);
+      }
+    }
+  }
+  lib_assert_msg(order.size() == reachable.size(), "Task graph contains a cycle");
+
+  /* Longest remaining path, in reverse topological order. */
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    TaskNode *node = *it;
+    float longest_successor = 0.0f;
+    for (TaskNode *successor : node->successors) {
+      longest_successor = std::max(longest_successor, successor->critical_path);
+    }
+    node->critical_path = node->effective_cost(use_recording) + longest_successor;
+  }
+
+  for (TaskNode *node : reachable) {
+    node->num_pending.store(std::max(node->num_predecessors, 0));
+  }
+  return int(reachable.size());
+}
+
+static void task_graph_schedule_run(TaskGraph *task_graph, const std::vector<TaskNode *> &roots)
+{
+  if (roots.empty()) {
+    return;
+  }
+  const int num_nodes = task_graph_schedule_prepare(task_graph, roots);
+  const int num_workers = std::max(1, std::min(lib_task_scheduler_num_threads(), num_nodes));
+
+  TaskGraphScheduler scheduler(task_graph, num_workers);
+  scheduler.num_remaining.store(num_nodes);
+  for (TaskNode *root : roots) {
+    if (root->num_pending.load() == 0) {
+      scheduler.push_ready(root);
+    }
+  }
+
+  if (num_workers == 1) {
+    scheduler.worker_run(0);
+  }
+  else {
+    TaskPool *pool = lib_task_pool_create(&scheduler, TASK_PRIORITY_HIGH);
+    for (int i = 0; i < num_workers; i++) {
+      lib_task_pool_push(pool, task_graph_scheduler_worker, POINTER_FROM_INT(i), false, nullptr);
+    }
+    lib_task_pool_work_and_wait(pool);
+    lib_task_pool_free(pool);
+  }
+
+  task_graph->has_recording = true;
+}
+
 TaskGraph *lib_task_graph_create()
 {
   return new TaskGraph();
 }
 
+TaskGraph *lib_task_graph_create_scheduled()
+{
+  TaskGraph *task_graph = new TaskGraph();
+  task_graph->use_scheduler = true;
+  return task_graph;
+}
+
 void lib_task_graph_free(TaskGraph *task_graph)
 {
   delete task_graph;
@@ -99,6 +421,15 @@ void lib_task_graph_free(TaskGraph *task_graph)
 
 void lib_task_graph_work_and_wait(TaskGraph *task_graph)
 {
+  if (task_graph->use_scheduler) {
+    /* Pushed nodes are consumed by this run, later runs only execute newly pushed nodes. */
+    if (!task_graph->roots.empty()) {
+      task_graph->replay_roots.swap(task_graph->roots);
+      task_graph->roots.clear();
+      task_graph_schedule_run(task_graph, task_graph->replay_roots);
+    }
+    return;
+  }
 #ifdef WITH_TBB
   task_graph->tbb_graph.wait_for_all();
 #else
@@ -106,18 +437,55 @@ void lib_task_graph_work_and_wait(TaskGraph *task_graph)
 #endif
 }
 
+void lib_task_graph_replay(TaskGraph *task_graph)
+{
+  lib_assert_msg(task_graph->use_scheduler,
+                 "Only graphs created with lib_task_graph_create_scheduled can be replayed");
+  task_graph_schedule_run(task_graph, task_graph->replay_roots);
+}
+
 TaskNode *lib_task_graph_node_create(TaskGraph *task_graph,
                                      TaskGraphNodeRunFn run,
                                      void *user_data,
                                      TaskGraphNodeFreeFn free_fn)
 {
-  TaskNode *task_node = new TaskNode(task_graph, run, user_data, free_f );
+  TaskNode *task_node = new TaskNode(task_graph, run, user_data, free_fn);
   task_graph->nodes.push_back(std::unique_ptr<TaskNode>(task_node));
   return task_node;
 }
 
+void lib_task_graph_node_set_priority(TaskNode *task_node, const int priority)
+{
+  task_node->priority = priority;
+}
+
+void lib_task_graph_node_set_cost(TaskNode *task_node, const float cost)
+{
+  lib_assert(cost >= 0.0f);
+  task_node->cost = cost;
+}
+
+void lib_task_graph_node_set_affinity(TaskNode *task_node, const int thread_index)
+{
+  task_node->affinity = thread_index;
+}
+
+double lib_task_graph_node_recorded_time(const TaskNode *task_node)
+{
+  return task_node->recorded_time;
+}
+
 bool lib_task_graph_node_push_work(TaskNode *task_node)
 {
+  if (task_node->graph->use_scheduler) {
+    /* Ex is deferred to work_and_wait(), once all roots are known. */
+    std::vector<TaskNode *> &roots = task_node->graph->roots;
+    if (std::find(roots.begin(), roots.end(), task_node) == roots.end()) {
+      roots.push_back(task_node);
+    }
+    return true;
+  }
+
 #ifdef WITH_TBB
   if (lib_task_scheduler_num_threads() > 1) {
     return task_node->tbb_node.try_put(tbb::flow::continue_msg());
@@ -130,12 +498,13 @@ bool lib_task_graph_node_push_work(TaskNode *task_node)
 
 void lib_task_graph_edge_create(TaskNode *from_node, TaskNode *to_node)
 {
+  /* The scheduler always needs the successors, the TBB edge is harmless
+   * for scheduled graphs since their TBB nodes are never triggered. */
+  from_node->successors.push_back(to_node);
+
 #ifdef WITH_TBB
   if (lib_task_scheduler_num_threads() > 1) {
     tbb::flow::make_edge(from_node->tbb_node, to_node->tbb_node);
-    return;
   }
 #endif
-
-  from_node->successors.push_back(to_node);
 }
@@ -282,3 +282,87 @@ LIB_INLINE bool lib_ghashIterator_done(const GHashIterator *ghi)
   for (lib_ghashIterator_init(&gh_iter_, ghash_), i_ = 0; \
        lib_ghashIterator_done(&gh_iter_) == false; \
        lib_ghashIterator_step(&gh_iter_), i_++)
+
+/** Concurrent GHash & GSet
+ *
+ * Sharded open addressing tables using the same callbacks as GHash,
+ * safe to use from multiple threads at once:
+ * lookups are lock-free and insertions only lock one shard.
+ * There is no removal, and NULL keys are not supported. */
+
+typedef struct GHashConcurrent GHashConcurrent;
+typedef struct GSetConcurrent GSetConcurrent;
+
+GHashConcurrent *lib_ghash_concurrent_new_ex(GHashHashFP hashfp,
+                                             GHashCmpFP cmpfp,
+                                             const char *info,
+                                             unsigned int nentries_reserve)
+    ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+GHashConcurrent *lib_ghash_concurrent_new(GHashHashFP hashfp,
+                                          GHashCmpFP cmpfp,
+                                          const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+/**
+ * Build a GHashConcurrent from arrays of keys and values, in parallel.
+ *
+ * param vals: Optional, when NULL all values are NULL.
+ * note When a key is duplicated, its first occurrence is kept.
+ */
+GHashConcurrent *lib_ghash_concurrent_new_from_array(GHashHashFP hashfp,
+                                                     GHashCmpFP cmpfp,
+                                                     const char *info,
+                                                     void **keys,
+                                                     void **vals,
+                                                     unsigned int nentries)
+    ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+void lib_ghash_concurrent_free(GHashConcurrent *gh,
+                               GHashKeyFreeFP keyfreefp,
+                               GHashValFreeFP valfreefp);
+/**
+ * Free the memory of shard tables replaced when growing.
+ *
+ * warning Only call when no other thread accesses gh.
+ */
+void lib_ghash_concurrent_reclaim(GHashConcurrent *gh);
+/**
+ * Add key/val when key isn't in gh yet, an existing value is never replaced.
+ *
+ * returns true if a new key has been added.
+ */
+bool lib_ghash_concurrent_add(GHashConcurrent *gh, void *key, void *val);
+/**
+ * Ensure key is in gh, adding it w val when it isn't.
+ *
+ * returns the value stored for key, which is val only when it has been added
+ * (when several threads ensure the same key, they all get the same value).
+ */
+void *lib_ghash_concurrent_ensure(GHashConcurrent *gh, void *key, void *val);
+void *lib_ghash_concurrent_lookup(const GHashConcurrent *gh,
+                                  const void *key) ATTR_WARN_UNUSED_RESULT;
+void *lib_ghash_concurrent_lookup_default(const GHashConcurrent *gh,
+                                          const void *key,
+                                          void *val_default) ATTR_WARN_UNUSED_RESULT;
+bool lib_ghash_concurrent_haskey(const GHashConcurrent *gh,
+                                 const void *key) ATTR_WARN_UNUSED_RESULT;
+/** Only exact when no insertion is running concurrently. */
+unsigned int lib_ghash_concurrent_len(const GHashConcurrent *gh) ATTR_WARN_UNUSED_RESULT;
+
+GSetConcurrent *lib_gset_concurrent_new_ex(GSetHashFP hashfp,
+                                           GSetCmpFP cmpfp,
+                                           const char *info,
+                                           unsigned int nentries_reserve)
+    ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+GSetConcurrent *lib_gset_concurrent_new(GSetHashFP hashfp,
+                                        GSetCmpFP cmpfp,
+                                        const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+GSetConcurrent *lib_gset_concurrent_new_from_array(GSetHashFP hashfp,
+                                                   GSetCmpFP cmpfp,
+                                                   const char *info,
+                                                   void **keys,
+                                                   unsigned int nentries)
+    ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+void lib_gset_concurrent_free(GSetConcurrent *gs, GSetKeyFreeFP keyfreefp);
+void lib_gset_concurrent_reclaim(GSetConcurrent *gs);
+/** returns true if a new key has been added. */
+bool lib_gset_concurrent_add(GSetConcurrent *gs, void *key);
+bool lib_gset_concurrent_haskey(const GSetConcurrent *gs, const void *key) ATTR_WARN_UNUSED_RESULT;
+unsigned int lib_gset_concurrent_len(const GSetConcurrent *gs) ATTR_WARN_UNUSED_RESULT;
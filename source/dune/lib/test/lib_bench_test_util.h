@@ -0,0 +1,23 @@
+#pragma once
+
+/* Harness for the benchmarks comparing thread-safe containers. */
+
+#include "lib_task.h"
+#include "lib_time.h"
+
+#include <cstdio>
+
+/* Run `fn` over [0, iter_num) in parallel & print the time it took. */
+static inline double lib_bench_parallel_range(const char *name,
+                                              const int iter_num,
+                                              void *userdata,
+                                              TaskParallelRangeFunc fn,
+                                              const TaskParallelSettings *settings)
+{
+  const double time_start = time_check_seconds_timer();
+  lib_task_parallel_range(0, iter_num, userdata, fn, settings);
+  const double time = time_check_seconds_timer() - time_start;
+  printf("bench (%s): %.6f\n", name, time);
+  fflush(stdout);
+  return time;
+}
@@ -1,12 +1,20 @@
 #include "testing/testing.h"
 
+#include "mem_guardedalloc.h"
+
 #define GHASH_INTERNAL_API
 
 #include "lib_ghash.h"
 #include "lib_rand.h"
+#include "lib_task.h"
+#include "lib_threads.h"
+#include "lib_time_utildefines.h"
 #include "lib_utildefines.h"
 
+#include "lib_bench_test_util.h"
+
 #define TESTCASE_SIZE 10000
+#define BENCH_SIZE 2000000
 
 /* Only keeping this in case here, for now. */
 #define PRINTF_GHASH_STATS(_gh) \
@@ -205,3 +213,176 @@ TEST(ghash, Pop)
 
   LIB_ghash_free(ghash, nullptr, nullptr);
 }
+
+/* Concurrent GHash. */
+
+struct GHashConcurrentTestData {
+  GHashConcurrent *ghash;
+  unsigned int *keys;
+};
+
+static void ghash_concurrent_add_fn(void *__restrict userdata,
+                                    const int i,
+                                    const TaskParallelTLS *__restrict /*tls*/)
+{
+  GHashConcurrentTestData *data = (GHashConcurrentTestData *)userdata;
+  const unsigned int k = data->keys[i];
+  lib_ghash_concurrent_add(data->ghash, POINTER_FROM_UINT(k), POINTER_FROM_UINT(k));
+}
+
+/* Insert from all threads at once, then lookup all keys. */
+TEST(ghash, ConcurrentInsertLookup)
+{
+  GHashConcurrent *ghash = lib_ghash_concurrent_new(
+      lib_ghashutil_inthash_p, lib_ghashutil_intcmp, __func__);
+  unsigned int keys[TESTCASE_SIZE];
+
+  init_keys(keys, 40);
+
+  GHashConcurrentTestData data = {ghash, keys};
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  lib_task_parallel_range(0, TESTCASE_SIZE, &data, ghash_concurrent_add_fn, &settings);
+
+  EXPECT_EQ(lib_ghash_concurrent_len(ghash), TESTCASE_SIZE);
+
+  for (int i = 0; i < TESTCASE_SIZE; i++) {
+    void *v = lib_ghash_concurrent_lookup(ghash, POINTER_FROM_UINT(keys[i]));
+    EXPECT_EQ(POINTER_AS_UINT(v), keys[i]);
+  }
+
+  /* Existing values are kept. */
+  EXPECT_FALSE(lib_ghash_concurrent_add(ghash, POINTER_FROM_UINT(keys[0]), nullptr));
+  EXPECT_EQ(lib_ghash_concurrent_ensure(ghash, POINTER_FROM_UINT(keys[0]), nullptr),
+            POINTER_FROM_UINT(keys[0]));
+
+  lib_ghash_concurrent_reclaim(ghash);
+  EXPECT_TRUE(lib_ghash_concurrent_haskey(ghash, POINTER_FROM_UINT(keys[1])));
+
+  lib_ghash_concurrent_free(ghash, nullptr, nullptr);
+}
+
+/* Bulk build w duplicated keys, first occurrence wins. */
+TEST(ghash, ConcurrentFromArray)
+{
+  unsigned int keys[TESTCASE_SIZE];
+  void *keys_p[TESTCASE_SIZE * 2], *vals_p[TESTCASE_SIZE * 2];
+
+  init_keys(keys, 50);
+
+  for (int i = 0; i < TESTCASE_SIZE; i++) {
+    keys_p[i] = keys_p[i + TESTCASE_SIZE] = POINTER_FROM_UINT(keys[i]);
+    vals_p[i] = POINTER_FROM_INT(i);
+    vals_p[i + TESTCASE_SIZE] = nullptr;
+  }
+
+  GHashConcurrent *ghash = lib_ghash_concurrent_new_from_array(lib_ghashutil_inthash_p,
+                                                               lib_ghashutil_intcmp,
+                                                               __func__,
+                                                               keys_p,
+                                                               vals_p,
+                                                               TESTCASE_SIZE * 2);
+
+  EXPECT_EQ(lib_ghash_concurrent_len(ghash), TESTCASE_SIZE);
+  for (int i = 0; i < TESTCASE_SIZE; i++) {
+    void *v = lib_ghash_concurrent_lookup(ghash, POINTER_FROM_UINT(keys[i]));
+    EXPECT_EQ(POINTER_AS_INT(v), i);
+  }
+
+  lib_ghash_concurrent_free(ghash, nullptr, nullptr);
+
+  GSetConcurrent *gset = lib_gset_concurrent_new_from_array(
+      lib_ghashutil_inthash_p, lib_ghashutil_intcmp, __func__, keys_p, TESTCASE_SIZE);
+  EXPECT_EQ(lib_gset_concurrent_len(gset), TESTCASE_SIZE);
+  for (int i = 0; i < TESTCASE_SIZE; i++) {
+    EXPECT_TRUE(lib_gset_concurrent_haskey(gset, POINTER_FROM_UINT(keys[i])));
+  }
+  EXPECT_FALSE(lib_gset_concurrent_add(gset, POINTER_FROM_UINT(keys[0])));
+  lib_gset_concurrent_free(gset, nullptr);
+}
+
+/* Benchmark: parallel insertion & lookup in a mutex-protected GHash vs a concurrent one. */
+
+struct GHashBenchData {
+  GHash *ghash;
+  GHashConcurrent *ghash_concurrent;
+  ThreadMutex mutex;
+};
+
+static void ghash_bench_locked_insert_fn(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict /*tls*/)
+{
+  GHashBenchData *data = (GHashBenchData *)userdata;
+  lib_mutex_lock(&data->mutex);
+  lib_ghash_insert(data->ghash, POINTER_FROM_INT(i + 1), POINTER_FROM_INT(i));
+  lib_mutex_unlock(&data->mutex);
+}
+
+static void ghash_bench_locked_lookup_fn(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict /*tls*/)
+{
+  GHashBenchData *data = (GHashBenchData *)userdata;
+  lib_mutex_lock(&data->mutex);
+  void *v = lib_ghash_lookup(data->ghash, POINTER_FROM_INT(i + 1));
+  lib_mutex_unlock(&data->mutex);
+  EXPECT_EQ(POINTER_AS_INT(v), i);
+}
+
+static void ghash_bench_concurrent_insert_fn(void *__restrict userdata,
+                                             const int i,
+                                             const TaskParallelTLS *__restrict /*tls*/)
+{
+  GHashBenchData *data = (GHashBenchData *)userdata;
+  lib_ghash_concurrent_add(data->ghash_concurrent, POINTER_FROM_INT(i + 1), POINTER_FROM_INT(i));
+}
+
+static void ghash_bench_concurrent_lookup_fn(void *__restrict userdata,
+                                             const int i,
+                                             const TaskParallelTLS *__restrict /*tls*/)
+{
+  GHashBenchData *data = (GHashBenchData *)userdata;
+  void *v = lib_ghash_concurrent_lookup(data->ghash_concurrent, POINTER_FROM_INT(i + 1));
+  EXPECT_EQ(POINTER_AS_INT(v), i);
+}
+
+TEST(ghash, ConcurrentBenchmark)
+{
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1024;
+
+  GHashBenchData data;
+  lib_mutex_init(&data.mutex);
+
+  data.ghash = lib_ghash_new(lib_ghashutil_inthash_p, lib_ghashutil_intcmp, __func__);
+  lib_bench_parallel_range("ghash_locked_insert", BENCH_SIZE, &data, ghash_bench_locked_insert_fn, &settings);
+  lib_bench_parallel_range("ghash_locked_lookup", BENCH_SIZE, &data, ghash_bench_locked_lookup_fn, &settings);
+  EXPECT_EQ(lib_ghash_len(data.ghash), BENCH_SIZE);
+  lib_ghash_free(data.ghash, nullptr, nullptr);
+
+  data.ghash_concurrent = lib_ghash_concurrent_new(
+      lib_ghashutil_inthash_p, lib_ghashutil_intcmp, __func__);
+  lib_bench_parallel_range("ghash_concurrent_insert", BENCH_SIZE, &data, ghash_bench_concurrent_insert_fn, &settings);
+  lib_bench_parallel_range("ghash_concurrent_lookup", BENCH_SIZE, &data, ghash_bench_concurrent_lookup_fn, &settings);
+  EXPECT_EQ(lib_ghash_concurrent_len(data.ghash_concurrent), BENCH_SIZE);
+  lib_ghash_concurrent_free(data.ghash_concurrent, nullptr, nullptr);
+
+  void **keys = (void **)mem_malloc(sizeof(void *) * BENCH_SIZE, __func__);
+  void **vals = (void **)mem_malloc(sizeof(void *) * BENCH_SIZE, __func__);
+  for (int i = 0; i < BENCH_SIZE; i++) {
+    keys[i] = POINTER_FROM_INT(i + 1);
+    vals[i] = POINTER_FROM_INT(i);
+  }
+  TIMEIT_START(ghash_concurrent_from_array);
+  data.ghash_concurrent = lib_ghash_concurrent_new_from_array(
+      lib_ghashutil_inthash_p, lib_ghashutil_intcmp, __func__, keys, vals, BENCH_SIZE);
+  TIMEIT_END(ghash_concurrent_from_array);
+  EXPECT_EQ(lib_ghash_concurrent_len(data.ghash_concurrent), BENCH_SIZE);
+  lib_ghash_concurrent_free(data.ghash_concurrent, nullptr, nullptr);
+  mem_free(keys);
+  mem_free(vals);
+
+  lib_mutex_end(&data.mutex);
+}
@@ -0,0 +1,158 @@
+#include "testing/testing.h"
+
+#include "lib_mempool.h"
+#include "lib_task.h"
+#include "lib_threads.h"
+#include "lib_utildefines.h"
+
+#include "lib_bench_test_util.h"
+
+#define TESTCASE_SIZE 10000
+#define BENCH_ELEM_NUM 2000000
+#define BENCH_BATCH 64
+
+struct TestElem {
+  int value;
+  float co[3];
+};
+
+/* Alloc and free from a single magazine, then check pool len and iter. */
+TEST(mempool, MagazineAllocFree)
+{
+  LibMempool *pool = lib_mempool_create_concurrent(
+      sizeof(TestElem), 512, LIB_MEMPOOL_ALLOW_ITER);
+  LibMempoolMagazine *mag = lib_mempool_magazine_acquire(pool);
+  TestElem *elems[TESTCASE_SIZE];
+
+  for (int i = 0; i < TESTCASE_SIZE; i++) {
+    elems[i] = (TestElem *)lib_mempool_magazine_alloc(mag);
+    elems[i]->value = i;
+  }
+  EXPECT_EQ(lib_mempool_len(pool), TESTCASE_SIZE);
+
+  for (int i = 0; i < TESTCASE_SIZE; i += 2) {
+    lib_mempool_magazine_free(mag, elems[i]);
+  }
+  EXPECT_EQ(lib_mempool_len(pool), TESTCASE_SIZE / 2);
+
+  LibMempoolIter iter;
+  int num_iter = 0;
+  lib_mempool_iternew(pool, &iter);
+  while (TestElem *elem = (TestElem *)lib_mempool_iterstep(&iter)) {
+    EXPECT_EQ(elem->value % 2, 1);
+    num_iter++;
+  }
+  EXPECT_EQ(num_iter, TESTCASE_SIZE / 2);
+
+  lib_mempool_magazine_release(mag);
+  lib_mempool_destroy(pool);
+}
+
+/* Elems freed through another magazine are returned to their owner. */
+TEST(mempool, MagazineRemoteFree)
+{
+  LibMempool *pool = lib_mempool_create_concurrent(sizeof(TestElem), 512, 0);
+  LibMempoolMagazine *mag_a = lib_mempool_magazine_acquire(pool);
+  LibMempoolMagazine *mag_b = lib_mempool_magazine_acquire(pool);
+  EXPECT_NE(mag_a, mag_b);
+
+  TestElem *elem = (TestElem *)lib_mempool_magazine_alloc(mag_a);
+  lib_mempool_magazine_free(mag_b, elem);
+  EXPECT_EQ(lib_mempool_len(pool), 0);
+
+  /* A released magazine is handed out again. */
+  lib_mempool_magazine_release(mag_a);
+  EXPECT_EQ(lib_mempool_magazine_acquire(pool), mag_a);
+
+  lib_mempool_magazine_release(mag_b);
+  lib_mempool_magazine_release(mag_a);
+  lib_mempool_destroy(pool);
+}
+
+/* Benchmark: parallel alloc/free w a mutex-protected pool vs magazines.
+ * Each thread holds on to its magazine for the whole run, as users of concurrent pools
+ * are expected to, so the magazine case measures the per-thread fast path. */
+
+struct MempoolBenchData {
+  LibMempool *pool;
+  ThreadMutex mutex;
+};
+
+struct MempoolBenchTLS {
+  LibMempoolMagazine *mag;
+};
+
+static void mempool_bench_locked_fn(void *__restrict userdata,
+                                    const int /*iter*/,
+                                    const TaskParallelTLS *__restrict /*tls*/)
+{
+  MempoolBenchData *data = (MempoolBenchData *)userdata;
+  void *elems[BENCH_BATCH];
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    lib_mutex_lock(&data->mutex);
+    elems[i] = lib_mempool_alloc(data->pool);
+    lib_mutex_unlock(&data->mutex);
+  }
+  for (int i = 0; i < BENCH_BATCH; i += 2) {
+    lib_mutex_lock(&data->mutex);
+    lib_mempool_free(data->pool, elems[i]);
+    lib_mutex_unlock(&data->mutex);
+  }
+}
+
+static void mempool_bench_magazine_fn(void *__restrict userdata,
+                                      const int /*iter*/,
+                                      const TaskParallelTLS *__restrict tls)
+{
+  MempoolBenchData *data = (MempoolBenchData *)userdata;
+  MempoolBenchTLS *bench_tls = (MempoolBenchTLS *)tls->userdata_chunk;
+  if (bench_tls->mag == nullptr) {
+    bench_tls->mag = lib_mempool_magazine_acquire(data->pool);
+  }
+  LibMempoolMagazine *mag = bench_tls->mag;
+  void *elems[BENCH_BATCH];
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    elems[i] = lib_mempool_magazine_alloc(mag);
+  }
+  for (int i = 0; i < BENCH_BATCH; i += 2) {
+    lib_mempool_magazine_free(mag, elems[i]);
+  }
+}
+
+static void mempool_bench_magazine_free(const void *__restrict /*userdata*/, void *chunk)
+{
+  MempoolBenchTLS *bench_tls = (MempoolBenchTLS *)chunk;
+  if (bench_tls->mag) {
+    lib_mempool_magazine_release(bench_tls->mag);
+  }
+}
+
+/* Benchmark: locked vs. magazine alloc/free of BENCH_ELEM_NUM elems.
+ * Disabled by default, run with `--gtest_also_run_disabled_tests`. */
+TEST(mempool, DISABLED_ConcurrentBenchmark)
+{
+  const int tasks_num = BENCH_ELEM_NUM / BENCH_BATCH;
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+
+  MempoolBenchData data;
+  lib_mutex_init(&data.mutex);
+
+  data.pool = lib_mempool_create(sizeof(TestElem), 0, 512, LIB_MEMPOOL_NOP);
+  lib_bench_parallel_range("mempool_locked", tasks_num, &data, mempool_bench_locked_fn, &settings);
+  EXPECT_EQ(lib_mempool_len(data.pool), tasks_num * (BENCH_BATCH / 2));
+  lib_mempool_destroy(data.pool);
+
+  MempoolBenchTLS bench_tls = {nullptr};
+  settings.userdata_chunk = &bench_tls;
+  settings.userdata_chunk_size = sizeof(bench_tls);
+  settings.func_free = mempool_bench_magazine_free;
+
+  data.pool = lib_mempool_create_concurrent(sizeof(TestElem), 512, LIB_MEMPOOL_NOP);
+  lib_bench_parallel_range(
+      "mempool_magazine", tasks_num, &data, mempool_bench_magazine_fn, &settings);
+  EXPECT_EQ(lib_mempool_len(data.pool), tasks_num * (BENCH_BATCH / 2));
+  lib_mempool_destroy(data.pool);
+
+  lib_mutex_end(&data.mutex);
+}
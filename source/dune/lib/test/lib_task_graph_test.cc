@@ -0,0 +1,83 @@
+#include "testing/testing.h"
+
+#include "lib_task.h"
+#include "lib_utildefines.h"
+
+#include <atomic>
+
+#define CHAIN_LEN 16
+
+struct TaskGraphCounter {
+  std::atomic<int> runs{0};
+};
+
+static void task_graph_count_run(void *task_data)
+{
+  TaskGraphCounter *counter = static_cast<TaskGraphCounter *>(task_data);
+  counter->runs.fetch_add(1);
+}
+
+/* A root w a chain of successors, so every run ex CHAIN_LEN + 1 nodes. */
+static TaskNode *task_graph_chain_create(TaskGraph *graph, TaskGraphCounter *counter)
+{
+  TaskNode *root = lib_task_graph_node_create(graph, task_graph_count_run, counter, nullptr);
+  TaskNode *prev = root;
+  for (int i = 0; i < CHAIN_LEN; i++) {
+    TaskNode *node = lib_task_graph_node_create(graph, task_graph_count_run, counter, nullptr);
+    lib_task_graph_edge_create(prev, node);
+    prev = node;
+  }
+  return root;
+}
+
+/* Pushing & waiting on the same graph again must only run the newly pushed nodes. */
+TEST(task_graph, ScheduledReuse)
+{
+  TaskGraphCounter counter;
+  TaskGraph *graph = lib_task_graph_create_scheduled();
+  TaskNode *root = task_graph_chain_create(graph, &counter);
+
+  for (int i = 1; i <= 3; i++) {
+    lib_task_graph_node_push_work(root);
+    lib_task_graph_work_and_wait(graph);
+    EXPECT_EQ(counter.runs.load(), (CHAIN_LEN + 1) * i);
+  }
+
+  /* Nothing pushed, nothing runs. */
+  lib_task_graph_work_and_wait(graph);
+  EXPECT_EQ(counter.runs.load(), (CHAIN_LEN + 1) * 3);
+
+  lib_task_graph_free(graph);
+}
+
+/* Pushing a node twice before waiting runs it once. */
+TEST(task_graph, ScheduledPushTwice)
+{
+  TaskGraphCounter counter;
+  TaskGraph *graph = lib_task_graph_create_scheduled();
+  TaskNode *root = task_graph_chain_create(graph, &counter);
+
+  lib_task_graph_node_push_work(root);
+  lib_task_graph_node_push_work(root);
+  lib_task_graph_work_and_wait(graph);
+  EXPECT_EQ(counter.runs.load(), CHAIN_LEN + 1);
+
+  lib_task_graph_free(graph);
+}
+
+/* Replay runs the roots of the last run again, without pushing them. */
+TEST(task_graph, ScheduledReplay)
+{
+  TaskGraphCounter counter;
+  TaskGraph *graph = lib_task_graph_create_scheduled();
+  TaskNode *root = task_graph_chain_create(graph, &counter);
+
+  lib_task_graph_node_push_work(root);
+  lib_task_graph_work_and_wait(graph);
+  lib_task_graph_replay(graph);
+  lib_task_graph_replay(graph);
+  EXPECT_EQ(counter.runs.load(), (CHAIN_LEN + 1) * 3);
+  EXPECT_GE(lib_task_graph_node_recorded_time(root), 0.0);
+
+  lib_task_graph_free(graph);
+}
@@ -287,6 +287,12 @@ typedef struct Mesh {
   /* element pools */
   struct lib_mempool *vpool, *epool, *lpool, *fpool;
 
+  /**
+   * Number of faces created or killed since the element pools were last packed,
+   * see mesh_compact_is_needed.
+   */
+  int totface_churn;
+
   /* mempool lookup tables (optional)
    * index tables, to map indices to elements via
    * mesh_elem_table_ensure and associated functions.  don't
@@ -1301,6 +1301,212 @@ void mesh_toolflags_set(Mesh *mesh, bool use_toolflags)
   mesh->use_toolflags = use_toolflags;
 }
 
+/* -------------------------------------------------------------------- */
+/** Mesh Compacting
+ *
+ * After many topology edits the elements are spread over partially used mempool chunks
+ * in an order unrelated to their location, so iterating over the mesh and walking
+ * its adjacency jumps around in memory.
+ * Compacting sorts the elements in spatial (Z-order) and re-allocates them contiguously,
+ * along w their custom-data blocks, with the loops of each face next to each other.
+ **/
+
+/* Don't bother compacting small meshes, they fit in the cache anyway. */
+#define MESH_COMPACT_FACES_MIN 10000
+
+typedef struct MeshCompactSortElem {
+  uint key;
+  uint index;
+} MeshCompactSortElem;
+
+static int mesh_compact_sort_elem_cmp(const void *a_v, const void *b_v)
+{
+  const MeshCompactSortElem *a = a_v;
+  const MeshCompactSortElem *b = b_v;
+  if (a->key != b->key) {
+    return a->key < b->key ? -1 : 1;
+  }
+  /* Keep the existing order for equal keys, so the result is deterministic. */
+  return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+/* Spread the lower 10 bits of x w two zero bits between each. */
+static uint mesh_compact_morton_expand(uint x)
+{
+  x &= 0x3ff;
+  x = (x | (x << 16)) & 0x030000ff;
+  x = (x | (x << 8)) & 0x0300f00f;
+  x = (x | (x << 4)) & 0x030c30c3;
+  x = (x | (x << 2)) & 0x09249249;
+  return x;
+}
+
+/* Sort elems and write the new index of each one into r_new_index (old to new). */
+static void mesh_compact_sort(MeshCompactSortElem *elems, const int elems_num, uint *r_new_index)
+{
+  qsort(elems, (size_t)elems_num, sizeof(*elems), mesh_compact_sort_elem_cmp);
+  for (int i = 0; i < elems_num; i++) {
+    r_new_index[elems[i].index] = (uint)i;
+  }
+}
+
+static void mesh_compact_customdata(Mesh *mesh,
+                                    CustomData *data,
+                                    const char itype,
+                                    const int elem_num,
+                                    const int chunk_size)
+{
+  if ((data->pool == NULL) || (data->totsize == 0)) {
+    return;
+  }
+  lib_mempool *pool_dst = lib_mempool_create(data->totsize, elem_num, chunk_size, LIB_MEMPOOL_NOP);
+  MeshIter iter;
+  MeshElem *ele;
+  MESH_ITER (ele, &iter, mesh, itype) {
+    void *block = lib_mempool_alloc(pool_dst);
+    memcpy(block, ele->head.data, (size_t)data->totsize);
+    ele->head.data = block;
+  }
+  lib_mempool_destroy(data->pool);
+  data->pool = pool_dst;
+}
+
+static void mesh_compact_customdata_loops(Mesh *mesh)
+{
+  CustomData *data = &mesh->ldata;
+  if ((data->pool == NULL) || (data->totsize == 0)) {
+    return;
+  }
+  lib_mempool *pool_dst = lib_mempool_create(
+      data->totsize, mesh->totloop, mesh_chunksize_default.totloop, LIB_MEMPOOL_NOP);
+  MeshIter iter;
+  MeshFace *f;
+  MESH_ITER (f, &iter, mesh, MESH_FACES_OF_MESH) {
+    MeshLoop *l_iter, *l_first;
+    l_iter = l_first = MESH_FACE_FIRST_LOOP(f);
+    do {
+      void *block = lib_mempool_alloc(pool_dst);
+      memcpy(block, l_iter->head.data, (size_t)data->totsize);
+      l_iter->head.data = block;
+    } while ((l_iter = l_iter->next) != l_first);
+  }
+  lib_mempool_destroy(data->pool);
+  data->pool = pool_dst;
+}
+
+bool mesh_compact_is_needed(const Mesh *mesh)
+{
+  return (mesh->totface >= MESH_COMPACT_FACES_MIN) && (mesh->totface_churn > mesh->totface / 2);
+}
+
+void mesh_compact(Mesh *mesh)
+{
+  if (mesh->totvert == 0) {
+    mesh->totface_churn = 0;
+    return;
+  }
+
+  mesh_elem_index_ensure(mesh, MESH_VERT | MESH_EDGE | MESH_FACE);
+
+  uint *vert_idx = mem_mallocn(sizeof(*vert_idx) * (size_t)mesh->totvert, __func__);
+  uint *edge_idx = mem_mallocn(sizeof(*edge_idx) * (size_t)mesh->totedge, __func__);
+  uint *face_idx = mem_mallocn(sizeof(*face_idx) * (size_t)mesh->totface, __func__);
+  const int sort_num = max_iii(mesh->totvert, mesh->totedge, mesh->totface);
+  MeshCompactSortElem *sort_elems = mem_mallocn(sizeof(*sort_elems) * (size_t)sort_num, __func__);
+
+  MeshIter iter;
+  int i;
+
+  /* Verts, in Z-order of their location w 10 bits per axis. */
+  {
+    float min[3], max[3], scale[3];
+    INIT_MINMAX(min, max);
+    MeshVert *v;
+    MESH_ITER (v, &iter, mesh, MESH_VERTS_OF_MESH) {
+      minmax_v3v3_v3(min, max, v->co);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      const float range = max[axis] - min[axis];
+      scale[axis] = (range > 0.0f) ? 1023.0f / range : 0.0f;
+    }
+    MESH_INDEX_ITER (v, &iter, mesh, MESH_VERTS_OF_MESH, i) {
+      uint key = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        const uint co_quantized = (uint)((v->co[axis] - min[axis]) * scale[axis]);
+        key |= mesh_compact_morton_expand(co_quantized) << axis;
+      }
+      sort_elems[i].key = key;
+      sort_elems[i].index = (uint)i;
+    }
+    mesh_compact_sort(sort_elems, mesh->totvert, vert_idx);
+  }
+
+  /* Edges & faces follow their lowest vert, keeping them close to their verts in memory. */
+  {
+    MeshEdge *e;
+    MESH_INDEX_ITER (e, &iter, mesh, MESH_EDGES_OF_MESH, i) {
+      sort_elems[i].key = min_uu(vert_idx[mesh_elem_index_get(e->v1)],
+                                 vert_idx[mesh_elem_index_get(e->v2)]);
+      sort_elems[i].index = (uint)i;
+    }
+    mesh_compact_sort(sort_elems, mesh->totedge, edge_idx);
+  }
+  {
+    MeshFace *f;
+    MESH_INDEX_ITER (f, &iter, mesh, MESH_FACES_OF_MESH, i) {
+      uint key = UINT_MAX;
+      MeshLoop *l_iter, *l_first;
+      l_iter = l_first = MESH_FACE_FIRST_LOOP(f);
+      do {
+        key = min_uu(key, vert_idx[mesh_elem_index_get(l_iter->v)]);
+      } while ((l_iter = l_iter->next) != l_first);
+      sort_elems[i].key = key;
+      sort_elems[i].index = (uint)i;
+    }
+    mesh_compact_sort(sort_elems, mesh->totface, face_idx);
+  }
+  mem_freen(sort_elems);
+
+  /* Reorder the elements in their pools, then move them into new pools in that order. */
+  mesh_remap(mesh, vert_idx, edge_idx, face_idx);
+  mem_freen(vert_idx);
+  mem_freen(edge_idx);
+  mem_freen(face_idx);
+
+  const MeshAllocTemplate allocsize = MESHALLOC_TEMPLATE_FROM_MESH(mesh);
+  lib_mempool *vpool_dst = NULL;
+  lib_mempool *epool_dst = NULL;
+  lib_mempool *lpool_dst = NULL;
+  lib_mempool *fpool_dst = NULL;
+  mesh_mempool_init_ex(
+      &allocsize, mesh->use_toolflags, &vpool_dst, &epool_dst, &lpool_dst, &fpool_dst);
+  mesh_rebuild(mesh,
+               &((struct MeshCreateParams){
+                   .use_toolflags = mesh->use_toolflags,
+               }),
+               vpool_dst,
+               epool_dst,
+               lpool_dst,
+               fpool_dst);
+
+  mesh_compact_customdata(
+      mesh, &mesh->vdata, MESH_VERTS_OF_MESH, mesh->totvert, mesh_chunksize_default.totvert);
+  mesh_compact_customdata(
+      mesh, &mesh->edata, MESH_EDGES_OF_MESH, mesh->totedge, mesh_chunksize_default.totedge);
+  mesh_compact_customdata(
+      mesh, &mesh->pdata, MESH_FACES_OF_MESH, mesh->totface, mesh_chunksize_default.totface);
+  mesh_compact_customdata_loops(mesh);
+
+  /* Loop normal spaces reference loops. */
+  if (mesh->lnor_spacearr) {
+    dune_lnor_spacearr_clear(mesh->lnor_spacearr);
+  }
+  mesh->spacearr_dirty |= MESH_SPACEARR_DIRTY_ALL;
+
+  mesh->elem_index_dirty |= MESH_ALL;
+  mesh->totface_churn = 0;
+}
+
 /* -------------------------------------------------------------------- */
 /** Mesh Coordinate Access **/
 
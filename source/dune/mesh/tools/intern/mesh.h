@@ -155,6 +155,20 @@ void mesh_rebuild(Mesh *mesh,
                   struct lib_mempool *lpool,
                   struct lib_mempool *fpool);
 
+/**
+ * Pack the elements & their custom-data into new mempools, sorted by location,
+ * to speed up iterating over large meshes after many topology edits.
+ *
+ * warning Like mesh_remap and mesh_rebuild, this invalidates all pointers to elements
+ * (other than the selection history and active face, which are updated).
+ */
+void mesh_compact(Mesh *mesh);
+/**
+ * Check if enough faces were added or removed since the mesh was converted (or compacted)
+ * for mesh_compact to be worthwhile.
+ */
+bool mesh_compact_is_needed(const Mesh *mesh);
+
 typedef struct MeshAllocTemplate {
   int totvert, totedge, totloop, totface;
 } MeshAllocTemplate;
@@ -78,7 +78,10 @@
 #include "lib_index_range.hh"
 #include "lib_listbase.h"
 #include "lib_math_vector.h"
+#include "lib_mempool.h"
 #include "lib_span.hh"
+#include "lib_task.hh"
+#include "lib_vector.hh"
 
 #include "dune_customdata.h"
 #include "dune_mesh.h"
@@ -100,6 +103,9 @@ static CLG_LogRef LOG = {"mesh.mesh.convert"};
 using dune::Array;
 using dune::IndexRange;
 using dune::Span;
+using dune::Vector;
+using dune::threading::parallel_for;
+using dune::threading::parallel_invoke;
 
 void mesh_cd_flag_ensure(Mesh *mesh, Mesh *mesh, const char cd_flag)
 {
@@ -197,6 +203,180 @@ static MeshFace *mesh_face_create_from_mpoly(Mesh &mesh,
   return mesh_face_create(&msh, verts.data(), edges.data(), loops.size(), nullptr, MESH_CREATE_SKIP_CD);
 }
 
+/* -------------------------------------------------------------------- */
+/** Custom-Data Layer Copying
+ *
+ * Instead of per element callbacks matching layers for every element,
+ * layers are matched once, then each layer is copied for a range of elements at a time,
+ * so worker threads read & write the mesh arrays contiguously. */
+
+struct MeshLayerCopyInfo {
+  eCustomDataType type;
+  /** Offset of the layer in the element blocks. */
+  int block_offset;
+  /** Matching mesh array, null when the layer only exists in the element blocks. */
+  void *array;
+  int elem_size;
+};
+
+/**
+ * Match the layers of element blocks to mesh arrays by name,
+ * or by their index among layers of the same type for unnamed layers.
+ */
+static Vector<MeshLayerCopyInfo> mesh_layer_copy_info_calc(const CustomData &block_data,
+                                                            const CustomData &array_data)
+{
+  Vector<MeshLayerCopyInfo> copy_info;
+  int type_index[CD_NUMTYPES] = {0};
+  for (const int i : IndexRange(block_data.totlayer)) {
+    const CustomDataLayer &layer = block_data.layers[i];
+    const eCustomDataType type = eCustomDataType(layer.type);
+    const int array_index = (layer.name[0] == '\0') ?
+                                CustomData_get_layer_index_n(&array_data, type, type_index[type]) :
+                                CustomData_get_named_layer_index(&array_data, type, layer.name);
+    type_index[type]++;
+
+    MeshLayerCopyInfo info;
+    info.type = type;
+    info.block_offset = layer.offset;
+    info.array = (array_index == -1) ? nullptr : array_data.layers[array_index].data;
+    info.elem_size = CustomData_sizeof(type);
+    copy_info.append(info);
+  }
+  return copy_info;
+}
+
+/**
+ * Copy mesh arrays, starting at `index_start`, into the already allocated blocks of `elems`.
+ * Null elements are skipped (faces that couldn't be created).
+ */
+template<typename T>
+static void mesh_layers_copy_to_blocks(const Span<MeshLayerCopyInfo> copy_info,
+                                       const Span<T *> elems,
+                                       const int index_start)
+{
+  for (const MeshLayerCopyInfo &info : copy_info) {
+    if (info.array == nullptr) {
+      for (T *elem : elems) {
+        if (elem != nullptr) {
+          CustomData_data_set_default_value(info.type,
+                                            POINTER_OFFSET(elem->head.data, info.block_offset));
+        }
+      }
+      continue;
+    }
+    const char *src = (const char *)POINTER_OFFSET(info.array,
+                                                   size_t(info.elem_size) * index_start);
+    for (T *elem : elems) {
+      if (elem != nullptr) {
+        CustomData_copy_elements(
+            info.type, (void *)src, POINTER_OFFSET(elem->head.data, info.block_offset), 1);
+      }
+      src += info.elem_size;
+    }
+  }
+}
+
+/** Copy mesh loop arrays into the already allocated loop blocks of `faces`. */
+static void mesh_loop_layers_copy_to_blocks(const Span<MeshLayerCopyInfo> copy_info,
+                                            const Span<MeshFace *> faces,
+                                            const Span<MeshPoly> mpoly)
+{
+  for (const MeshLayerCopyInfo &info : copy_info) {
+    for (const int i : faces.index_range()) {
+      const MeshFace *f = faces[i];
+      if (f == nullptr) {
+        continue;
+      }
+      const char *src = info.array ? (const char *)POINTER_OFFSET(
+                                         info.array, size_t(info.elem_size) * mpoly[i].loopstart) :
+                                     nullptr;
+      MeshLoop *l_first = MESH_FACE_FIRST_LOOP(f);
+      MeshLoop *l_iter = l_first;
+      do {
+        void *dst = POINTER_OFFSET(l_iter->head.data, info.block_offset);
+        if (info.array == nullptr) {
+          CustomData_data_set_default_value(info.type, dst);
+        }
+        else {
+          CustomData_copy_elements(info.type, (void *)src, dst, 1);
+          src += info.elem_size;
+        }
+      } while ((l_iter = l_iter->next) != l_first);
+    }
+  }
+}
+
+/** Copy the blocks of `elems` into mesh arrays, starting at `index_start`. */
+template<typename T>
+static void mesh_layers_copy_from_blocks(const Span<MeshLayerCopyInfo> copy_info,
+                                         const Span<T *> elems,
+                                         const int index_start)
+{
+  for (const MeshLayerCopyInfo &info : copy_info) {
+    if (info.array == nullptr) {
+      continue;
+    }
+    char *dst = (char *)POINTER_OFFSET(info.array, size_t(info.elem_size) * index_start);
+    for (const T *elem : elems) {
+      CustomData_copy_elements(
+          info.type, POINTER_OFFSET(elem->head.data, info.block_offset), dst, 1);
+      dst += info.elem_size;
+    }
+  }
+}
+
+/** Copy the loop blocks of `faces` into mesh arrays, loop indices must be valid. */
+static void mesh_loop_layers_copy_from_blocks(const Span<MeshLayerCopyInfo> copy_info,
+                                              const Span<MeshFace *> faces)
+{
+  for (const MeshLayerCopyInfo &info : copy_info) {
+    if (info.array == nullptr) {
+      continue;
+    }
+    for (const MeshFace *f : faces) {
+      const MeshLoop *l_first = MESH_FACE_FIRST_LOOP(f);
+      char *dst = (char *)POINTER_OFFSET(info.array,
+                                         size_t(info.elem_size) * mesh_elem_index_get(l_first));
+      const MeshLoop *l_iter = l_first;
+      do {
+        CustomData_copy_elements(
+            info.type, POINTER_OFFSET(l_iter->head.data, info.block_offset), dst, 1);
+        dst += info.elem_size;
+      } while ((l_iter = l_iter->next) != l_first);
+    }
+  }
+}
+
+/**
+ * Allocate element & custom-data chunks up-front,
+ * so creating elements doesn't have to (and their memory stays contiguous).
+ */
+static void mesh_from_me_mempools_reserve(Mesh *mesh, const Mesh *me)
+{
+  const struct {
+    lib_mempool *pool;
+    int num;
+  } pools[] = {
+      {mesh->vpool, me->totvert},
+      {mesh->epool, me->totedge},
+      {mesh->lpool, me->totloop},
+      {mesh->fpool, me->totpoly},
+      {mesh->vtoolflagpool, me->totvert},
+      {mesh->etoolflagpool, me->totedge},
+      {mesh->ftoolflagpool, me->totpoly},
+      {mesh->vdata.pool, me->totvert},
+      {mesh->edata.pool, me->totedge},
+      {mesh->ldata.pool, me->totloop},
+      {mesh->pdata.pool, me->totpoly},
+  };
+  for (const auto &item : pools) {
+    if (item.pool != nullptr) {
+      lib_mempool_reserve(item.pool, uint(item.num));
+    }
+  }
+}
+
 void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *params)
 {
   const bool is_new = !(mesh->totvert || (mesh->vdata.totlayer || mesh->edata.totlayer ||
@@ -351,6 +531,11 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
                                            CustomData_get_offset(&mesh->vdata, CD_SHAPE_KEYINDEX) :
                                            -1;
 
+  mesh_from_me_mempools_reserve(mesh, me);
+
+  /* Elements are created serially (they are linked to each other & counted for selection),
+   * custom-data, normals & shape-keys are then filled in parallel. */
+
   Span<MeshVert> mvert{me->mvert, me->totvert};
   Array<MeshVert *> vtable(me->totvert);
   for (const int i : mvert.index_range()) {
@@ -366,29 +551,7 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
       mesh_vert_select_set(mesh, v, true);
     }
 
-    if (vert_normals) {
-      copy_v3_v3(v->no, vert_normals[i]);
-    }
-
-    /* Copy Custom Data */
-    CustomData_to_mesh_block(&me->vdata, &mesh->vdata, i, &v->head.data, true);
-
-    if (cd_vert_bweight_offset != -1) {
-      MESH_ELEM_CD_SET_FLOAT(v, cd_vert_bweight_offset, (float)mvert[i].bweight / 255.0f);
-    }
-
-    /* Set shape key original index. */
-    if (cd_shape_keyindex_offset != -1) {
-      MESH_ELEM_CD_SET_INT(v, cd_shape_keyindex_offset, i);
-    }
-
-    /* Set shape-key data. */
-    if (tot_shape_keys) {
-      float(*co_dst)[3] = (float(*)[3])MESH_ELEM_CD_GET_VOID_P(v, cd_shape_key_offset);
-      for (int j = 0; j < tot_shape_keys; j++, co_dst++) {
-        copy_v3_v3(*co_dst, shape_key_table[j][i]);
-      }
-    }
+    CustomData_mesh_alloc_block(&mesh->vdata, &v->head.data);
   }
   if (is_new) {
     mesh->elem_index_dirty &= ~MESH_VERT; /* Added in order, clear dirty flag. */
@@ -409,15 +572,7 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
       mesh_edge_select_set(mesh, e, true);
     }
 
-    /* Copy Custom Data */
-    CustomData_to_mesh_block(&me->edata, &bm->edata, i, &e->head.data, true);
-
-    if (cd_edge_bweight_offset != -1) {
-      MESH_ELEM_CD_SET_FLOAT(e, cd_edge_bweight_offset, (float)medge[i].weight / 255.0f);
-    }
-    if (cd_edge_crease_offset != -1) {
-      MESH_ELEM_CD_SET_FLOAT(e, cd_edge_crease_offset, (float)medge[i].crease / 255.0f);
-    }
+    CustomData_mesh_alloc_block(&mesh->edata, &e->head.data);
   }
   if (is_new) {
     mesh->elem_index_dirty &= ~MESH_EDGE; /* Added in order, clear dirty flag. */
@@ -426,20 +581,13 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
   Span<MeshPoly> mpoly{me->mpoly, me->totpoly};
   Span<MeshLoop> mloop{me->mloop, me->totloop};
 
-  /* Only needed for selection. */
-
-  Array<MeshFace *> ftable;
-  if (me->mselect && me->totselect != 0) {
-    ftable.reinitialize(me->totpoly);
-  }
+  /* Null for faces that couldn't be created. */
+  Array<MeshFace *> ftable(me->totpoly);
 
   int totloops = 0;
   for (const int i : mpoly.index_range()) {
-    MeshFace *f = mesh_face_create_from_mpoly(
+    MeshFace *f = ftable[i] = mesh_face_create_from_mpoly(
         *mesh, mloop.slice(mpoly[i].loopstart, mpoly[i].totloop), vtable, etable);
-    if (!ftable.is_empty()) {
-      ftable[i] = f;
-    }
 
     if (UNLIKELY(f == nullptr)) {
       printf(
@@ -467,28 +615,92 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
       mesh->act_face = f;
     }
 
-    int j = mpoly[i].loopstart;
     MeshLoop *l_first = MESH_FACE_FIRST_LOOP(f);
     MeshLoop *l_iter = l_first;
     do {
       /* Don't use 'j' since we may have skipped some faces, hence some loops. */
       mesh_elem_index_set(l_iter, totloops++); /* set_ok */
-
-      /* Save index of corresponding MeehLoop. */
-      CustomData_to_mesh_block(&me->ldata, &mesh->ldata, j++, &l_iter->head.data, true);
+      CustomData_mesh_alloc_block(&mesh->ldata, &l_iter->head.data);
     } while ((l_iter = l_iter->next) != l_first);
 
-    /* Copy Custom Data */
-    CustomData_to_mesh_block(&me->pdata, &mesh->pdata, i, &f->head.data, true);
-
-    if (params->calc_face_normal) {
-      mesh_face_normal_update(f);
-    }
+    CustomData_mesh_alloc_block(&mesh->pdata, &f->head.data);
   }
   if (is_new) {
     mesh->elem_index_dirty &= ~(MESH_FACE | MESH_LOOP); /* Added in order, clear dirty flag. */
   }
 
+  const Vector<MeshLayerCopyInfo> vert_copy_info = mesh_layer_copy_info_calc(mesh->vdata,
+                                                                             me->vdata);
+  const Vector<MeshLayerCopyInfo> edge_copy_info = mesh_layer_copy_info_calc(mesh->edata,
+                                                                             me->edata);
+  const Vector<MeshLayerCopyInfo> loop_copy_info = mesh_layer_copy_info_calc(mesh->ldata,
+                                                                             me->ldata);
+  const Vector<MeshLayerCopyInfo> face_copy_info = mesh_layer_copy_info_calc(mesh->pdata,
+                                                                             me->pdata);
+
+  parallel_invoke(
+      [&]() {
+        parallel_for(mvert.index_range(), 2048, [&](const IndexRange range) {
+          const Span<MeshVert *> verts = vtable.as_span().slice(range);
+          mesh_layers_copy_to_blocks(vert_copy_info, verts, int(range.start()));
+
+          for (const int i : range) {
+            MeshVert *v = vtable[i];
+            if (vert_normals) {
+              copy_v3_v3(v->no, vert_normals[i]);
+            }
+
+            if (cd_vert_bweight_offset != -1) {
+              MESH_ELEM_CD_SET_FLOAT(v, cd_vert_bweight_offset, (float)mvert[i].bweight / 255.0f);
+            }
+
+            /* Set shape key original index. */
+            if (cd_shape_keyindex_offset != -1) {
+              MESH_ELEM_CD_SET_INT(v, cd_shape_keyindex_offset, i);
+            }
+
+            /* Set shape-key data. */
+            if (tot_shape_keys) {
+              float(*co_dst)[3] = (float(*)[3])MESH_ELEM_CD_GET_VOID_P(v, cd_shape_key_offset);
+              for (int j = 0; j < tot_shape_keys; j++, co_dst++) {
+                copy_v3_v3(*co_dst, shape_key_table[j][i]);
+              }
+            }
+          }
+        });
+      },
+      [&]() {
+        parallel_for(medge.index_range(), 4096, [&](const IndexRange range) {
+          const Span<MeshEdge *> edges = etable.as_span().slice(range);
+          mesh_layers_copy_to_blocks(edge_copy_info, edges, int(range.start()));
+
+          for (const int i : range) {
+            MeshEdge *e = etable[i];
+            if (cd_edge_bweight_offset != -1) {
+              MESH_ELEM_CD_SET_FLOAT(e, cd_edge_bweight_offset, (float)medge[i].bweight / 255.0f);
+            }
+            if (cd_edge_crease_offset != -1) {
+              MESH_ELEM_CD_SET_FLOAT(e, cd_edge_crease_offset, (float)medge[i].crease / 255.0f);
+            }
+          }
+        });
+      },
+      [&]() {
+        parallel_for(mpoly.index_range(), 1024, [&](const IndexRange range) {
+          const Span<MeshFace *> faces = ftable.as_span().slice(range);
+          mesh_layers_copy_to_blocks(face_copy_info, faces, int(range.start()));
+          mesh_loop_layers_copy_to_blocks(loop_copy_info, faces, mpoly.slice(range));
+
+          if (params->calc_face_normal) {
+            for (MeshFace *f : faces) {
+              if (f != nullptr) {
+                mesh_face_normal_update(f);
+              }
+            }
+          }
+        });
+      });
+
   /* -------------------------------------------------------------------- */
   /* MSelect clears the array elements (to avoid adding multiple times).
    *
@@ -523,6 +735,9 @@ void mesh_from_me(Mesh *mesh, const Mesh *me, const struct MeshFromParams *param
   else {
     mesh_select_history_clear(mesh);
   }
+
+  /* Faces created by the conversion don't count towards #mesh_compact_is_needed. */
+  mesh->totface_churn = 0;
 }
 
 /** Mesh -> Mesh **/
@@ -899,10 +1114,7 @@ LIB_INLINE void mesh_quick_edgedraw_flag(MeshEdge *med, MeshEdge *e)
 
 void mesh_bm_to_me(Main *main, BMesh *bm, Mesh *me, const struct BMeshToMeshParams *params)
 {
-  MeshEdge *med;
-  MeshVert *v, *eve;
-  MeshEdge *e;
-  MeshFace *f;
+  MeshVert *eve;
   MeshIter iter;
   int i, j;
 
@@ -962,90 +1174,92 @@ void mesh_bm_to_me(Main *main, BMesh *bm, Mesh *me, const struct BMeshToMeshPara
   /* This is called again, 'dotess' arg is used there. */
   dune_mesh_update_customdata_pointers(me, false);
 
-  i = 0;
-  MESH_ITER (v, &iter, mesh, MESH_VERTS_OF_MESH) {
-    copy_v3_v3(mvert->co, v->co);
-
-    mvert->flag = mesh_vert_flag_to_mflag(v);
-
-    mesh_elem_index_set(v, i); /* set_inline */
-
-    /* Copy over custom-data. */
-    CustomData_from_bmesh_block(&mesh->vdata, &me->vdata, v->head.data, i);
-
-    if (cd_vert_bweight_offset != -1) {
-      mvert->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(v, cd_vert_bweight_offset);
-    }
-
-    i++;
-    mvert++;
-
-    MESH_CHECK_ELEMENT(v);
-  }
-  mesh->elem_index_dirty &= ~MESH_VERT;
-
-  med = medge;
-  i = 0;
-  MESH_ITER (e, &iter, mesh, MESH_EDGES_OF_MESH) {
-    med->v1 = mesh_elem_index_get(e->v1);
-    med->v2 = mesh_elem_index_get(e->v2);
-
-    med->flag = mesh_edge_flag_to_mflag(e);
-
-    mesh_elem_index_set(e, i); /* set_inline */
-
-    /* Copy over custom-data. */
-    CustomData_from_bmesh_block(&bm->edata, &me->edata, e->head.data, i);
-
-    bmesh_quick_edgedraw_flag(med, e);
-
-    if (cd_edge_crease_offset != -1) {
-      med->crease = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_crease_offset);
-    }
-    if (cd_edge_bweight_offset != -1) {
-      med->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_bweight_offset);
-    }
-
-    i++;
-    med++;
-    MESH_CHECK_ELEMENT(e);
-  }
-  mesh->elem_index_dirty &= ~MESH_EDGE;
-
-  i = 0;
-  j = 0;
-  MESH_ITER (f, &iter, mesh, MESH_FACES_OF_MESH) {
-    MeshLoop *l_iter, *l_first;
-    mpoly->loopstart = j;
-    mpoly->totloop = f->len;
-    mpoly->mat_nr = f->mat_nr;
-    mpoly->flag = mesh_face_flag_to_mflag(f);
-
-    l_iter = l_first = MESH_FACE_FIRST_LOOP(f);
-    do {
-      mloop->e = mesh_elem_index_get(l_iter->e);
-      mloop->v = mesh_elem_index_get(l_iter->v);
-
-      /* Copy over custom-data. */
-      CustomData_from_bmesh_block(&mesh->ldata, &me->ldata, l_iter->head.data, j);
-
-      j++;
-      mloop++;
-      MESH_CHECK_ELEMENT(l_iter);
-      MESH_CHECK_ELEMENT(l_iter->e);
-      MESH_CHECK_ELEMENT(l_iter->v);
-    } while ((l_iter = l_iter->next) != l_first);
-
-    if (f == bm->act_face) {
-      me->act_face = i;
-    }
-
-    /* Copy over custom-data. */
-    CustomData_from_bmesh_block(&bm->pdata, &me->pdata, f->head.data, i);
+  /* Indices & tables are assigned in bulk, then each element type is converted in parallel. */
+  mesh_elem_index_ensure(bm, MESH_VERT | MESH_EDGE | MESH_FACE | MESH_LOOP);
+  mesh_elem_table_ensure(bm, MESH_VERT | MESH_EDGE | MESH_FACE);
+
+  const Span<MeshVert *> bm_verts{bm->vtable, bm->totvert};
+  const Span<MeshEdge *> bm_edges{bm->etable, bm->totedge};
+  const Span<MeshFace *> bm_faces{bm->ftable, bm->totface};
+
+  const Vector<MeshLayerCopyInfo> vert_copy_info = mesh_layer_copy_info_calc(bm->vdata,
+                                                                             me->vdata);
+  const Vector<MeshLayerCopyInfo> edge_copy_info = mesh_layer_copy_info_calc(bm->edata,
+                                                                             me->edata);
+  const Vector<MeshLayerCopyInfo> loop_copy_info = mesh_layer_copy_info_calc(bm->ldata,
+                                                                             me->ldata);
+  const Vector<MeshLayerCopyInfo> face_copy_info = mesh_layer_copy_info_calc(bm->pdata,
+                                                                             me->pdata);
+
+  parallel_invoke(
+      [&]() {
+        parallel_for(bm_verts.index_range(), 2048, [&](const IndexRange range) {
+          mesh_layers_copy_from_blocks(vert_copy_info, bm_verts.slice(range), int(range.start()));
+          for (const int i : range) {
+            const MeshVert *v = bm_verts[i];
+            copy_v3_v3(mvert[i].co, v->co);
+            mvert[i].flag = mesh_vert_flag_to_mflag(v);
+            if (cd_vert_bweight_offset != -1) {
+              mvert[i].bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(v, cd_vert_bweight_offset);
+            }
+            MESH_CHECK_ELEMENT(v);
+          }
+        });
+      },
+      [&]() {
+        parallel_for(bm_edges.index_range(), 4096, [&](const IndexRange range) {
+          mesh_layers_copy_from_blocks(edge_copy_info, bm_edges.slice(range), int(range.start()));
+          for (const int i : range) {
+            MeshEdge *e = bm_edges[i];
+            MeshEdge *med = &medge[i];
+            med->v1 = mesh_elem_index_get(e->v1);
+            med->v2 = mesh_elem_index_get(e->v2);
+            med->flag = mesh_edge_flag_to_mflag(e);
+
+            mesh_quick_edgedraw_flag(med, e);
+
+            if (cd_edge_crease_offset != -1) {
+              med->crease = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_crease_offset);
+            }
+            if (cd_edge_bweight_offset != -1) {
+              med->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_bweight_offset);
+            }
+            MESH_CHECK_ELEMENT(e);
+          }
+        });
+      },
+      [&]() {
+        parallel_for(bm_faces.index_range(), 1024, [&](const IndexRange range) {
+          const Span<MeshFace *> faces = bm_faces.slice(range);
+          mesh_layers_copy_from_blocks(face_copy_info, faces, int(range.start()));
+          mesh_loop_layers_copy_from_blocks(loop_copy_info, faces);
+          for (const int i : range) {
+            MeshFace *f = bm_faces[i];
+            MeshPoly *mp = &mpoly[i];
+            const MeshLoop *l_iter, *l_first;
+            l_iter = l_first = MESH_FACE_FIRST_LOOP(f);
+
+            mp->loopstart = mesh_elem_index_get(l_first);
+            mp->totloop = f->len;
+            mp->mat_nr = f->mat_nr;
+            mp->flag = mesh_face_flag_to_mflag(f);
+
+            MeshLoop *ml = &mloop[mp->loopstart];
+            do {
+              ml->e = mesh_elem_index_get(l_iter->e);
+              ml->v = mesh_elem_index_get(l_iter->v);
+              ml++;
+              MESH_CHECK_ELEMENT(l_iter);
+              MESH_CHECK_ELEMENT(l_iter->e);
+              MESH_CHECK_ELEMENT(l_iter->v);
+            } while ((l_iter = l_iter->next) != l_first);
+            MESH_CHECK_ELEMENT(f);
+          }
+        });
+      });
 
-    i++;
-    mpoly++;
-    MESH_CHECK_ELEMENT(f);
+  if (bm->act_face) {
+    me->act_face = mesh_elem_index_get(bm->act_face);
   }
 
   /* Patch hook indices and vertex parents. */
@@ -1191,19 +1405,14 @@ void mesh_bm_to_me_for_eval(Mesh *mesh, Mesh *me, const CustomData_MeshMasks *cd
 
   dune_mesh_update_customdata_pointers(me, false);
 
-  MeshIter iter;
-  MeshVert *eve;
-  MeshEdge *eed;
-  MeshFace *efa;
   MeshVert *mvert = me->mvert;
   MeshEdge *medge = me->medge;
   MeshLoop *mloop = me->mloop;
   MeshPoly *mpoly = me->mpoly;
-  unsigned int i, j;
 
-  const int cd_vert_bweight_offset = CustomData_get_offset(&bm->vdata, CD_BWEIGHT);
-  const int cd_edge_bweight_offset = CustomData_get_offset(&bm->edata, CD_BWEIGHT);
-  const int cd_edge_crease_offset = CustomData_get_offset(&bm->edata, CD_CREASE);
+  const int cd_vert_bweight_offset = CustomData_get_offset(&mesh->vdata, CD_BWEIGHT);
+  const int cd_edge_bweight_offset = CustomData_get_offset(&mesh->edata, CD_BWEIGHT);
+  const int cd_edge_crease_offset = CustomData_get_offset(&mesh->edata, CD_CREASE);
 
   /* Clear normals on the mesh completely, since the original vertex and polygon count might be
    * different than the Mesh's. */
@@ -1211,80 +1420,91 @@ void mesh_bm_to_me_for_eval(Mesh *mesh, Mesh *me, const CustomData_MeshMasks *cd
 
   me->runtime.deformed_only = true;
 
-  MESH_INDEX_ITER (eve, &iter, mesh, MESH_VERTS_OF_MESH, i) {
-    MeshVert *mv = &mvert[i];
-
-    copy_v3_v3(mv->co, eve->co);
-
-    mesh_elem_index_set(eve, i); /* set_inline */
-
-    mv->flag = mesh_vert_flag_to_mflag(eve);
-
-    if (cd_vert_bweight_offset != -1) {
-      mv->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eve, cd_vert_bweight_offset);
-    }
-
-    CustomData_from_bmesh_block(&mesh->vdata, &me->vdata, eve->head.data, i);
-  }
-  bm->elem_index_dirty &= ~MESH_VERT;
-
-  MESH_ITER_MESH_INDEX (eed, &iter, bm, BM_EDGES_OF_MESH, i) {
-    MEdge *med = &medge[i];
-
-    mesh_elem_index_set(eed, i); /* set_inline */
-
-    med->v1 = mesh_elem_index_get(eed->v1);
-    med->v2 = mesh_elem_index_get(eed->v2);
-
-    med->flag = mesh_edge_flag_to_mflag(eed);
-
-    /* Handle this differently to editmode switching,
-     * only enable draw for single user edges rather than calculating angle. */
-    if ((med->flag & ME_EDGEDRAW) == 0) {
-      if (eed->l && eed->l == eed->l->radial_next) {
-        med->flag |= ME_EDGEDRAW;
-      }
-    }
-
-    if (cd_edge_crease_offset != -1) {
-      med->crease = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eed, cd_edge_crease_offset);
-    }
-    if (cd_edge_bweight_offset != -1) {
-      med->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eed, cd_edge_bweight_offset);
-    }
-
-    CustomData_from_mesh_block(&mesh->edata, &me->edata, eed->head.data, i);
-  }
-  mesh->elem_index_dirty &= ~MESH_EDGE;
-
-  j = 0;
-  MESH_INDEX_ITER (efa, &iter, mesh, MESH_FACES_OF_MESH, i) {
-    MeshLoop *l_iter;
-    MeshLoop *l_first;
-    MeshPoly *mp = &mpoly[i];
-
-    mesh_elem_index_set(efa, i); /* set_inline */
-
-    mp->totloop = efa->len;
-    mp->flag = mesh_face_flag_to_mflag(efa);
-    mp->loopstart = j;
-    mp->mat_nr = efa->mat_nr;
-
-    l_iter = l_first = MESH_FACE_FIRST_LOOP(efa);
-    do {
-      mloop->v = mesh_elem_index_get(l_iter->v);
-      mloop->e = mesh_elem_index_get(l_iter->e);
-      CustomData_from_mesh_block(&mesh->ldata, &me->ldata, l_iter->head.data, j);
-
-      mesh_elem_index_set(l_iter, j); /* set_inline */
-
-      j++;
-      mloop++;
-    } while ((l_iter = l_iter->next) != l_first);
+  mesh_elem_index_ensure(mesh, MESH_VERT | MESH_EDGE | MESH_FACE | MESH_LOOP);
+  mesh_elem_table_ensure(mesh, MESH_VERT | MESH_EDGE | MESH_FACE);
+
+  const Span<MeshVert *> bm_verts{mesh->vtable, mesh->totvert};
+  const Span<MeshEdge *> bm_edges{mesh->etable, mesh->totedge};
+  const Span<MeshFace *> bm_faces{mesh->ftable, mesh->totface};
+
+  const Vector<MeshLayerCopyInfo> vert_copy_info = mesh_layer_copy_info_calc(mesh->vdata,
+                                                                             me->vdata);
+  const Vector<MeshLayerCopyInfo> edge_copy_info = mesh_layer_copy_info_calc(mesh->edata,
+                                                                             me->edata);
+  const Vector<MeshLayerCopyInfo> loop_copy_info = mesh_layer_copy_info_calc(mesh->ldata,
+                                                                             me->ldata);
+  const Vector<MeshLayerCopyInfo> face_copy_info = mesh_layer_copy_info_calc(mesh->pdata,
+                                                                             me->pdata);
+
+  parallel_invoke(
+      [&]() {
+        parallel_for(bm_verts.index_range(), 2048, [&](const IndexRange range) {
+          mesh_layers_copy_from_blocks(vert_copy_info, bm_verts.slice(range), int(range.start()));
+          for (const int i : range) {
+            const MeshVert *eve = bm_verts[i];
+            MeshVert *mv = &mvert[i];
+            copy_v3_v3(mv->co, eve->co);
+            mv->flag = mesh_vert_flag_to_mflag(eve);
+            if (cd_vert_bweight_offset != -1) {
+              mv->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eve, cd_vert_bweight_offset);
+            }
+          }
+        });
+      },
+      [&]() {
+        parallel_for(bm_edges.index_range(), 4096, [&](const IndexRange range) {
+          mesh_layers_copy_from_blocks(edge_copy_info, bm_edges.slice(range), int(range.start()));
+          for (const int i : range) {
+            const MeshEdge *eed = bm_edges[i];
+            MEdge *med = &medge[i];
+
+            med->v1 = mesh_elem_index_get(eed->v1);
+            med->v2 = mesh_elem_index_get(eed->v2);
+
+            med->flag = mesh_edge_flag_to_mflag(eed);
+
+            /* Handle this differently to editmode switching,
+             * only enable draw for single user edges rather than calculating angle. */
+            if ((med->flag & ME_EDGEDRAW) == 0) {
+              if (eed->l && eed->l == eed->l->radial_next) {
+                med->flag |= ME_EDGEDRAW;
+              }
+            }
 
-    CustomData_from_mesh_block(&mesh->pdata, &me->pdata, efa->head.data, i);
-  }
-  mesh->elem_index_dirty &= ~(MESH_FACE | MESH_LOOP);
+            if (cd_edge_crease_offset != -1) {
+              med->crease = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eed, cd_edge_crease_offset);
+            }
+            if (cd_edge_bweight_offset != -1) {
+              med->bweight = MESH_ELEM_CD_GET_FLOAT_AS_UCHAR(eed, cd_edge_bweight_offset);
+            }
+          }
+        });
+      },
+      [&]() {
+        parallel_for(bm_faces.index_range(), 1024, [&](const IndexRange range) {
+          const Span<MeshFace *> faces = bm_faces.slice(range);
+          mesh_layers_copy_from_blocks(face_copy_info, faces, int(range.start()));
+          mesh_loop_layers_copy_from_blocks(loop_copy_info, faces);
+          for (const int i : range) {
+            const MeshFace *efa = bm_faces[i];
+            MeshPoly *mp = &mpoly[i];
+            const MeshLoop *l_iter, *l_first;
+            l_iter = l_first = MESH_FACE_FIRST_LOOP(efa);
+
+            mp->totloop = efa->len;
+            mp->flag = mesh_face_flag_to_mflag(efa);
+            mp->loopstart = mesh_elem_index_get(l_first);
+            mp->mat_nr = efa->mat_nr;
+
+            MeshLoop *ml = &mloop[mp->loopstart];
+            do {
+              ml->v = mesh_elem_index_get(l_iter->v);
+              ml->e = mesh_elem_index_get(l_iter->e);
+              ml++;
+            } while ((l_iter = l_iter->next) != l_first);
+          }
+        });
+      });
 
   me->cd_flag = mesh_cd_flag_from_bmesh(bm);
 }
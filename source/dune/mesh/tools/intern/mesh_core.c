@@ -378,6 +378,7 @@ LIB_INLINE MeshFace *mesh_face_create__internal(Mesh *mesh)
   mesh->spacearr_dirty |= MESH_SPACEARR_DIRTY_ALL;
 
   mesh->totface++;
+  mesh->totface_churn++;
 
 #ifdef USE_MESH_HOLES
   f->totbounds = 0;
@@ -752,6 +753,7 @@ static void bm_kill_only_face(BMesh *bm, BMFace *f)
   }
 
   bm->totface--;
+  bm->totface_churn++;
   bm->elem_index_dirty |= BM_FACE;
   bm->elem_table_dirty |= BM_FACE;
   bm->spacearr_dirty |= BM_SPACEARR_DIRTY_ALL;
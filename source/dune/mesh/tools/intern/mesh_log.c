@@ -9,14 +9,21 @@
  * - Moving vertices
  * - Setting vertex paint-mask values
  * - Setting vertex hflags
+ *
+ * Entries which are no longer being written to are packed: the elements of each map
+ * are stored as sorted arrays, delta encoded & compressed, see mesh_log_entry_pack.
  */
 
+#include <string.h>
+#include <zstd.h>
+
 #include "mem_guardedalloc.h"
 
 #include "lib_ghash.h"
 #include "lib_listbase.h"
 #include "lib_math.h"
 #include "lib_mempool.h"
+#include "lib_task.h"
 #include "lib_utildefines.h"
 
 #include "dune_customdata.h"
@@ -49,6 +56,10 @@ struct MeshLogEntry {
   lib_mempool *pool_verts;
   lib_mempool *pool_faces;
 
+  /* Packed copy of the maps above (LOG_SET_NUM items), once the entry is no longer
+   * being written to. The maps & pools are NULL while the entry is packed. */
+  struct MeshLogPackedSet *packed;
+
   /* This is only needed for dropping MeshLogEntries while still in
    * dynamic-topology mode, as that should release vert/face IDs
    * back to the MeshLog but no MeshLog pointer is available at that
@@ -101,6 +112,37 @@ typedef struct {
   char hflag;
 } MeshLogFace;
 
+/* The element maps of an entry, in the order they're packed. */
+enum {
+  LOG_SET_DELETED_VERTS = 0,
+  LOG_SET_DELETED_FACES,
+  LOG_SET_ADDED_VERTS,
+  LOG_SET_ADDED_FACES,
+  LOG_SET_MODIFIED_VERTS,
+  LOG_SET_MODIFIED_FACES,
+};
+#define LOG_SET_NUM 6
+#define LOG_SET_IS_VERTS(set) (((set)&1) == 0)
+
+/* Encoded elements of one map, zstd compressed when data_compressed_len is set. */
+typedef struct MeshLogPackedSet {
+  uint len;
+  uchar *data;
+  size_t data_len;
+  size_t data_compressed_len;
+} MeshLogPackedSet;
+
+/* Unpacked elements of one map, ids sorted ascending, elems are MeshLogVert or MeshLogFace. */
+typedef struct MeshLogSetArray {
+  uint len;
+  uint *ids;
+  void *elems;
+} MeshLogSetArray;
+
+/* Don't bother compressing tiny sets. */
+#define LOG_SET_COMPRESS_MIN 256
+#define LOG_SET_ZSTD_LEVEL 1
+
 /************************* Get/set element IDs ************************/
 
 /* bypass actual hashing, the keys don't overlap */
@@ -220,73 +262,66 @@ static MeshLogFace *mesh_log_face_alloc(MeshLog *log, MeshFace *f)
 
 /************************ Helpers for undo/redo ***********************/
 
-static void mesh_log_verts_unmake(Mesh *mesh, MeshLog *log, GHash *verts)
+static void mesh_log_verts_unmake(Mesh *mesh, MeshLog *log, MeshLogSetArray *verts)
 {
-  const int cd_vert_mask_offset = CustomData_get_offset(&bm->vdata, CD_PAINT_MASK);
+  const int cd_vert_mask_offset = CustomData_get_offset(&mesh->vdata, CD_PAINT_MASK);
+  MeshLogVert *lverts = verts->elems;
 
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, verts) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    MeshLogVert *lv = lib_ghashIterator_getValue(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-    MeehVert *v = mesh_log_vert_from_id(log, id);
+  for (uint i = 0; i < verts->len; i++) {
+    MeshVert *v = mesh_log_vert_from_id(log, verts->ids[i]);
 
     /* Ensure the log has the final values of the vertex before
      * deleting it */
-    mesh_log_vert_meshvert_copy(lv, v, cd_vert_mask_offset);
+    mesh_log_vert_meshvert_copy(&lverts[i], v, cd_vert_mask_offset);
 
     mesh_vert_kill(mesh, v);
   }
 }
 
-static void mesh_log_faces_unmake(Mesh *mesh, MeshLog *log, GHash *faces)
+static void mesh_log_faces_unmake(Mesh *mesh, MeshLog *log, const MeshLogSetArray *faces)
 {
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, faces) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-    MeshFace *f = mesh_log_face_from_id(log, id);
+  for (uint i = 0; i < faces->len; i++) {
+    MeshFace *f = mesh_log_face_from_id(log, faces->ids[i]);
     MeshEdge *e_tri[3];
     MeshLoop *l_iter;
-    int i;
+    int j;
 
     l_iter = MESH_FACE_FIRST_LOOP(f);
-    for (i = 0; i < 3; i++, l_iter = l_iter->next) {
-      e_tri[i] = l_iter->e;
+    for (j = 0; j < 3; j++, l_iter = l_iter->next) {
+      e_tri[j] = l_iter->e;
     }
 
     /* Remove any unused edges */
     mesh_face_kill(mesh, f);
-    for (i = 0; i < 3; i++) {
-      if (mesh_edge_is_wire(e_tri[i])) {
-        mesh_edge_kill(mesh, e_tri[i]);
+    for (j = 0; j < 3; j++) {
+      if (mesh_edge_is_wire(e_tri[j])) {
+        mesh_edge_kill(mesh, e_tri[j]);
       }
     }
   }
 }
 
-static void mesh_log_verts_restore(Mesh *mesh, MeshLog *log, GHash *verts)
+static void mesh_log_verts_restore(Mesh *mesh, MeshLog *log, const MeshLogSetArray *verts)
 {
   const int cd_vert_mask_offset = CustomData_get_offset(&mesh->vdata, CD_PAINT_MASK);
+  const MeshLogVert *lverts = verts->elems;
 
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, verts) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    MeshLogVert *lv = lib_ghashIterator_getValue(&gh_iter);
+  for (uint i = 0; i < verts->len; i++) {
+    const MeshLogVert *lv = &lverts[i];
     MeshVert *v = mesh_vert_create(mesh, lv->co, NULL, MESH_CREATE_NOP);
     vert_mask_set(v, lv->mask, cd_vert_mask_offset);
     v->head.hflag = lv->hflag;
     copy_v3_v3(v->no, lv->no);
-    mesh_log_vert_id_set(log, v, PTR_AS_UINT(key));
+    mesh_log_vert_id_set(log, v, verts->ids[i]);
   }
 }
 
-static void mesh_log_faces_restore(Mesh *mesh, MeshLog *log, GHash *faces)
+static void mesh_log_faces_restore(Mesh *mesh, MeshLog *log, const MeshLogSetArray *faces)
 {
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, faces) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    MeshLogFace *lf = lib_ghashIterator_getValue(&gh_iter);
+  const MeshLogFace *lfaces = faces->elems;
+
+  for (uint i = 0; i < faces->len; i++) {
+    const MeshLogFace *lf = &lfaces[i];
     MeshVert *v[3] = {
         mesh_log_vert_from_id(log, lf->v_ids[0]),
         mesh_log_vert_from_id(log, lf->v_ids[1]),
@@ -296,44 +331,528 @@ static void mesh_log_faces_restore(Mesh *mesh, MeshLog *log, GHash *faces)
 
     f = mesh_face_create_verts(mesh, v, 3, NULL, MESH_CREATE_NOP, true);
     f->head.hflag = lf->hflag;
-    mesh_log_face_id_set(log, f, PTR_AS_UINT(key));
+    mesh_log_face_id_set(log, f, faces->ids[i]);
   }
 }
 
-static void mesh_log_vert_values_swap(Mesh *mesh, MeshLog *log, GHash *verts)
+typedef struct MeshLogSwapData {
+  MeshLog *log;
+  MeshLogSetArray *set;
+  int cd_vert_mask_offset;
+} MeshLogSwapData;
+
+static void mesh_log_vert_values_swap_cb(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshLogSwapData *data = userdata;
+  MeshLogVert *lv = &((MeshLogVert *)data->set->elems)[i];
+  /* Only reads the id map, which isn't modified while swapping. */
+  MeshVert *v = mesh_log_vert_from_id(data->log, data->set->ids[i]);
+  float mask;
+
+  swap_v3_v3(v->co, lv->co);
+  swap_v3_v3(v->no, lv->no);
+  SWAP(char, v->head.hflag, lv->hflag);
+  mask = lv->mask;
+  lv->mask = vert_mask_get(v, data->cd_vert_mask_offset);
+  vert_mask_set(v, mask, data->cd_vert_mask_offset);
+}
+
+static void mesh_log_vert_values_swap(Mesh *mesh, MeshLog *log, MeshLogSetArray *verts)
 {
-  const int cd_vert_mask_offset = CustomData_get_offset(&mesh->vdata, CD_PAINT_MASK);
+  MeshLogSwapData data = {
+      .log = log,
+      .set = verts,
+      .cd_vert_mask_offset = CustomData_get_offset(&mesh->vdata, CD_PAINT_MASK),
+  };
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (int)verts->len >= MESH_OMP_LIMIT;
+  lib_task_parallel_range(0, (int)verts->len, &data, mesh_log_vert_values_swap_cb, &settings);
+}
 
-  GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, verts) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    MeshLogVert *lv = lib_ghashIterator_getValue(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-    MeshVert *v = mesh_log_vert_from_id(log, id);
-    float mask;
+static void mesh_log_face_values_swap_cb(void *__restrict userdata,
+                                         const int i,
+                                         const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshLogSwapData *data = userdata;
+  MeshLogFace *lf = &((MeshLogFace *)data->set->elems)[i];
+  MeshFace *f = mesh_log_face_from_id(data->log, data->set->ids[i]);
+
+  SWAP(char, f->head.hflag, lf->hflag);
+}
+
+static void mesh_log_face_values_swap(MeshLog *log, MeshLogSetArray *faces)
+{
+  MeshLogSwapData data = {
+      .log = log,
+      .set = faces,
+  };
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.use_threading = (int)faces->len >= MESH_OMP_LIMIT;
+  lib_task_parallel_range(0, (int)faces->len, &data, mesh_log_face_values_swap_cb, &settings);
+}
+
+/*************************** Packed entries ***************************/
+
+/* Growable byte buffer for encoding. */
+typedef struct MeshLogWriter {
+  uchar *data;
+  size_t len;
+  size_t alloc;
+} MeshLogWriter;
+
+/* Write value as a variable length integer, 7 bits per byte. */
+static void mesh_log_writer_put_uint(MeshLogWriter *writer, uint value)
+{
+  if (UNLIKELY(writer->len + 5 > writer->alloc)) {
+    writer->alloc = MAX2(writer->alloc * 2, 256);
+    writer->data = mem_reallocn(writer->data, writer->alloc);
+  }
+  while (value >= 0x80) {
+    writer->data[writer->len++] = (uchar)(value | 0x80);
+    value >>= 7;
+  }
+  writer->data[writer->len++] = (uchar)value;
+}
+
+static uint mesh_log_reader_get_uint(const uchar **data)
+{
+  uint value = 0;
+  uint shift = 0;
+  uchar byte;
+  do {
+    byte = *(*data)++;
+    value |= (uint)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+/* Zig-zag encode the difference to the previous value,
+ * so small changes in either direction give small values. */
+LIB_INLINE uint mesh_log_delta_encode(const uint value, const uint value_prev)
+{
+  const int delta = (int)(value - value_prev);
+  return ((uint)delta << 1) ^ (uint)(delta >> 31);
+}
+
+LIB_INLINE uint mesh_log_delta_decode(const uint code, const uint value_prev)
+{
+  const int delta = (int)(code >> 1) ^ -(int)(code & 1);
+  return value_prev + (uint)delta;
+}
+
+/* Floats are delta encoded by their bits, so the coordinates are restored exactly. */
+LIB_INLINE uint mesh_log_float_bits(const float f)
+{
+  uint bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+LIB_INLINE float mesh_log_float_from_bits(const uint bits)
+{
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static void mesh_log_set_encode(const MeshLogSetArray *array,
+                                const bool is_verts,
+                                MeshLogWriter *writer)
+{
+  uint id_prev = 0;
+
+  if (is_verts) {
+    const MeshLogVert *lverts = array->elems;
+    uint values_prev[8] = {0};
+    for (uint i = 0; i < array->len; i++) {
+      const MeshLogVert *lv = &lverts[i];
+      const uint values[8] = {
+          mesh_log_float_bits(lv->co[0]),
+          mesh_log_float_bits(lv->co[1]),
+          mesh_log_float_bits(lv->co[2]),
+          mesh_log_float_bits(lv->no[0]),
+          mesh_log_float_bits(lv->no[1]),
+          mesh_log_float_bits(lv->no[2]),
+          mesh_log_float_bits(lv->mask),
+          (uint)(uchar)lv->hflag,
+      };
+      /* Ids are sorted, so the difference is never negative. */
+      mesh_log_writer_put_uint(writer, array->ids[i] - id_prev);
+      id_prev = array->ids[i];
+      for (int j = 0; j < 8; j++) {
+        mesh_log_writer_put_uint(writer, mesh_log_delta_encode(values[j], values_prev[j]));
+        values_prev[j] = values[j];
+      }
+    }
+  }
+  else {
+    const MeshLogFace *lfaces = array->elems;
+    uint v_ids_prev[3] = {0};
+    for (uint i = 0; i < array->len; i++) {
+      const MeshLogFace *lf = &lfaces[i];
+      mesh_log_writer_put_uint(writer, array->ids[i] - id_prev);
+      id_prev = array->ids[i];
+      for (int j = 0; j < 3; j++) {
+        mesh_log_writer_put_uint(writer, mesh_log_delta_encode(lf->v_ids[j], v_ids_prev[j]));
+        v_ids_prev[j] = lf->v_ids[j];
+      }
+      mesh_log_writer_put_uint(writer, (uint)(uchar)lf->hflag);
+    }
+  }
+}
+
+static void mesh_log_set_decode(const uchar *data, const bool is_verts, MeshLogSetArray *array)
+{
+  uint id_prev = 0;
+
+  if (is_verts) {
+    MeshLogVert *lverts = array->elems;
+    uint values[8] = {0};
+    for (uint i = 0; i < array->len; i++) {
+      MeshLogVert *lv = &lverts[i];
+      id_prev += mesh_log_reader_get_uint(&data);
+      array->ids[i] = id_prev;
+      for (int j = 0; j < 8; j++) {
+        values[j] = mesh_log_delta_decode(mesh_log_reader_get_uint(&data), values[j]);
+      }
+      for (int j = 0; j < 3; j++) {
+        lv->co[j] = mesh_log_float_from_bits(values[j]);
+        lv->no[j] = mesh_log_float_from_bits(values[j + 3]);
+      }
+      lv->mask = mesh_log_float_from_bits(values[6]);
+      lv->hflag = (char)values[7];
+    }
+  }
+  else {
+    MeshLogFace *lfaces = array->elems;
+    uint v_ids[3] = {0};
+    for (uint i = 0; i < array->len; i++) {
+      MeshLogFace *lf = &lfaces[i];
+      id_prev += mesh_log_reader_get_uint(&data);
+      array->ids[i] = id_prev;
+      for (int j = 0; j < 3; j++) {
+        v_ids[j] = mesh_log_delta_decode(mesh_log_reader_get_uint(&data), v_ids[j]);
+        lf->v_ids[j] = v_ids[j];
+      }
+      lf->hflag = (char)mesh_log_reader_get_uint(&data);
+    }
+  }
+}
+
+static void mesh_log_set_pack(const MeshLogSetArray *array,
+                              const bool is_verts,
+                              MeshLogPackedSet *r_packed)
+{
+  MeshLogWriter writer = {NULL};
+
+  memset(r_packed, 0, sizeof(*r_packed));
+  r_packed->len = array->len;
+  if (array->len == 0) {
+    return;
+  }
+
+  mesh_log_set_encode(array, is_verts, &writer);
+  r_packed->data_len = writer.len;
+
+  if (writer.len >= LOG_SET_COMPRESS_MIN) {
+    const size_t bound = ZSTD_compressBound(writer.len);
+    uchar *data = mem_mallocn(bound, __func__);
+    const size_t data_len = ZSTD_compress(data, bound, writer.data, writer.len, LOG_SET_ZSTD_LEVEL);
+    /* Only keep the compressed data when it's worth decompressing on undo. */
+    if (!ZSTD_isError(data_len) && data_len < writer.len - (writer.len / 8)) {
+      mem_freen(writer.data);
+      r_packed->data = mem_reallocn(data, data_len);
+      r_packed->data_compressed_len = data_len;
+      return;
+    }
+    mem_freen(data);
+  }
+  r_packed->data = mem_reallocn(writer.data, writer.len);
+}
+
+static void mesh_log_set_unpack(const MeshLogPackedSet *packed,
+                                const bool is_verts,
+                                MeshLogSetArray *r_array)
+{
+  r_array->len = packed->len;
+  if (packed->len == 0) {
+    r_array->ids = NULL;
+    r_array->elems = NULL;
+    return;
+  }
 
-    swap_v3_v3(v->co, lv->co);
-    swap_v3_v3(v->no, lv->no);
-    SWAP(char, v->head.hflag, lv->hflag);
-    mask = lv->mask;
-    lv->mask = vert_mask_get(v, cd_vert_mask_offset);
-    vert_mask_set(v, mask, cd_vert_mask_offset);
+  r_array->ids = mem_mallocn(sizeof(*r_array->ids) * packed->len, __func__);
+  r_array->elems = mem_mallocn(
+      (is_verts ? sizeof(MeshLogVert) : sizeof(MeshLogFace)) * packed->len, __func__);
+
+  if (packed->data_compressed_len) {
+    uchar *data = mem_mallocn(packed->data_len, __func__);
+    const size_t data_len = ZSTD_decompress(
+        data, packed->data_len, packed->data, packed->data_compressed_len);
+    lib_assert(!ZSTD_isError(data_len) && data_len == packed->data_len);
+    UNUSED_VARS_NDEBUG(data_len);
+    mesh_log_set_decode(data, is_verts, r_array);
+    mem_freen(data);
+  }
+  else {
+    mesh_log_set_decode(packed->data, is_verts, r_array);
   }
 }
 
-static void mesh_log_face_values_swap(MeshLog *log, GHash *faces)
+static void mesh_log_set_array_free(MeshLogSetArray *array)
+{
+  MEM_SAFE_FREE(array->ids);
+  MEM_SAFE_FREE(array->elems);
+  array->len = 0;
+}
+
+static int mesh_log_id_cmp(const void *a_v, const void *b_v)
+{
+  const uint a = *(const uint *)a_v;
+  const uint b = *(const uint *)b_v;
+  return (a > b) - (a < b);
+}
+
+static void mesh_log_set_array_from_ghash(GHash *ghash,
+                                          const bool is_verts,
+                                          MeshLogSetArray *r_array)
 {
+  const size_t elem_size = is_verts ? sizeof(MeshLogVert) : sizeof(MeshLogFace);
   GHashIterator gh_iter;
-  GHASH_ITER (gh_iter, faces) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    MeshLogFace *lf = lib_ghashIterator_getValue(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-    MeshFace *f = mesh_log_face_from_id(log, id);
+  uint i = 0;
+
+  r_array->len = lib_ghash_len(ghash);
+  if (r_array->len == 0) {
+    r_array->ids = NULL;
+    r_array->elems = NULL;
+    return;
+  }
+
+  r_array->ids = mem_mallocn(sizeof(*r_array->ids) * r_array->len, __func__);
+  r_array->elems = mem_mallocn(elem_size * r_array->len, __func__);
+
+  GHASH_ITER (gh_iter, ghash) {
+    r_array->ids[i++] = PTR_AS_UINT(lib_ghashIterator_getKey(&gh_iter));
+  }
+  qsort(r_array->ids, r_array->len, sizeof(*r_array->ids), mesh_log_id_cmp);
 
-    SWAP(char, f->head.hflag, lf->hflag);
+  for (i = 0; i < r_array->len; i++) {
+    const void *elem = lib_ghash_lookup(ghash, PTR_FROM_UINT(r_array->ids[i]));
+    memcpy((char *)r_array->elems + elem_size * i, elem, elem_size);
   }
 }
 
+static GHash **mesh_log_entry_set_ghash_p(MeshLogEntry *entry, const int set)
+{
+  switch (set) {
+    case LOG_SET_DELETED_VERTS:
+      return &entry->deleted_verts;
+    case LOG_SET_DELETED_FACES:
+      return &entry->deleted_faces;
+    case LOG_SET_ADDED_VERTS:
+      return &entry->added_verts;
+    case LOG_SET_ADDED_FACES:
+      return &entry->added_faces;
+    case LOG_SET_MODIFIED_VERTS:
+      return &entry->modified_verts;
+    case LOG_SET_MODIFIED_FACES:
+      return &entry->modified_faces;
+  }
+  lib_assert_unreachable();
+  return NULL;
+}
+
+typedef struct MeshLogPackData {
+  MeshLogEntry *entry;
+  MeshLogSetArray *arrays;
+} MeshLogPackData;
+
+static void mesh_log_entry_pack_cb(void *__restrict userdata,
+                                   const int set,
+                                   const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshLogPackData *data = userdata;
+  mesh_log_set_pack(&data->arrays[set], LOG_SET_IS_VERTS(set), &data->entry->packed[set]);
+}
+
+static void mesh_log_entry_unpack_cb(void *__restrict userdata,
+                                     const int set,
+                                     const TaskParallelTLS *__restrict UNUSED(tls))
+{
+  MeshLogPackData *data = userdata;
+  mesh_log_set_unpack(&data->entry->packed[set], LOG_SET_IS_VERTS(set), &data->arrays[set]);
+}
+
+static void mesh_log_entry_packed_free(MeshLogEntry *entry)
+{
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    MEM_SAFE_FREE(entry->packed[set].data);
+  }
+  MEM_SAFE_FREE(entry->packed);
+}
+
+/* Replace the packed sets of an entry by arrays, the sets are encoded in parallel. */
+static void mesh_log_entry_pack_arrays(MeshLogEntry *entry, MeshLogSetArray arrays[LOG_SET_NUM])
+{
+  if (entry->packed) {
+    mesh_log_entry_packed_free(entry);
+  }
+  entry->packed = mem_callocn(sizeof(*entry->packed) * LOG_SET_NUM, __func__);
+
+  MeshLogPackData data = {entry, arrays};
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1;
+  lib_task_parallel_range(0, LOG_SET_NUM, &data, mesh_log_entry_pack_cb, &settings);
+}
+
+static void mesh_log_entry_unpack_arrays(MeshLogEntry *entry, MeshLogSetArray r_arrays[LOG_SET_NUM])
+{
+  lib_assert(entry->packed);
+
+  MeshLogPackData data = {entry, r_arrays};
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+  settings.min_iter_per_thread = 1;
+  lib_task_parallel_range(0, LOG_SET_NUM, &data, mesh_log_entry_unpack_cb, &settings);
+}
+
+static void mesh_log_entry_maps_free(MeshLogEntry *entry)
+{
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    GHash **ghash_p = mesh_log_entry_set_ghash_p(entry, set);
+    lib_ghash_free(*ghash_p, NULL, NULL);
+    *ghash_p = NULL;
+  }
+
+  lib_mempool_destroy(entry->pool_verts);
+  lib_mempool_destroy(entry->pool_faces);
+  entry->pool_verts = NULL;
+  entry->pool_faces = NULL;
+}
+
+/* Get the sets of an entry as arrays, an unpacked entry's maps are freed. */
+static void mesh_log_entry_sets_take(MeshLogEntry *entry, MeshLogSetArray r_arrays[LOG_SET_NUM])
+{
+  if (entry->packed) {
+    mesh_log_entry_unpack_arrays(entry, r_arrays);
+    return;
+  }
+
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    mesh_log_set_array_from_ghash(
+        *mesh_log_entry_set_ghash_p(entry, set), LOG_SET_IS_VERTS(set), &r_arrays[set]);
+  }
+  mesh_log_entry_maps_free(entry);
+}
+
+/* Pack an entry which is no longer being written to, freeing its maps. */
+static void mesh_log_entry_pack(MeshLogEntry *entry)
+{
+  if (entry->packed) {
+    return;
+  }
+
+  MeshLogSetArray arrays[LOG_SET_NUM];
+  mesh_log_entry_sets_take(entry, arrays);
+  mesh_log_entry_pack_arrays(entry, arrays);
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    mesh_log_set_array_free(&arrays[set]);
+  }
+}
+
+static void mesh_log_entry_maps_create(MeshLogEntry *entry)
+{
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    *mesh_log_entry_set_ghash_p(entry, set) = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
+  }
+
+  entry->pool_verts = lib_mempool_create(sizeof(MeshLogVert), 0, 64, LIB_MEMPOOL_NOP);
+  entry->pool_faces = lib_mempool_create(sizeof(MeshLogFace), 0, 64, LIB_MEMPOOL_NOP);
+}
+
+/* Build the maps of an entry from its sets, freeing the arrays. */
+static void mesh_log_entry_maps_from_arrays(MeshLogEntry *entry,
+                                            MeshLogSetArray arrays[LOG_SET_NUM])
+{
+  mesh_log_entry_maps_create(entry);
+  for (int set = 0; set < LOG_SET_NUM; set++) {
+    const bool is_verts = LOG_SET_IS_VERTS(set);
+    GHash *ghash = *mesh_log_entry_set_ghash_p(entry, set);
+    lib_mempool *pool = is_verts ? entry->pool_verts : entry->pool_faces;
+    const size_t elem_size = is_verts ? sizeof(MeshLogVert) : sizeof(MeshLogFace);
+
+    lib_ghash_reserve(ghash, arrays[set].len);
+    for (uint i = 0; i < arrays[set].len; i++) {
+      void *elem = lib_mempool_alloc(pool);
+      memcpy(elem, (const char *)arrays[set].elems + elem_size * i, elem_size);
+      lib_ghash_insert(ghash, PTR_FROM_UINT(arrays[set].ids[i]), elem);
+    }
+    mesh_log_set_array_free(&arrays[set]);
+  }
+}
+
+/* Restore the maps of a packed entry, so it can be written to again. */
+static void mesh_log_entry_unpack(MeshLogEntry *entry)
+{
+  if (entry->packed == NULL) {
+    return;
+  }
+
+  MeshLogSetArray arrays[LOG_SET_NUM];
+  mesh_log_entry_unpack_arrays(entry, arrays);
+  mesh_log_entry_packed_free(entry);
+  mesh_log_entry_maps_from_arrays(entry, arrays);
+}
+
+/* Make `entry` the current one. The current entry is always unpacked, this is done here
+ * (from undo, redo & entry add) rather than on lookup, since the original data queries
+ * are called from sculpt threads and must not modify the entry. */
+static void mesh_log_current_entry_set(MeshLog *log, MeshLogEntry *entry)
+{
+  if (entry) {
+    mesh_log_entry_unpack(entry);
+  }
+  log->current_entry = entry;
+}
+
+/* The current entry, its maps can be looked up & written to. */
+static MeshLogEntry *mesh_log_current_entry_unpacked(const MeshLog *log)
+{
+  MeshLogEntry *entry = log->current_entry;
+  lib_assert(entry == NULL || entry->packed == NULL);
+  return entry;
+}
+
+/* The ids of all elements in a set of the entry, packed or not, sorted when packed. */
+static uint *mesh_log_entry_set_ids(MeshLogEntry *entry, const int set, uint *r_len)
+{
+  MeshLogSetArray array;
+  if (entry->packed) {
+    mesh_log_set_unpack(&entry->packed[set], LOG_SET_IS_VERTS(set), &array);
+    MEM_SAFE_FREE(array.elems);
+  }
+  else {
+    GHash *ghash = *mesh_log_entry_set_ghash_p(entry, set);
+    GHashIterator gh_iter;
+    uint i = 0;
+    array.len = lib_ghash_len(ghash);
+    array.ids = array.len ? mem_mallocn(sizeof(*array.ids) * array.len, __func__) : NULL;
+    GHASH_ITER (gh_iter, ghash) {
+      array.ids[i++] = PTR_AS_UINT(lib_ghashIterator_getKey(&gh_iter));
+    }
+  }
+  *r_len = array.len;
+  return array.ids;
+}
+
 /**********************************************************************/
 
 /* Assign unique IDs to all vertices and faces already in the Mesh */
@@ -361,15 +880,7 @@ static MeshLogEntry *mesh_log_entry_create(void)
 {
   MeshLogEntry *entry = mem_callocn(sizeof(MeshLogEntry), __func__);
 
-  entry->deleted_verts = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-  entry->deleted_faces = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-  entry->added_verts = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-  entry->added_faces = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-  entry->modified_verts = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-  entry->modified_faces = lib_ghash_new(logkey_hash, logkey_cmp, __func__);
-
-  entry->pool_verts = lib_mempool_create(sizeof(MeshLogVert), 0, 64, LIB_MEMPOOL_NOP);
-  entry->pool_faces = lib_mempool_create(sizeof(MeshLogFace), 0, 64, LIB_MEMPOOL_NOP);
+  mesh_log_entry_maps_create(entry);
 
   return entry;
 }
@@ -379,27 +890,23 @@ static MeshLogEntry *mesh_log_entry_create(void)
  * NOTE: does not free the log entry itself. */
 static void mesh_log_entry_free(MeshLogEntry *entry)
 {
-  lib_ghash_free(entry->deleted_verts, NULL, NULL);
-  lib_ghash_free(entry->deleted_faces, NULL, NULL);
-  lib_ghash_free(entry->added_verts, NULL, NULL);
-  lib_ghash_free(entry->added_faces, NULL, NULL);
-  lib_ghash_free(entry->modified_verts, NULL, NULL);
-  lib_ghash_free(entry->modified_faces, NULL, NULL);
-
-  lib_mempool_destroy(entry->pool_verts);
-  lib_mempool_destroy(entry->pool_faces);
+  if (entry->packed) {
+    mesh_log_entry_packed_free(entry);
+  }
+  else {
+    mesh_log_entry_maps_free(entry);
+  }
 }
 
-static void mesh_log_id_ghash_retake(RangeTreeUInt *unused_ids, GHash *id_ghash)
+static void mesh_log_id_set_retake(RangeTreeUInt *unused_ids, MeshLogEntry *entry, const int set)
 {
-  GHashIterator gh_iter;
+  uint ids_len;
+  uint *ids = mesh_log_entry_set_ids(entry, set, &ids_len);
 
-  GHASH_ITER (gh_iter, id_ghash) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-
-    range_tree_uint_retake(unused_ids, id);
+  for (uint i = 0; i < ids_len; i++) {
+    range_tree_uint_retake(unused_ids, ids[i]);
   }
+  MEM_SAFE_FREE(ids);
 }
 
 static int uint_compare(const void *a_v, const void *b_v)
@@ -433,16 +940,16 @@ static GHash *mesh_log_compress_ids_to_indices(uint *ids, uint totid)
   return map;
 }
 
-/* Release all ID keys in id_ghash */
-static void mesh_log_id_ghash_release(MeshLog *log, GHash *id_ghash)
+/* Release all ID keys in a set of the entry */
+static void mesh_log_id_set_release(MeshLog *log, MeshLogEntry *entry, const int set)
 {
-  GHashIterator gh_iter;
+  uint ids_len;
+  uint *ids = mesh_log_entry_set_ids(entry, set, &ids_len);
 
-  GHASH_ITER (gh_iter, id_ghash) {
-    void *key = lib_ghashIterator_getKey(&gh_iter);
-    uint id = PTR_AS_UINT(key);
-    range_tree_uint_release(log->unused_ids, id);
+  for (uint i = 0; i < ids_len; i++) {
+    range_tree_uint_release(log->unused_ids, ids[i]);
   }
+  MEM_SAFE_FREE(ids);
 }
 
 /***************************** Public API *****************************/
@@ -468,14 +975,15 @@ void mesh_log_cleanup_entry(MeshLogEntry *entry)
 
   if (log) {
     /* Take all used IDs */
-    mesh_log_id_ghash_retake(log->unused_ids, entry->deleted_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->deleted_faces);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->added_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->added_faces);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->modified_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->modified_faces);
+    for (int set = 0; set < LOG_SET_NUM; set++) {
+      mesh_log_id_set_retake(log->unused_ids, entry, set);
+    }
 
     /* delete entries to avoid releasing ids in node cleanup */
+    if (entry->packed) {
+      mesh_log_entry_packed_free(entry);
+      mesh_log_entry_maps_create(entry);
+    }
     lib_ghash_clear(entry->deleted_verts, NULL, NULL);
     lib_ghash_clear(entry->deleted_faces, NULL, NULL);
     lib_ghash_clear(entry->added_verts, NULL, NULL);
@@ -488,12 +996,7 @@ MeshLog *mesh_log_from_existing_entries_create(BMesh *bm, BMLogEntry *entry)
 {
   MeshLog *log = mesh_log_create(mesh);
 
-  if (entry->prev) {
-    log->current_entry = entry;
-  }
-  else {
-    log->current_entry = NULL;
-  }
+  mesh_log_current_entry_set(log, entry->prev ? entry : NULL);
 
   /* MeshLog manage the entry list again */
   log->entries.first = log->entries.last = entry;
@@ -514,12 +1017,9 @@ MeshLog *mesh_log_from_existing_entries_create(BMesh *bm, BMLogEntry *entry)
     entry->log = log;
 
     /* Take all used IDs */
-    mesh_log_id_ghash_retake(log->unused_ids, entry->deleted_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->deleted_faces);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->added_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->added_faces);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->modified_verts);
-    mesh_log_id_ghash_retake(log->unused_ids, entry->modified_faces);
+    for (int set = 0; set < LOG_SET_NUM; set++) {
+      mesh_log_id_set_retake(log->unused_ids, entry, set);
+    }
   }
 
   return log;
@@ -624,11 +1124,16 @@ MeshLogEntry *mesh_log_entry_add(MeshLog *log)
   }
 #endif
 
+  /* The previous entry is done, only undo & redo will read it from now on */
+  if (log->current_entry) {
+    mesh_log_entry_pack(log->current_entry);
+  }
+
   /* Create and append the new entry */
   entry = mesh_log_entry_create();
   lib_addtail(&log->entries, entry);
   entry->log = log;
-  log->current_entry = entry;
+  mesh_log_current_entry_set(log, entry);
 
   return entry;
 }
@@ -676,23 +1181,23 @@ void mesh_log_entry_drop(MeshLogEntry *entry)
      * Also, design wise, a first entry should not have any deleted vertices since it
      * should not have anything to delete them -from-
      */
-    // mesh_log_id_ghash_release(log, entry->deleted_faces);
-    // mesh_log_id_ghash_release(log, entry->deleted_verts);
+    // mesh_log_id_set_release(log, entry, LOG_SET_DELETED_FACES);
+    // mesh_log_id_set_release(log, entry, LOG_SET_DELETED_VERTS);
   }
   else if (!entry->next) {
     /* Release IDs of elements that are added by this entry. Since
      * the entry is at the end of the undo stack, and it's being
      * deleted, those elements can never be restored. Their IDs
      * can go back into the pool. */
-    mesh_log_id_ghash_release(log, entry->added_faces);
-    mesh_log_id_ghash_release(log, entry->added_verts);
+    mesh_log_id_set_release(log, entry, LOG_SET_ADDED_FACES);
+    mesh_log_id_set_release(log, entry, LOG_SET_ADDED_VERTS);
   }
   else {
     lib_assert_msg(0, "Cannot drop MeshLogEntry from middle");
   }
 
   if (log->current_entry == entry) {
-    log->current_entry = entry->prev;
+    mesh_log_current_entry_set(log, entry->prev);
   }
 
   mesh_log_entry_free(entry);
@@ -704,19 +1209,29 @@ void mesh_log_undo(Mesh *mesh, MeshLog *log)
   MeshLogEntry *entry = log->current_entry;
 
   if (entry) {
-    log->current_entry = entry->prev;
+    MeshLogSetArray sets[LOG_SET_NUM];
+
+    mesh_log_entry_sets_take(entry, sets);
 
     /* Delete added faces and verts */
-    mesh_log_faces_unmake(mesh, log, entry->added_faces);
-    mesh_log_verts_unmake(mesh, log, entry->added_verts);
+    mesh_log_faces_unmake(mesh, log, &sets[LOG_SET_ADDED_FACES]);
+    mesh_log_verts_unmake(mesh, log, &sets[LOG_SET_ADDED_VERTS]);
 
     /* Restore deleted verts and faces */
-    mesh_log_verts_restore(mesh, log, entry->deleted_verts);
-    mesh_log_faces_restore(mesh, log, entry->deleted_faces);
+    mesh_log_verts_restore(mesh, log, &sets[LOG_SET_DELETED_VERTS]);
+    mesh_log_faces_restore(mesh, log, &sets[LOG_SET_DELETED_FACES]);
 
     /* Restore vertex coordinates, mask, and hflag */
-    mesh_log_vert_values_swap(mesh, log, entry->modified_verts);
-    mesh_log_face_values_swap(log, entry->modified_faces);
+    mesh_log_vert_values_swap(mesh, log, &sets[LOG_SET_MODIFIED_VERTS]);
+    mesh_log_face_values_swap(log, &sets[LOG_SET_MODIFIED_FACES]);
+
+    /* Store the swapped values for redo */
+    mesh_log_entry_pack_arrays(entry, sets);
+    for (int set = 0; set < LOG_SET_NUM; set++) {
+      mesh_log_set_array_free(&sets[set]);
+    }
+
+    mesh_log_current_entry_set(log, entry->prev);
   }
 }
 
@@ -737,26 +1252,40 @@ void mesh_log_redo(Mesh *mesh, MeshLog *log)
     return;
   }
 
-  log->current_entry = entry;
-
   if (entry) {
+    MeshLogSetArray sets[LOG_SET_NUM];
+
+    mesh_log_entry_sets_take(entry, sets);
+
     /* Re-delete previously deleted faces and verts */
-    mesh_log_faces_unmake(mesh, log, entry->deleted_faces);
-    mesh_log_verts_unmake(mesh, log, entry->deleted_verts);
+    mesh_log_faces_unmake(mesh, log, &sets[LOG_SET_DELETED_FACES]);
+    mesh_log_verts_unmake(mesh, log, &sets[LOG_SET_DELETED_VERTS]);
 
     /* Restore previously added verts and faces */
-    mesh_log_verts_restore(mesh, log, entry->added_verts);
-    mesh_log_faces_restore(mesh, log, entry->added_faces);
+    mesh_log_verts_restore(mesh, log, &sets[LOG_SET_ADDED_VERTS]);
+    mesh_log_faces_restore(mesh, log, &sets[LOG_SET_ADDED_FACES]);
 
     /* Restore vertex coordinates, mask, and hflag */
-    mesh_log_vert_values_swap(mesh, log, entry->modified_verts);
-    mesh_log_face_values_swap(log, entry->modified_faces);
+    mesh_log_vert_values_swap(mesh, log, &sets[LOG_SET_MODIFIED_VERTS]);
+    mesh_log_face_values_swap(log, &sets[LOG_SET_MODIFIED_FACES]);
+
+    /* The entry we moved past is only read by undo & redo from now on */
+    if (log->current_entry) {
+      mesh_log_entry_pack(log->current_entry);
+    }
+
+    /* Store the swapped values for undo, the entry is current so keep it unpacked */
+    if (entry->packed) {
+      mesh_log_entry_packed_free(entry);
+    }
+    mesh_log_entry_maps_from_arrays(entry, sets);
+    log->current_entry = entry;
   }
 }
 
 void mesh_log_vert_before_modified(MeshLog *log, MeshVert *v, const int cd_vert_mask_offset)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   MeshLogVert *lv;
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
@@ -774,27 +1303,29 @@ void mesh_log_vert_before_modified(MeshLog *log, MeshVert *v, const int cd_vert_
 
 void mesh_log_vert_added(MeshLog *log, MeshVert *v, const int cd_vert_mask_offset)
 {
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   MeshLogVert *lv;
   uint v_id = range_tree_uint_take_any(log->unused_ids);
   void *key = PTR_FROM_UINT(v_id);
 
   mesh_log_vert_id_set(log, v, v_id);
   lv = mesh_log_vert_alloc(log, v, cd_vert_mask_offset);
-  lib_ghash_insert(log->current_entry->added_verts, key, lv);
+  lib_ghash_insert(entry->added_verts, key, lv);
 }
 
 void mesh_log_face_modified(MeshLog *log, MeshFace *f)
 {
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   MeshLogFace *lf;
   uint f_id = mesh_log_face_id_get(log, f);
   void *key = PTR_FROM_UINT(f_id);
 
   lf = mesh_log_face_alloc(log, f);
-  lib_ghash_insert(log->current_entry->modified_faces, key, lf);
+  lib_ghash_insert(entry->modified_faces, key, lf);
 }
 void mesh_log_vert_removed(MeshLog *log, MeshVert *v, const int cd_vert_mask_offset)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
 
@@ -822,7 +1353,7 @@ void mesh_log_vert_removed(MeshLog *log, MeshVert *v, const int cd_vert_mask_off
 
 void mesh_log_face_removed(MeshLog *log, MeshFace *f)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   uint f_id = mesh_log_face_id_get(log, f);
   void *key = PTR_FROM_UINT(f_id);
 
@@ -844,17 +1375,18 @@ void mesh_log_face_removed(MeshLog *log, MeshFace *f)
 void mesh_log_all_added(Mesh *mesh, MeshLog *log)
 {
   const int cd_vert_mask_offset = CustomData_get_offset(&mesh->vdata, CD_PAINT_MASK);
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   MeshIter bm_iter;
   MeshVert *v;
   MeshFace *f;
 
   /* avoid unnecessary resizing on initialization */
-  if (lib_ghash_len(log->current_entry->added_verts) == 0) {
-    lib_ghash_reserve(log->current_entry->added_verts, (uint)mesh->totvert);
+  if (lib_ghash_len(entry->added_verts) == 0) {
+    lib_ghash_reserve(entry->added_verts, (uint)mesh->totvert);
   }
 
-  if (lib_ghash_len(log->current_entry->added_faces) == 0) {
-    lib_ghash_reserve(log->current_entry->added_faces, (uint)mesh->totface);
+  if (lib_ghash_len(entry->added_faces) == 0) {
+    lib_ghash_reserve(entry->added_faces, (uint)mesh->totface);
   }
 
   /* Log all vertices as newly created */
@@ -888,7 +1420,7 @@ void mesh_log_before_all_removed(Mesh *mesh, MeshLog *log)
 
 const float *mesh_log_original_vert_co(MeshLog *log, MeshVert *v)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   const MeshLogVert *lv;
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
@@ -903,7 +1435,7 @@ const float *mesh_log_original_vert_co(MeshLog *log, MeshVert *v)
 
 const float *mesh_log_original_vert_no(MeshLog *log, MeshVert *v)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   const MeshLogVert *lv;
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
@@ -918,7 +1450,7 @@ const float *mesh_log_original_vert_no(MeshLog *log, MeshVert *v)
 
 float mesh_log_original_mask(MeshLog *log, MeshVert *v)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   const MeshLogVert *lv;
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
@@ -933,7 +1465,7 @@ float mesh_log_original_mask(MeshLog *log, MeshVert *v)
 
 void mesh_log_original_vert_data(MeshLog *log, MeshVert *v, const float **r_co, const float **r_no)
 {
-  MeshLogEntry *entry = log->current_entry;
+  MeshLogEntry *entry = mesh_log_current_entry_unpacked(log);
   const MeshLogVert *lv;
   uint v_id = mesh_log_vert_id_get(log, v);
   void *key = PTR_FROM_UINT(v_id);
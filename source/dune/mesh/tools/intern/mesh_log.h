@@ -45,6 +45,7 @@ void mesh_log_mesh_elems_reorder(Mesh *meeh, MeshLog *log);
  * following entries are deleted.
  *
  * In either case, the new entry is set as the current log entry.
+ * The previous entry is packed, since it's only used for undo & redo from now on.
  */
 MeshLogEntry *mesh_log_entry_add(MeshLog *log);
 
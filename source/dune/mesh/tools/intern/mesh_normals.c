@@ -1140,6 +1140,8 @@ typedef struct MeshLoopsCalcNormalsWithCoordsData {
   const int cd_loop_clnors_offset;
   const bool do_rebuild;
   const float split_angle_cos;
+  /** Only for partial updates, the verts to iterate over. */
+  MeshVert **partial_verts;
 
   /* Output. */
   float (*r_lnos)[3];
@@ -1689,6 +1691,163 @@ void mesh_loops_calc_normal_vcos(Mesh *mesh,
   }
 }
 
+/* -------------------------------------------------------------------- */
+/** Loop Normals (Partial Updates)
+ *
+ * Every loop whose smooth fan or normal space can change is a loop of one of the partial verts:
+ * fans only depend on the normals of the faces around the vertex and the edges of these faces,
+ * and the partial verts include all verts of the faces that are updated.
+ **/
+
+static void mesh_partial_verts_calc_loop_normals_with_clnors_cb(
+    void *__restrict userdata, const int iter, const TaskParallelTLS *__restrict tls)
+{
+  MeshLoopsCalcNormalsWithCoordsData *data = userdata;
+  mesh_loops_calc_normals_for_vert_with_clnors_fn(
+      userdata, (MempoolIterData *)data->partial_verts[iter], tls);
+}
+
+static void mesh_partial_verts_calc_loop_normals_without_clnors_cb(
+    void *__restrict userdata, const int iter, const TaskParallelTLS *__restrict tls)
+{
+  MeshLoopsCalcNormalsWithCoordsData *data = userdata;
+  mesh_loops_calc_normals_for_vert_without_clnors_fn(
+      userdata, (MempoolIterData *)data->partial_verts[iter], tls);
+}
+
+static void mesh_loops_calc_normals_with_partial(Mesh *mesh,
+                                                 const MeshPartialUpdate *bmpinfo,
+                                                 const float (*vcos)[3],
+                                                 const float (*fnos)[3],
+                                                 float (*r_lnos)[3],
+                                                 MeshLoopNorSpaceArray *r_lnors_spacearr,
+                                                 const short (*clnors_data)[2],
+                                                 const int cd_loop_clnors_offset,
+                                                 const bool do_rebuild,
+                                                 const float split_angle_cos)
+{
+  const bool has_clnors = clnors_data || (cd_loop_clnors_offset != -1);
+  MeshLoopNorSpaceArray _lnors_spacearr = {NULL};
+
+  {
+    char htype = MESH_LOOP;
+    if (vcos) {
+      htype |= MESH_VERT;
+    }
+    if (fnos) {
+      htype |= MESH_FACE;
+    }
+    mesh_elem_index_ensure(mesh, htype);
+  }
+
+  if (!r_lnors_spacearr && has_clnors) {
+    /* We need to compute lnor spacearr if some custom lnor data are given to us! */
+    r_lnors_spacearr = &_lnors_spacearr;
+  }
+  if (r_lnors_spacearr) {
+    dune_lnor_spacearr_init(r_lnors_spacearr, mesh->totloop, MLNOR_SPACEARR_BMLOOP_PTR);
+  }
+
+  TaskParallelSettings settings;
+  lib_parallel_range_settings_defaults(&settings);
+
+  MeshLoopsCalcNormalsWithCoords_TLS tls = {NULL};
+
+  settings.userdata_chunk = &tls;
+  settings.userdata_chunk_size = sizeof(tls);
+
+  settings.func_init = mesh_loops_calc_normals_for_vert_init_fn;
+  settings.func_reduce = mesh_loops_calc_normals_for_vert_reduce_fn;
+  settings.func_free = mesh_loops_calc_normals_for_vert_free_fn;
+
+  MeshLoopsCalcNormalsWithCoordsData data = {
+      .mesh = mesh,
+      .vcos = vcos,
+      .fnos = fnos,
+      .r_lnos = r_lnos,
+      .r_lnors_spacearr = r_lnors_spacearr,
+      .clnors_data = clnors_data,
+      .cd_loop_clnors_offset = cd_loop_clnors_offset,
+      .do_rebuild = do_rebuild,
+      .split_angle_cos = split_angle_cos,
+      .partial_verts = bmpinfo->verts,
+  };
+
+  lib_task_parallel_range(0,
+                          bmpinfo->verts_len,
+                          &data,
+                          has_clnors ? mesh_partial_verts_calc_loop_normals_with_clnors_cb :
+                                       mesh_partial_verts_calc_loop_normals_without_clnors_cb,
+                          &settings);
+
+  if (r_lnors_spacearr) {
+    if (r_lnors_spacearr == &_lnors_spacearr) {
+      dune_lnor_spacearr_free(r_lnors_spacearr);
+    }
+  }
+}
+
+void mesh_loops_calc_normal_vcos_with_partial(Mesh *mesh,
+                                              const MeshPartialUpdate *bmpinfo,
+                                              const float (*vcos)[3],
+                                              const float (*vnos)[3],
+                                              const float (*fnos)[3],
+                                              const bool use_split_normals,
+                                              const float split_angle,
+                                              float (*r_lnos)[3],
+                                              MeshLoopNorSpaceArray *r_lnors_spacearr,
+                                              short (*clnors_data)[2],
+                                              const int cd_loop_clnors_offset,
+                                              const bool do_rebuild)
+{
+  lib_assert(bmpinfo->params.do_normals);
+  /* While harmless, exit early if there is nothing to do. */
+  if (UNLIKELY(bmpinfo->verts_len == 0)) {
+    return;
+  }
+
+  const bool has_clnors = clnors_data || (cd_loop_clnors_offset != -1);
+
+  if (use_split_normals) {
+    mesh_loops_calc_normals_with_partial(mesh,
+                                         bmpinfo,
+                                         vcos,
+                                         fnos,
+                                         r_lnos,
+                                         r_lnors_spacearr,
+                                         clnors_data,
+                                         cd_loop_clnors_offset,
+                                         do_rebuild,
+                                         has_clnors ? -1.0f : cosf(split_angle));
+  }
+  else {
+    lib_assert(!r_lnors_spacearr);
+    {
+      char htype = MESH_LOOP;
+      if (vnos) {
+        htype |= MESH_VERT;
+      }
+      if (fnos) {
+        htype |= MESH_FACE;
+      }
+      mesh_elem_index_ensure(mesh, htype);
+    }
+
+    for (int i = 0; i < bmpinfo->verts_len; i++) {
+      MeshVert *v = bmpinfo->verts[i];
+      MeshLoop *l_curr;
+      MeshIter liter;
+      MESH_ELEM_ITER (l_curr, &liter, v, MESH_LOOPS_OF_VERT) {
+        const bool is_face_flat = !mesh_elem_flag_test(l_curr->f, MESH_ELEM_SMOOTH);
+        const float *no = is_face_flat ?
+                              (fnos ? fnos[mesh_elem_index_get(l_curr->f)] : l_curr->f->no) :
+                              (vnos ? vnos[mesh_elem_index_get(v)] : v->no);
+        copy_v3_v3(r_lnos[mesh_elem_index_get(l_curr)], no);
+      }
+    }
+  }
+}
+
 /* -------------------------------------------------------------------- */
 /** Loop Normal Space API **/
 
@@ -1786,6 +1945,32 @@ void mesh_lnorspace_invalidate(Mesh *mesh, const bool do_invalidate_all)
   mesh->spacearr_dirty |= MESH_SPACEARR_DIRTY;
 }
 
+void mesh_lnorspace_invalidate_with_partial(Mesh *mesh, const MeshPartialUpdate *bmpinfo)
+{
+  lib_assert(bmpinfo->params.do_normals);
+  if (mesh->spacearr_dirty & MESH_SPACEARR_DIRTY_ALL) {
+    return;
+  }
+  if (mesh->lnor_spacearr == NULL) {
+    mesh->spacearr_dirty |= MESH_SPACEARR_DIRTY_ALL;
+    return;
+  }
+  if (UNLIKELY(bmpinfo->verts_len == 0)) {
+    return;
+  }
+
+  /* Unlike mesh_lnorspace_invalidate there is no need to include the neighbors,
+   * the verts of all faces touching the modified verts are already part of the partial update. */
+  for (int i = 0; i < bmpinfo->verts_len; i++) {
+    MeshLoop *l;
+    MeshIter liter;
+    MESH_ELEM_ITER (l, &liter, bmpinfo->verts[i], MESH_LOOPS_OF_VERT) {
+      MESH_ELEM_API_FLAG_ENABLE(l, MESH_LNORSPACE_UPDATE);
+    }
+  }
+  mesh->spacearr_dirty |= MESH_SPACEARR_DIRTY;
+}
+
 void mesh_lnorspace_rebuild(Mesh *mesh, bool preserve_clnor)
 {
   lib_assert(bm->lnor_spacearr != NULL);
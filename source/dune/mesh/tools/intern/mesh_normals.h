@@ -55,6 +55,24 @@ void mesh_loops_calc_normal_vcos(Mesh *mesh,
                                int cd_loop_clnors_offset,
                                bool do_rebuild);
 
+/**
+ * A version of mesh_loops_calc_normal_vcos that only calculates the normals
+ * (and spaces, when r_lnors_spacearr is given) of the loops of the partial update's verts,
+ * the other loops of r_lnos are left as-is.
+ */
+void mesh_loops_calc_normal_vcos_with_partial(Mesh *mesh,
+                                              const struct MeshPartialUpdate *bmpinfo,
+                                              const float (*vcos)[3],
+                                              const float (*vnos)[3],
+                                              const float (*fnos)[3],
+                                              bool use_split_normals,
+                                              float split_angle,
+                                              float (*r_lnos)[3],
+                                              struct MeshLoopNorSpaceArray *r_lnors_spacearr,
+                                              short (*clnors_data)[2],
+                                              int cd_loop_clnors_offset,
+                                              bool do_rebuild);
+
 /**
  * Check whether given loop is part of an unknown-so-far cyclic smooth fan, or not.
  * Needed because cyclic smooth fans have no obvious 'entry point',
@@ -63,6 +81,11 @@ void mesh_loops_calc_normal_vcos(Mesh *mesh,
 bool mesh_loop_check_cyclic_smooth_fan(MeshLoop *l_curr);
 void mesh_lnorspacearr_store(Mesh *mesh, float (*r_lnors)[3]);
 void mesh_lnorspace_invalidate(Mesh *mesh, bool do_invalidate_all);
+/**
+ * Invalidate the loop normal spaces that can be changed by modifying the geometry
+ * of the partial update, so mesh_lnorspace_rebuild only rebuilds those.
+ */
+void mesh_lnorspace_invalidate_with_partial(Mesh *mesh, const struct MeshPartialUpdate *bmpinfo);
 void mesh_lnorspace_rebuild(Mesh *m, bool preserve_clnor);
 /**
  * warning This function sets MESH_ELEM_TAG on loops & edges via _mesh_loops_calc_normals,
@@ -300,9 +300,14 @@ typedef struct BMOperator {
 
 enum {
   BMO_FLAG_RESPECT_HIDE = 1,
+  /**
+   * Operators running parts of their work in parallel (see mesh_op_islands_exec)
+   * create elements in the same order every time, so the result doesn't depend on scheduling.
+   */
+  BMO_FLAG_DETERMINISTIC = 2,
 };
 
-#define BMO_FLAG_DEFAULTS BMO_FLAG_RESPECT_HIDE
+#define BMO_FLAG_DEFAULTS (BMO_FLAG_RESPECT_HIDE | BMO_FLAG_DETERMINISTIC)
 
 #define MAX_SLOTNAME 32
 
@@ -818,6 +823,59 @@ bool BMO_iter_map_value_bool(BMOIter *iter);
        ele; \
        BM_CHECK_TYPE_ELEM_ASSIGN(ele) = BMO_iter_step(iter), i_++)
 
+/* -------------------------------------------------------------------- */
+/** Island Executor
+ *
+ * Operators working on faces can split them into islands (batches of faces)
+ * and prepare the islands concurrently.
+ *
+ * The work is split in two callbacks:
+ * - prepare_fn: runs in parallel & calculates the changes to make to an island.
+ *   It may only read the elements of its own island and must not change the mesh.
+ * - apply_fn: makes the changes, one island at a time on the calling thread,
+ *   while other islands are still being prepared.
+ **/
+
+typedef struct MeshOpIslands {
+  /** Faces grouped by island, in the order they were passed in. */
+  MeshFace **faces;
+  /** Start of each island in faces, (islands_num + 1) items. */
+  int *offsets;
+  int islands_num;
+} MeshOpIslands;
+
+/**
+ * Split faces into contiguous ranges. Since prepare_fn doesn't write to the mesh,
+ * faces sharing verts don't need to be grouped, so connected meshes still get prepared
+ * in parallel.
+ */
+void mesh_op_islands_from_ranges(MeshFace **faces, int faces_len, MeshOpIslands *r_islands);
+void mesh_op_islands_free(MeshOpIslands *islands);
+
+typedef struct MeshOpIslandsExecParams {
+  void *userdata;
+  /** Size of the (zero initialized) per-island data passed to both callbacks. */
+  size_t island_data_size;
+  void (*prepare_fn)(void *userdata, MeshFace **faces, int faces_len, void *island_data, void *tls);
+  /** Must free anything prepare_fn allocated in island_data. */
+  void (*apply_fn)(Mesh *mesh, void *userdata, MeshFace **faces, int faces_len, void *island_data);
+
+  /** Optional scratch data for prepare_fn, zero initialized, created once per thread. */
+  size_t tls_size;
+  void (*tls_init_fn)(void *userdata, void *tls);
+  void (*tls_free_fn)(void *userdata, void *tls);
+
+  /**
+   * Apply islands in order, so the result is the same on every run (see BMO_FLAG_DETERMINISTIC).
+   * Otherwise islands are applied as soon as they're prepared.
+   */
+  bool use_deterministic;
+} MeshOpIslandsExecParams;
+
+void mesh_op_islands_exec(Mesh *mesh,
+                          const MeshOpIslands *islands,
+                          const MeshOpIslandsExecParams *params);
+
 /* operator slot type information - size of one element of the type given. */
 extern const int BMO_OPSLOT_TYPEINFO[BMO_OP_SLOT_TOTAL_TYPES];
 
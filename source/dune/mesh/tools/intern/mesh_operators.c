@@ -2,11 +2,15 @@
 
 #include "mem_guardedalloc.h"
 
+#include "atomic_ops.h"
+
 #include "lib_listbase.h"
 #include "lib_math.h"
 #include "lib_memarena.h"
 #include "lib_mempool.h"
 #include "lib_string.h"
+#include "lib_task.h"
+#include "lib_threads.h"
 #include "lib_utildefines.h"
 
 #include "i18n.h"
@@ -1434,6 +1438,217 @@ bool mesh_iter_map_value_bool(MeshOpIter *iter)
   return **((bool **)iter->val);
 }
 
+/* island executor */
+
+/* Minimum number of faces prepared by a single task. */
+#define MESH_OP_ISLANDS_BATCH_FACES_MIN 64
+
+void mesh_op_islands_from_ranges(MeshFace **faces, const int faces_len, MeshOpIslands *r_islands)
+{
+  const int islands_num = (faces_len + MESH_OP_ISLANDS_BATCH_FACES_MIN - 1) /
+                          MESH_OP_ISLANDS_BATCH_FACES_MIN;
+  int *offsets = mem_mallocn(sizeof(*offsets) * (size_t)(islands_num + 1), __func__);
+  for (int i = 0; i < islands_num; i++) {
+    offsets[i] = i * MESH_OP_ISLANDS_BATCH_FACES_MIN;
+  }
+  offsets[islands_num] = faces_len;
+
+  r_islands->faces = mem_mallocn(sizeof(*r_islands->faces) * (size_t)faces_len, __func__);
+  memcpy(r_islands->faces, faces, sizeof(*faces) * (size_t)faces_len);
+  r_islands->offsets = offsets;
+  r_islands->islands_num = islands_num;
+}
+
+void mesh_op_islands_free(MeshOpIslands *islands)
+{
+  MEM_SAFE_FREE(islands->faces);
+  MEM_SAFE_FREE(islands->offsets);
+  islands->islands_num = 0;
+}
+
+typedef struct MeshOpIslandsExecData {
+  const MeshOpIslands *islands;
+  const MeshOpIslandsExecParams *params;
+  char *island_data;
+
+  /** Islands prepared by each batch, (batches_num + 1) items. */
+  int *batch_offsets;
+  int batches_num;
+  /** Next batch to prepare, claimed atomically by the calling thread & the workers. */
+  int batch_next;
+
+  /** Islands which are prepared but not applied yet, stored as (index + 1). */
+  ThreadQueue *ready_queue;
+} MeshOpIslandsExecData;
+
+static void *mesh_op_islands_data_get(const MeshOpIslandsExecData *data, const int island)
+{
+  return data->island_data ? data->island_data + data->params->island_data_size * (size_t)island :
+                             NULL;
+}
+
+static void *mesh_op_islands_tls_create(const MeshOpIslandsExecParams *params)
+{
+  void *tls = params->tls_size ? mem_callocn(params->tls_size, __func__) : NULL;
+  if (params->tls_init_fn) {
+    params->tls_init_fn(params->userdata, tls);
+  }
+  return tls;
+}
+
+static void mesh_op_islands_tls_free(const MeshOpIslandsExecParams *params, void *tls)
+{
+  if (params->tls_free_fn) {
+    params->tls_free_fn(params->userdata, tls);
+  }
+  MEM_SAFE_FREE(tls);
+}
+
+static void mesh_op_islands_prepare_batch(MeshOpIslandsExecData *data,
+                                          const int batch,
+                                          void *tls)
+{
+  const MeshOpIslandsExecParams *params = data->params;
+  const MeshOpIslands *islands = data->islands;
+
+  for (int i = data->batch_offsets[batch]; i < data->batch_offsets[batch + 1]; i++) {
+    params->prepare_fn(params->userdata,
+                       &islands->faces[islands->offsets[i]],
+                       islands->offsets[i + 1] - islands->offsets[i],
+                       mesh_op_islands_data_get(data, i),
+                       tls);
+    if (data->ready_queue) {
+      lib_thread_queue_push(data->ready_queue, POINTER_FROM_INT(i + 1));
+    }
+  }
+}
+
+static bool mesh_op_islands_prepare_claim(MeshOpIslandsExecData *data, void **tls_p)
+{
+  const int batch = atomic_fetch_and_add_int32(&data->batch_next, 1);
+  if (batch >= data->batches_num) {
+    return false;
+  }
+  /* Scratch data is created once per thread, on its first batch. */
+  if (*tls_p == NULL) {
+    *tls_p = mesh_op_islands_tls_create(data->params);
+  }
+  mesh_op_islands_prepare_batch(data, batch, *tls_p);
+  return true;
+}
+
+static void mesh_op_islands_prepare_task(TaskPool *__restrict pool, void *UNUSED(taskdata))
+{
+  MeshOpIslandsExecData *data = lib_task_pool_user_data(pool);
+  void *tls = NULL;
+  while (mesh_op_islands_prepare_claim(data, &tls)) {
+    /* pass */
+  }
+  if (tls) {
+    mesh_op_islands_tls_free(data->params, tls);
+  }
+}
+
+static void mesh_op_islands_apply(Mesh *mesh, const MeshOpIslandsExecData *data, const int island)
+{
+  const MeshOpIslands *islands = data->islands;
+  data->params->apply_fn(mesh,
+                         data->params->userdata,
+                         &islands->faces[islands->offsets[island]],
+                         islands->offsets[island + 1] - islands->offsets[island],
+                         mesh_op_islands_data_get(data, island));
+}
+
+void mesh_op_islands_exec(Mesh *mesh,
+                          const MeshOpIslands *islands,
+                          const MeshOpIslandsExecParams *params)
+{
+  const int islands_num = islands->islands_num;
+  if (islands_num == 0) {
+    return;
+  }
+
+  const int threads_num = lib_task_scheduler_num_threads();
+  const int faces_len = islands->offsets[islands_num];
+
+  MeshOpIslandsExecData data = {
+      .islands = islands,
+      .params = params,
+  };
+  if (params->island_data_size) {
+    data.island_data = mem_callocn(params->island_data_size * (size_t)islands_num, __func__);
+  }
+
+  /* Split the islands into batches of similar size, several per thread to balance the load. */
+  const int batch_faces = max_ii(faces_len / (threads_num * 8), MESH_OP_ISLANDS_BATCH_FACES_MIN);
+  data.batch_offsets = mem_mallocn(sizeof(*data.batch_offsets) * (size_t)(islands_num + 1),
+                                   __func__);
+  data.batch_offsets[0] = 0;
+  for (int i = 0, faces_num = 0; i < islands_num; i++) {
+    faces_num += islands->offsets[i + 1] - islands->offsets[i];
+    if (faces_num >= batch_faces || i == islands_num - 1) {
+      data.batch_offsets[++data.batches_num] = i + 1;
+      faces_num = 0;
+    }
+  }
+
+  if (threads_num <= 1 || data.batches_num == 1) {
+    void *tls = mesh_op_islands_tls_create(params);
+    for (int batch = 0; batch < data.batches_num; batch++) {
+      mesh_op_islands_prepare_batch(&data, batch, tls);
+      for (int i = data.batch_offsets[batch]; i < data.batch_offsets[batch + 1]; i++) {
+        mesh_op_islands_apply(mesh, &data, i);
+      }
+    }
+    mesh_op_islands_tls_free(params, tls);
+  }
+  else {
+    data.ready_queue = lib_thread_queue_init();
+    TaskPool *task_pool = lib_task_pool_create(&data, TASK_PRIORITY_HIGH);
+    for (int i = 0; i < min_ii(threads_num - 1, data.batches_num - 1); i++) {
+      lib_task_pool_push(task_pool, mesh_op_islands_prepare_task, NULL, false, NULL);
+    }
+
+    /* Only used to apply in order. */
+    bool *island_ready = params->use_deterministic ?
+                             mem_callocn(sizeof(*island_ready) * (size_t)islands_num, __func__) :
+                             NULL;
+    int islands_applied = 0;
+    void *tls = NULL;
+
+    while (islands_applied < islands_num) {
+      /* Help preparing rather than waiting. Once all batches are claimed,
+       * the remaining islands are being prepared & waiting for them can't stall. */
+      if (lib_thread_queue_is_empty(data.ready_queue) &&
+          mesh_op_islands_prepare_claim(&data, &tls)) {
+        continue;
+      }
+      const int island = POINTER_AS_INT(lib_thread_queue_pop(data.ready_queue)) - 1;
+      if (island_ready) {
+        island_ready[island] = true;
+        while (islands_applied < islands_num && island_ready[islands_applied]) {
+          mesh_op_islands_apply(mesh, &data, islands_applied++);
+        }
+      }
+      else {
+        mesh_op_islands_apply(mesh, &data, island);
+        islands_applied++;
+      }
+    }
+
+    if (tls) {
+      mesh_op_islands_tls_free(params, tls);
+    }
+    lib_task_pool_work_and_wait(task_pool);
+    lib_task_pool_free(task_pool);
+    lib_thread_queue_free(data.ready_queue);
+    MEM_SAFE_FREE(island_ready);
+  }
+
+  mem_freen(data.batch_offsets);
+  MEM_SAFE_FREE(data.island_data);
+}
+
 /* error system */
 typedef struct MeshOpError {
   struct MeshOpError *next, *prev;
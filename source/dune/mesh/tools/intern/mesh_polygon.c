@@ -928,144 +928,150 @@ bool mesh_face_point_inside_test(const MeshFace *f, const float co[3])
   return isect_point_poly_v2(co_2d, projverts, f->len, false);
 }
 
-void mesh_face_triangulate(Mesh *mesh,
-                           MeshFace *f,
-                           MeshFace **r_faces_new,
-                           int *r_faces_new_tot,
-                           MeshEdge **r_edges_new,
-                           int *r_edges_new_tot,
-                           LinkNode **r_faces_double,
-                           const int quad_method,
-                           const int ngon_method,
-                           const bool use_tag,
-                           /* use for ngons only! */
-                           MemArena *pf_arena,
-
-                           /* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
-                           struct Heap *pf_heap)
+void mesh_face_triangulate_calc(MeshFace *f,
+                                const int quad_method,
+                                const int ngon_method,
+                                MeshLoop **r_loops,
+                                uint (*r_tris)[3],
+                                MemArena *pf_arena,
+                                struct Heap *pf_heap)
 {
-  const int cd_loop_mdisp_offset = CustomData_get_offset(&bm->ldata, CD_MDISPS);
   const bool use_beauty = (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY);
-  MeshLoop *l_first, *l_new;
-  MeshFace *f_new;
-  int nf_i = 0;
-  int ne_i = 0;
 
   lib_assert(mesh_face_is_normal_valid(f));
-
-  /* ensure both are valid or NULL */
-  lib_assert((r_faces_new == NULL) == (r_faces_new_tot == NULL));
-
   lib_assert(f->len > 3);
 
-  {
-    MeshLoop **loops = lib_array_alloca(loops, f->len);
-    uint(*tris)[3] = lib_array_alloca(tris, f->len);
-    const int totfilltri = f->len - 2;
-    const int last_tri = f->len - 3;
-    int i;
-    /* for mdisps */
-    float f_center[3];
-
-    if (f->len == 4) {
-      /* even though we're not using lib_polyfill, fill in 'tris' and 'loops'
-       * so we can share code to handle face creation afterwards. */
-      MeshLoop *l_v1, *l_v2;
-
-      l_first = MESH_FACE_FIRST_LOOP(f);
-
-      switch (quad_method) {
-        case MOD_TRIANGULATE_QUAD_FIXED: {
-          l_v1 = l_first;
-          l_v2 = l_first->next->next;
-          break;
+  if (f->len == 4) {
+    /* even though we're not using lib_polyfill, fill in 'tris' and 'loops'
+     * so we can share code to handle face creation afterwards. */
+    MeshLoop *l_first = MESH_FACE_FIRST_LOOP(f);
+    MeshLoop *l_v1, *l_v2;
+
+    switch (quad_method) {
+      case MOD_TRIANGULATE_QUAD_FIXED: {
+        l_v1 = l_first;
+        l_v2 = l_first->next->next;
+        break;
+      }
+      case MOD_TRIANGULATE_QUAD_ALTERNATE: {
+        l_v1 = l_first->next;
+        l_v2 = l_first->prev;
+        break;
+      }
+      case MOD_TRIANGULATE_QUAD_SHORTEDGE:
+      case MOD_TRIANGULATE_QUAD_LONGEDGE:
+      case MOD_TRIANGULATE_QUAD_BEAUTY:
+      default: {
+        MeshLoop *l_v3, *l_v4;
+        bool split_24;
+
+        l_v1 = l_first->next;
+        l_v2 = l_first->next->next;
+        l_v3 = l_first->prev;
+        l_v4 = l_first;
+
+        if (quad_method == MOD_TRIANGULATE_QUAD_SHORTEDGE) {
+          float d1, d2;
+          d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
+          d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
+          split_24 = ((d2 - d1) > 0.0f);
         }
-        case MOD_TRIANGULATE_QUAD_ALTERNATE: {
-          l_v1 = l_first->next;
-          l_v2 = l_first->prev;
-          break;
+        else if (quad_method == MOD_TRIANGULATE_QUAD_LONGEDGE) {
+          float d1, d2;
+          d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
+          d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
+          split_24 = ((d2 - d1) < 0.0f);
         }
-        case MOD_TRIANGULATE_QUAD_SHORTEDGE:
-        case MOD_TRIANGULATE_QUAD_LONGEDGE:
-        case MOD_TRIANGULATE_QUAD_BEAUTY:
-        default: {
-          MeshLoop *l_v3, *l_v4;
-          bool split_24;
-
-          l_v1 = l_first->next;
-          l_v2 = l_first->next->next;
-          l_v3 = l_first->prev;
-          l_v4 = l_first;
-
-          if (quad_method == MOD_TRIANGULATE_QUAD_SHORTEDGE) {
-            float d1, d2;
-            d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
-            d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
-            split_24 = ((d2 - d1) > 0.0f);
+        else {
+          /* first check if the quad is concave on either diagonal */
+          const int flip_flag = is_quad_flip_v3(
+              l_v1->v->co, l_v2->v->co, l_v3->v->co, l_v4->v->co);
+          if (UNLIKELY(flip_flag & (1 << 0))) {
+            split_24 = true;
           }
-          else if (quad_method == MOD_TRIANGULATE_QUAD_LONGEDGE) {
-            float d1, d2;
-            d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
-            d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
-            split_24 = ((d2 - d1) < 0.0f);
+          else if (UNLIKELY(flip_flag & (1 << 1))) {
+            split_24 = false;
           }
           else {
-            /* first check if the quad is concave on either diagonal */
-            const int flip_flag = is_quad_flip_v3(
-                l_v1->v->co, l_v2->v->co, l_v3->v->co, l_v4->v->co);
-            if (UNLIKELY(flip_flag & (1 << 0))) {
-              split_24 = true;
-            }
-            else if (UNLIKELY(flip_flag & (1 << 1))) {
-              split_24 = false;
-            }
-            else {
-              split_24 = (mesh_verts_calc_rotate_beauty(l_v1->v, l_v2->v, l_v3->v, l_v4->v, 0, 0) >
-                          0.0f);
-            }
+            split_24 = (mesh_verts_calc_rotate_beauty(l_v1->v, l_v2->v, l_v3->v, l_v4->v, 0, 0) >
+                        0.0f);
           }
+        }
 
-          /* named confusingly, l_v1 is in fact the second vertex */
-          if (split_24) {
-            l_v1 = l_v4;
-            // l_v2 = l_v2;
-          }
-          else {
-            // l_v1 = l_v1;
-            l_v2 = l_v3;
-          }
-          break;
+        /* named confusingly, l_v1 is in fact the second vertex */
+        if (split_24) {
+          l_v1 = l_v4;
+          // l_v2 = l_v2;
         }
+        else {
+          // l_v1 = l_v1;
+          l_v2 = l_v3;
+        }
+        break;
       }
+    }
 
-      loops[0] = l_v1;
-      loops[1] = l_v1->next;
-      loops[2] = l_v2;
-      loops[3] = l_v2->next;
+    r_loops[0] = l_v1;
+    r_loops[1] = l_v1->next;
+    r_loops[2] = l_v2;
+    r_loops[3] = l_v2->next;
 
-      ARRAY_SET_ITEMS(tris[0], 0, 1, 2);
-      ARRAY_SET_ITEMS(tris[1], 0, 2, 3);
+    ARRAY_SET_ITEMS(r_tris[0], 0, 1, 2);
+    ARRAY_SET_ITEMS(r_tris[1], 0, 2, 3);
+  }
+  else {
+    MeshLoop *l_iter;
+    int i;
+    float axis_mat[3][3];
+    float(*projverts)[2] = lib_array_alloca(projverts, f->len);
+
+    axis_dominant_v3_to_m3_negate(axis_mat, f->no);
+
+    for (i = 0, l_iter = MESH_FACE_FIRST_LOOP(f); i < f->len; i++, l_iter = l_iter->next) {
+      r_loops[i] = l_iter;
+      mul_v2_m3v3(projverts[i], axis_mat, l_iter->v->co);
     }
-    else {
-      MeshLoop *l_iter;
-      float axis_mat[3][3];
-      float(*projverts)[2] = lib_array_alloca(projverts, f->len);
 
-      axis_dominant_v3_to_m3_negate(axis_mat, f->no);
+    lib_polyfill_calc_arena(projverts, f->len, 1, r_tris, pf_arena);
 
-      for (i = 0, l_iter = MESH_FACE_FIRST_LOOP(f); i < f->len; i++, l_iter = l_iter->next) {
-        loops[i] = l_iter;
-        mul_v2_m3v3(projverts[i], axis_mat, l_iter->v->co);
-      }
+    if (use_beauty) {
+      lib_polyfill_beautify(projverts, f->len, r_tris, pf_arena, pf_heap);
+    }
 
-      lib_polyfill_calc_arena(projverts, f->len, 1, tris, pf_arena);
+    lib_memarena_clear(pf_arena);
+  }
+}
 
-      if (use_beauty) {
-        lib_polyfill_beautify(projverts, f->len, tris, pf_arena, pf_heap);
-      }
+void mesh_face_triangulate_ex(Mesh *mesh,
+                              MeshFace *f,
+                              MeshLoop **loops,
+                              const uint (*tris)[3],
+                              MeshFace **r_faces_new,
+                              int *r_faces_new_tot,
+                              MeshEdge **r_edges_new,
+                              int *r_edges_new_tot,
+                              LinkNode **r_faces_double,
+                              const bool use_tag)
+{
+  const int cd_loop_mdisp_offset = CustomData_get_offset(&bm->ldata, CD_MDISPS);
+  MeshLoop *l_first, *l_new;
+  MeshFace *f_new;
+  int nf_i = 0;
+  int ne_i = 0;
 
-      lib_memarena_clear(pf_arena);
-    }
+  lib_assert(mesh_face_is_normal_valid(f));
+
+  /* ensure both are valid or NULL */
+  lib_assert((r_faces_new == NULL) == (r_faces_new_tot == NULL));
+
+  lib_assert(f->len > 3);
+
+  {
+    const int totfilltri = f->len - 2;
+    const int last_tri = f->len - 3;
+    int i;
+    /* for mdisps */
+    float f_center[3];
 
     if (cd_loop_mdisp_offset != -1) {
       mesh_face_calc_center_median(f, f_center);
@@ -1157,6 +1163,38 @@ void mesh_face_triangulate(Mesh *mesh,
   }
 }
 
+void mesh_face_triangulate(Mesh *mesh,
+                           MeshFace *f,
+                           MeshFace **r_faces_new,
+                           int *r_faces_new_tot,
+                           MeshEdge **r_edges_new,
+                           int *r_edges_new_tot,
+                           LinkNode **r_faces_double,
+                           const int quad_method,
+                           const int ngon_method,
+                           const bool use_tag,
+                           /* use for ngons only! */
+                           MemArena *pf_arena,
+
+                           /* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
+                           struct Heap *pf_heap)
+{
+  MeshLoop **loops = lib_array_alloca(loops, f->len);
+  uint(*tris)[3] = lib_array_alloca(tris, f->len);
+
+  mesh_face_triangulate_calc(f, quad_method, ngon_method, loops, tris, pf_arena, pf_heap);
+  mesh_face_triangulate_ex(mesh,
+                           f,
+                           loops,
+                           (const uint(*)[3])tris,
+                           r_faces_new,
+                           r_faces_new_tot,
+                           r_edges_new,
+                           r_edges_new_tot,
+                           r_faces_double,
+                           use_tag);
+}
+
 void mesh_face_splits_check_legal(Mesh *mesh, MeshFace *f, MeshLoop *(*loops)[2], int len)
 {
   float out[2] = {-FLT_MAX, -FLT_MAX};
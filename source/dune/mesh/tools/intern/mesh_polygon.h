@@ -147,6 +147,35 @@ void mesh_face_normal_flip(Mesh *mesh, MeshFace *f) ATTR_NONNULL();
 bool mesh_face_point_inside_test(const BMFace *f, const float co[3]) ATTR_WARN_UNUSED_RESULT
     ATTR_NONNULL();
 
+/**
+ * Calculate the triangles mesh_face_triangulate creates, wo changing the mesh.
+ * Only reads f & its verts, so it can run on many faces in parallel.
+ *
+ * param r_loops: Array of f->len loops the triangle indices refer to.
+ * param r_tris: Array of (f->len - 2) triangles.
+ */
+void mesh_face_triangulate_calc(MeshFace *f,
+                                int quad_method,
+                                int ngon_method,
+                                MeshLoop **r_loops,
+                                uint (*r_tris)[3],
+                                struct MemArena *pf_arena,
+                                struct Heap *pf_heap) ATTR_NONNULL(1, 4, 5, 6);
+/**
+ * Triangulate f using triangles from mesh_face_triangulate_calc,
+ * see mesh_face_triangulate for the other arguments.
+ */
+void mesh_face_triangulate_ex(Mesh *mesh,
+                              MeshFace *f,
+                              MeshLoop **loops,
+                              const uint (*tris)[3],
+                              MeshFace **r_faces_new,
+                              int *r_faces_new_tot,
+                              MeshEdge **r_edges_new,
+                              int *r_edges_new_tot,
+                              struct LinkNode **r_faces_double,
+                              bool use_tag) ATTR_NONNULL(1, 2, 3, 4);
+
 /**
  * MESH TRIANGULATE FACE
  *
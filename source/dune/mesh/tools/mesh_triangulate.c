@@ -66,6 +66,215 @@ static void bm_face_triangulate_mapping(BMesh *bm,
   }
 }
 
+/* -------------------------------------------------------------------- */
+/** Parallel Triangulation
+ *
+ * The triangles of each face are calculated in parallel (per range of faces),
+ * creating the faces remains single threaded.
+ **/
+
+/* Below this, threading overhead outweighs the gains. */
+#define TRIANGULATE_PARALLEL_FACES_MIN 1024
+
+typedef struct TriangulateData {
+  int quad_method;
+  int ngon_method;
+  bool use_tag;
+  BMOperator *op;
+  BMOpSlot *slot_facemap_out;
+  BMOpSlot *slot_facemap_double_out;
+  /* Only used when there is no mapping slot. */
+  LinkNode *faces_double;
+} TriangulateData;
+
+typedef struct TriangulateIslandData {
+  /* Loops & triangles of all faces in the island, see #mesh_face_triangulate_calc. */
+  BMLoop **loops;
+  uint (*tris)[3];
+} TriangulateIslandData;
+
+typedef struct TriangulateTLS {
+  MemArena *pf_arena;
+  Heap *pf_heap;
+} TriangulateTLS;
+
+static void bm_triangulate_tls_init(void *userdata, void *tls_v)
+{
+  const TriangulateData *data = userdata;
+  TriangulateTLS *tls = tls_v;
+  tls->pf_arena = BLI_memarena_new(BLI_POLYFILL_ARENA_SIZE, __func__);
+  if (data->ngon_method == MOD_TRIANGULATE_NGON_BEAUTY) {
+    tls->pf_heap = BLI_heap_new_ex(BLI_POLYFILL_ALLOC_NGON_RESERVE);
+  }
+}
+
+static void bm_triangulate_tls_free(void *UNUSED(userdata), void *tls_v)
+{
+  TriangulateTLS *tls = tls_v;
+  BLI_memarena_free(tls->pf_arena);
+  if (tls->pf_heap) {
+    BLI_heap_free(tls->pf_heap, NULL);
+  }
+}
+
+static void bm_triangulate_island_prepare(
+    void *userdata, BMFace **faces, const int faces_len, void *island_data_v, void *tls_v)
+{
+  const TriangulateData *data = userdata;
+  TriangulateIslandData *island_data = island_data_v;
+  TriangulateTLS *tls = tls_v;
+
+  int loops_len = 0;
+  for (int i = 0; i < faces_len; i++) {
+    loops_len += faces[i]->len;
+  }
+  island_data->loops = MEM_mallocN(sizeof(*island_data->loops) * (size_t)loops_len, __func__);
+  island_data->tris = MEM_mallocN(sizeof(*island_data->tris) * (size_t)(loops_len - faces_len * 2),
+                                  __func__);
+
+  BMLoop **loops = island_data->loops;
+  uint(*tris)[3] = island_data->tris;
+  for (int i = 0; i < faces_len; i++) {
+    mesh_face_triangulate_calc(faces[i],
+                               data->quad_method,
+                               data->ngon_method,
+                               loops,
+                               tris,
+                               tls->pf_arena,
+                               tls->pf_heap);
+    loops += faces[i]->len;
+    tris += faces[i]->len - 2;
+  }
+}
+
+static void bm_triangulate_island_apply(
+    BMesh *bm, void *userdata, BMFace **faces, const int faces_len, void *island_data_v)
+{
+  TriangulateData *data = userdata;
+  TriangulateIslandData *island_data = island_data_v;
+
+  BMLoop **loops = island_data->loops;
+  const uint(*tris)[3] = (const uint(*)[3])island_data->tris;
+  for (int i = 0; i < faces_len; i++) {
+    BMFace *face = faces[i];
+    /* Read before triangulating, the face is reused for one of the triangles. */
+    const int face_len = face->len;
+
+    if (data->slot_facemap_out) {
+      int faces_array_tot = face_len - 3;
+      BMFace **faces_array = BLI_array_alloca(faces_array, faces_array_tot);
+      LinkNode *faces_double = NULL;
+
+      mesh_face_triangulate_ex(bm,
+                               face,
+                               loops,
+                               tris,
+                               faces_array,
+                               &faces_array_tot,
+                               NULL,
+                               NULL,
+                               &faces_double,
+                               data->use_tag);
+
+      if (faces_array_tot) {
+        BMO_slot_map_elem_insert(data->op, data->slot_facemap_out, face, face);
+        for (int j = 0; j < faces_array_tot; j++) {
+          BMO_slot_map_elem_insert(data->op, data->slot_facemap_out, faces_array[j], face);
+        }
+
+        while (faces_double) {
+          LinkNode *next = faces_double->next;
+          BMO_slot_map_elem_insert(
+              data->op, data->slot_facemap_double_out, faces_double->link, face);
+          MEM_freeN(faces_double);
+          faces_double = next;
+        }
+      }
+    }
+    else {
+      mesh_face_triangulate_ex(
+          bm, face, loops, tris, NULL, NULL, NULL, NULL, &data->faces_double, data->use_tag);
+    }
+
+    loops += face_len;
+    tris += face_len - 2;
+  }
+
+  MEM_freeN(island_data->loops);
+  MEM_freeN(island_data->tris);
+}
+
+/* Collect the faces to triangulate, the array is only used for the parallel path. */
+static BMFace **bm_mesh_triangulate_faces_get(BMesh *bm,
+                                              const int min_vertices,
+                                              const bool tag_only,
+                                              int *r_faces_len)
+{
+  BMIter iter;
+  BMFace *face;
+  BMFace **faces = MEM_mallocN(sizeof(*faces) * (size_t)bm->totface, __func__);
+  int faces_len = 0;
+
+  BM_ITER_MESH (face, &iter, bm, BM_FACES_OF_MESH) {
+    if (face->len >= min_vertices) {
+      if (tag_only == false || BM_elem_flag_test(face, BM_ELEM_TAG)) {
+        faces[faces_len++] = face;
+      }
+    }
+  }
+
+  *r_faces_len = faces_len;
+  return faces;
+}
+
+static void bm_mesh_triangulate_parallel(BMesh *bm,
+                                         BMFace **faces,
+                                         const int faces_len,
+                                         const int quad_method,
+                                         const int ngon_method,
+                                         const bool tag_only,
+                                         BMOperator *op,
+                                         BMOpSlot *slot_facemap_out,
+                                         BMOpSlot *slot_facemap_double_out)
+{
+  TriangulateData data = {
+      .quad_method = quad_method,
+      .ngon_method = ngon_method,
+      .use_tag = tag_only,
+      .op = op,
+      .slot_facemap_out = slot_facemap_out,
+      .slot_facemap_double_out = slot_facemap_double_out,
+  };
+
+  /* Calculating the triangles only reads each face, so faces sharing verts
+   * don't have to be grouped into islands, any range of faces can be prepared. */
+  MeshOpIslands islands;
+  mesh_op_islands_from_ranges(faces, faces_len, &islands);
+
+  mesh_op_islands_exec(bm,
+                       &islands,
+                       &(const MeshOpIslandsExecParams){
+                           .userdata = &data,
+                           .island_data_size = sizeof(TriangulateIslandData),
+                           .prepare_fn = bm_triangulate_island_prepare,
+                           .apply_fn = bm_triangulate_island_apply,
+                           .tls_size = sizeof(TriangulateTLS),
+                           .tls_init_fn = bm_triangulate_tls_init,
+                           .tls_free_fn = bm_triangulate_tls_free,
+                           /* Modifiers have no operator & must always give the same result. */
+                           .use_deterministic = op ? (op->flag & BMO_FLAG_DETERMINISTIC) != 0 :
+                                                     true,
+                       });
+  mesh_op_islands_free(&islands);
+
+  while (data.faces_double) {
+    LinkNode *next = data.faces_double->next;
+    BM_face_kill(bm, data.faces_double->link);
+    MEM_freeN(data.faces_double);
+    data.faces_double = next;
+  }
+}
+
 void BM_mesh_triangulate(BMesh *bm,
                          const int quad_method,
                          const int ngon_method,
@@ -80,6 +289,26 @@ void BM_mesh_triangulate(BMesh *bm,
   MemArena *pf_arena;
   Heap *pf_heap;
 
+  if (bm->totface >= TRIANGULATE_PARALLEL_FACES_MIN) {
+    /* Decide on the number of faces which are triangulated, not the size of the mesh. */
+    int faces_len;
+    BMFace **faces = bm_mesh_triangulate_faces_get(bm, min_vertices, tag_only, &faces_len);
+    if (faces_len >= TRIANGULATE_PARALLEL_FACES_MIN) {
+      bm_mesh_triangulate_parallel(bm,
+                                   faces,
+                                   faces_len,
+                                   quad_method,
+                                   ngon_method,
+                                   tag_only,
+                                   op,
+                                   slot_facemap_out,
+                                   slot_facemap_double_out);
+      MEM_freeN(faces);
+      return;
+    }
+    MEM_freeN(faces);
+  }
+
   pf_arena = BLI_memarena_new(BLI_POLYFILL_ARENA_SIZE, __func__);
 
   if (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY) {
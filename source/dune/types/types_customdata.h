@@ -4,6 +4,15 @@
 
 #include "types_defs.h"
 
+#ifdef __cplusplus
+namespace dune {
+class ImplicitSharingInfo;
+}
+using ImplicitSharingInfoHandle = dune::ImplicitSharingInfo;
+#else
+typedef struct ImplicitSharingInfoHandle ImplicitSharingInfoHandle;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,6 +46,11 @@ typedef struct CustomDataLayer {
    * otherwise there will always be a strong reference and the attribute can't be removed
    * automatically */
   const struct AnonymousAttributeID *anonymous_id;
+  /* Run-time data that allows sharing `data` with other layers (e.g. of evaluated meshes),
+   * null when the layer is the only owner of its data. A layer copied by value doesn't hold
+   * a user, so copies (and layers written to or read from files) must clear it,
+   * see #CustomData_layers_sharing_info_clear. */
+  const ImplicitSharingInfoHandle *sharing_info;
 } CustomDataLayer;
 
 #define MAX_CUSTOMDATA_LAYER_NAME 64